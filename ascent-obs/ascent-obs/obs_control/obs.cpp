@@ -19,6 +19,8 @@
 #include <numeric>
 
 #include <util/windows/win-version.h>
+#include <util/platform.h>
+#include <util/bmem.h>
 
 
 using namespace settings;
@@ -703,6 +705,12 @@ bool OBS::AddGameSource(OBSData& game_settings) {
 
 //------------------------------------------------------------------------------
 bool OBS::LoadModules() {
+  // modules that only register types are loaded when they're first used
+  char* manifest_path =
+    os_get_config_path_ptr("ascent-obs/module-manifest.json");
+  obs_defer_module_loading(manifest_path);
+  bfree(manifest_path);
+
   obs_load_all_modules();
   //obs_register_output(&offscreen_output_info);
   //obs_log_loaded_modules();
@@ -302,11 +302,23 @@ bool ReplayOutput::Start(int identifier,
     }
   }
 
-  int max_size_mb = 1000;
+  // long replay windows keep only the newest |max_ram_size_mb| in memory and
+  // spill older GOPs to disk (see obs-ffmpeg replay_buffer)
+  int max_size_mb = (int)obs_data_get_int(replay_settings, "max_size_mb");
+  if (max_size_mb <= 0) {
+    max_size_mb = 1000;
+  }
+  auto max_ram_size_mb = obs_data_get_int(replay_settings, "max_ram_size_mb");
   auto max_time_sec = obs_data_get_int(replay_settings,  "max_time_sec");
   obs_data_t* settings_data = obs_data_create();
   obs_data_set_int(settings_data, "max_time_sec", max_time_sec ? max_time_sec : 60);
   obs_data_set_int(settings_data, "max_size_mb", max_size_mb);
+  obs_data_set_int(settings_data, "max_ram_size_mb", max_ram_size_mb);
+  obs_data_set_string(settings_data, "spill_path",
+    obs_data_get_string(replay_settings, "spill_path"));
+  // saving writes out GOPs that were muxed while buffering
+  obs_data_set_bool(settings_data, "premux_fragments",
+    obs_data_get_bool(replay_settings, "premux_fragments"));
   obs_data_set_default_bool(settings_data, "allow_spaces", false);
   advanced_output_->applay_fragmented_file(settings_data);
   
@@ -95,6 +95,7 @@ bool disable_shutdown_check = false;
 static bool multi = false;
 static bool log_verbose = false;
 static bool unfiltered_log = false;
+static bool trace_events = false;
 bool opt_start_streaming = false;
 bool opt_start_recording = false;
 bool opt_studio_mode = false;
@@ -2284,28 +2285,52 @@ ProfilerSnapshot GetSnapshot()
 	return ProfilerSnapshot{profile_snapshot_create(), SnapshotRelease};
 }
 
-static void SaveProfilerData(const ProfilerSnapshot &snap)
+static BPtr<char> GetProfilerDataPath(const char *extension)
 {
 	if (currentLogFile.empty())
-		return;
+		return nullptr;
 
 	auto pos = currentLogFile.rfind('.');
 	if (pos == currentLogFile.npos)
-		return;
+		return nullptr;
 
 #define LITERAL_SIZE(x) x, (sizeof(x) - 1)
 	ostringstream dst;
 	dst.write(LITERAL_SIZE("obs-studio/profiler_data/"));
 	dst.write(currentLogFile.c_str(), pos);
-	dst.write(LITERAL_SIZE(".csv.gz"));
+	dst << extension;
 #undef LITERAL_SIZE
 
-	BPtr<char> path = GetConfigPathPtr(dst.str().c_str());
+	return GetConfigPathPtr(dst.str().c_str());
+}
+
+static void SaveProfilerData(const ProfilerSnapshot &snap)
+{
+	BPtr<char> path = GetProfilerDataPath(".csv.gz");
+	if (!path)
+		return;
+
 	if (!profiler_snapshot_dump_csv_gz(snap.get(), path))
 		blog(LOG_WARNING, "Could not save profiler data to '%s'",
 		     static_cast<const char *>(path));
 }
 
+static void SaveTraceData()
+{
+	if (!trace_events)
+		return;
+
+	profiler_trace_stop();
+
+	BPtr<char> path = GetProfilerDataPath(".trace.json.gz");
+	if (!path)
+		return;
+
+	if (!profiler_trace_dump_json_gz(path))
+		blog(LOG_WARNING, "Could not save trace events to '%s'",
+		     static_cast<const char *>(path));
+}
+
 static auto ProfilerFree = [](void *) {
 	profiler_stop();
 
@@ -2315,6 +2340,7 @@ static auto ProfilerFree = [](void *) {
 	profiler_print_time_between_calls(snap.get());
 
 	SaveProfilerData(snap);
+	SaveTraceData();
 
 	profiler_free();
 };
@@ -2341,6 +2367,8 @@ static int run_program(fstream &logFile, int argc, char *argv[])
 		static_cast<void *>(&ProfilerFree), ProfilerFree);
 
 	profiler_start();
+	if (trace_events)
+		profiler_trace_start(0);
 	profile_register_root(run_program_init, 0);
 
 	ScopeProfiler prof{run_program_init};
@@ -3361,6 +3389,9 @@ int main(int argc, char *argv[])
 		} else if (arg_is(argv[i], "--unfiltered_log", nullptr)) {
 			unfiltered_log = true;
 
+		} else if (arg_is(argv[i], "--trace-events", nullptr)) {
+			trace_events = true;
+
 		} else if (arg_is(argv[i], "--startstreaming", nullptr)) {
 			opt_start_streaming = true;
 
@@ -3427,6 +3458,7 @@ int main(int argc, char *argv[])
 				"--verbose: Make log more verbose.\n"
 				"--always-on-top: Start in 'always on top' mode.\n\n"
 				"--unfiltered_log: Make log unfiltered.\n\n"
+				"--trace-events: Record trace events and save them next to the profiler data on exit.\n\n"
 				"--disable-updater: Disable built-in updater (Windows/Mac only)\n\n"
 				"--disable-missing-files-check: Disable the missing files dialog which can appear on startup.\n\n";
 
@@ -4776,6 +4776,11 @@ int OBSBasic::ResetVideo()
 				ovi.base_height);
 	}
 
+	obs_set_video_parallel_inputs(config_get_bool(
+		App()->GlobalConfig(), "Video", "ParallelRawEncoders"));
+	obs_set_video_scale_band_height((uint32_t)config_get_uint(
+		App()->GlobalConfig(), "Video", "ScaleBandHeight"));
+
 	ret = AttemptToResetVideo(&ovi);
 	if (ret == OBS_VIDEO_CURRENTLY_ACTIVE) {
 		blog(LOG_WARNING, "Tried to reset when already active");
@@ -4832,6 +4837,9 @@ bool OBSBasic::ResetAudio()
 		ai.fixed_buffering = true;
 	}
 
+	ai.parallel_render = config_get_bool(GetGlobalConfig(), "Audio",
+					     "ParallelAudioRender");
+
 	return obs_reset_audio2(&ai);
 }
 
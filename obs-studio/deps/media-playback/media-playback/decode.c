@@ -90,11 +90,15 @@ static int mp_open_codec(struct mp_decode *d, bool hw)
 	if (hw)
 		init_hw_decoder(d, c);
 
+	/* several sources decoding at once each get their own threads, so the
+	 * count can be limited to keep them from competing for every core */
 	if (c->thread_count == 1 && c->codec_id != AV_CODEC_ID_PNG &&
 	    c->codec_id != AV_CODEC_ID_TIFF &&
 	    c->codec_id != AV_CODEC_ID_JPEG2000 &&
-	    c->codec_id != AV_CODEC_ID_MPEG4 && c->codec_id != AV_CODEC_ID_WEBP)
-		c->thread_count = 0;
+	    c->codec_id != AV_CODEC_ID_MPEG4 && c->codec_id != AV_CODEC_ID_WEBP) {
+		c->thread_count = d->m->decode_threads;
+		c->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	}
 
 	ret = avcodec_open2(c, d->codec, NULL);
 	if (ret < 0)
@@ -337,6 +341,10 @@ static int decode_packet(struct mp_decode *d, int *got_frame)
 			return ret;
 		}
 
+		/* the previous frame may still be referenced by the source,
+		 * so don't transfer into its buffers */
+		av_frame_unref(d->sw_frame);
+
 		int err = av_hwframe_transfer_data(d->sw_frame, d->hw_frame, 0);
 		if (err == 0) {
 			err = av_frame_copy_props(d->sw_frame, d->hw_frame);
@@ -357,6 +365,9 @@ bool mp_decode_next(struct mp_decode *d)
 	int got_frame;
 	int ret;
 
+	if (mp_loop_cache_replaying_frames(&d->m->loop))
+		return mp_loop_cache_next_frame(d);
+
 	d->frame_ready = false;
 
 	if (!eof && !d->packets.size)
@@ -448,6 +459,8 @@ bool mp_decode_next(struct mp_decode *d)
 
 		d->last_duration = duration;
 		d->next_pts = d->frame_pts + duration;
+
+		mp_loop_cache_add_frame(d);
 	}
 
 	return true;
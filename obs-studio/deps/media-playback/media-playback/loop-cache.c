@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "loop-cache.h"
+#include "media.h"
+
+void mp_loop_cache_init(struct mp_loop_cache *lc, size_t budget)
+{
+	memset(lc, 0, sizeof(*lc));
+	lc->budget = budget;
+	lc->state = budget ? MP_LOOP_CACHE_IDLE : MP_LOOP_CACHE_OFF;
+}
+
+static void free_frames(struct mp_loop_cache *lc)
+{
+	for (size_t i = 0; i < 2; i++) {
+		for (size_t j = 0; j < lc->frames[i].num; j++)
+			av_frame_free(&lc->frames[i].array[j].frame);
+		da_free(lc->frames[i]);
+		lc->frame_idx[i] = 0;
+	}
+
+	lc->frames_size = 0;
+	lc->raw = false;
+}
+
+static void free_packets(struct mp_loop_cache *lc)
+{
+	for (size_t i = 0; i < lc->packets.num; i++)
+		av_packet_free(&lc->packets.array[i]);
+	da_free(lc->packets);
+
+	lc->packet_idx = 0;
+	lc->packets_size = 0;
+}
+
+void mp_loop_cache_free(struct mp_loop_cache *lc)
+{
+	free_frames(lc);
+	free_packets(lc);
+	lc->replaying = false;
+}
+
+/* decoded frames are dropped first, the packets are only dropped once they
+ * don't fit by themselves either */
+static void check_budget(struct mp_media *m)
+{
+	struct mp_loop_cache *lc = &m->loop;
+
+	if (lc->raw && lc->frames_size + lc->packets_size > lc->budget)
+		free_frames(lc);
+
+	if (lc->packets_size > lc->budget) {
+		mp_loop_cache_free(lc);
+		lc->state = MP_LOOP_CACHE_OFF;
+
+		blog(LOG_INFO, "MP: '%s' doesn't fit in the loop cache",
+		     m->path);
+	}
+}
+
+void mp_loop_cache_reset(struct mp_media *m)
+{
+	struct mp_loop_cache *lc = &m->loop;
+
+	switch (lc->state) {
+	case MP_LOOP_CACHE_OFF:
+		break;
+
+	case MP_LOOP_CACHE_IDLE:
+	case MP_LOOP_CACHE_RECORDING:
+		/* hardware frames hold on to decoder surfaces */
+		mp_loop_cache_free(lc);
+		lc->raw = !m->hw;
+		lc->state = MP_LOOP_CACHE_RECORDING;
+		break;
+
+	case MP_LOOP_CACHE_READY:
+		lc->frame_idx[0] = 0;
+		lc->frame_idx[1] = 0;
+		lc->packet_idx = 0;
+		lc->replaying = true;
+
+		/* nothing has to be read when the frames are cached */
+		if (lc->raw)
+			m->eof = true;
+		break;
+	}
+}
+
+void mp_loop_cache_finish(struct mp_media *m)
+{
+	struct mp_loop_cache *lc = &m->loop;
+
+	if (lc->state != MP_LOOP_CACHE_RECORDING)
+		return;
+
+	if (lc->raw)
+		free_packets(lc);
+
+	lc->state = MP_LOOP_CACHE_READY;
+
+	blog(LOG_INFO, "MP: Cached loop of '%s' as %s (%d MB)", m->path,
+	     lc->raw ? "frames" : "packets",
+	     (int)((lc->frames_size + lc->packets_size) / (1024 * 1024)));
+}
+
+void mp_loop_cache_seek(struct mp_media *m)
+{
+	struct mp_loop_cache *lc = &m->loop;
+
+	if (lc->state == MP_LOOP_CACHE_RECORDING) {
+		mp_loop_cache_free(lc);
+		lc->state = MP_LOOP_CACHE_IDLE;
+
+	} else if (lc->replaying) {
+		if (lc->raw)
+			m->eof = false;
+		lc->replaying = false;
+	}
+}
+
+void mp_loop_cache_add_packet(struct mp_media *m, const AVPacket *pkt)
+{
+	struct mp_loop_cache *lc = &m->loop;
+
+	if (lc->state != MP_LOOP_CACHE_RECORDING)
+		return;
+
+	AVPacket *copy = av_packet_clone(pkt);
+	if (!copy)
+		return;
+
+	da_push_back(lc->packets, &copy);
+	lc->packets_size += (size_t)copy->size + sizeof(*copy);
+	check_budget(m);
+}
+
+static inline size_t get_frame_size(const AVFrame *f)
+{
+	size_t size = sizeof(*f);
+
+	for (size_t i = 0; i < AV_NUM_DATA_POINTERS && f->buf[i]; i++)
+		size += f->buf[i]->size;
+	for (int i = 0; i < f->nb_extended_buf; i++)
+		size += f->extended_buf[i]->size;
+
+	return size;
+}
+
+void mp_loop_cache_add_frame(struct mp_decode *d)
+{
+	struct mp_media *m = d->m;
+	struct mp_loop_cache *lc = &m->loop;
+
+	if (lc->state != MP_LOOP_CACHE_RECORDING || !lc->raw)
+		return;
+
+	if (d->frame == d->hw_frame) {
+		free_frames(lc);
+		return;
+	}
+
+	struct mp_cached_frame cached = {
+		.frame = av_frame_clone(d->frame),
+		.pts = d->frame_pts,
+		.duration = d->last_duration,
+	};
+
+	if (!cached.frame) {
+		free_frames(lc);
+		return;
+	}
+
+	da_push_back(lc->frames[d->audio], &cached);
+	lc->frames_size += get_frame_size(cached.frame);
+	check_budget(m);
+}
+
+int mp_loop_cache_read_packet(struct mp_media *m, AVPacket *pkt)
+{
+	struct mp_loop_cache *lc = &m->loop;
+
+	if (lc->packet_idx == lc->packets.num)
+		return AVERROR_EOF;
+
+	return av_packet_ref(pkt, lc->packets.array[lc->packet_idx++]);
+}
+
+bool mp_loop_cache_next_frame(struct mp_decode *d)
+{
+	struct mp_loop_cache *lc = &d->m->loop;
+	size_t *idx = &lc->frame_idx[d->audio];
+	struct mp_cached_frame *cached;
+
+	d->frame_ready = false;
+
+	if (*idx == lc->frames[d->audio].num) {
+		d->eof = true;
+		return true;
+	}
+
+	cached = &lc->frames[d->audio].array[(*idx)++];
+
+	d->frame = cached->frame;
+	d->frame_pts = cached->pts;
+	d->last_duration = cached->duration;
+	d->next_pts = cached->pts + cached->duration;
+	d->frame_ready = true;
+	return true;
+}
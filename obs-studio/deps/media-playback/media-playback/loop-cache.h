@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <util/darray.h>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4204)
+#endif
+
+#include <libavcodec/avcodec.h>
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+/* The loop cache records the first full pass over a local file, and replays
+ * later passes from memory.  Decoded frames are kept while they fit in the
+ * memory budget, so that loops don't have to be decoded again.  Otherwise
+ * the compressed packets are kept, which still skips reading and seeking the
+ * file.  If neither fits, the media is played from the file as usual. */
+
+enum mp_loop_cache_state {
+	MP_LOOP_CACHE_OFF,
+	MP_LOOP_CACHE_IDLE,
+	MP_LOOP_CACHE_RECORDING,
+	MP_LOOP_CACHE_READY,
+};
+
+struct mp_cached_frame {
+	AVFrame *frame;
+	int64_t pts;
+	int64_t duration;
+};
+
+struct mp_loop_cache {
+	enum mp_loop_cache_state state;
+	size_t budget;
+	size_t frames_size;
+	size_t packets_size;
+
+	/* decoded frames are still being kept/replayed */
+	bool raw;
+	bool replaying;
+
+	/* video, audio */
+	DARRAY(struct mp_cached_frame) frames[2];
+	size_t frame_idx[2];
+
+	DARRAY(AVPacket *) packets;
+	size_t packet_idx;
+};
+
+struct mp_media;
+struct mp_decode;
+
+extern void mp_loop_cache_init(struct mp_loop_cache *lc, size_t budget);
+extern void mp_loop_cache_free(struct mp_loop_cache *lc);
+
+/* called when playback restarts from the beginning of the file */
+extern void mp_loop_cache_reset(struct mp_media *m);
+/* called when the end of the file has been reached */
+extern void mp_loop_cache_finish(struct mp_media *m);
+/* called before seeking anywhere other than the start */
+extern void mp_loop_cache_seek(struct mp_media *m);
+
+extern void mp_loop_cache_add_packet(struct mp_media *m, const AVPacket *pkt);
+extern void mp_loop_cache_add_frame(struct mp_decode *d);
+
+extern int mp_loop_cache_read_packet(struct mp_media *m, AVPacket *pkt);
+extern bool mp_loop_cache_next_frame(struct mp_decode *d);
+
+static inline bool
+mp_loop_cache_replaying_frames(const struct mp_loop_cache *lc)
+{
+	return lc->replaying && lc->raw;
+}
+
+static inline bool
+mp_loop_cache_replaying_packets(const struct mp_loop_cache *lc)
+{
+	return lc->replaying && !lc->raw;
+}
+
+#ifdef __cplusplus
+}
+#endif
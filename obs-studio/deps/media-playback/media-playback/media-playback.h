@@ -25,10 +25,17 @@ typedef void (*mp_video_cb)(void *opaque, struct obs_source_frame *frame);
 typedef void (*mp_audio_cb)(void *opaque, struct obs_source_audio *audio);
 typedef void (*mp_stop_cb)(void *opaque);
 
+/* Lends a frame without copying it, release has to be called with param once
+ * the frame data isn't used anymore, from any thread */
+typedef void (*mp_frame_release_cb)(void *param);
+typedef void (*mp_video_lend_cb)(void *opaque, struct obs_source_frame *frame,
+				 mp_frame_release_cb release, void *param);
+
 struct mp_media_info {
 	void *opaque;
 
 	mp_video_cb v_cb;
+	mp_video_lend_cb v_lend_cb;
 	mp_video_cb v_preload_cb;
 	mp_video_cb v_seek_cb;
 	mp_audio_cb a_cb;
@@ -39,6 +46,11 @@ struct mp_media_info {
 	char *ffmpeg_options;
 	int buffering;
 	int speed;
+	/* 0 lets libavcodec pick the number of decoding threads */
+	int decode_threads;
+	/* memory for replaying loops without decoding them again, 0 to
+	 * disable, see loop-cache.h */
+	size_t loop_cache_size;
 	enum video_range_type force_range;
 	bool is_linear_alpha;
 	bool hardware_decoding;
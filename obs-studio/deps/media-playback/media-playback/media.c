@@ -24,9 +24,86 @@
 
 #include <libavdevice/avdevice.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
 
 static int64_t base_sys_ts = 0;
 
+/* Frames lent to the source can outlive the media, so the pool is freed by
+ * whichever releases it last */
+struct mp_frame_pool {
+	volatile long refs;
+	pthread_mutex_t mutex;
+	DARRAY(struct mp_pool_frame *) frames;
+};
+
+/* the pool can't be kept in the AVFrame itself, av_frame_ref copies the
+ * opaque of the source frame over it */
+struct mp_pool_frame {
+	struct mp_frame_pool *pool;
+	AVFrame *frame;
+};
+
+static struct mp_frame_pool *mp_frame_pool_create(void)
+{
+	struct mp_frame_pool *pool = bzalloc(sizeof(*pool));
+	pool->refs = 1;
+	pthread_mutex_init(&pool->mutex, NULL);
+	return pool;
+}
+
+static void mp_frame_pool_release(struct mp_frame_pool *pool)
+{
+	if (!pool || os_atomic_dec_long(&pool->refs) != 0)
+		return;
+
+	for (size_t i = 0; i < pool->frames.num; i++) {
+		av_frame_free(&pool->frames.array[i]->frame);
+		bfree(pool->frames.array[i]);
+	}
+	da_free(pool->frames);
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool);
+}
+
+static struct mp_pool_frame *mp_frame_pool_get(struct mp_frame_pool *pool)
+{
+	struct mp_pool_frame *frame = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->frames.num) {
+		frame = da_end(pool->frames)[0];
+		da_pop_back(pool->frames);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!frame) {
+		AVFrame *av_frame = av_frame_alloc();
+		if (!av_frame)
+			return NULL;
+
+		frame = bmalloc(sizeof(*frame));
+		frame->pool = pool;
+		frame->frame = av_frame;
+	}
+
+	os_atomic_inc_long(&pool->refs);
+	return frame;
+}
+
+static void mp_frame_pool_return(void *param)
+{
+	struct mp_pool_frame *frame = param;
+	struct mp_frame_pool *pool = frame->pool;
+
+	av_frame_unref(frame->frame);
+
+	pthread_mutex_lock(&pool->mutex);
+	da_push_back(pool->frames, &frame);
+	pthread_mutex_unlock(&pool->mutex);
+
+	mp_frame_pool_release(pool);
+}
+
 static inline enum video_format convert_pixel_format(int f)
 {
 	switch (f) {
@@ -183,16 +260,20 @@ static int mp_media_next_packet(mp_media_t *media)
 		pkt = av_packet_alloc();
 	}
 
-	int ret = av_read_frame(media->fmt, pkt);
+	int ret = mp_loop_cache_replaying_packets(&media->loop)
+			  ? mp_loop_cache_read_packet(media, pkt)
+			  : av_read_frame(media->fmt, pkt);
 	if (ret < 0) {
 		if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
 			blog(LOG_WARNING, "MP: av_read_frame failed: %s (%d)",
 			     av_err2str(ret), ret);
+		mp_media_free_packet(media, pkt);
 		return ret;
 	}
 
 	struct mp_decode *d = get_packet_decoder(media, pkt);
 	if (d && pkt->size) {
+		mp_loop_cache_add_packet(media, pkt);
 		mp_decode_push_packet(d, pkt);
 	} else {
 		mp_media_free_packet(media, pkt);
@@ -244,18 +325,48 @@ static inline int get_sws_range(enum AVColorRange r)
 
 #define FIXED_1_0 (1 << 16)
 
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+/* swscale splits the frame into slices over its own threads */
+static struct SwsContext *create_scaler(mp_media_t *m)
+{
+	const AVCodecContext *c = m->v.decoder;
+	struct SwsContext *swscale = sws_alloc_context();
+	if (!swscale)
+		return NULL;
+
+	av_opt_set_int(swscale, "srcw", c->width, 0);
+	av_opt_set_int(swscale, "srch", c->height, 0);
+	av_opt_set_pixel_fmt(swscale, "src_format", c->pix_fmt, 0);
+	av_opt_set_int(swscale, "dstw", c->width, 0);
+	av_opt_set_int(swscale, "dsth", c->height, 0);
+	av_opt_set_pixel_fmt(swscale, "dst_format", m->scale_format, 0);
+	av_opt_set_int(swscale, "sws_flags", SWS_POINT, 0);
+	av_opt_set_int(swscale, "threads", m->decode_threads, 0);
+
+	if (sws_init_context(swscale, NULL, NULL) < 0) {
+		sws_freeContext(swscale);
+		return NULL;
+	}
+
+	return swscale;
+}
+#else
+static struct SwsContext *create_scaler(mp_media_t *m)
+{
+	const AVCodecContext *c = m->v.decoder;
+	return sws_getCachedContext(NULL, c->width, c->height, c->pix_fmt,
+				    c->width, c->height, m->scale_format,
+				    SWS_POINT, NULL, NULL, NULL);
+}
+#endif
+
 static bool mp_media_init_scaling(mp_media_t *m)
 {
 	int space = get_sws_colorspace(m->v.decoder->colorspace);
 	int range = get_sws_range(m->v.decoder->color_range);
 	const int *coeff = sws_getCoefficients(space);
 
-	m->swscale = sws_getCachedContext(NULL, m->v.decoder->width,
-					  m->v.decoder->height,
-					  m->v.decoder->pix_fmt,
-					  m->v.decoder->width,
-					  m->v.decoder->height, m->scale_format,
-					  SWS_POINT, NULL, NULL, NULL);
+	m->swscale = create_scaler(m);
 	if (!m->swscale) {
 		blog(LOG_WARNING, "MP: Failed to initialize scaler");
 		return false;
@@ -263,16 +374,40 @@ static bool mp_media_init_scaling(mp_media_t *m)
 
 	sws_setColorspaceDetails(m->swscale, coeff, range, coeff, range, 0,
 				 FIXED_1_0, FIXED_1_0);
+	return true;
+}
 
-	int ret = av_image_alloc(m->scale_pic, m->scale_linesizes,
-				 m->v.decoder->width, m->v.decoder->height,
-				 m->scale_format, 32);
-	if (ret < 0) {
+/* scaled frames come from a buffer pool, so they can be lent to the source
+ * like decoded frames */
+static bool mp_media_scale_frame(mp_media_t *m, const AVFrame *f, AVFrame *out)
+{
+	int size = av_image_get_buffer_size(m->scale_format, f->width,
+					    f->height, 32);
+	if (size < 0)
+		return false;
+
+	if (!m->scale_pool || m->scale_pool_size != size) {
+		av_buffer_pool_uninit(&m->scale_pool);
+		m->scale_pool = av_buffer_pool_init(size, NULL);
+		m->scale_pool_size = size;
+	}
+
+	out->buf[0] = av_buffer_pool_get(m->scale_pool);
+	if (!out->buf[0]) {
 		blog(LOG_WARNING, "MP: Failed to create scale pic data");
 		return false;
 	}
 
-	return true;
+	av_image_fill_arrays(out->data, out->linesize, out->buf[0]->data,
+			     m->scale_format, f->width, f->height, 32);
+	out->format = m->scale_format;
+	out->width = f->width;
+	out->height = f->height;
+
+	int ret = sws_scale(m->swscale, (const uint8_t *const *)f->data,
+			    f->linesize, 0, f->height, out->data,
+			    out->linesize);
+	return ret >= 0;
 }
 
 bool mp_media_prepare_frames(mp_media_t *m)
@@ -404,6 +539,10 @@ void mp_media_next_video(mp_media_t *m, bool preload)
 	enum video_colorspace new_space;
 	enum video_range_type new_range;
 	AVFrame *f = d->frame;
+	struct mp_pool_frame *pool_frame;
+	AVFrame *out;
+	bool success;
+	bool flip;
 
 	if (!preload) {
 		if (!mp_media_can_play_frame(m, d))
@@ -411,38 +550,37 @@ void mp_media_next_video(mp_media_t *m, bool preload)
 
 		d->frame_ready = false;
 
-		if (!m->v_cb)
+		if (!m->v_cb && !m->v_lend_cb)
 			return;
 	} else if (!d->frame_ready) {
 		return;
 	}
 
-	bool flip = false;
-	if (m->swscale) {
-		int ret = sws_scale(m->swscale, (const uint8_t *const *)f->data,
-				    f->linesize, 0, f->height, m->scale_pic,
-				    m->scale_linesizes);
-		if (ret < 0)
-			return;
+	pool_frame = mp_frame_pool_get(m->frame_pool);
+	if (!pool_frame)
+		return;
 
-		flip = m->scale_linesizes[0] < 0 && m->scale_linesizes[1] == 0;
-		for (size_t i = 0; i < 4; i++) {
-			frame->data[i] = m->scale_pic[i];
-			frame->linesize[i] = abs(m->scale_linesizes[i]);
-		}
+	out = pool_frame->frame;
 
-	} else {
-		flip = f->linesize[0] < 0 && f->linesize[1] == 0;
+	success = m->swscale ? mp_media_scale_frame(m, f, out)
+			     : av_frame_ref(out, f) == 0;
+	if (!success)
+		goto fail;
 
-		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-			frame->data[i] = f->data[i];
-			frame->linesize[i] = abs(f->linesize[i]);
-		}
+	flip = out->linesize[0] < 0 && out->linesize[1] == 0;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		frame->data[i] = out->data[i];
+		frame->linesize[i] = abs(out->linesize[i]);
 	}
 
 	if (flip)
 		frame->data[0] -= frame->linesize[0] * ((size_t)f->height - 1);
 
+	/* keeps the data of m->obsframe valid for preloading */
+	av_frame_unref(m->cur_frame);
+	av_frame_ref(m->cur_frame, out);
+
 	new_format = convert_pixel_format(m->scale_format);
 	new_space = convert_color_space(f->colorspace, f->color_trc,
 					f->color_primaries);
@@ -452,8 +590,6 @@ void mp_media_next_video(mp_media_t *m, bool preload)
 
 	if (new_format != frame->format || new_space != m->cur_space ||
 	    new_range != m->cur_range) {
-		bool success;
-
 		frame->format = new_format;
 		frame->full_range = new_range == VIDEO_RANGE_FULL;
 
@@ -467,12 +603,12 @@ void mp_media_next_video(mp_media_t *m, bool preload)
 
 		if (!success) {
 			frame->format = VIDEO_FORMAT_NONE;
-			return;
+			goto fail;
 		}
 	}
 
 	if (frame->format == VIDEO_FORMAT_NONE)
-		return;
+		goto fail;
 
 	frame->timestamp = m->full_decode
 				   ? d->frame_pts
@@ -510,7 +646,7 @@ void mp_media_next_video(mp_media_t *m, bool preload)
 #else
 		if (!(f->flags & AV_FRAME_FLAG_KEY))
 #endif
-			return;
+			goto fail;
 
 		d->got_first_keyframe = true;
 	}
@@ -521,9 +657,16 @@ void mp_media_next_video(mp_media_t *m, bool preload)
 		} else if (!m->request_preload) {
 			m->v_preload_cb(m->opaque, frame);
 		}
+	} else if (m->v_lend_cb) {
+		m->v_lend_cb(m->opaque, frame, mp_frame_pool_return,
+			     pool_frame);
+		return;
 	} else {
 		m->v_cb(m->opaque, frame);
 	}
+
+fail:
+	mp_frame_pool_return(pool_frame);
 }
 
 static void mp_media_calc_next_ns(mp_media_t *m)
@@ -564,7 +707,8 @@ static void seek_to(mp_media_t *m, int64_t pos)
 						     stream->time_base)
 				      : seek_pos;
 
-	if (m->is_local_file) {
+	/* replaying a loop doesn't read the file */
+	if (m->is_local_file && !m->loop.replaying) {
 		int ret = av_seek_frame(m->fmt, 0, seek_target, seek_flags);
 		if (ret < 0) {
 			blog(LOG_WARNING, "MP: Failed to seek: %s",
@@ -597,6 +741,8 @@ bool mp_media_reset(mp_media_t *m)
 	m->base_ts += next_ts;
 	m->seek_next_ts = false;
 
+	mp_loop_cache_reset(m);
+
 	seek_to(m, start_time);
 
 	pthread_mutex_lock(&m->mutex);
@@ -660,6 +806,8 @@ bool mp_media_eof(mp_media_t *m)
 	if (eof) {
 		bool looping;
 
+		mp_loop_cache_finish(m);
+
 		pthread_mutex_lock(&m->mutex);
 		looping = m->looping;
 		if (!looping) {
@@ -841,6 +989,7 @@ static inline bool mp_media_thread(mp_media_t *m)
 
 		if (seek) {
 			m->seek_next_ts = true;
+			mp_loop_cache_seek(m);
 			seek_to(m, seek_pos);
 			continue;
 		}
@@ -934,10 +1083,18 @@ bool mp_media_init(mp_media_t *media, const struct mp_media_info *info)
 	media->is_linear_alpha = info->is_linear_alpha;
 	media->buffering = info->buffering;
 	media->speed = info->speed;
+	media->decode_threads = info->decode_threads;
+	media->v_lend_cb = info->v_lend_cb;
 	media->request_preload = info->request_preload;
 	media->is_local_file = info->is_local_file;
+	media->frame_pool = mp_frame_pool_create();
+	media->cur_frame = av_frame_alloc();
 	da_init(media->packet_pool);
 
+	mp_loop_cache_init(&media->loop, info->is_local_file && !info->full_decode
+						 ? info->loop_cache_size
+						 : 0);
+
 	if (!info->is_local_file || media->speed < 1 || media->speed > 200)
 		media->speed = 100;
 
@@ -987,7 +1144,10 @@ void mp_media_free(mp_media_t *media)
 	pthread_mutex_destroy(&media->mutex);
 	os_sem_destroy(media->sem);
 	sws_freeContext(media->swscale);
-	av_freep(&media->scale_pic[0]);
+	av_buffer_pool_uninit(&media->scale_pool);
+	av_frame_free(&media->cur_frame);
+	mp_frame_pool_release(media->frame_pool);
+	mp_loop_cache_free(&media->loop);
 	bfree(media->path);
 	bfree(media->format_name);
 	memset(media, 0, sizeof(*media));
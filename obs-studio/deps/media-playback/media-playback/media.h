@@ -18,6 +18,7 @@
 
 #include <obs.h>
 #include "decode.h"
+#include "loop-cache.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +32,7 @@ extern "C" {
 
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
 #include <libswscale/swscale.h>
 #include <util/threading.h>
 
@@ -38,6 +40,8 @@ extern "C" {
 #pragma warning(pop)
 #endif
 
+struct mp_frame_pool;
+
 struct mp_media {
 	AVFormatContext *fmt;
 
@@ -45,6 +49,7 @@ struct mp_media {
 	mp_video_cb v_seek_cb;
 	mp_stop_cb stop_cb;
 	mp_video_cb v_cb;
+	mp_video_lend_cb v_lend_cb;
 	mp_audio_cb a_cb;
 	void *opaque;
 
@@ -53,11 +58,19 @@ struct mp_media {
 	char *ffmpeg_options;
 	int buffering;
 	int speed;
+	int decode_threads;
 
 	enum AVPixelFormat scale_format;
 	struct SwsContext *swscale;
-	int scale_linesizes[4];
-	uint8_t *scale_pic[4];
+	AVBufferPool *scale_pool;
+	int scale_pool_size;
+
+	/* output frames are references to decoded or scaled frames, which are
+	 * lent to the source when possible instead of being copied */
+	struct mp_frame_pool *frame_pool;
+	AVFrame *cur_frame;
+
+	struct mp_loop_cache loop;
 
 	DARRAY(AVPacket *) packet_pool;
 	struct mp_decode v;
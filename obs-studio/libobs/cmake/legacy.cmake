@@ -58,6 +58,7 @@ target_sources(
           obs-output.c
           obs-output.h
           obs-output-delay.c
+          obs-packet-pool.c
           obs-properties.c
           obs-properties.h
           obs-service.c
@@ -19,6 +19,8 @@
 #include "../util/base.h"
 #include "../util/platform.h"
 #include "../util/dstr.h"
+#include "../util/threading.h"
+#include "../util/task.h"
 #include "vec4.h"
 
 #define blog(level, format, ...) \
@@ -56,9 +58,9 @@ static void bi_def_bitmap_modified(void *bitmap)
 	UNUSED_PARAMETER(bitmap);
 }
 
-static inline int get_full_decoded_gif_size(gs_image_file_t *image)
+static inline size_t get_full_decoded_gif_size(gs_image_file_t *image)
 {
-	return image->gif.width * image->gif.height * 4 *
+	return (size_t)image->gif.width * image->gif.height * 4 *
 	       image->gif.frame_count;
 }
 
@@ -72,6 +74,311 @@ static inline void *alloc_mem(gs_image_file_t *image, uint64_t *mem_usage,
 	return bzalloc(size);
 }
 
+/* ------------------------------------------------------------------------- */
+/* Streaming gif decoding
+ *
+ * Gifs that would take more than GIF_STREAM_MIN_SIZE to keep fully decoded
+ * are decoded on demand instead.  A few decoded frames are kept in a small
+ * LRU cache which a background task on the shared task pool fills ahead of
+ * playback, and copies of the decoder canvas are stored at regular intervals
+ * so that seeking backwards doesn't have to decode everything from the first
+ * frame.
+ *
+ * Only the decode task touches the decoder and the checkpoints.  It decodes
+ * into a private buffer and swaps it into the cache under the mutex, so the
+ * render thread never waits for a decode.  If the current frame isn't ready
+ * yet, the previous one stays on screen until it is. */
+
+#define GIF_STREAM_MIN_SIZE (64 * 1024 * 1024)
+#define GIF_STREAM_CACHE_FRAMES 4
+#define GIF_STREAM_DECODE_AHEAD 2
+#define GIF_STREAM_CHECKPOINT_SIZE (64 * 1024 * 1024)
+#define GIF_STREAM_MAX_CHECKPOINTS 16
+/* same value libnsgif uses for gif_animation::decoded_frame */
+#define GIF_STREAM_NO_FRAME -1
+
+struct gif_cached_frame {
+	int frame;
+	uint64_t last_used;
+	uint8_t *data;
+};
+
+struct gif_checkpoint {
+	int frame;
+	uint8_t *canvas;
+};
+
+struct gs_gif_stream {
+	os_task_pool_t *pool;
+	os_task_group_t *group;
+	volatile bool decoding;
+	volatile bool stop;
+	volatile long next_frame;
+
+	enum gs_image_alpha_mode alpha_mode;
+	size_t frame_size;
+
+	/* cache, shared with the render thread */
+	pthread_mutex_t mutex;
+	uint64_t use_count;
+	struct gif_cached_frame cache[GIF_STREAM_CACHE_FRAMES];
+
+	/* render thread only */
+	int shown_frame;
+
+	/* decode task only */
+	uint8_t *decoded;
+	struct gif_checkpoint *checkpoints;
+	unsigned int num_checkpoints;
+	unsigned int checkpoint_interval;
+};
+
+static void premultiply_frame(uint8_t *data, size_t area,
+			      enum gs_image_alpha_mode alpha_mode)
+{
+	if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB)
+		gs_premultiply_xyza_srgb_loop(data, area);
+	else if (alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY)
+		gs_premultiply_xyza_loop(data, area);
+}
+
+/* moves the decoder canvas to the closest checkpoint before the frame if
+ * that saves decoding frames, returns the first frame left to decode */
+static int gif_stream_seek(gs_image_file_t *image, int frame)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+	int decoded = image->gif.decoded_frame;
+	int start = (decoded != GIF_STREAM_NO_FRAME && decoded <= frame)
+			    ? decoded + 1
+			    : 0;
+
+	for (unsigned int i = stream->num_checkpoints; i > 0; i--) {
+		struct gif_checkpoint *cp = &stream->checkpoints[i - 1];
+
+		if (cp->frame == GIF_STREAM_NO_FRAME || cp->frame > frame)
+			continue;
+		if (cp->frame + 1 <= start)
+			break;
+
+		memcpy(image->gif.frame_image, cp->canvas, stream->frame_size);
+		image->gif.decoded_frame = cp->frame;
+		return cp->frame + 1;
+	}
+
+	return start;
+}
+
+static void gif_stream_save_checkpoint(gs_image_file_t *image, int frame)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+	unsigned int idx;
+
+	if (!frame || frame % stream->checkpoint_interval != 0)
+		return;
+
+	idx = frame / stream->checkpoint_interval - 1;
+	if (idx >= stream->num_checkpoints ||
+	    stream->checkpoints[idx].frame == frame)
+		return;
+
+	memcpy(stream->checkpoints[idx].canvas, image->gif.frame_image,
+	       stream->frame_size);
+	stream->checkpoints[idx].frame = frame;
+}
+
+/* returns the cached frame, the stream mutex must be held while using it */
+static uint8_t *gif_stream_find_frame(struct gs_gif_stream *stream, int frame)
+{
+	for (size_t i = 0; i < GIF_STREAM_CACHE_FRAMES; i++) {
+		struct gif_cached_frame *cached = &stream->cache[i];
+
+		if (cached->frame == frame) {
+			cached->last_used = ++stream->use_count;
+			return cached->data;
+		}
+	}
+
+	return NULL;
+}
+
+static bool gif_stream_cached(struct gs_gif_stream *stream, int frame)
+{
+	pthread_mutex_lock(&stream->mutex);
+	bool cached = gif_stream_find_frame(stream, frame) != NULL;
+	pthread_mutex_unlock(&stream->mutex);
+	return cached;
+}
+
+/* decodes and premultiplies the frame into stream->decoded */
+static bool gif_stream_decode(gs_image_file_t *image, int frame)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+
+	for (int i = gif_stream_seek(image, frame); i <= frame; i++) {
+		if (gif_decode_frame(&image->gif, i) != GIF_OK) {
+			image->gif.decoded_frame = GIF_STREAM_NO_FRAME;
+			return false;
+		}
+
+		gif_stream_save_checkpoint(image, i);
+	}
+
+	memcpy(stream->decoded, image->gif.frame_image, stream->frame_size);
+	premultiply_frame(stream->decoded, stream->frame_size / 4,
+			  stream->alpha_mode);
+	return true;
+}
+
+/* swaps the decoded frame with the least recently used one in the cache */
+static void gif_stream_publish(struct gs_gif_stream *stream, int frame)
+{
+	struct gif_cached_frame *slot = &stream->cache[0];
+	uint8_t *data;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	for (size_t i = 1; i < GIF_STREAM_CACHE_FRAMES; i++) {
+		if (stream->cache[i].last_used < slot->last_used)
+			slot = &stream->cache[i];
+	}
+
+	data = slot->data;
+	slot->data = stream->decoded;
+	slot->frame = frame;
+	slot->last_used = ++stream->use_count;
+	stream->decoded = data;
+
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static void gif_stream_decode_task(void *param)
+{
+	gs_image_file_t *image = param;
+	struct gs_gif_stream *stream = image->gif_stream;
+	long next;
+
+	do {
+		next = os_atomic_load_long(&stream->next_frame);
+
+		for (long i = 0; i <= GIF_STREAM_DECODE_AHEAD; i++) {
+			int frame = (int)((next + i) % image->gif.frame_count);
+
+			if (os_atomic_load_bool(&stream->stop))
+				break;
+			if (!gif_stream_cached(stream, frame) &&
+			    gif_stream_decode(image, frame))
+				gif_stream_publish(stream, frame);
+		}
+
+		os_atomic_set_bool(&stream->decoding, false);
+
+		/* the tick doesn't queue another task while this one runs,
+		 * so pick up a frame change that happened in the meantime */
+	} while (next != os_atomic_load_long(&stream->next_frame) &&
+		 !os_atomic_load_bool(&stream->stop) &&
+		 !os_atomic_exchange_bool(&stream->decoding, true));
+}
+
+static void gif_stream_request(gs_image_file_t *image)
+{
+	struct gs_gif_stream *stream = image->gif_stream;
+
+	os_atomic_set_long(&stream->next_frame, image->cur_frame);
+	if (!os_atomic_exchange_bool(&stream->decoding, true))
+		os_task_group_queue_task(stream->group, gif_stream_decode_task,
+					 image);
+}
+
+static void gif_stream_destroy(struct gs_gif_stream *stream)
+{
+	if (!stream)
+		return;
+
+	if (stream->group) {
+		os_atomic_set_bool(&stream->stop, true);
+		os_task_group_destroy(stream->group);
+	}
+	os_task_pool_release(stream->pool);
+
+	for (size_t i = 0; i < GIF_STREAM_CACHE_FRAMES; i++)
+		bfree(stream->cache[i].data);
+	for (size_t i = 0; i < stream->num_checkpoints; i++)
+		bfree(stream->checkpoints[i].canvas);
+
+	bfree(stream->decoded);
+	bfree(stream->checkpoints);
+	pthread_mutex_destroy(&stream->mutex);
+	bfree(stream);
+}
+
+static bool gif_stream_create(gs_image_file_t *image, uint64_t *mem_usage,
+			      enum gs_image_alpha_mode alpha_mode)
+{
+	struct gs_gif_stream *stream = bzalloc(sizeof(*stream));
+	size_t frame_size = (size_t)image->gif.width * image->gif.height * 4;
+	unsigned int max_checkpoints;
+
+	image->gif_stream = stream;
+	stream->alpha_mode = alpha_mode;
+	stream->frame_size = frame_size;
+	stream->shown_frame = GIF_STREAM_NO_FRAME;
+
+	if (pthread_mutex_init(&stream->mutex, NULL) != 0) {
+		bfree(stream);
+		image->gif_stream = NULL;
+		return false;
+	}
+
+	for (size_t i = 0; i < GIF_STREAM_CACHE_FRAMES; i++) {
+		stream->cache[i].frame = GIF_STREAM_NO_FRAME;
+		stream->cache[i].data = alloc_mem(image, mem_usage, frame_size);
+	}
+	stream->decoded = alloc_mem(image, mem_usage, frame_size);
+
+	/* checkpoints are spread evenly over the animation and limited by
+	 * their total size, frame 0 never needs one */
+	max_checkpoints = (unsigned int)(GIF_STREAM_CHECKPOINT_SIZE / frame_size);
+	if (max_checkpoints > GIF_STREAM_MAX_CHECKPOINTS)
+		max_checkpoints = GIF_STREAM_MAX_CHECKPOINTS;
+
+	if (max_checkpoints) {
+		stream->checkpoint_interval =
+			image->gif.frame_count / (max_checkpoints + 1) + 1;
+		stream->num_checkpoints =
+			(image->gif.frame_count - 1) /
+			stream->checkpoint_interval;
+		stream->checkpoints = bzalloc(stream->num_checkpoints *
+					      sizeof(struct gif_checkpoint));
+
+		for (size_t i = 0; i < stream->num_checkpoints; i++) {
+			stream->checkpoints[i].frame = GIF_STREAM_NO_FRAME;
+			stream->checkpoints[i].canvas =
+				alloc_mem(image, mem_usage, frame_size);
+		}
+	}
+
+	/* the first frame is needed for the texture right away */
+	if (!gif_stream_decode(image, 0))
+		goto fail;
+	gif_stream_publish(stream, 0);
+
+	stream->pool = os_task_pool_get_shared();
+	stream->group = os_task_group_create(stream->pool,
+					     OS_TASK_PRIORITY_BACKGROUND);
+	if (!stream->group)
+		goto fail;
+
+	gif_stream_request(image);
+	return true;
+
+fail:
+	gif_stream_destroy(stream);
+	image->gif_stream = NULL;
+	return false;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static bool init_animated_gif(gs_image_file_t *image, const char *path,
 			      uint64_t *mem_usage,
 			      enum gs_image_alpha_mode alpha_mode)
@@ -128,14 +435,24 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path,
 	max_size = (uint64_t)image->gif.width * (uint64_t)image->gif.height *
 		   (uint64_t)image->gif.frame_count * 4LLU;
 
-	if ((uint64_t)get_full_decoded_gif_size(image) != max_size) {
-		blog(LOG_WARNING, "Gif '%s' overflowed maximum pointer size",
-		     path);
-		goto fail;
-	}
-
 	image->is_animated_gif = (image->gif.frame_count > 1 && result >= 0);
-	if (image->is_animated_gif) {
+	if (image->is_animated_gif && max_size > GIF_STREAM_MIN_SIZE) {
+		if (!gif_stream_create(image, mem_usage, alpha_mode)) {
+			blog(LOG_WARNING,
+			     "Failed to start decoding gif '%s'", path);
+			goto fail;
+		}
+
+		image->cx = (uint32_t)image->gif.width;
+		image->cy = (uint32_t)image->gif.height;
+		image->format = GS_RGBA;
+
+		if (mem_usage) {
+			*mem_usage += (size_t)4 * image->cx * image->cy;
+			*mem_usage += size;
+		}
+
+	} else if (image->is_animated_gif) {
 		gif_decode_frame(&image->gif, 0);
 
 		image->animation_frame_cache =
@@ -244,6 +561,7 @@ void gs_image_file_free(gs_image_file_t *image)
 
 	if (image->loaded) {
 		if (image->is_animated_gif) {
+			gif_stream_destroy(image->gif_stream);
 			gif_finalise(&image->gif);
 			bfree(image->animation_frame_cache);
 			bfree(image->animation_frame_data);
@@ -288,7 +606,21 @@ void gs_image_file_init_texture(gs_image_file_t *image)
 	if (!image->loaded)
 		return;
 
-	if (image->is_animated_gif) {
+	if (image->gif_stream) {
+		struct gs_gif_stream *stream = image->gif_stream;
+
+		pthread_mutex_lock(&stream->mutex);
+		const uint8_t *data =
+			gif_stream_find_frame(stream, image->cur_frame);
+		image->texture = gs_texture_create(image->cx, image->cy,
+						   image->format, 1,
+						   data ? &data : NULL,
+						   GS_DYNAMIC);
+		if (data)
+			stream->shown_frame = image->cur_frame;
+		pthread_mutex_unlock(&stream->mutex);
+
+	} else if (image->is_animated_gif) {
 		image->texture = gs_texture_create(
 			image->cx, image->cy, image->format, 1,
 			(const uint8_t **)&image->gif.frame_image, GS_DYNAMIC);
@@ -395,13 +727,20 @@ static bool gs_image_file_tick_internal(gs_image_file_t *image,
 		int new_frame =
 			calculate_new_frame(image, elapsed_time_ns, loops);
 
-		if (new_frame != image->cur_frame) {
+		if (new_frame != image->cur_frame && image->gif_stream) {
+			image->cur_frame = new_frame;
+			gif_stream_request(image);
+			return true;
+
+		} else if (new_frame != image->cur_frame) {
 			decode_new_frame(image, new_frame, alpha_mode);
 			return true;
 		}
 	}
 
-	return false;
+	/* keep updating until the decode task has the current frame ready */
+	return image->gif_stream &&
+	       image->gif_stream->shown_frame != image->cur_frame;
 }
 
 bool gs_image_file_tick(gs_image_file_t *image, uint64_t elapsed_time_ns)
@@ -434,6 +773,20 @@ gs_image_file_update_texture_internal(gs_image_file_t *image,
 	if (!image->is_animated_gif || !image->loaded)
 		return;
 
+	if (image->gif_stream) {
+		struct gs_gif_stream *stream = image->gif_stream;
+
+		pthread_mutex_lock(&stream->mutex);
+		uint8_t *data = gif_stream_find_frame(stream, image->cur_frame);
+		if (data) {
+			gs_texture_set_image(image->texture, data,
+					     image->gif.width * 4, false);
+			stream->shown_frame = image->cur_frame;
+		}
+		pthread_mutex_unlock(&stream->mutex);
+		return;
+	}
+
 	if (!image->animation_frame_cache[image->cur_frame])
 		decode_new_frame(image, image->cur_frame, alpha_mode);
 
@@ -24,6 +24,8 @@
 extern "C" {
 #endif
 
+struct gs_gif_stream;
+
 struct gs_image_file {
 	gs_texture_t *texture;
 	enum gs_color_format format;
@@ -44,6 +46,9 @@ struct gs_image_file {
 
 	uint8_t *texture_data;
 	gif_bitmap_callback_vt bitmap_callbacks;
+
+	/* decodes on demand when a gif is too large to keep fully decoded */
+	struct gs_gif_stream *gif_stream;
 };
 
 struct gs_image_file2 {
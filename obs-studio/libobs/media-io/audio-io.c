@@ -24,6 +24,7 @@
 #include "../util/platform.h"
 #include "../util/profiler.h"
 #include "../util/util_uint64.h"
+#include "../util/sse-intrin.h"
 
 #include "audio-io.h"
 #include "audio-resampler.h"
@@ -133,6 +134,35 @@ static inline void do_audio_output(struct audio_output *audio, size_t mix_idx,
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
+/* Copies the unclamped mix and scrubs NaNs/clamps the output mix in a single
+ * pass over the buffer. */
+static inline void clamp_audio_plane(float *unclamped, float *data,
+				     size_t count)
+{
+	const __m128 min_val = _mm_set1_ps(-1.0f);
+	const __m128 max_val = _mm_set1_ps(1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		_mm_storeu_ps(unclamped + i, val);
+
+		/* NaN compares unequal to itself, mask it to 0 */
+		val = _mm_and_ps(val, _mm_cmpeq_ps(val, val));
+		val = _mm_min_ps(_mm_max_ps(val, min_val), max_val);
+		_mm_storeu_ps(data + i, val);
+	}
+
+	for (; i < count; i++) {
+		float val = data[i];
+		unclamped[i] = val;
+		val = (val == val) ? val : 0.0f;
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
 static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 {
 	size_t float_size = bytes / sizeof(float);
@@ -144,20 +174,9 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		if (!mix->inputs.num)
 			continue;
 
-		for (size_t plane = 0; plane < audio->planes; plane++) {
-			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
-			/* Unclamped mix is copied directly. */
-			memcpy(mix->buffer_unclamped[plane], mix_data, bytes);
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val == val) ? val : 0.0f;
-				val = (val > 1.0f) ? 1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
-		}
+		for (size_t plane = 0; plane < audio->planes; plane++)
+			clamp_audio_plane(mix->buffer_unclamped[plane],
+					  mix->buffer[plane], float_size);
 	}
 }
 
@@ -200,6 +200,82 @@ void convert_uyvx_to_i444(const uint8_t *input, uint32_t in_linesize,
 	}
 }
 
+/* Stores 16 pixels of a 4:2:0 line as packed 444 (v, u, y, 0 per pixel).
+ * u and v hold one chroma sample per pixel pair in their low 8 bytes. */
+static FORCE_INLINE void store_420_line(uint8_t *output, __m128i lum, __m128i u,
+					__m128i v)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i vu = _mm_unpacklo_epi8(v, u);
+	__m128i vu_lo = _mm_unpacklo_epi16(vu, vu);
+	__m128i vu_hi = _mm_unpackhi_epi16(vu, vu);
+	__m128i lum_lo = _mm_unpacklo_epi8(lum, zero);
+	__m128i lum_hi = _mm_unpackhi_epi8(lum, zero);
+
+	_mm_storeu_si128((__m128i *)output, _mm_unpacklo_epi16(vu_lo, lum_lo));
+	_mm_storeu_si128((__m128i *)(output + 16),
+			 _mm_unpackhi_epi16(vu_lo, lum_lo));
+	_mm_storeu_si128((__m128i *)(output + 32),
+			 _mm_unpacklo_epi16(vu_hi, lum_hi));
+	_mm_storeu_si128((__m128i *)(output + 48),
+			 _mm_unpackhi_epi16(vu_hi, lum_hi));
+}
+
+/* Combines 4 pixels into packed 444 (y, u, v, 0 per pixel).  lum holds one
+ * 16-bit luma sample and uv one u, v pair per pixel in the low 8 bytes. */
+static FORCE_INLINE __m128i nv12_pixels(__m128i lum, __m128i uv)
+{
+	__m128i zero = _mm_setzero_si128();
+	return _mm_or_si128(_mm_unpacklo_epi16(lum, zero),
+			    _mm_slli_epi32(_mm_unpacklo_epi16(uv, zero), 8));
+}
+
+/* Stores 16 pixels of an NV12 line as packed 444 (y, u, v, 0 per pixel).
+ * uv holds 8 interleaved chroma pairs. */
+static FORCE_INLINE void store_nv12_line(uint8_t *output, __m128i lum,
+					 __m128i uv)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i uv_lo = _mm_unpacklo_epi16(uv, uv);
+	__m128i uv_hi = _mm_unpackhi_epi16(uv, uv);
+	__m128i lum_lo = _mm_unpacklo_epi8(lum, zero);
+	__m128i lum_hi = _mm_unpackhi_epi8(lum, zero);
+
+	_mm_storeu_si128((__m128i *)output, nv12_pixels(lum_lo, uv_lo));
+	_mm_storeu_si128((__m128i *)(output + 16),
+			 nv12_pixels(_mm_srli_si128(lum_lo, 8),
+				     _mm_srli_si128(uv_lo, 8)));
+	_mm_storeu_si128((__m128i *)(output + 32), nv12_pixels(lum_hi, uv_hi));
+	_mm_storeu_si128((__m128i *)(output + 48),
+			 nv12_pixels(_mm_srli_si128(lum_hi, 8),
+				     _mm_srli_si128(uv_hi, 8)));
+}
+
+/* Reduces 16 10-bit samples to 8 bits */
+static FORCE_INLINE __m128i pack_10bit(const uint16_t *input, int shift)
+{
+	__m128i lo = _mm_loadu_si128((const __m128i *)input);
+	__m128i hi = _mm_loadu_si128((const __m128i *)(input + 8));
+
+	if (shift == 8) {
+		lo = _mm_srli_epi16(lo, 8);
+		hi = _mm_srli_epi16(hi, 8);
+	} else {
+		lo = _mm_srli_epi16(lo, 2);
+		hi = _mm_srli_epi16(hi, 2);
+	}
+
+	return _mm_packus_epi16(lo, hi);
+}
+
+/* Reduces 8 10-bit samples to 8 bits in the low half of the result */
+static FORCE_INLINE __m128i pack_10bit_half(const uint16_t *input)
+{
+	__m128i val = _mm_loadu_si128((const __m128i *)input);
+	val = _mm_srli_epi16(val, 2);
+	return _mm_packus_epi16(val, val);
+}
+
 void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 		    uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize)
@@ -214,14 +290,33 @@ void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
 		register const uint8_t *lum0, *lum1;
 		register uint32_t *output0, *output1;
-		uint32_t x;
+		uint32_t x = 0;
 
 		lum0 = input[0] + y * 2 * in_linesize[0];
 		lum1 = lum0 + in_linesize[0];
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
+		for (; x + 8 <= width_d2; x += 8) {
+			__m128i u = _mm_loadl_epi64((const __m128i *)chroma0);
+			__m128i v = _mm_loadl_epi64((const __m128i *)chroma1);
+
+			store_420_line((uint8_t *)output0,
+				       _mm_loadu_si128((const __m128i *)lum0),
+				       u, v);
+			store_420_line((uint8_t *)output1,
+				       _mm_loadu_si128((const __m128i *)lum1),
+				       u, v);
+
+			chroma0 += 8;
+			chroma1 += 8;
+			lum0 += 16;
+			lum1 += 16;
+			output0 += 16;
+			output1 += 16;
+		}
+
+		for (; x < width_d2; x++) {
 			uint32_t out;
 			out = (*(chroma0++) << 8) | *(chroma1++);
 
@@ -247,7 +342,7 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		const uint16_t *chroma;
 		register const uint8_t *lum0, *lum1;
 		register uint32_t *output0, *output1;
-		uint32_t x;
+		uint32_t x = 0;
 
 		chroma = (const uint16_t *)(input[1] + y * in_linesize[1]);
 		lum0 = input[0] + y * 2 * in_linesize[0];
@@ -255,7 +350,24 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
+		for (; x + 8 <= width_d2; x += 8) {
+			__m128i uv = _mm_loadu_si128((const __m128i *)chroma);
+
+			store_nv12_line((uint8_t *)output0,
+					_mm_loadu_si128((const __m128i *)lum0),
+					uv);
+			store_nv12_line((uint8_t *)output1,
+					_mm_loadu_si128((const __m128i *)lum1),
+					uv);
+
+			chroma += 8;
+			lum0 += 16;
+			lum1 += 16;
+			output0 += 16;
+			output1 += 16;
+		}
+
+		for (; x < width_d2; x++) {
 			uint32_t out = *(chroma++) << 8;
 
 			*(output0++) = *(lum0++) | out;
@@ -267,23 +379,151 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 	}
 }
 
+void decompress_p010(const uint8_t *const input[], const uint32_t in_linesize[],
+		     uint32_t start_y, uint32_t end_y, uint8_t *output,
+		     uint32_t out_linesize)
+{
+	uint32_t start_y_d2 = start_y / 2;
+	uint32_t width_d2 = min_uint32(in_linesize[0] / 2, out_linesize) / 2;
+	uint32_t height_d2 = end_y / 2;
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint16_t *chroma;
+		const uint16_t *lum0, *lum1;
+		uint32_t *output0, *output1;
+		uint32_t x = 0;
+
+		chroma = (const uint16_t *)(input[1] + y * in_linesize[1]);
+		lum0 = (const uint16_t *)(input[0] + y * 2 * in_linesize[0]);
+		lum1 = (const uint16_t *)((const uint8_t *)lum0 +
+					  in_linesize[0]);
+		output0 = (uint32_t *)(output + y * 2 * out_linesize);
+		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
+
+		for (; x + 8 <= width_d2; x += 8) {
+			__m128i uv = pack_10bit(chroma, 8);
+
+			store_nv12_line((uint8_t *)output0,
+					pack_10bit(lum0, 8), uv);
+			store_nv12_line((uint8_t *)output1,
+					pack_10bit(lum1, 8), uv);
+
+			chroma += 16;
+			lum0 += 16;
+			lum1 += 16;
+			output0 += 16;
+			output1 += 16;
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t out = ((uint32_t)(chroma[0] >> 8) << 8) |
+				       ((uint32_t)(chroma[1] >> 8) << 16);
+			chroma += 2;
+
+			*(output0++) = (*(lum0++) >> 8) | out;
+			*(output0++) = (*(lum0++) >> 8) | out;
+
+			*(output1++) = (*(lum1++) >> 8) | out;
+			*(output1++) = (*(lum1++) >> 8) | out;
+		}
+	}
+}
+
+void decompress_i010(const uint8_t *const input[], const uint32_t in_linesize[],
+		     uint32_t start_y, uint32_t end_y, uint8_t *output,
+		     uint32_t out_linesize)
+{
+	uint32_t start_y_d2 = start_y / 2;
+	uint32_t width_d2 = in_linesize[0] / 4;
+	uint32_t height_d2 = end_y / 2;
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint16_t *chroma0, *chroma1;
+		const uint16_t *lum0, *lum1;
+		uint32_t *output0, *output1;
+		uint32_t x = 0;
+
+		chroma0 = (const uint16_t *)(input[1] + y * in_linesize[1]);
+		chroma1 = (const uint16_t *)(input[2] + y * in_linesize[2]);
+		lum0 = (const uint16_t *)(input[0] + y * 2 * in_linesize[0]);
+		lum1 = (const uint16_t *)((const uint8_t *)lum0 +
+					  in_linesize[0]);
+		output0 = (uint32_t *)(output + y * 2 * out_linesize);
+		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
+
+		for (; x + 8 <= width_d2; x += 8) {
+			__m128i u = pack_10bit_half(chroma0);
+			__m128i v = pack_10bit_half(chroma1);
+
+			store_420_line((uint8_t *)output0,
+				       pack_10bit(lum0, 2), u, v);
+			store_420_line((uint8_t *)output1,
+				       pack_10bit(lum1, 2), u, v);
+
+			chroma0 += 8;
+			chroma1 += 8;
+			lum0 += 16;
+			lum1 += 16;
+			output0 += 16;
+			output1 += 16;
+		}
+
+		for (; x < width_d2; x++) {
+			uint32_t out;
+			out = ((uint32_t)(*(chroma0++) >> 2) << 8) |
+			      (uint32_t)(*(chroma1++) >> 2);
+
+			*(output0++) = ((uint32_t)(*(lum0++) >> 2) << 16) | out;
+			*(output0++) = ((uint32_t)(*(lum0++) >> 2) << 16) | out;
+
+			*(output1++) = ((uint32_t)(*(lum1++) >> 2) << 16) | out;
+			*(output1++) = ((uint32_t)(*(lum1++) >> 2) << 16) | out;
+		}
+	}
+}
+
 void decompress_422(const uint8_t *input, uint32_t in_linesize,
 		    uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize, bool leading_lum)
 {
-	uint32_t width_d2 = min_uint32(in_linesize, out_linesize) / 2;
+	/* each input dword holds a pixel pair, output pixels are dwords */
+	uint32_t width_d2 = min_uint32(in_linesize / 4, out_linesize / 8);
 	uint32_t y;
 
 	register const uint32_t *input32;
 	register const uint32_t *input32_end;
 	register uint32_t *output32;
 
-	if (leading_lum) {
-		for (y = start_y; y < end_y; y++) {
-			input32 = (const uint32_t *)(input + y * in_linesize);
-			input32_end = input32 + width_d2;
-			output32 = (uint32_t *)(output + y * out_linesize);
+	/* the second pixel of each pair takes the pair's second luma sample in
+	 * place of the first */
+	__m128i keep_mask = _mm_set1_epi32(leading_lum ? 0xFFFFFF00
+						       : 0xFFFF00FF);
+	__m128i lum_mask = _mm_set1_epi32(leading_lum ? 0x000000FF
+						      : 0x0000FF00);
+
+	for (y = start_y; y < end_y; y++) {
+		input32 = (const uint32_t *)(input + y * in_linesize);
+		input32_end = input32 + width_d2;
+		output32 = (uint32_t *)(output + y * out_linesize);
+
+		while (input32 + 4 <= input32_end) {
+			__m128i dw = _mm_loadu_si128((const __m128i *)input32);
+			__m128i dw2 = _mm_or_si128(
+				_mm_and_si128(dw, keep_mask),
+				_mm_and_si128(_mm_srli_epi32(dw, 16), lum_mask));
+
+			_mm_storeu_si128((__m128i *)output32,
+					 _mm_unpacklo_epi32(dw, dw2));
+			_mm_storeu_si128((__m128i *)(output32 + 4),
+					 _mm_unpackhi_epi32(dw, dw2));
+
+			output32 += 8;
+			input32 += 4;
+		}
 
+		if (leading_lum) {
 			while (input32 < input32_end) {
 				register uint32_t dw = *input32;
 
@@ -295,13 +535,7 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize,
 				output32 += 2;
 				input32++;
 			}
-		}
-	} else {
-		for (y = start_y; y < end_y; y++) {
-			input32 = (const uint32_t *)(input + y * in_linesize);
-			input32_end = input32 + width_d2;
-			output32 = (uint32_t *)(output + y * out_linesize);
-
+		} else {
 			while (input32 < input32_end) {
 				register uint32_t dw = *input32;
 
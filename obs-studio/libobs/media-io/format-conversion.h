@@ -25,6 +25,9 @@ extern "C" {
 
 /*
  * Functions for converting to and from packed 444 YUV
+ *
+ * All of them are written against SSE2 through util/sse-intrin.h, which maps
+ * to NEON on ARM.  There is no AVX2 variant.
  */
 
 EXPORT void compress_uyvx_to_i420(const uint8_t *input, uint32_t in_linesize,
@@ -52,6 +55,21 @@ EXPORT void decompress_420(const uint8_t *const input[],
 			   uint32_t end_y, uint8_t *output,
 			   uint32_t out_linesize);
 
+/*
+ * 10-bit variants, the output keeps the 8 most significant bits of each
+ * sample in the same layout as decompress_nv12 and decompress_420
+ */
+
+EXPORT void decompress_p010(const uint8_t *const input[],
+			    const uint32_t in_linesize[], uint32_t start_y,
+			    uint32_t end_y, uint8_t *output,
+			    uint32_t out_linesize);
+
+EXPORT void decompress_i010(const uint8_t *const input[],
+			    const uint32_t in_linesize[], uint32_t start_y,
+			    uint32_t end_y, uint8_t *output,
+			    uint32_t out_linesize);
+
 EXPORT void decompress_422(const uint8_t *input, uint32_t in_linesize,
 			   uint32_t start_y, uint32_t end_y, uint8_t *output,
 			   uint32_t out_linesize, bool leading_lum);
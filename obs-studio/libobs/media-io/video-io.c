@@ -22,6 +22,7 @@
 #include "../util/profiler.h"
 #include "../util/threading.h"
 #include "../util/darray.h"
+#include "../util/deque.h"
 #include "../util/util_uint64.h"
 
 #include "format-conversion.h"
@@ -33,13 +34,23 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
-
+#define MAX_INPUT_QUEUE 3
+
+/* count is the number of times the frame still has to be output, a slot is
+ * free once it reaches 0.  the graphics thread only fills free slots or adds
+ * to the count of the newest slot, the video thread is the only one that
+ * decrements it, so neither side needs a lock to hand frames over.  every
+ * output past filled_count is a repeat, i.e. a skipped frame.  refs is the
+ * number of frames queued to input threads that still read the slot. */
 struct cached_frame_info {
 	struct video_data frame;
-	int skipped;
-	int count;
+	long filled_count;
+	volatile long count;
+	volatile long refs;
 };
 
+struct video_input_worker;
+
 struct video_input {
 	struct video_scale_info conversion;
 	video_scaler_t *scaler;
@@ -58,10 +69,123 @@ struct video_input {
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
+
+	struct video_input_worker *worker;
 };
 
+static inline bool scale_video_output(struct video_input *input,
+				      struct video_data *data);
+
+struct queued_frame {
+	struct cached_frame_info *cfi;
+	struct video_data frame;
+};
+
+/* In parallel mode each input is scaled and called back on its own thread so
+ * that a slow encoder doesn't hold up the others.  The worker gets its own
+ * copy of the input because the inputs array may be reallocated. */
+struct video_input_worker {
+	struct video_input input;
+	pthread_t thread;
+	os_sem_t *sem;
+	pthread_mutex_t mutex;
+	struct deque frames;
+	volatile bool stop;
+	volatile long skipped_frames;
+	long total_frames;
+};
+
+static inline void release_queued_frame(struct queued_frame *qf)
+{
+	os_atomic_dec_long(&qf->cfi->refs);
+}
+
+static void *video_input_thread(void *param)
+{
+	struct video_input_worker *worker = param;
+	struct video_input *input = &worker->input;
+
+	os_set_thread_name("video-io: input thread");
+
+	while (os_sem_wait(worker->sem) == 0) {
+		struct queued_frame qf;
+
+		if (os_atomic_load_bool(&worker->stop))
+			break;
+
+		pthread_mutex_lock(&worker->mutex);
+		deque_pop_front(&worker->frames, &qf, sizeof(qf));
+		pthread_mutex_unlock(&worker->mutex);
+
+		if (scale_video_output(input, &qf.frame))
+			input->callback(input->param, &qf.frame);
+
+		release_queued_frame(&qf);
+	}
+
+	return NULL;
+}
+
+static bool video_input_start_worker(struct video_input *input)
+{
+	struct video_input_worker *worker = bzalloc(sizeof(*worker));
+
+	worker->input = *input;
+
+	if (pthread_mutex_init(&worker->mutex, NULL) != 0)
+		goto fail0;
+	if (os_sem_init(&worker->sem, 0) != 0)
+		goto fail1;
+	if (pthread_create(&worker->thread, NULL, video_input_thread,
+			   worker) != 0)
+		goto fail2;
+
+	input->worker = worker;
+	return true;
+
+fail2:
+	os_sem_destroy(worker->sem);
+fail1:
+	pthread_mutex_destroy(&worker->mutex);
+fail0:
+	bfree(worker);
+	return false;
+}
+
+static void video_input_stop_worker(struct video_input *input)
+{
+	struct video_input_worker *worker = input->worker;
+	struct queued_frame qf;
+	void *thread_ret;
+
+	os_atomic_set_bool(&worker->stop, true);
+	os_sem_post(worker->sem);
+	pthread_join(worker->thread, &thread_ret);
+
+	while (worker->frames.size) {
+		deque_pop_front(&worker->frames, &qf, sizeof(qf));
+		release_queued_frame(&qf);
+	}
+
+	if (worker->skipped_frames)
+		blog(LOG_INFO,
+		     "video-io: input thread skipped %ld/%ld frames due to "
+		     "encoding lag",
+		     worker->skipped_frames, worker->total_frames);
+
+	deque_free(&worker->frames);
+	os_sem_destroy(worker->sem);
+	pthread_mutex_destroy(&worker->mutex);
+	bfree(worker);
+
+	input->worker = NULL;
+}
+
 static inline void video_input_free(struct video_input *input)
 {
+	if (input->worker)
+		video_input_stop_worker(input);
+
 	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
 		video_frame_free(&input->frame[i]);
 	video_scaler_destroy(input->scaler);
@@ -71,7 +195,6 @@ struct video_output {
 	struct video_output_info info;
 
 	pthread_t thread;
-	pthread_mutex_t data_mutex;
 	bool stop;
 
 	os_sem_t *update_semaphore;
@@ -82,15 +205,18 @@ struct video_output {
 	pthread_mutex_t input_mutex;
 	DARRAY(struct video_input) inputs;
 
-	size_t available_frames;
-	size_t first_added;
-	size_t last_added;
+	size_t read_idx;
+	size_t write_idx;
+	long read_outputs;
 	struct cached_frame_info cache[MAX_CACHE_SIZE];
 
 	struct video_output *parent;
 
 	volatile bool raw_active;
 	volatile long gpu_refs;
+
+	volatile bool parallel_inputs;
+	volatile long scale_band_height;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -126,19 +252,40 @@ static inline bool scale_video_output(struct video_input *input,
 	return success;
 }
 
+static void queue_input_frame(struct video_output *video,
+			      struct video_input_worker *worker,
+			      struct cached_frame_info *cfi,
+			      struct video_data *frame)
+{
+	struct queued_frame qf = {cfi, *frame};
+	bool queued = false;
+
+	pthread_mutex_lock(&worker->mutex);
+	if (worker->frames.size < MAX_INPUT_QUEUE * sizeof(qf)) {
+		os_atomic_inc_long(&cfi->refs);
+		deque_push_back(&worker->frames, &qf, sizeof(qf));
+		queued = true;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+
+	worker->total_frames++;
+
+	if (queued) {
+		os_sem_post(worker->sem);
+	} else {
+		os_atomic_inc_long(&worker->skipped_frames);
+		os_atomic_inc_long(&video->skipped_frames);
+	}
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
 	bool complete;
-	bool skipped;
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
-
-	frame_info = &video->cache[video->first_added];
-
-	pthread_mutex_unlock(&video->data_mutex);
+	frame_info = &video->cache[video->read_idx];
 
 	/* -------------------------------- */
 
@@ -159,6 +306,12 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (skip)
 			continue;
 
+		if (input->worker) {
+			queue_input_frame(video, input->worker, frame_info,
+					  &frame);
+			continue;
+		}
+
 		if (scale_video_output(input, &frame))
 			input->callback(input->param, &frame);
 	}
@@ -167,25 +320,19 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
-
+	/* the slot can be reused as soon as its count reaches 0, so nothing
+	 * may touch it after the decrement if the frame is complete */
 	frame_info->frame.timestamp += video->frame_time;
-	complete = --frame_info->count == 0;
-	skipped = frame_info->skipped > 0;
+	if (++video->read_outputs > frame_info->filled_count)
+		os_atomic_inc_long(&video->skipped_frames);
+	complete = os_atomic_dec_long(&frame_info->count) == 0;
 
 	if (complete) {
-		if (++video->first_added == video->info.cache_size)
-			video->first_added = 0;
-
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
-	} else if (skipped) {
-		--frame_info->skipped;
-		os_atomic_inc_long(&video->skipped_frames);
+		video->read_outputs = 0;
+		if (++video->read_idx == video->info.cache_size)
+			video->read_idx = 0;
 	}
 
-	pthread_mutex_unlock(&video->data_mutex);
-
 	/* -------------------------------- */
 
 	return complete;
@@ -200,6 +347,9 @@ static void *video_thread(void *param)
 	const char *video_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
 				   "video_thread(%s)", video->info.name);
+	const char *skipped_frames_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				   "skipped_frames(%s)", video->info.name);
 
 	while (os_sem_wait(video->update_semaphore) == 0) {
 		if (video->stop)
@@ -211,6 +361,9 @@ static void *video_thread(void *param)
 		}
 
 		os_atomic_inc_long(&video->total_frames);
+		profile_trace_counter(
+			skipped_frames_name,
+			os_atomic_load_long(&video->skipped_frames));
 		profile_end(video_thread_name);
 
 		profile_reenable_thread();
@@ -239,8 +392,6 @@ static inline void init_cache(struct video_output *video)
 		video_frame_init(frame, video->info.format, video->info.width,
 				 video->info.height);
 	}
-
-	video->available_frames = video->info.cache_size;
 }
 
 int video_output_open(video_t **video, struct video_output_info *info)
@@ -258,26 +409,22 @@ int video_output_open(video_t **video, struct video_output_info *info)
 	out->frame_time =
 		util_mul_div64(1000000000ULL, info->fps_den, info->fps_num);
 
-	if (pthread_mutex_init_recursive(&out->data_mutex) != 0)
-		goto fail0;
 	if (pthread_mutex_init_recursive(&out->input_mutex) != 0)
-		goto fail1;
+		goto fail0;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
-		goto fail2;
+		goto fail1;
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
-		goto fail3;
+		goto fail2;
 
 	init_cache(out);
 
 	*video = out;
 	return VIDEO_OUTPUT_SUCCESS;
 
-fail3:
-	os_sem_destroy(out->update_semaphore);
 fail2:
-	pthread_mutex_destroy(&out->input_mutex);
+	os_sem_destroy(out->update_semaphore);
 fail1:
-	pthread_mutex_destroy(&out->data_mutex);
+	pthread_mutex_destroy(&out->input_mutex);
 fail0:
 	bfree(out);
 	return VIDEO_OUTPUT_FAIL;
@@ -301,7 +448,6 @@ void video_output_close(video_t *video)
 
 	pthread_mutex_unlock(&video->input_mutex);
 	os_sem_destroy(video->update_semaphore);
-	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
 
 	bfree(video);
@@ -364,9 +510,13 @@ static inline bool video_input_init(struct video_input *input,
 						.colorspace =
 							video->info.colorspace};
 
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
+		uint32_t band_height =
+			(uint32_t)os_atomic_load_long(&video->scale_band_height);
+
+		int ret = video_scaler_create2(&input->scaler,
+					       &input->conversion, &from,
+					       VIDEO_SCALE_FAST_BILINEAR,
+					       band_height);
 		if (ret != VIDEO_SCALER_SUCCESS) {
 			if (ret == VIDEO_SCALER_BAD_CONVERSION)
 				blog(LOG_ERROR, "video_input_init: Bad "
@@ -454,6 +604,11 @@ bool video_output_connect2(
 			input.conversion.height = video->info.height;
 
 		success = video_input_init(&input, video);
+		if (success && os_atomic_load_bool(&video->parallel_inputs)) {
+			success = video_input_start_worker(&input);
+			if (!success)
+				video_input_free(&input);
+		}
 		if (success) {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -531,39 +686,52 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 			     int count, uint64_t timestamp)
 {
 	struct cached_frame_info *cfi;
-	bool locked;
+	struct cached_frame_info *last;
+	size_t last_idx;
+	long cur;
 
 	if (!video)
 		return false;
 
 	video = get_root(video);
 
-	pthread_mutex_lock(&video->data_mutex);
-
-	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
-		locked = false;
+	last_idx = video->write_idx ? video->write_idx - 1
+				    : video->info.cache_size - 1;
+	last = &video->cache[last_idx];
 
-	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
+	for (;;) {
+		cfi = &video->cache[video->write_idx];
 
-		cfi = &video->cache[video->last_added];
-		cfi->frame.timestamp = timestamp;
-		cfi->count = count;
-		cfi->skipped = 0;
+		if (os_atomic_load_long(&cfi->count) == 0 &&
+		    os_atomic_load_long(&cfi->refs) == 0) {
+			cfi->frame.timestamp = timestamp;
+			cfi->filled_count = count;
+			os_atomic_set_long(&cfi->count, count);
 
-		memcpy(frame, &cfi->frame, sizeof(*frame));
+			if (++video->write_idx == video->info.cache_size)
+				video->write_idx = 0;
 
-		locked = true;
-	}
+			memcpy(frame, &cfi->frame, sizeof(*frame));
+			return true;
+		}
 
-	pthread_mutex_unlock(&video->data_mutex);
+		/* the cache is full, repeat the newest frame instead.  if the
+		 * video thread finishes it in the meantime every older slot is
+		 * done as well, so try again with the now free slot */
+		cur = os_atomic_load_long(&last->count);
+		while (cur != 0) {
+			if (os_atomic_compare_exchange_long(&last->count, &cur,
+							    cur + count))
+				return false;
+		}
 
-	return locked;
+		/* every frame was output, but an input thread is still
+		 * reading the oldest one */
+		if (os_atomic_load_long(&cfi->refs) != 0) {
+			os_atomic_inc_long(&video->skipped_frames);
+			return false;
+		}
+	}
 }
 
 void video_output_unlock_frame(video_t *video)
@@ -573,12 +741,25 @@ void video_output_unlock_frame(video_t *video)
 
 	video = get_root(video);
 
-	pthread_mutex_lock(&video->data_mutex);
-
-	video->available_frames--;
 	os_sem_post(video->update_semaphore);
+}
+
+void video_output_set_parallel_inputs(video_t *video, bool enable)
+{
+	if (!video)
+		return;
+
+	video = get_root(video);
+	os_atomic_set_bool(&video->parallel_inputs, enable);
+}
 
-	pthread_mutex_unlock(&video->data_mutex);
+void video_output_set_scale_band_height(video_t *video, uint32_t lines)
+{
+	if (!video)
+		return;
+
+	video = get_root(video);
+	os_atomic_set_long(&video->scale_band_height, (long)lines);
 }
 
 uint64_t video_output_get_frame_time(const video_t *video)
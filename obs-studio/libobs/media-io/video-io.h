@@ -318,6 +318,17 @@ EXPORT void video_output_disconnect(video_t *video,
 						     struct video_data *frame),
 				    void *param);
 
+/* When enabled, inputs connected afterwards are scaled and called back on
+ * their own thread instead of sequentially on the video thread.  Off by
+ * default, see obs_set_video_parallel_inputs. */
+EXPORT void video_output_set_parallel_inputs(video_t *video, bool enable);
+
+/* Scalers of inputs connected afterwards split each frame into bands of about
+ * this many output lines and scale them in parallel on the shared task pool.
+ * 0 (the default) scales on a single thread, see
+ * obs_set_video_scale_band_height. */
+EXPORT void video_output_set_scale_band_height(video_t *video, uint32_t lines);
+
 EXPORT bool video_output_active(const video_t *video);
 
 EXPORT const struct video_output_info *
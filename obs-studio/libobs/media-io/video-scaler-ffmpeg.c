@@ -16,18 +16,48 @@
 ******************************************************************************/
 
 #include "../util/bmem.h"
+#include "../util/platform.h"
+#include "../util/task.h"
 #include "video-scaler.h"
 
+#include <libavutil/frame.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libswscale/swscale.h>
 
+/* swscale gained the frame/slice API needed to scale output bands separately
+ * in 6.1.100; older versions always scale the whole frame at once */
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+#define SCALER_SLICE_THREADS
+#endif
+
+#ifdef SCALER_SLICE_THREADS
+/* every band has its own context, so bands can be scaled at the same time */
+struct scaler_band {
+	struct video_scaler *scaler;
+	struct SwsContext *swscale;
+	int start;
+	int height;
+	int ret;
+};
+#endif
+
 struct video_scaler {
 	struct SwsContext *swscale;
 	int src_height;
 	int dst_heights[4];
 	uint8_t *dst_pointers[4];
 	int dst_linesizes[4];
+
+#ifdef SCALER_SLICE_THREADS
+	size_t num_bands;
+	struct scaler_band *bands;
+	os_task_pool_t *pool;
+	os_task_group_t *group;
+	AVFrame *src_frame;
+	AVFrame *dst_frame;
+	AVBufferRef *borrowed;
+#endif
 };
 
 static inline enum AVPixelFormat
@@ -145,10 +175,9 @@ static inline int get_ffmpeg_range_type(enum video_range_type type)
 
 #define FIXED_1_0 (1 << 16)
 
-int video_scaler_create(video_scaler_t **scaler_out,
-			const struct video_scale_info *dst,
-			const struct video_scale_info *src,
-			enum video_scale_type type)
+static struct SwsContext *create_swscale(const struct video_scale_info *dst,
+					 const struct video_scale_info *src,
+					 enum video_scale_type type)
 {
 	enum AVPixelFormat format_src = get_ffmpeg_video_format(src->format);
 	enum AVPixelFormat format_dst = get_ffmpeg_video_format(dst->format);
@@ -157,6 +186,208 @@ int video_scaler_create(video_scaler_t **scaler_out,
 	const int *coeff_dst = get_ffmpeg_coeffs(dst->colorspace);
 	int range_src = get_ffmpeg_range_type(src->range);
 	int range_dst = get_ffmpeg_range_type(dst->range);
+	struct SwsContext *swscale;
+	int ret;
+
+	swscale = sws_alloc_context();
+	if (!swscale) {
+		blog(LOG_ERROR, "video_scaler_create: Could not create "
+				"swscale");
+		return NULL;
+	}
+
+	av_opt_set_int(swscale, "sws_flags", scale_type, 0);
+	av_opt_set_int(swscale, "srcw", src->width, 0);
+	av_opt_set_int(swscale, "srch", src->height, 0);
+	av_opt_set_int(swscale, "dstw", dst->width, 0);
+	av_opt_set_int(swscale, "dsth", dst->height, 0);
+	av_opt_set_int(swscale, "src_format", format_src, 0);
+	av_opt_set_int(swscale, "dst_format", format_dst, 0);
+	av_opt_set_int(swscale, "src_range", range_src, 0);
+	av_opt_set_int(swscale, "dst_range", range_dst, 0);
+
+	if (sws_init_context(swscale, NULL, NULL) < 0) {
+		blog(LOG_ERROR, "video_scaler_create: sws_init_context failed");
+		sws_freeContext(swscale);
+		return NULL;
+	}
+
+	ret = sws_setColorspaceDetails(swscale, coeff_src, range_src,
+				       coeff_dst, range_dst, 0, FIXED_1_0,
+				       FIXED_1_0);
+	if (ret < 0) {
+		blog(LOG_DEBUG, "video_scaler_create: "
+				"sws_setColorspaceDetails failed, ignoring");
+	}
+
+	return swscale;
+}
+
+#ifdef SCALER_SLICE_THREADS
+static size_t get_num_bands(const struct video_scale_info *dst,
+			    uint32_t band_height, os_task_pool_t *pool)
+{
+	size_t bands;
+	size_t workers;
+
+	if (!band_height || !pool)
+		return 1;
+
+	bands = (dst->height + band_height - 1) / band_height;
+	workers = os_task_pool_num_workers(pool);
+	if (bands > workers)
+		bands = workers;
+	return bands > 1 ? bands : 1;
+}
+
+static void borrowed_free(void *opaque, uint8_t *data)
+{
+	UNUSED_PARAMETER(opaque);
+	UNUSED_PARAMETER(data);
+}
+
+/* swscale's frame API takes references on the frames it is given, and would
+ * copy any frame that isn't refcounted.  Both frames are marked as backed by
+ * a buffer that frees nothing, so the caller's planes are read in place and
+ * the output lands directly in the scaler's own planes. */
+static bool init_slice_frames(struct video_scaler *scaler,
+			      const struct video_scale_info *dst,
+			      const struct video_scale_info *src,
+			      enum AVPixelFormat format_dst,
+			      enum AVPixelFormat format_src)
+{
+	scaler->borrowed = av_buffer_create((uint8_t *)scaler, 1, borrowed_free,
+					    NULL, 0);
+	scaler->src_frame = av_frame_alloc();
+	scaler->dst_frame = av_frame_alloc();
+	if (!scaler->borrowed || !scaler->src_frame || !scaler->dst_frame)
+		return false;
+
+	scaler->src_frame->format = format_src;
+	scaler->src_frame->width = src->width;
+	scaler->src_frame->height = src->height;
+
+	scaler->dst_frame->format = format_dst;
+	scaler->dst_frame->width = dst->width;
+	scaler->dst_frame->height = dst->height;
+	for (size_t i = 0; i < 4; i++) {
+		scaler->dst_frame->data[i] = scaler->dst_pointers[i];
+		scaler->dst_frame->linesize[i] = scaler->dst_linesizes[i];
+	}
+
+	/* each frame owns one reference so av_frame_free releases it */
+	scaler->src_frame->buf[0] = av_buffer_ref(scaler->borrowed);
+	scaler->dst_frame->buf[0] = av_buffer_ref(scaler->borrowed);
+	return scaler->src_frame->buf[0] && scaler->dst_frame->buf[0];
+}
+
+/* splits the output into bands that start on the chroma alignment swscale
+ * requires, the last band takes the remaining lines */
+static bool init_bands(struct video_scaler *scaler,
+		       const struct video_scale_info *dst,
+		       const struct video_scale_info *src,
+		       enum video_scale_type type)
+{
+	int height = scaler->dst_heights[0];
+	int num = (int)scaler->num_bands;
+	int band_height;
+	int align;
+
+	scaler->bands = bzalloc(sizeof(*scaler->bands) * scaler->num_bands);
+
+	for (size_t i = 0; i < scaler->num_bands; i++) {
+		scaler->bands[i].scaler = scaler;
+		scaler->bands[i].swscale = create_swscale(dst, src, type);
+		if (!scaler->bands[i].swscale)
+			return false;
+	}
+
+	align = (int)sws_receive_slice_alignment(scaler->bands[0].swscale);
+	band_height = (height + num - 1) / num;
+	band_height = (band_height + align - 1) / align * align;
+
+	for (size_t i = 0; i < scaler->num_bands; i++) {
+		struct scaler_band *band = &scaler->bands[i];
+		int start = (int)i * band_height;
+
+		band->start = start < height ? start : height;
+		band->height = height - band->start;
+		if (band->height > band_height)
+			band->height = band_height;
+	}
+
+	scaler->group = os_task_group_create(scaler->pool,
+					     OS_TASK_PRIORITY_VIDEO);
+	return !!scaler->group;
+}
+
+static void scale_band(void *param)
+{
+	struct scaler_band *band = param;
+	struct video_scaler *scaler = band->scaler;
+
+	if (!band->height) {
+		band->ret = 0;
+		return;
+	}
+
+	band->ret = sws_frame_start(band->swscale, scaler->dst_frame,
+				    scaler->src_frame);
+	if (band->ret < 0)
+		return;
+
+	/* the whole source is available up front, so every band only depends
+	 * on source lines and the output doesn't depend on the band count */
+	band->ret = sws_send_slice(band->swscale, 0, scaler->src_height);
+	if (band->ret >= 0)
+		band->ret = sws_receive_slice(band->swscale, band->start,
+					      band->height);
+
+	sws_frame_end(band->swscale);
+}
+
+static int scale_slices(struct video_scaler *scaler,
+			const uint8_t *const input[],
+			const uint32_t in_linesize[])
+{
+	AVFrame *src_frame = scaler->src_frame;
+
+	for (size_t i = 0; i < 4; i++) {
+		src_frame->data[i] = (uint8_t *)input[i];
+		src_frame->linesize[i] = (int)in_linesize[i];
+	}
+
+	/* the calling thread scales the first band itself */
+	for (size_t i = 1; i < scaler->num_bands; i++)
+		os_task_group_queue_task(scaler->group, scale_band,
+					 &scaler->bands[i]);
+	scale_band(&scaler->bands[0]);
+	os_task_group_join(scaler->group);
+
+	for (size_t i = 0; i < scaler->num_bands; i++) {
+		if (scaler->bands[i].ret < 0)
+			return scaler->bands[i].ret;
+	}
+
+	return scaler->dst_heights[0];
+}
+#endif
+
+int video_scaler_create(video_scaler_t **scaler_out,
+			const struct video_scale_info *dst,
+			const struct video_scale_info *src,
+			enum video_scale_type type)
+{
+	return video_scaler_create2(scaler_out, dst, src, type, 0);
+}
+
+int video_scaler_create2(video_scaler_t **scaler_out,
+			 const struct video_scale_info *dst,
+			 const struct video_scale_info *src,
+			 enum video_scale_type type, uint32_t band_height)
+{
+	enum AVPixelFormat format_src = get_ffmpeg_video_format(src->format);
+	enum AVPixelFormat format_dst = get_ffmpeg_video_format(dst->format);
 	struct video_scaler *scaler;
 	int ret;
 
@@ -191,34 +422,32 @@ int video_scaler_create(video_scaler_t **scaler_out,
 		goto fail;
 	}
 
-	scaler->swscale = sws_alloc_context();
-	if (!scaler->swscale) {
-		blog(LOG_ERROR, "video_scaler_create: Could not create "
-				"swscale");
-		goto fail;
+#ifdef SCALER_SLICE_THREADS
+	if (band_height) {
+		scaler->pool = os_task_pool_get_shared();
+		scaler->num_bands = get_num_bands(dst, band_height,
+						  scaler->pool);
 	}
 
-	av_opt_set_int(scaler->swscale, "sws_flags", scale_type, 0);
-	av_opt_set_int(scaler->swscale, "srcw", src->width, 0);
-	av_opt_set_int(scaler->swscale, "srch", src->height, 0);
-	av_opt_set_int(scaler->swscale, "dstw", dst->width, 0);
-	av_opt_set_int(scaler->swscale, "dsth", dst->height, 0);
-	av_opt_set_int(scaler->swscale, "src_format", format_src, 0);
-	av_opt_set_int(scaler->swscale, "dst_format", format_dst, 0);
-	av_opt_set_int(scaler->swscale, "src_range", range_src, 0);
-	av_opt_set_int(scaler->swscale, "dst_range", range_dst, 0);
-	if (sws_init_context(scaler->swscale, NULL, NULL) < 0) {
-		blog(LOG_ERROR, "video_scaler_create: sws_init_context failed");
-		goto fail;
-	}
+	if (scaler->num_bands > 1) {
+		if (!init_bands(scaler, dst, src, type) ||
+		    !init_slice_frames(scaler, dst, src, format_dst,
+				       format_src)) {
+			blog(LOG_ERROR, "video_scaler_create: Could not "
+					"create scaler bands");
+			goto fail;
+		}
 
-	ret = sws_setColorspaceDetails(scaler->swscale, coeff_src, range_src,
-				       coeff_dst, range_dst, 0, FIXED_1_0,
-				       FIXED_1_0);
-	if (ret < 0) {
-		blog(LOG_DEBUG, "video_scaler_create: "
-				"sws_setColorspaceDetails failed, ignoring");
+		*scaler_out = scaler;
+		return VIDEO_SCALER_SUCCESS;
 	}
+#else
+	UNUSED_PARAMETER(band_height);
+#endif
+
+	scaler->swscale = create_swscale(dst, src, type);
+	if (!scaler->swscale)
+		goto fail;
 
 	*scaler_out = scaler;
 	return VIDEO_SCALER_SUCCESS;
@@ -233,6 +462,20 @@ void video_scaler_destroy(video_scaler_t *scaler)
 	if (scaler) {
 		sws_freeContext(scaler->swscale);
 
+#ifdef SCALER_SLICE_THREADS
+		os_task_group_destroy(scaler->group);
+		if (scaler->bands) {
+			for (size_t i = 0; i < scaler->num_bands; i++)
+				sws_freeContext(scaler->bands[i].swscale);
+			bfree(scaler->bands);
+		}
+		os_task_pool_release(scaler->pool);
+
+		av_frame_free(&scaler->src_frame);
+		av_frame_free(&scaler->dst_frame);
+		av_buffer_unref(&scaler->borrowed);
+#endif
+
 		if (scaler->dst_pointers[0])
 			av_freep(scaler->dst_pointers);
 
@@ -248,9 +491,16 @@ bool video_scaler_scale(video_scaler_t *scaler, uint8_t *output[],
 	if (!scaler)
 		return false;
 
-	int ret = sws_scale(scaler->swscale, input, (const int *)in_linesize, 0,
-			    scaler->src_height, scaler->dst_pointers,
-			    scaler->dst_linesizes);
+	int ret;
+
+#ifdef SCALER_SLICE_THREADS
+	if (scaler->num_bands > 1)
+		ret = scale_slices(scaler, input, in_linesize);
+	else
+#endif
+		ret = sws_scale(scaler->swscale, input,
+				(const int *)in_linesize, 0, scaler->src_height,
+				scaler->dst_pointers, scaler->dst_linesizes);
 	if (ret <= 0) {
 		blog(LOG_ERROR, "video_scaler_scale: sws_scale failed: %d",
 		     ret);
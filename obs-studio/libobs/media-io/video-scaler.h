@@ -35,6 +35,17 @@ EXPORT int video_scaler_create(video_scaler_t **scaler,
 			       const struct video_scale_info *dst,
 			       const struct video_scale_info *src,
 			       enum video_scale_type type);
+
+/* Same as video_scaler_create, but splits each frame into horizontal output
+ * bands of roughly band_height lines that are scaled in parallel as tasks of
+ * the shared task pool (at most one band per worker).  The output is
+ * identical to the single-threaded path.  A band_height of 0 disables
+ * slicing. */
+EXPORT int video_scaler_create2(video_scaler_t **scaler,
+				const struct video_scale_info *dst,
+				const struct video_scale_info *src,
+				enum video_scale_type type,
+				uint32_t band_height);
 EXPORT void video_scaler_destroy(video_scaler_t *scaler);
 
 EXPORT bool video_scaler_scale(video_scaler_t *scaler, uint8_t *output[],
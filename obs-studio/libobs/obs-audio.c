@@ -18,6 +18,7 @@
 #include <inttypes.h>
 #include "obs-internal.h"
 #include "util/util_uint64.h"
+#include "util/sse-intrin.h"
 
 struct ts_info {
 	uint64_t start;
@@ -45,9 +46,40 @@ static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 	return (size_t)util_mul_div64(t, sample_rate, 1000000000ULL);
 }
 
+static inline void mix_audio_plane(float *mix, const float *aud,
+				   size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128 m0 = _mm_loadu_ps(mix + i);
+		__m128 m1 = _mm_loadu_ps(mix + i + 4);
+		__m128 m2 = _mm_loadu_ps(mix + i + 8);
+		__m128 m3 = _mm_loadu_ps(mix + i + 12);
+
+		m0 = _mm_add_ps(m0, _mm_loadu_ps(aud + i));
+		m1 = _mm_add_ps(m1, _mm_loadu_ps(aud + i + 4));
+		m2 = _mm_add_ps(m2, _mm_loadu_ps(aud + i + 8));
+		m3 = _mm_add_ps(m3, _mm_loadu_ps(aud + i + 12));
+
+		_mm_storeu_ps(mix + i, m0);
+		_mm_storeu_ps(mix + i + 4, m1);
+		_mm_storeu_ps(mix + i + 8, m2);
+		_mm_storeu_ps(mix + i + 12, m3);
+	}
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(mix + i, _mm_add_ps(_mm_loadu_ps(mix + i),
+						  _mm_loadu_ps(aud + i)));
+
+	for (; i < count; i++)
+		mix[i] += aud[i];
+}
+
 static inline void mix_audio(struct audio_output_data *mixes,
-			     obs_source_t *source, size_t channels,
-			     size_t sample_rate, struct ts_info *ts)
+			     obs_source_t *source, uint32_t mixers,
+			     size_t channels, size_t sample_rate,
+			     struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
@@ -64,18 +96,23 @@ static inline void mix_audio(struct audio_output_data *mixes,
 		total_floats -= start_point;
 	}
 
-	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
+	/* mixes the source isn't routed to have been zeroed by
+	 * obs_source_audio_render and inactive mixes are never output, so
+	 * neither needs to be accumulated.  submix sources fill their output
+	 * buffers differently and are always mixed in full. */
+	if (!(source->info.output_flags & OBS_SOURCE_SUBMIX))
+		mixers &= source->audio_mixers;
+	else
+		mixers = (1 << MAX_AUDIO_MIXES) - 1;
 
-			mix += start_point;
-			end = aud + total_floats;
+	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
 
-			while (aud < end)
-				*(mix++) += *(aud++);
+		for (size_t ch = 0; ch < channels; ch++) {
+			mix_audio_plane(mixes[mix_idx].data[ch] + start_point,
+					source->audio_output_buf[mix_idx][ch],
+					total_floats);
 		}
 	}
 }
@@ -451,6 +488,100 @@ static bool audio_buffer_insufficient(struct obs_source *source,
 	return false;
 }
 
+static void render_audio_source(struct obs_core_audio *audio,
+				obs_source_t *source)
+{
+	uint32_t mixers = audio->render_mixers;
+	size_t channels = audio->render_channels;
+	size_t sample_rate = audio->render_sample_rate;
+	size_t audio_size = AUDIO_OUTPUT_FRAMES * sizeof(float);
+
+	obs_source_audio_render(source, mixers, channels, sample_rate,
+				audio_size);
+
+	/* if a source has gone backward in time and we can no
+	 * longer buffer, drop some or all of its audio */
+	if (audio_buffering_maxed(audio) && source->audio_ts != 0 &&
+	    source->audio_ts < audio->render_start_ts) {
+		if (source->info.audio_render) {
+			blog(LOG_DEBUG,
+			     "render audio source %s timestamp has "
+			     "gone backwards",
+			     obs_source_get_name(source));
+
+			/* just avoid further damage */
+			source->audio_pending = true;
+#if DEBUG_AUDIO == 1
+			/* this should really be fixed */
+			assert(false);
+#endif
+		} else {
+			pthread_mutex_lock(&source->audio_buf_mutex);
+			bool rerender = ignore_audio(source, channels,
+						     sample_rate,
+						     audio->render_start_ts);
+			pthread_mutex_unlock(&source->audio_buf_mutex);
+
+			/* if we (potentially) recovered, re-render */
+			if (rerender)
+				obs_source_audio_render(source, mixers,
+							channels, sample_rate,
+							audio_size);
+		}
+	}
+}
+
+static void render_audio_task(void *param)
+{
+	render_audio_source(&obs->audio, param);
+}
+
+/* Composite and submix sources read the output of other sources, everything
+ * else only ever touches its own buffers. */
+static inline bool audio_render_independent(const obs_source_t *source)
+{
+	return !source->info.audio_render && !source->info.audio_mix;
+}
+
+/* Rendering a source is cheap, so a run has to be long enough for the
+ * parallel render to be worth the join on the audio thread */
+#define MIN_PARALLEL_AUDIO_SOURCES 8
+
+/* Renders the sources in render order.  Long runs of independent sources are
+ * rendered in parallel, and every composite or submix source still renders
+ * on the audio thread after everything before it and before everything after
+ * it, so the output is the same as rendering one source at a time. */
+static void render_audio_sources(struct obs_core_audio *audio)
+{
+	obs_source_t **sources = audio->render_order.array;
+	size_t num = audio->render_order.num;
+	size_t i = 0;
+
+	while (i < num) {
+		size_t end = i + 1;
+
+		if (audio->render_group && audio_render_independent(sources[i]))
+			while (end < num &&
+			       audio_render_independent(sources[end]))
+				end++;
+
+		if (end - i < MIN_PARALLEL_AUDIO_SOURCES) {
+			for (; i < end; i++)
+				render_audio_source(audio, sources[i]);
+			continue;
+		}
+
+		for (size_t j = i; j + 1 < end; j++)
+			os_task_group_queue_task(audio->render_group,
+						 render_audio_task, sources[j]);
+
+		render_audio_source(audio, sources[end - 1]);
+		os_task_group_join(audio->render_group);
+
+		i = end;
+	}
+}
+
 static inline const char *find_min_ts(struct obs_core_data *data,
 				      uint64_t *min_ts)
 {
@@ -525,7 +656,6 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	size_t sample_rate = audio_output_get_sample_rate(audio->audio);
 	size_t channels = audio_output_get_channels(audio->audio);
 	struct ts_info ts = {start_ts_in, end_ts_in};
-	size_t audio_size;
 	uint64_t min_ts;
 
 	da_resize(audio->render_order, 0);
@@ -535,8 +665,6 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	deque_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
 	min_ts = ts.start;
 
-	audio_size = AUDIO_OUTPUT_FRAMES * sizeof(float);
-
 #if DEBUG_AUDIO == 1
 	blog(LOG_DEBUG, "ts %llu-%llu", ts.start, ts.end);
 #endif
@@ -583,43 +711,12 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	/* ------------------------------------------------ */
 	/* render audio data */
-	for (size_t i = 0; i < audio->render_order.num; i++) {
-		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate,
-					audio_size);
-
-		/* if a source has gone backward in time and we can no
-		 * longer buffer, drop some or all of its audio */
-		if (audio_buffering_maxed(audio) && source->audio_ts != 0 &&
-		    source->audio_ts < ts.start) {
-			if (source->info.audio_render) {
-				blog(LOG_DEBUG,
-				     "render audio source %s timestamp has "
-				     "gone backwards",
-				     obs_source_get_name(source));
-
-				/* just avoid further damage */
-				source->audio_pending = true;
-#if DEBUG_AUDIO == 1
-				/* this should really be fixed */
-				assert(false);
-#endif
-			} else {
-				pthread_mutex_lock(&source->audio_buf_mutex);
-				bool rerender = ignore_audio(source, channels,
-							     sample_rate,
-							     ts.start);
-				pthread_mutex_unlock(&source->audio_buf_mutex);
-
-				/* if we (potentially) recovered, re-render */
-				if (rerender)
-					obs_source_audio_render(source, mixers,
-								channels,
-								sample_rate,
-								audio_size);
-			}
-		}
-	}
+	audio->render_mixers = mixers;
+	audio->render_channels = channels;
+	audio->render_sample_rate = sample_rate;
+	audio->render_start_ts = ts.start;
+
+	render_audio_sources(audio);
 
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
@@ -650,8 +747,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 			pthread_mutex_lock(&source->audio_buf_mutex);
 
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate,
-					  &ts);
+				mix_audio(mixes, source, mixers, channels,
+					  sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
@@ -27,12 +27,17 @@
 #include "graphics/quat.h"
 #include "obs-data.h"
 
-#include <jansson.h>
+#include <locale.h>
+#include <errno.h>
+#include <math.h>
+
+struct obs_data_arena;
 
 struct obs_data_item {
 	volatile long ref;
 	const char *name;
 	struct obs_data *parent;
+	struct obs_data_arena *arena;
 	UT_hash_handle hh;
 	enum obs_data_type type;
 	size_t name_len;
@@ -63,6 +68,86 @@ struct obs_data_number {
 	};
 };
 
+/* ------------------------------------------------------------------------- */
+/* Item arena
+ *
+ * Items parsed from JSON are carved out of large blocks shared by the whole
+ * document instead of being allocated one at a time.  Each item holds a
+ * reference to the arena, and the blocks are freed along with the last item.
+ * Items that have to grow later are moved out to their own allocation.
+ *
+ * The trade-off is that the blocks go away as a whole: holding on to any
+ * object or array of the document, however small, keeps every block of the
+ * document alive until it is released.  Items are not copied out when the
+ * rest of the document is released, as a retained object may still be in use
+ * on another thread at that point.  Callers that keep a small part of a large
+ * document around copy it with obs_data_apply() into a new object instead. */
+
+#define ARENA_BLOCK_SIZE (16 * 1024)
+
+struct arena_block {
+	struct arena_block *next;
+};
+
+struct obs_data_arena {
+	volatile long ref;
+	struct arena_block *blocks;
+	uint8_t *cur;
+	size_t left;
+};
+
+static inline size_t get_align_size(size_t size);
+
+static struct obs_data_arena *arena_create(void)
+{
+	struct obs_data_arena *arena = bzalloc(sizeof(*arena));
+	arena->ref = 1;
+	return arena;
+}
+
+static void arena_release(struct obs_data_arena *arena)
+{
+	if (!arena || os_atomic_dec_long(&arena->ref) != 0)
+		return;
+
+	struct arena_block *block = arena->blocks;
+	while (block) {
+		struct arena_block *next = block->next;
+		bfree(block);
+		block = next;
+	}
+
+	bfree(arena);
+}
+
+/* not thread safe, only used while a document is being parsed */
+static void *arena_alloc(struct obs_data_arena *arena, size_t size)
+{
+	size_t header = get_align_size(sizeof(struct arena_block));
+	uint8_t *ptr;
+
+	size = get_align_size(size);
+
+	if (size > arena->left) {
+		size_t block_size = size > ARENA_BLOCK_SIZE - header
+					    ? header + size
+					    : ARENA_BLOCK_SIZE;
+		struct arena_block *block = bmalloc(block_size);
+
+		block->next = arena->blocks;
+		arena->blocks = block;
+		arena->cur = (uint8_t *)block + header;
+		arena->left = block_size - header;
+	}
+
+	ptr = arena->cur;
+	arena->cur += size;
+	arena->left -= size;
+
+	os_atomic_inc_long(&arena->ref);
+	return ptr;
+}
+
 /* ------------------------------------------------------------------------- */
 /* Item structure, designed to be one allocation only */
 
@@ -336,7 +421,14 @@ obs_data_item_ensure_capacity(struct obs_data_item *item)
 	struct obs_data *parent = item->parent;
 	obs_data_item_detach(item);
 
-	new_item = brealloc(item, new_size);
+	if (item->arena) {
+		new_item = bmalloc(new_size);
+		memcpy(new_item, item, item->capacity);
+		arena_release(item->arena);
+		new_item->arena = NULL;
+	} else {
+		new_item = brealloc(item, new_size);
+	}
 	new_item->capacity = new_size;
 	new_item->name = get_item_name(new_item);
 
@@ -354,7 +446,11 @@ static inline void obs_data_item_destroy(struct obs_data_item *item)
 	item_default_data_release(item);
 	item_autoselect_data_release(item);
 	obs_data_item_detach(item);
-	bfree(item);
+
+	if (item->arena)
+		arena_release(item->arena);
+	else
+		bfree(item);
 }
 
 static inline void move_data(obs_data_item_t *old_item, void *old_data,
@@ -459,156 +555,813 @@ obs_data_item_set_autoselect_data(struct obs_data_item **p_item,
 
 /* ------------------------------------------------------------------------- */
 
-static void obs_data_add_json_item(obs_data_t *data, const char *key,
-				   json_t *json);
+/* JSON reader
+ *
+ * Parses straight into obs_data without an intermediate tree, accepting the
+ * same documents as jansson did with JSON_REJECT_DUPLICATES: the root must be
+ * an object or an array, strings must be valid UTF-8 without \u0000, numbers
+ * without a fraction or exponent must fit in a long long, and duplicate keys
+ * are an error.  Nulls and array elements that aren't objects are skipped. */
+
+#define JSON_MAX_DEPTH 2048
+
+struct json_reader {
+	const char *pos;
+	int line;
+	int depth;
+	struct obs_data_arena *arena;
+	struct dstr key;
+	struct dstr str;
+	char error[160];
+};
 
-static inline void obs_data_add_json_object_data(obs_data_t *data, json_t *jobj)
+static bool json_error(struct json_reader *r, const char *format, ...)
 {
-	const char *item_key;
-	json_t *jitem;
+	va_list args;
+
+	if (*r->error)
+		return false;
+
+	va_start(args, format);
+	vsnprintf(r->error, sizeof(r->error), format, args);
+	va_end(args);
+	return false;
+}
 
-	json_object_foreach (jobj, item_key, jitem) {
-		obs_data_add_json_item(data, item_key, jitem);
+static inline void json_skip_whitespace(struct json_reader *r)
+{
+	for (;;) {
+		char ch = *r->pos;
+		if (ch == '\n')
+			r->line++;
+		else if (ch != ' ' && ch != '\t' && ch != '\r')
+			return;
+		r->pos++;
 	}
 }
 
-static inline void obs_data_add_json_object(obs_data_t *data, const char *key,
-					    json_t *jobj)
+static inline bool json_expect(struct json_reader *r, char ch)
 {
-	obs_data_t *sub_obj = obs_data_create();
+	json_skip_whitespace(r);
+	if (*r->pos != ch)
+		return json_error(r, "'%c' expected", ch);
 
-	obs_data_add_json_object_data(sub_obj, jobj);
-	obs_data_set_obj(data, key, sub_obj);
-	obs_data_release(sub_obj);
+	r->pos++;
+	return true;
 }
 
-static void obs_data_add_json_array(obs_data_t *data, const char *key,
-				    json_t *jarray)
+/* returns the length of the UTF-8 sequence at str, or 0 if it's invalid */
+static size_t utf8_sequence_len(const uint8_t *str)
 {
-	obs_data_array_t *array = obs_data_array_create();
-	size_t idx;
-	json_t *jitem;
+	uint32_t cp;
+	size_t len;
 
-	json_array_foreach (jarray, idx, jitem) {
-		obs_data_t *item;
+	if (str[0] < 0x80)
+		return 1;
+	else if (str[0] < 0xC2)
+		return 0;
+	else if (str[0] < 0xE0)
+		len = 2, cp = str[0] & 0x1F;
+	else if (str[0] < 0xF0)
+		len = 3, cp = str[0] & 0x0F;
+	else if (str[0] < 0xF5)
+		len = 4, cp = str[0] & 0x07;
+	else
+		return 0;
 
-		if (!json_is_object(jitem))
-			continue;
+	for (size_t i = 1; i < len; i++) {
+		if ((str[i] & 0xC0) != 0x80)
+			return 0;
+		cp = (cp << 6) | (str[i] & 0x3F);
+	}
+
+	/* overlong, surrogate or out of range */
+	if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+	    (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+		return 0;
+
+	return len;
+}
+
+static void dstr_cat_utf8(struct dstr *str, uint32_t cp)
+{
+	char buf[4];
+	size_t len;
 
-		item = obs_data_create();
-		obs_data_add_json_object_data(item, jitem);
-		obs_data_array_push_back(array, item);
-		obs_data_release(item);
+	if (cp < 0x80) {
+		buf[0] = (char)cp;
+		len = 1;
+	} else if (cp < 0x800) {
+		buf[0] = (char)(0xC0 | (cp >> 6));
+		buf[1] = (char)(0x80 | (cp & 0x3F));
+		len = 2;
+	} else if (cp < 0x10000) {
+		buf[0] = (char)(0xE0 | (cp >> 12));
+		buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		buf[2] = (char)(0x80 | (cp & 0x3F));
+		len = 3;
+	} else {
+		buf[0] = (char)(0xF0 | (cp >> 18));
+		buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+		buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		buf[3] = (char)(0x80 | (cp & 0x3F));
+		len = 4;
 	}
 
-	obs_data_set_array(data, key, array);
-	obs_data_array_release(array);
+	dstr_ncat(str, buf, len);
 }
 
-static void obs_data_add_json_item(obs_data_t *data, const char *key,
-				   json_t *json)
+static bool json_read_hex4(struct json_reader *r, uint32_t *val)
 {
-	if (json_is_object(json))
-		obs_data_add_json_object(data, key, json);
-	else if (json_is_array(json))
-		obs_data_add_json_array(data, key, json);
-	else if (json_is_string(json))
-		obs_data_set_string(data, key, json_string_value(json));
-	else if (json_is_integer(json))
-		obs_data_set_int(data, key, json_integer_value(json));
-	else if (json_is_real(json))
-		obs_data_set_double(data, key, json_real_value(json));
-	else if (json_is_true(json))
-		obs_data_set_bool(data, key, true);
-	else if (json_is_false(json))
-		obs_data_set_bool(data, key, false);
+	*val = 0;
+
+	for (size_t i = 0; i < 4; i++) {
+		char ch = *r->pos++;
+		*val <<= 4;
+
+		if (ch >= '0' && ch <= '9')
+			*val |= (uint32_t)(ch - '0');
+		else if (ch >= 'a' && ch <= 'f')
+			*val |= (uint32_t)(ch - 'a' + 10);
+		else if (ch >= 'A' && ch <= 'F')
+			*val |= (uint32_t)(ch - 'A' + 10);
+		else
+			return json_error(r, "invalid escape");
+	}
+
+	return true;
 }
 
-/* ------------------------------------------------------------------------- */
+static bool json_read_escape(struct json_reader *r, struct dstr *str)
+{
+	uint32_t cp, low;
+	char ch = *r->pos++;
+
+	switch (ch) {
+	case '"':
+	case '\\':
+	case '/':
+		dstr_cat_ch(str, ch);
+		return true;
+	case 'b':
+		dstr_cat_ch(str, '\b');
+		return true;
+	case 'f':
+		dstr_cat_ch(str, '\f');
+		return true;
+	case 'n':
+		dstr_cat_ch(str, '\n');
+		return true;
+	case 'r':
+		dstr_cat_ch(str, '\r');
+		return true;
+	case 't':
+		dstr_cat_ch(str, '\t');
+		return true;
+	case 'u':
+		break;
+	default:
+		return json_error(r, "invalid escape");
+	}
+
+	if (!json_read_hex4(r, &cp))
+		return false;
+
+	if (cp >= 0xD800 && cp <= 0xDBFF) {
+		if (r->pos[0] != '\\' || r->pos[1] != 'u')
+			return json_error(r, "invalid Unicode '\\u%04X'", cp);
+
+		r->pos += 2;
+		if (!json_read_hex4(r, &low))
+			return false;
+		if (low < 0xDC00 || low > 0xDFFF)
+			return json_error(r, "invalid Unicode '\\u%04X\\u%04X'",
+					  cp, low);
+
+		cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+
+	} else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+		return json_error(r, "invalid Unicode '\\u%04X'", cp);
+
+	} else if (cp == 0) {
+		return json_error(r, "\\u0000 is not allowed");
+	}
 
-static inline void set_json_string(json_t *json, const char *name,
-				   obs_data_item_t *item)
+	dstr_cat_utf8(str, cp);
+	return true;
+}
+
+/* the opening quote is already consumed */
+static bool json_read_string(struct json_reader *r, struct dstr *str)
+{
+	str->len = 0;
+	str->array[0] = 0;
+
+	for (;;) {
+		const char *start = r->pos;
+
+		/* copy runs of plain ASCII in one go */
+		while ((uint8_t)*r->pos >= 0x20 && (uint8_t)*r->pos < 0x80 &&
+		       *r->pos != '"' && *r->pos != '\\')
+			r->pos++;
+		if (r->pos != start)
+			dstr_ncat(str, start, r->pos - start);
+
+		uint8_t ch = (uint8_t)*r->pos;
+
+		if (ch == '"') {
+			r->pos++;
+			return true;
+		} else if (ch == '\\') {
+			r->pos++;
+			if (!json_read_escape(r, str))
+				return false;
+		} else if (ch == 0) {
+			return json_error(r, "premature end of input");
+		} else if (ch < 0x20) {
+			return json_error(r, "control character 0x%x", ch);
+		} else {
+			size_t len = utf8_sequence_len((const uint8_t *)r->pos);
+			if (!len)
+				return json_error(r, "invalid UTF-8");
+			dstr_ncat(str, r->pos, len);
+			r->pos += len;
+		}
+	}
+}
+
+static inline bool is_digit(char ch)
 {
-	const char *val = obs_data_item_get_string(item);
-	json_object_set_new(json, name, json_string(val));
+	return ch >= '0' && ch <= '9';
 }
 
-static inline void set_json_number(json_t *json, const char *name,
-				   obs_data_item_t *item)
+static bool json_read_number(struct json_reader *r,
+			     struct obs_data_number *num)
 {
-	enum obs_data_number_type type = obs_data_item_numtype(item);
+	const char *start = r->pos;
+	const char *p = start;
+	bool real = false;
+	char buf[64];
+	char *end;
+
+	if (*p == '-')
+		p++;
+
+	if (*p == '0') {
+		p++;
+		if (is_digit(*p))
+			return json_error(r, "invalid token");
+	} else if (is_digit(*p)) {
+		while (is_digit(*p))
+			p++;
+	} else {
+		return json_error(r, "invalid token");
+	}
+
+	if (*p == '.') {
+		p++;
+		if (!is_digit(*p))
+			return json_error(r, "invalid token");
+		while (is_digit(*p))
+			p++;
+		real = true;
+	}
+
+	if (*p == 'e' || *p == 'E') {
+		p++;
+		if (*p == '+' || *p == '-')
+			p++;
+		if (!is_digit(*p))
+			return json_error(r, "invalid token");
+		while (is_digit(*p))
+			p++;
+		real = true;
+	}
 
-	if (type == OBS_DATA_NUM_INT) {
-		long long val = obs_data_item_get_int(item);
-		json_object_set_new(json, name, json_integer(val));
+	size_t len = p - start;
+	char *text = len < sizeof(buf) ? buf : bmalloc(len + 1);
+	bool success = true;
+
+	memcpy(text, start, len);
+	text[len] = 0;
+	r->pos = p;
+	errno = 0;
+
+	if (!real) {
+		num->type = OBS_DATA_NUM_INT;
+		num->int_val = strtoll(text, &end, 10);
+		if (errno == ERANGE)
+			success = json_error(r, "too big %sinteger",
+					     *text == '-' ? "negative " : "");
 	} else {
-		double val = obs_data_item_get_double(item);
-		json_object_set_new(json, name, json_real(val));
+		/* strtod uses the locale's decimal point */
+		const char *point = localeconv()->decimal_point;
+		char *dot = strchr(text, '.');
+		if (dot && *point != '.')
+			*dot = *point;
+
+		num->type = OBS_DATA_NUM_DOUBLE;
+		num->double_val = strtod(text, &end);
+		if (errno == ERANGE && (num->double_val == HUGE_VAL ||
+					num->double_val == -HUGE_VAL))
+			success = json_error(r, "real number overflow");
 	}
+
+	if (text != buf)
+		bfree(text);
+	return success;
 }
 
-static inline void set_json_bool(json_t *json, const char *name,
-				 obs_data_item_t *item)
+static void json_add_item(struct json_reader *r, obs_data_t *data,
+			  const char *name, const void *ptr, size_t size,
+			  enum obs_data_type type)
 {
-	bool val = obs_data_item_get_bool(item);
-	json_object_set_new(json, name, val ? json_true() : json_false());
+	size_t name_size = get_name_align_size(name);
+	size_t total_size = sizeof(struct obs_data_item) + name_size + size;
+	struct obs_data_item *item = arena_alloc(r->arena, total_size);
+
+	memset(item, 0, sizeof(struct obs_data_item));
+	item->arena = r->arena;
+	item->capacity = total_size;
+	item->type = type;
+	item->name_len = name_size;
+	item->data_len = size;
+	item->data_size = size;
+	item->ref = 1;
+
+	char *name_ptr = get_item_name(item);
+	item->name = name_ptr;
+
+	strcpy(name_ptr, name);
+	memcpy(get_item_data(item), ptr, size);
+
+	item_data_addref(item);
+
+	item->parent = data;
+	HASH_ADD_STR(data->items, name, item);
 }
 
-static json_t *obs_data_to_json(obs_data_t *data);
+static bool json_read_object(struct json_reader *r, obs_data_t *data);
+static bool json_read_array(struct json_reader *r, obs_data_array_t *array);
 
-static inline void set_json_obj(json_t *json, const char *name,
-				obs_data_item_t *item)
+static bool json_read_literal(struct json_reader *r, const char *literal)
 {
-	obs_data_t *obj = obs_data_item_get_obj(item);
-	json_object_set_new(json, name, obs_data_to_json(obj));
-	obs_data_release(obj);
+	size_t len = strlen(literal);
+
+	if (strncmp(r->pos, literal, len) != 0)
+		return json_error(r, "invalid token");
+
+	r->pos += len;
+	return true;
+}
+
+/* Reads the value of a member named r->key.  With no data the value is only
+ * validated. */
+static bool json_read_member(struct json_reader *r, obs_data_t *data)
+{
+	const char *name = r->key.array;
+	struct obs_data_number num;
+	bool val;
+
+	json_skip_whitespace(r);
+
+	switch (*r->pos) {
+	case '{': {
+		obs_data_t *obj = data ? obs_data_create() : NULL;
+		if (obj)
+			json_add_item(r, data, name, &obj, sizeof(obj),
+				      OBS_DATA_OBJECT);
+
+		r->pos++;
+		bool success = json_read_object(r, obj);
+		obs_data_release(obj);
+		return success;
+	}
+	case '[': {
+		obs_data_array_t *array = data ? obs_data_array_create() : NULL;
+		if (array)
+			json_add_item(r, data, name, &array, sizeof(array),
+				      OBS_DATA_ARRAY);
+
+		r->pos++;
+		bool success = json_read_array(r, array);
+		obs_data_array_release(array);
+		return success;
+	}
+	case '"':
+		r->pos++;
+		if (!json_read_string(r, &r->str))
+			return false;
+		if (data)
+			json_add_item(r, data, name, r->str.array,
+				      r->str.len + 1, OBS_DATA_STRING);
+		return true;
+	case 't':
+		val = true;
+		if (!json_read_literal(r, "true"))
+			return false;
+		break;
+	case 'f':
+		val = false;
+		if (!json_read_literal(r, "false"))
+			return false;
+		break;
+	case 'n':
+		return json_read_literal(r, "null");
+	default:
+		if (!json_read_number(r, &num))
+			return false;
+		if (data)
+			json_add_item(r, data, name, &num, sizeof(num),
+				      OBS_DATA_NUMBER);
+		return true;
+	}
+
+	if (data)
+		json_add_item(r, data, name, &val, sizeof(val),
+			      OBS_DATA_BOOLEAN);
+	return true;
+}
+
+static inline bool json_enter(struct json_reader *r)
+{
+	if (++r->depth > JSON_MAX_DEPTH)
+		return json_error(r, "maximum parsing depth reached");
+	return true;
+}
+
+static bool json_key_seen(struct json_reader *r, obs_data_t *data,
+			  const char *const *keys, size_t num)
+{
+	struct obs_data_item *item = NULL;
+
+	if (data) {
+		HASH_FIND_STR(data->items, r->key.array, item);
+		if (item)
+			return true;
+	}
+
+	for (size_t i = 0; i < num; i++) {
+		if (strcmp(keys[i], r->key.array) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/* the opening brace is already consumed */
+static bool json_read_object(struct json_reader *r, obs_data_t *data)
+{
+	/* keys that don't end up in data: nulls, or everything when the
+	 * object is only being validated */
+	DARRAY(char *) keys;
+	bool success = false;
+
+	if (!json_enter(r))
+		return false;
+
+	da_init(keys);
+
+	json_skip_whitespace(r);
+	if (*r->pos == '}') {
+		r->pos++;
+		r->depth--;
+		return true;
+	}
+
+	for (;;) {
+		if (!json_expect(r, '"') || !json_read_string(r, &r->key))
+			goto exit;
+
+		if (json_key_seen(r, data, (const char *const *)keys.array,
+				  keys.num)) {
+			json_error(r, "duplicate object key");
+			goto exit;
+		}
+
+		if (!json_expect(r, ':'))
+			goto exit;
+
+		json_skip_whitespace(r);
+		if (!data || *r->pos == 'n') {
+			char *key = bstrdup(r->key.array);
+			da_push_back(keys, &key);
+		}
+
+		if (!json_read_member(r, data))
+			goto exit;
+
+		json_skip_whitespace(r);
+		if (*r->pos == '}') {
+			r->pos++;
+			break;
+		}
+		if (!json_expect(r, ','))
+			goto exit;
+	}
+
+	r->depth--;
+	success = true;
+
+exit:
+	for (size_t i = 0; i < keys.num; i++)
+		bfree(keys.array[i]);
+	da_free(keys);
+	return success;
+}
+
+/* the opening bracket is already consumed */
+static bool json_read_array(struct json_reader *r, obs_data_array_t *array)
+{
+	if (!json_enter(r))
+		return false;
+
+	json_skip_whitespace(r);
+	if (*r->pos == ']') {
+		r->pos++;
+		r->depth--;
+		return true;
+	}
+
+	for (;;) {
+		json_skip_whitespace(r);
+
+		if (*r->pos == '{') {
+			obs_data_t *obj = array ? obs_data_create() : NULL;
+			if (obj)
+				obs_data_array_push_back(array, obj);
+
+			r->pos++;
+			bool success = json_read_object(r, obj);
+			obs_data_release(obj);
+			if (!success)
+				return false;
+
+		} else if (!json_read_member(r, NULL)) {
+			return false;
+		}
+
+		json_skip_whitespace(r);
+		if (*r->pos == ']') {
+			r->pos++;
+			break;
+		}
+		if (!json_expect(r, ','))
+			return false;
+	}
+
+	r->depth--;
+	return true;
 }
 
-static inline void set_json_array(json_t *json, const char *name,
-				  obs_data_item_t *item)
+static bool json_read_document(struct json_reader *r, obs_data_t *data)
 {
-	json_t *jarray = json_array();
-	obs_data_array_t *array = obs_data_item_get_array(item);
-	size_t count = obs_data_array_count(array);
+	bool success;
+
+	json_skip_whitespace(r);
+
+	if (*r->pos == '{') {
+		r->pos++;
+		success = json_read_object(r, data);
+	} else if (*r->pos == '[') {
+		r->pos++;
+		success = json_read_array(r, NULL);
+	} else {
+		return json_error(r, "'[' or '{' expected");
+	}
+
+	if (!success)
+		return false;
+
+	json_skip_whitespace(r);
+	if (*r->pos)
+		return json_error(r, "end of file expected");
+
+	return true;
+}
 
-	for (size_t idx = 0; idx < count; idx++) {
-		obs_data_t *sub_item = obs_data_array_item(array, idx);
-		json_t *jitem = obs_data_to_json(sub_item);
-		json_array_append_new(jarray, jitem);
-		obs_data_release(sub_item);
+/* ------------------------------------------------------------------------- */
+/* JSON writer
+ *
+ * Produces the same text jansson's json_dumps did with JSON_PRESERVE_ORDER.
+ * Items jansson would have refused (strings or keys that aren't valid UTF-8,
+ * and non-finite numbers) are left out the same way. */
+
+static bool utf8_valid(const char *str)
+{
+	while (*str) {
+		size_t len = utf8_sequence_len((const uint8_t *)str);
+		if (!len)
+			return false;
+		str += len;
 	}
 
-	json_object_set_new(json, name, jarray);
-	obs_data_array_release(array);
+	return true;
 }
 
-static json_t *obs_data_to_json(obs_data_t *data)
+static void json_write_string(struct dstr *out, const char *str)
 {
-	json_t *json = json_object();
+	dstr_cat_ch(out, '"');
+
+	for (;;) {
+		const char *start = str;
+
+		while ((uint8_t)*str >= 0x20 && *str != '"' && *str != '\\')
+			str++;
+		if (str != start)
+			dstr_ncat(out, start, str - start);
+
+		char ch = *str++;
+		switch (ch) {
+		case 0:
+			dstr_cat_ch(out, '"');
+			return;
+		case '"':
+			dstr_cat(out, "\\\"");
+			break;
+		case '\\':
+			dstr_cat(out, "\\\\");
+			break;
+		case '\b':
+			dstr_cat(out, "\\b");
+			break;
+		case '\f':
+			dstr_cat(out, "\\f");
+			break;
+		case '\n':
+			dstr_cat(out, "\\n");
+			break;
+		case '\r':
+			dstr_cat(out, "\\r");
+			break;
+		case '\t':
+			dstr_cat(out, "\\t");
+			break;
+		default: {
+			char seq[8];
+			snprintf(seq, sizeof(seq), "\\u%04X", (unsigned)ch);
+			dstr_cat(out, seq);
+		}
+		}
+	}
+}
 
+static void json_write_double(struct dstr *out, double val)
+{
+	char buf[32];
+	char *p;
+
+	snprintf(buf, sizeof(buf), "%.17g", val);
+
+	/* undo the locale's decimal point */
+	p = strchr(buf, *localeconv()->decimal_point);
+	if (p && *p != '.')
+		*p = '.';
+
+	if (!strchr(buf, '.') && !strchr(buf, 'e'))
+		strcat(buf, ".0");
+
+	/* no '+' or leading zeros in the exponent */
+	p = strchr(buf, 'e');
+	if (p) {
+		char *start = ++p;
+		char *end = start + 1;
+
+		if (*start == '-')
+			start++;
+		while (*end == '0')
+			end++;
+		if (end != start)
+			memmove(start, end, strlen(end) + 1);
+	}
+
+	dstr_cat(out, buf);
+}
+
+static void json_write_indent(struct dstr *out, int indent, int depth)
+{
+	if (!indent)
+		return;
+
+	dstr_cat_ch(out, '\n');
+	for (int i = 0; i < indent * depth; i++)
+		dstr_cat_ch(out, ' ');
+}
+
+static void json_write_object(struct dstr *out, obs_data_t *data, int indent,
+			      int depth);
+
+static void json_write_array(struct dstr *out, obs_data_array_t *array,
+			     int indent, int depth)
+{
+	dstr_cat_ch(out, '[');
+
+	for (size_t i = 0; i < array->objects.num; i++) {
+		if (i)
+			dstr_cat_ch(out, ',');
+		json_write_indent(out, indent, depth + 1);
+		json_write_object(out, array->objects.array[i], indent,
+				  depth + 1);
+	}
+
+	if (array->objects.num)
+		json_write_indent(out, indent, depth);
+	dstr_cat_ch(out, ']');
+}
+
+static bool json_item_writable(struct obs_data_item *item)
+{
+	void *ptr = get_item_data(item);
+
+	if (!obs_data_item_has_user_value(item) || !utf8_valid(item->name))
+		return false;
+
+	switch (item->type) {
+	case OBS_DATA_STRING:
+		return utf8_valid(ptr);
+	case OBS_DATA_NUMBER: {
+		struct obs_data_number *num = ptr;
+		return num->type == OBS_DATA_NUM_INT ||
+		       isfinite(num->double_val);
+	}
+	case OBS_DATA_BOOLEAN:
+		return true;
+	case OBS_DATA_OBJECT:
+	case OBS_DATA_ARRAY:
+		return *(void **)ptr != NULL;
+	case OBS_DATA_NULL:
+		return false;
+	}
+
+	return false;
+}
+
+static void json_write_object(struct dstr *out, obs_data_t *data, int indent,
+			      int depth)
+{
 	obs_data_item_t *item = NULL;
 	obs_data_item_t *temp = NULL;
+	bool first = true;
+
+	dstr_cat_ch(out, '{');
 
 	HASH_ITER (hh, data->items, item, temp) {
-		enum obs_data_type type = obs_data_item_gettype(item);
-		const char *name = get_item_name(item);
+		void *ptr = get_item_data(item);
 
-		if (!obs_data_item_has_user_value(item))
+		if (!json_item_writable(item))
 			continue;
 
-		if (type == OBS_DATA_STRING)
-			set_json_string(json, name, item);
-		else if (type == OBS_DATA_NUMBER)
-			set_json_number(json, name, item);
-		else if (type == OBS_DATA_BOOLEAN)
-			set_json_bool(json, name, item);
-		else if (type == OBS_DATA_OBJECT)
-			set_json_obj(json, name, item);
-		else if (type == OBS_DATA_ARRAY)
-			set_json_array(json, name, item);
+		if (!first)
+			dstr_cat_ch(out, ',');
+		first = false;
+
+		json_write_indent(out, indent, depth + 1);
+		json_write_string(out, item->name);
+		dstr_cat(out, indent ? ": " : ":");
+
+		switch (item->type) {
+		case OBS_DATA_STRING:
+			json_write_string(out, ptr);
+			break;
+		case OBS_DATA_NUMBER: {
+			struct obs_data_number *num = ptr;
+			if (num->type == OBS_DATA_NUM_INT)
+				dstr_catf(out, "%lld", num->int_val);
+			else
+				json_write_double(out, num->double_val);
+			break;
+		}
+		case OBS_DATA_BOOLEAN:
+			dstr_cat(out, *(bool *)ptr ? "true" : "false");
+			break;
+		case OBS_DATA_OBJECT:
+			json_write_object(out, *(obs_data_t **)ptr, indent,
+					  depth + 1);
+			break;
+		case OBS_DATA_ARRAY:
+			json_write_array(out, *(obs_data_array_t **)ptr, indent,
+					 depth + 1);
+			break;
+		case OBS_DATA_NULL:
+			break;
+		}
 	}
 
-	return json;
+	if (!first)
+		json_write_indent(out, indent, depth);
+	dstr_cat_ch(out, '}');
+}
+
+static const char *obs_data_write_json(obs_data_t *data, int indent)
+{
+	struct dstr out = {0};
+
+	dstr_reserve(&out, 256);
+	json_write_object(&out, data, indent, 0);
+
+	bfree(data->json);
+	data->json = out.array;
+	return data->json;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -624,22 +1377,30 @@ obs_data_t *obs_data_create()
 obs_data_t *obs_data_create_from_json(const char *json_string)
 {
 	obs_data_t *data = obs_data_create();
+	struct json_reader r = {
+		.pos = json_string ? json_string : "",
+		.line = 1,
+		.arena = arena_create(),
+	};
 
-	json_error_t error;
-	json_t *root = json_loads(json_string, JSON_REJECT_DUPLICATES, &error);
+	dstr_reserve(&r.key, 64);
+	dstr_reserve(&r.str, 256);
 
-	if (root) {
-		obs_data_add_json_object_data(data, root);
-		json_decref(root);
-	} else {
+	if (!json_string)
+		json_error(&r, "wrong arguments");
+
+	if (!json_string || !json_read_document(&r, data)) {
 		blog(LOG_ERROR,
 		     "obs-data.c: [obs_data_create_from_json] "
 		     "Failed reading json string (%d): %s",
-		     error.line, error.text);
+		     r.line, r.error);
 		obs_data_release(data);
 		data = NULL;
 	}
 
+	dstr_free(&r.key);
+	dstr_free(&r.str);
+	arena_release(r.arena);
 	return data;
 }
 
@@ -702,8 +1463,7 @@ static inline void obs_data_destroy(struct obs_data *data)
 		obs_data_item_release(&item);
 	}
 
-	/* NOTE: don't use bfree for json text, allocated by json */
-	free(data->json);
+	bfree(data->json);
 	bfree(data);
 }
 
@@ -718,34 +1478,12 @@ void obs_data_release(obs_data_t *data)
 
 const char *obs_data_get_json(obs_data_t *data)
 {
-	if (!data)
-		return NULL;
-
-	/* NOTE: don't use libobs bfree for json text */
-	free(data->json);
-	data->json = NULL;
-
-	json_t *root = obs_data_to_json(data);
-	data->json = json_dumps(root, JSON_PRESERVE_ORDER | JSON_COMPACT);
-	json_decref(root);
-
-	return data->json;
+	return data ? obs_data_write_json(data, 0) : NULL;
 }
 
 const char *obs_data_get_json_pretty(obs_data_t *data)
 {
-	if (!data)
-		return NULL;
-
-	/* NOTE: don't use libobs bfree for json text */
-	free(data->json);
-	data->json = NULL;
-
-	json_t *root = obs_data_to_json(data);
-	data->json = json_dumps(root, JSON_PRESERVE_ORDER | JSON_INDENT(4));
-	json_decref(root);
-
-	return data->json;
+	return data ? obs_data_write_json(data, 4) : NULL;
 }
 
 const char *obs_data_get_last_json(obs_data_t *data)
@@ -29,12 +29,17 @@ static void encoder_set_video(obs_encoder_t *encoder, video_t *video);
 
 struct obs_encoder_info *find_encoder(const char *id)
 {
-	for (size_t i = 0; i < obs->encoder_types.num; i++) {
-		struct obs_encoder_info *info = obs->encoder_types.array + i;
+	do {
+		size_t num = os_atomic_load_size(&obs->encoder_types.num);
 
-		if (strcmp(info->id, id) == 0)
-			return info;
-	}
+		for (size_t i = 0; i < num; i++) {
+			struct obs_encoder_info *info =
+				obs->encoder_types.array + i;
+
+			if (strcmp(info->id, id) == 0)
+				return info;
+		}
+	} while (obs_load_deferred_module_type(OBS_MODULE_TYPES_ENCODER, id));
 
 	return NULL;
 }
@@ -580,6 +585,12 @@ static void intitialize_audio_encoder(struct obs_encoder *encoder)
 
 static THREAD_LOCAL bool can_reroute = false;
 
+/* data of the packet allocated with obs_encoder_packet_alloc during the
+ * current encode call, and of the packet currently being sent to outputs if
+ * it is an instance they can reference */
+static THREAD_LOCAL uint8_t *pooled_packet_data = NULL;
+static THREAD_LOCAL uint8_t *shared_packet_data = NULL;
+
 static inline bool obs_encoder_initialize_internal(obs_encoder_t *encoder)
 {
 	if (!encoder->media) {
@@ -1262,12 +1273,44 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	da_free(data);
 }
 
+static inline size_t trace_frame_index(const struct obs_encoder *encoder,
+					int64_t pts)
+{
+	int64_t step = (int64_t)encoder->timebase_num *
+		       (int64_t)encoder->frame_rate_divisor;
+	return (size_t)((uint64_t)(pts / step) % ENCODER_TRACE_FRAMES);
+}
+
+void obs_encoder_trace_frame(struct obs_encoder *encoder, int64_t pts,
+			     uint64_t timestamp)
+{
+	if (!profiler_trace_active() || pts < 0)
+		return;
+
+	encoder->trace_frame_ts[trace_frame_index(encoder, pts)] = timestamp;
+	profile_trace_flow(obs_frame_flow_name, timestamp, PROFILE_FLOW_STEP);
+}
+
+static inline void trace_packet(const struct obs_encoder *encoder,
+				const struct encoder_packet *packet)
+{
+	if (!profiler_trace_active() || packet->type != OBS_ENCODER_VIDEO ||
+	    packet->pts < 0)
+		return;
+
+	uint64_t ts = encoder->trace_frame_ts[trace_frame_index(encoder,
+								packet->pts)];
+	if (ts)
+		profile_trace_flow(obs_frame_flow_name, ts, PROFILE_FLOW_END);
+}
+
 static const char *send_packet_name = "send_packet";
 static inline void send_packet(struct obs_encoder *encoder,
 			       struct encoder_callback *cb,
 			       struct encoder_packet *packet)
 {
 	profile_start(send_packet_name);
+	trace_packet(encoder, packet);
 	/* include SEI in first video packet */
 	if (encoder->info.type == OBS_ENCODER_VIDEO && !cb->sent_first_packet)
 		send_first_video_packet(encoder, cb, packet);
@@ -1299,16 +1342,53 @@ void full_stop(struct obs_encoder *encoder)
 	}
 }
 
+/* Returns the packet as an instance that every output can reference instead
+ * of copying it: either the pooled packet the encoder allocated itself, or a
+ * single copy when more than one output would otherwise copy it. */
+static bool get_shared_packet(obs_encoder_t *encoder,
+			      struct encoder_packet *pkt,
+			      struct encoder_packet *shared)
+{
+	bool pooled = pkt->data && pkt->data == pooled_packet_data;
+
+	pooled_packet_data = NULL;
+
+	if (pooled) {
+		*shared = *pkt;
+		return true;
+	}
+
+	if (pkt->data && encoder->callbacks.num > 1) {
+		obs_encoder_packet_create_instance(shared, pkt);
+		return true;
+	}
+
+	return false;
+}
+
 void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 			     bool received, struct encoder_packet *pkt)
 {
+	struct encoder_packet shared;
+	bool is_shared;
+
 	if (!success) {
+		if (pkt->data && pkt->data == pooled_packet_data)
+			obs_encoder_packet_release(pkt);
+		pooled_packet_data = NULL;
+
 		blog(LOG_ERROR, "Error encoding with encoder '%s'",
 		     encoder->context.name);
 		full_stop(encoder);
 		return;
 	}
 
+	if (!received) {
+		if (pkt->data && pkt->data == pooled_packet_data)
+			obs_encoder_packet_release(pkt);
+		pooled_packet_data = NULL;
+	}
+
 	if (received) {
 		if (!encoder->first_received) {
 			encoder->offset_usec = packet_dts_usec(pkt);
@@ -1332,12 +1412,25 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
+		is_shared = get_shared_packet(encoder, pkt, &shared);
+		if (is_shared) {
+			pkt->data = shared.data;
+			shared_packet_data = shared.data;
+		}
+
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array + (i - 1);
 			send_packet(encoder, cb, pkt);
 		}
 
+		/* outputs may allocate their own packets while handling this
+		 * one, those are never the next encode call's packet */
+		pooled_packet_data = NULL;
+		shared_packet_data = NULL;
+		if (is_shared)
+			obs_encoder_packet_release(&shared);
+
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
 	}
 }
@@ -1442,6 +1535,7 @@ static void receive_video(void *param, struct video_data *frame)
 	enc_frame.pts    = encoder->cur_pts;
 	enc_frame.sys_pts = frame->timestamp;
 	encoder->last_ts = frame->timestamp;
+	obs_encoder_trace_frame(encoder, enc_frame.pts, frame->timestamp);
 
 	if (do_encode(encoder, &enc_frame))
 		encoder->cur_pts +=
@@ -1715,15 +1809,48 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 					const struct encoder_packet *src)
 {
-	long *p_refs;
-
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void *)(p_refs + 1);
-	*p_refs = 1;
+
+	/* the packet being sent out is already an instance shared by all
+	 * outputs of the encoder */
+	if (src->data && src->data == shared_packet_data) {
+		long *p_refs = ((long *)src->data) - 1;
+		os_atomic_inc_long(p_refs);
+		return;
+	}
+
+	dst->data = obs_packet_pool_alloc(src->size);
 	memcpy(dst->data, src->data, src->size);
 }
 
+uint8_t *obs_encoder_packet_alloc(struct encoder_packet *packet, size_t size)
+{
+	if (!packet)
+		return NULL;
+
+	packet->data = obs_packet_pool_alloc(size);
+	packet->size = size;
+	pooled_packet_data = packet->data;
+	return packet->data;
+}
+
+void obs_encoder_send_packet(obs_encoder_t *encoder,
+			     struct encoder_packet *packet)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_send_packet"))
+		return;
+	if (!obs_ptr_valid(packet, "obs_encoder_send_packet"))
+		return;
+
+	packet->encoder = encoder;
+	packet->timebase_num = encoder->timebase_num;
+	if (encoder->info.type == OBS_ENCODER_VIDEO)
+		packet->timebase_num *= encoder->frame_rate_divisor;
+	packet->timebase_den = encoder->timebase_den;
+
+	send_off_encoder_packet(encoder, true, encoder_active(encoder), packet);
+}
+
 /* OBS_DEPRECATED */
 void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 				  const struct encoder_packet *src)
@@ -1758,7 +1885,11 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 
 	if (pkt->data) {
 		long *p_refs = ((long *)pkt->data) - 1;
-		if (os_atomic_dec_long(p_refs) == 0)
+		long refs = os_atomic_dec_long(p_refs);
+
+		if (refs == PACKET_POOL_REF_FLAG)
+			obs_packet_pool_release(pkt->data);
+		else if (refs == 0)
 			bfree(p_refs);
 	}
 
@@ -135,6 +135,23 @@ struct obs_module {
 
 extern void free_module(struct obs_module *mod);
 
+/* kinds of types a module can register, used to find deferred modules */
+enum obs_module_types {
+	OBS_MODULE_TYPES_SOURCE,
+	OBS_MODULE_TYPES_OUTPUT,
+	OBS_MODULE_TYPES_ENCODER,
+	OBS_MODULE_TYPES_SERVICE,
+	OBS_MODULE_TYPES_COUNT,
+};
+
+/* loads the deferred module that registers the given type id, returns false
+ * if there is none */
+extern bool obs_load_deferred_module_type(enum obs_module_types kind,
+					  const char *id);
+/* loads all deferred modules that register types of the given kind */
+extern void obs_load_deferred_modules(enum obs_module_types kind);
+extern void obs_free_deferred_modules(void);
+
 struct obs_module_path {
 	char *bin;
 	char *data;
@@ -276,6 +293,9 @@ struct obs_task_info {
 	void *param;
 };
 
+/* trace flow following a frame from render through encode to output */
+extern const char *obs_frame_flow_name;
+
 struct obs_core_video_mix {
 	struct obs_view *view;
 
@@ -374,9 +394,18 @@ struct obs_core_video {
 	pthread_mutex_t task_mutex;
 	struct deque tasks;
 
+	/* sources that can tick independently are ticked through this group */
+	os_task_group_t *tick_group;
+	float tick_seconds;
+
 	pthread_mutex_t mixes_mutex;
 	DARRAY(struct obs_core_video_mix *) mixes;
 	struct obs_core_video_mix *main_mix;
+
+	/* opt-in, see obs_set_video_parallel_inputs and
+	 * obs_set_video_scale_band_height */
+	bool parallel_inputs;
+	uint32_t scale_band_height;
 };
 
 struct audio_monitor;
@@ -387,6 +416,14 @@ struct obs_core_audio {
 	DARRAY(struct obs_source *) render_order;
 	DARRAY(struct obs_source *) root_nodes;
 
+	/* independent sources are rendered in parallel through this group,
+	 * with the parameters of the current tick */
+	os_task_group_t *render_group;
+	uint32_t render_mixers;
+	size_t render_channels;
+	size_t render_sample_rate;
+	uint64_t render_start_ts;
+
 	uint64_t buffered_ts;
 	struct deque buffered_timestamps;
 	uint64_t buffering_wait_ticks;
@@ -411,6 +448,7 @@ struct obs_core_data {
 
 	/* Linked lists */
 	struct obs_source *first_audio_source;
+	struct obs_source *first_tick_source;
 	struct obs_display *first_display;
 	struct obs_output *first_output;
 	struct obs_encoder *first_encoder;
@@ -422,6 +460,7 @@ struct obs_core_data {
 	pthread_mutex_t encoders_mutex;
 	pthread_mutex_t services_mutex;
 	pthread_mutex_t audio_sources_mutex;
+	pthread_mutex_t tick_sources_mutex;
 	pthread_mutex_t draw_callbacks_mutex;
 	DARRAY(struct draw_callback) draw_callbacks;
 	DARRAY(struct rendered_callback) rendered_callbacks;
@@ -481,6 +520,14 @@ struct obs_core {
 	DARRAY(struct obs_module_path) module_paths;
 	DARRAY(char *) safe_modules;
 
+	/* modules that are only loaded once one of their types is used */
+	char *module_manifest_path;
+	obs_data_array_t *module_manifest;
+	DARRAY(obs_data_t *) deferred_modules;
+	volatile long num_deferred_modules;
+	volatile long deferred_loads;
+	pthread_mutex_t deferred_modules_mutex;
+
 	obs_source_info_array_t source_types;
 	obs_source_info_array_t input_types;
 	obs_source_info_array_t filter_types;
@@ -504,6 +551,7 @@ struct obs_core {
 	struct obs_core_data data;
 	struct obs_core_hotkeys hotkeys;
 
+	os_task_pool_t *task_pool;
 	os_task_queue_t *destruction_task_thread;
 
 	obs_task_handler_t ui_task_handler;
@@ -561,6 +609,24 @@ struct obs_weak_object {
 
 typedef void (*obs_destroy_cb)(void *obj);
 
+/* Objects that contexts keep are copied out of the loaded document, as
+ * anything still referenced from a parsed document keeps all of it in memory
+ * (see obs-data.c) */
+static inline obs_data_t *obs_data_get_obj_copy(obs_data_t *data,
+						const char *name)
+{
+	obs_data_t *obj = obs_data_get_obj(data, name);
+	obs_data_t *copy;
+
+	if (!obj)
+		return NULL;
+
+	copy = obs_data_create();
+	obs_data_apply(copy, obj);
+	obs_data_release(obj);
+	return copy;
+}
+
 struct obs_context_data {
 	char *name;
 	const char *uuid;
@@ -670,6 +736,13 @@ struct async_frame {
 	bool used;
 };
 
+struct lent_frame {
+	struct obs_source_frame *frame;
+	void (*release)(void *param);
+	void *param;
+	bool queued;
+};
+
 enum audio_action_type {
 	AUDIO_ACTION_VOL,
 	AUDIO_ACTION_MUTE,
@@ -780,6 +853,11 @@ struct obs_source {
 	bool muted;
 	struct obs_source *next_audio_source;
 	struct obs_source **prev_next_audio_source;
+
+	/* sources that may need a tick, see obs_source_wake_tick */
+	volatile bool tick_listed;
+	struct obs_source *next_tick_source;
+	struct obs_source **prev_next_tick_source;
 	uint64_t audio_ts;
 	struct deque audio_input_buf[MAX_AUDIO_CHANNELS];
 	size_t last_audio_input_buf_size;
@@ -825,6 +903,7 @@ struct obs_source {
 	struct obs_source_frame *async_preload_frame;
 	DARRAY(struct async_frame) async_cache;
 	DARRAY(struct obs_source_frame *) async_frames;
+	DARRAY(struct lent_frame) async_lent;
 	pthread_mutex_t async_mutex;
 	uint32_t async_width;
 	uint32_t async_height;
@@ -1030,6 +1109,25 @@ extern void obs_source_set_texcoords_centered(obs_source_t *source,
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern void obs_source_tick_state(obs_source_t *source, float seconds);
+extern void obs_source_tick_callback(obs_source_t *source, float seconds);
+extern void obs_source_wake_tick(obs_source_t *source);
+extern bool obs_source_needs_tick(const obs_source_t *source);
+
+/* requires tick_sources_mutex */
+static inline void tick_list_remove(struct obs_source *source)
+{
+	if (!source->prev_next_tick_source)
+		return;
+
+	*source->prev_next_tick_source = source->next_tick_source;
+	if (source->next_tick_source)
+		source->next_tick_source->prev_next_tick_source =
+			source->prev_next_tick_source;
+
+	source->next_tick_source = NULL;
+	source->prev_next_tick_source = NULL;
+}
 extern float obs_source_get_target_volume(obs_source_t *source,
 					  obs_source_t *target);
 
@@ -1089,6 +1187,9 @@ struct caption_text {
 	struct caption_text *next;
 };
 
+#define MAX_INTERLEAVED_TRACKS \
+	(MAX_OUTPUT_VIDEO_ENCODERS + MAX_OUTPUT_AUDIO_ENCODERS)
+
 struct pause_data {
 	pthread_mutex_t mutex;
 	uint64_t last_video_ts;
@@ -1120,7 +1221,11 @@ struct obs_output {
 	pthread_t end_data_capture_thread;
 	os_event_t *stopping_event;
 	pthread_mutex_t interleaved_mutex;
-	DARRAY(struct encoder_packet) interleaved_packets;
+	/* one packet queue per track (video tracks first), merged in send
+	 * order through a min-heap of the tracks that have packets queued */
+	struct deque interleaved_tracks[MAX_INTERLEAVED_TRACKS];
+	size_t interleaved_heap[MAX_INTERLEAVED_TRACKS];
+	size_t interleaved_heap_size;
 	int stop_code;
 
 	int reconnect_retry_sec;
@@ -1216,11 +1321,24 @@ extern void obs_output_remove_encoder(struct obs_output *output,
 extern void
 obs_encoder_packet_create_instance(struct encoder_packet *dst,
 				   const struct encoder_packet *src);
+
+/* Pooled packet payloads, the returned data has a reference count of 1.
+ *
+ * Pooled reference counts also carry this flag, so that packets which plugins
+ * still build themselves with a bmalloc'd long in front of the data can be
+ * told apart and freed the old way. */
+#define PACKET_POOL_REF_FLAG (1L << (sizeof(long) * 8 - 2))
+
+extern uint8_t *obs_packet_pool_alloc(size_t size);
+extern void obs_packet_pool_release(uint8_t *data);
+extern void obs_packet_pool_free(void);
 void obs_output_destroy(obs_output_t *output);
 
 /* ------------------------------------------------------------------------- */
 /* encoders  */
 
+#define ENCODER_TRACE_FRAMES 128
+
 struct obs_weak_encoder {
 	struct obs_weak_ref ref;
 	struct obs_encoder *encoder;
@@ -1319,6 +1437,9 @@ struct obs_encoder {
 
 	/* reconfigure encoder at next possible opportunity */
 	bool reconfigure_requested;
+
+	/* frame timestamps by pts, ends trace flows on reordered packets */
+	uint64_t trace_frame_ts[ENCODER_TRACE_FRAMES];
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
@@ -1344,6 +1465,8 @@ extern bool start_gpu_encode(obs_encoder_t *encoder);
 extern void stop_gpu_encode(obs_encoder_t *encoder);
 
 extern bool do_encode(struct obs_encoder *encoder, struct encoder_frame *frame);
+extern void obs_encoder_trace_frame(struct obs_encoder *encoder, int64_t pts,
+				    uint64_t timestamp);
 extern void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 				    bool received, struct encoder_packet *pkt);
 
@@ -15,7 +15,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <sys/stat.h>
+
 #include "util/platform.h"
+#include "util/threading.h"
 #include "util/dstr.h"
 
 #include "obs-defs.h"
@@ -101,15 +104,10 @@ static inline char *get_module_name(const char *file)
 extern void reset_win32_symbol_paths(void);
 #endif
 
-int obs_open_module(obs_module_t **module, const char *path,
-		    const char *data_path)
+/* opens the library and resolves its exports without touching any global
+ * state, so several modules can be opened at once */
+static int open_module_file(struct obs_module *mod, const char *path)
 {
-	struct obs_module mod = {0};
-	int errorcode;
-
-	if (!module || !path || !obs)
-		return MODULE_ERROR;
-
 #ifdef __APPLE__
 	/* HACK: Do not load obsolete obs-browser build on macOS; the
 	 * obs-browser plugin used to live in the Application Support
@@ -121,17 +119,19 @@ int obs_open_module(obs_module_t **module, const char *path,
 	}
 #endif
 
-	blog(LOG_DEBUG, "---------------------------------");
-
-	mod.module = os_dlopen(path);
-	if (!mod.module) {
+	mod->module = os_dlopen(path);
+	if (!mod->module) {
 		blog(LOG_WARNING, "Module '%s' not loaded", path);
 		return MODULE_FILE_NOT_FOUND;
 	}
 
-	errorcode = load_module_exports(&mod, path);
-	if (errorcode != MODULE_SUCCESS)
-		return errorcode;
+	return load_module_exports(mod, path);
+}
+
+static void attach_module(obs_module_t **module, struct obs_module mod,
+			  const char *path, const char *data_path)
+{
+	blog(LOG_DEBUG, "---------------------------------");
 
 	mod.bin_path = bstrdup(path);
 	mod.file = strrchr(mod.bin_path, '/');
@@ -150,10 +150,411 @@ int obs_open_module(obs_module_t **module, const char *path,
 
 	if (mod.set_locale)
 		mod.set_locale(obs->locale);
+}
+
+int obs_open_module(obs_module_t **module, const char *path,
+		    const char *data_path)
+{
+	struct obs_module mod = {0};
+	int errorcode;
 
+	if (!module || !path || !obs)
+		return MODULE_ERROR;
+
+	errorcode = open_module_file(&mod, path);
+	if (errorcode != MODULE_SUCCESS)
+		return errorcode;
+
+	attach_module(module, mod, path, data_path);
 	return MODULE_SUCCESS;
 }
 
+/* ------------------------------------------------------------------------- */
+/* Module manifest
+ *
+ * Records which types every module registers, so that modules which only
+ * register types can be skipped at startup and loaded the first time one of
+ * their types is requested. */
+
+static const char *module_type_keys[OBS_MODULE_TYPES_COUNT] = {
+	"sources",
+	"outputs",
+	"encoders",
+	"services",
+};
+
+/* manifest entry of the module being initialized on this thread */
+static THREAD_LOCAL obs_data_t *loading_entry = NULL;
+/* whether this thread is loading a deferred module */
+static THREAD_LOCAL bool loading_deferred = false;
+/* number of finished deferred loads this thread last knew about */
+static THREAD_LOCAL long seen_deferred_loads = 0;
+
+/* modules whose obs_module_load only registers types.  whatever else a module
+ * does when it's loaded (hotkeys, signal and proc handlers, tick and frontend
+ * callbacks) can't be recorded in the manifest, so no other module is ever
+ * deferred */
+static const char *deferrable_modules[] = {
+	"image-source",     "linux-alsa",      "linux-jack",
+	"linux-pulseaudio", "mac-syphon",      "obs-filters",
+	"obs-libfdk",       "obs-transitions", "obs-vst",
+	"obs-x264",         "oss-audio",       "sndio",
+	"text-freetype2",   "vlc-video",
+};
+
+/* extra room reserved in every type array, in case a deferred module
+ * registers more types than the last time it was loaded */
+#define DEFERRED_TYPE_SLACK 16
+
+static obs_data_t *create_manifest_entry(obs_module_t *module)
+{
+	struct stat st;
+	obs_data_t *entry;
+
+	if (!obs->module_manifest || os_stat(module->bin_path, &st) != 0)
+		return NULL;
+
+	entry = obs_data_create();
+	obs_data_set_string(entry, "name", module->mod_name);
+	obs_data_set_string(entry, "bin_path", module->bin_path);
+	obs_data_set_string(entry, "data_path", module->data_path);
+	obs_data_set_int(entry, "size", (long long)st.st_size);
+	obs_data_set_int(entry, "mtime", (long long)st.st_mtime);
+	obs_data_set_bool(entry, "post_load", !!module->post_load);
+	return entry;
+}
+
+static void manifest_add_type(enum obs_module_types kind, const char *id,
+			      const char *unversioned_id)
+{
+	const char *key = module_type_keys[kind];
+	obs_data_array_t *types;
+	obs_data_t *type;
+
+	if (!loading_entry)
+		return;
+
+	types = obs_data_get_array(loading_entry, key);
+	if (!types) {
+		types = obs_data_array_create();
+		obs_data_set_array(loading_entry, key, types);
+	}
+
+	type = obs_data_create();
+	obs_data_set_string(type, "id", id);
+	if (unversioned_id)
+		obs_data_set_string(type, "unversioned_id", unversioned_id);
+	obs_data_array_push_back(types, type);
+
+	obs_data_release(type);
+	obs_data_array_release(types);
+}
+
+static size_t manifest_type_count(obs_data_t *entry, enum obs_module_types kind)
+{
+	obs_data_array_t *types =
+		obs_data_get_array(entry, module_type_keys[kind]);
+	size_t count = obs_data_array_count(types);
+
+	obs_data_array_release(types);
+	return count;
+}
+
+static bool manifest_has_type(obs_data_t *entry, enum obs_module_types kind,
+			      const char *id)
+{
+	obs_data_array_t *types =
+		obs_data_get_array(entry, module_type_keys[kind]);
+	size_t count = obs_data_array_count(types);
+	bool found = false;
+
+	for (size_t i = 0; i < count && !found; i++) {
+		obs_data_t *type = obs_data_array_item(types, i);
+		const char *unversioned_id =
+			obs_data_get_string(type, "unversioned_id");
+
+		found = strcmp(obs_data_get_string(type, "id"), id) == 0 ||
+			strcmp(unversioned_id, id) == 0;
+		obs_data_release(type);
+	}
+
+	obs_data_array_release(types);
+	return found;
+}
+
+static bool is_deferrable_module(const char *name)
+{
+	for (size_t i = 0; i < OBS_COUNTOF(deferrable_modules); i++) {
+		if (strcmp(name, deferrable_modules[i]) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/* a module can be deferred if it's known to only register types, hasn't
+ * changed since the manifest was written and registered types the last time
+ * it was loaded */
+static bool can_defer_module(obs_data_t *entry, const char *bin_path)
+{
+	struct stat st;
+	bool has_types = false;
+
+	if (!is_deferrable_module(obs_data_get_string(entry, "name")))
+		return false;
+	if (obs_data_get_bool(entry, "post_load"))
+		return false;
+	if (os_stat(bin_path, &st) != 0 ||
+	    obs_data_get_int(entry, "size") != (long long)st.st_size ||
+	    obs_data_get_int(entry, "mtime") != (long long)st.st_mtime)
+		return false;
+
+	for (size_t i = 0; i < OBS_MODULE_TYPES_COUNT; i++)
+		has_types |= manifest_type_count(entry, i) > 0;
+
+	return has_types;
+}
+
+static obs_data_t *find_manifest_entry(obs_data_array_t *entries,
+				       const char *bin_path)
+{
+	size_t count = obs_data_array_count(entries);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *entry = obs_data_array_item(entries, i);
+
+		if (strcmp(obs_data_get_string(entry, "bin_path"), bin_path) ==
+		    0)
+			return entry;
+
+		obs_data_release(entry);
+	}
+
+	return NULL;
+}
+
+static obs_data_array_t *load_module_manifest(void)
+{
+	obs_data_array_t *entries = NULL;
+	obs_data_t *manifest;
+
+	if (!obs->module_manifest_path)
+		return NULL;
+
+	manifest = obs_data_create_from_json_file_safe(
+		obs->module_manifest_path, "bak");
+	if (manifest && obs_data_get_int(manifest, "version") ==
+				LIBOBS_API_VER)
+		entries = obs_data_get_array(manifest, "modules");
+
+	obs_data_release(manifest);
+	obs->module_manifest = obs_data_array_create();
+	return entries;
+}
+
+static void save_module_manifest(void)
+{
+	struct dstr dir = {0};
+	obs_data_t *manifest;
+	char *slash;
+
+	if (!obs->module_manifest)
+		return;
+
+	dstr_copy(&dir, obs->module_manifest_path);
+	dstr_replace(&dir, "\\", "/");
+	slash = strrchr(dir.array, '/');
+	if (slash) {
+		*slash = 0;
+		os_mkdirs(dir.array);
+	}
+	dstr_free(&dir);
+
+	manifest = obs_data_create();
+	obs_data_set_int(manifest, "version", LIBOBS_API_VER);
+	obs_data_set_array(manifest, "modules", obs->module_manifest);
+
+	if (!obs_data_save_json_safe(manifest, obs->module_manifest_path,
+				     "tmp", "bak"))
+		blog(LOG_WARNING, "Failed to save module manifest '%s'",
+		     obs->module_manifest_path);
+
+	obs_data_release(manifest);
+	obs_data_array_release(obs->module_manifest);
+	obs->module_manifest = NULL;
+}
+
+/* makes room for the types of deferred modules up front, so loading them
+ * later doesn't reallocate the type arrays other threads may be reading.
+ * deferred modules can't grow the arrays past this, see type_array_full */
+static void reserve_deferred_types(void)
+{
+	size_t counts[OBS_MODULE_TYPES_COUNT] = {0};
+
+	if (!obs->deferred_modules.num)
+		return;
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		for (size_t j = 0; j < OBS_MODULE_TYPES_COUNT; j++)
+			counts[j] += manifest_type_count(
+				obs->deferred_modules.array[i], j);
+	}
+
+	for (size_t j = 0; j < OBS_MODULE_TYPES_COUNT; j++)
+		counts[j] += DEFERRED_TYPE_SLACK;
+
+	da_reserve(obs->source_types,
+		   obs->source_types.num + counts[OBS_MODULE_TYPES_SOURCE]);
+	da_reserve(obs->input_types,
+		   obs->input_types.num + counts[OBS_MODULE_TYPES_SOURCE]);
+	da_reserve(obs->filter_types,
+		   obs->filter_types.num + counts[OBS_MODULE_TYPES_SOURCE]);
+	da_reserve(obs->transition_types, obs->transition_types.num +
+						  counts[OBS_MODULE_TYPES_SOURCE]);
+	da_reserve(obs->output_types,
+		   obs->output_types.num + counts[OBS_MODULE_TYPES_OUTPUT]);
+	da_reserve(obs->encoder_types,
+		   obs->encoder_types.num + counts[OBS_MODULE_TYPES_ENCODER]);
+	da_reserve(obs->service_types,
+		   obs->service_types.num + counts[OBS_MODULE_TYPES_SERVICE]);
+	da_reserve(obs->data.protocols,
+		   obs->data.protocols.num + counts[OBS_MODULE_TYPES_OUTPUT]);
+}
+
+void obs_defer_module_loading(const char *manifest_path)
+{
+	if (!obs)
+		return;
+
+	bfree(obs->module_manifest_path);
+	obs->module_manifest_path = manifest_path ? bstrdup(manifest_path)
+						  : NULL;
+}
+
+/* a module that's being loaded stays in the list until its types are
+ * registered, so it has to be skipped if it looks up its own types */
+static inline bool can_load_deferred(obs_data_t *entry)
+{
+	return !obs_data_get_bool(entry, "loading");
+}
+
+/* the deferred modules mutex has to be held */
+static void load_deferred_module(obs_data_t *entry)
+{
+	const char *bin_path = obs_data_get_string(entry, "bin_path");
+	const char *data_path = obs_data_get_string(entry, "data_path");
+	bool prev_deferred = loading_deferred;
+	obs_module_t *module;
+
+	obs_data_set_bool(entry, "loading", true);
+	loading_deferred = true;
+
+	blog(LOG_INFO, "Loading deferred module '%s'",
+	     obs_data_get_string(entry, "name"));
+
+	if (obs_open_module(&module, bin_path, data_path) == MODULE_SUCCESS) {
+		if (!obs_init_module(module))
+			free_module(module);
+	} else {
+		blog(LOG_WARNING, "Failed to load deferred module '%s'",
+		     bin_path);
+	}
+
+	loading_deferred = prev_deferred;
+
+	/* other threads either wait for the mutex or skip it once the count
+	 * drops, so the entry only goes once its types can be found */
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		if (obs->deferred_modules.array[i] == entry) {
+			da_erase(obs->deferred_modules, i);
+			break;
+		}
+	}
+
+	os_atomic_inc_long(&obs->deferred_loads);
+	os_atomic_dec_long(&obs->num_deferred_modules);
+	obs_data_release(entry);
+}
+
+/* returns true if a deferred module finished loading since this thread last
+ * asked, as its types may be what the caller failed to find */
+static bool deferred_loads_changed(void)
+{
+	long loads = os_atomic_load_long(&obs->deferred_loads);
+	bool changed = loads != seen_deferred_loads;
+
+	seen_deferred_loads = loads;
+	return changed;
+}
+
+bool obs_load_deferred_module_type(enum obs_module_types kind, const char *id)
+{
+	bool loaded = false;
+
+	if (!obs || !id)
+		return false;
+	if (!os_atomic_load_long(&obs->num_deferred_modules))
+		return deferred_loads_changed();
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		obs_data_t *entry = obs->deferred_modules.array[i];
+
+		if (can_load_deferred(entry) &&
+		    manifest_has_type(entry, kind, id)) {
+			load_deferred_module(entry);
+			loaded = true;
+			break;
+		}
+	}
+
+	/* also check after loading, so the load itself isn't reported again
+	 * by the next call */
+	loaded |= deferred_loads_changed();
+
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+	return loaded;
+}
+
+void obs_load_deferred_modules(enum obs_module_types kind)
+{
+	size_t i = 0;
+
+	if (!obs || !os_atomic_load_long(&obs->num_deferred_modules))
+		return;
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+
+	/* loading a module can load others, so start over after each one */
+	while (i < obs->deferred_modules.num) {
+		obs_data_t *entry = obs->deferred_modules.array[i];
+
+		if (can_load_deferred(entry) &&
+		    manifest_type_count(entry, kind)) {
+			load_deferred_module(entry);
+			i = 0;
+		} else {
+			i++;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+}
+
+void obs_free_deferred_modules(void)
+{
+	for (size_t i = 0; i < obs->deferred_modules.num; i++)
+		obs_data_release(obs->deferred_modules.array[i]);
+	da_free(obs->deferred_modules);
+
+	bfree(obs->module_manifest_path);
+	obs->module_manifest_path = NULL;
+	pthread_mutex_destroy(&obs->deferred_modules_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
 bool obs_init_module(obs_module_t *module)
 {
 	if (!module || !obs)
@@ -166,6 +567,9 @@ bool obs_init_module(obs_module_t *module)
 				   "obs_init_module(%s)", module->file);
 	profile_start(profile_name);
 
+	obs_data_t *prev_entry = loading_entry;
+	loading_entry = create_manifest_entry(module);
+
  __try {
 	module->loaded = module->load();
 	if (!module->loaded)
@@ -177,6 +581,14 @@ bool obs_init_module(obs_module_t *module)
 		     module->file);
 }
 
+	if (loading_entry) {
+		if (module->loaded)
+			obs_data_array_push_back(obs->module_manifest,
+						 loading_entry);
+		obs_data_release(loading_entry);
+	}
+	loading_entry = prev_entry;
+
 	profile_end(profile_name);
 	return module->loaded;
 }
@@ -187,6 +599,13 @@ void obs_log_loaded_modules(void)
 
 	for (obs_module_t *mod = obs->first_module; !!mod; mod = mod->next)
 		blog(LOG_INFO, "    %s", mod->file);
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+	for (size_t i = 0; i < obs->deferred_modules.num; i++)
+		blog(LOG_INFO, "    %s (deferred)",
+		     obs_data_get_string(obs->deferred_modules.array[i],
+					 "name"));
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
 }
 
 const char *obs_get_module_file_name(obs_module_t *module)
@@ -318,75 +737,170 @@ static bool is_safe_module(const char *name)
 	return false;
 }
 
-static void load_all_callback(void *param, const struct obs_module_info2 *info)
-{
-	struct fail_info *fail_info = param;
-	obs_module_t *module;
+struct module_load {
+	char *bin_path;
+	char *data_path;
+	char *name;
+	bool skip;
 
 	bool is_obs_plugin;
-	bool can_load_obs_plugin;
+	bool can_load;
+	struct obs_module mod;
+	int code;
+};
 
-	get_plugin_info(info->bin_path, &is_obs_plugin, &can_load_obs_plugin);
+typedef DARRAY(struct module_load) module_load_array_t;
 
-	if (!is_obs_plugin) {
-		blog(LOG_WARNING, "Skipping module '%s', not an OBS plugin",
-		     info->bin_path);
-		return;
+static void collect_module(void *param, const struct obs_module_info2 *info)
+{
+	module_load_array_t *modules = param;
+	struct module_load *load = da_push_back_new(*modules);
+
+	load->bin_path = bstrdup(info->bin_path);
+	load->data_path = bstrdup(info->data_path);
+	load->name = bstrdup(info->name);
+}
+
+/* checking and opening a module is mostly file i/o, so it runs on the task
+ * pool for all modules at once */
+static void open_module_task(void *param)
+{
+	struct module_load *load = param;
+
+	get_plugin_info(load->bin_path, &load->is_obs_plugin, &load->can_load);
+	if (load->is_obs_plugin && load->can_load)
+		load->code = open_module_file(&load->mod, load->bin_path);
+}
+
+static bool defer_module(obs_data_array_t *manifest, struct module_load *load)
+{
+	obs_data_t *entry = find_manifest_entry(manifest, load->bin_path);
+	bool defer = entry && can_defer_module(entry, load->bin_path);
+
+	if (defer) {
+		obs_data_set_string(entry, "data_path", load->data_path);
+		obs_data_array_push_back(obs->module_manifest, entry);
+
+		obs_data_addref(entry);
+		da_push_back(obs->deferred_modules, &entry);
+		os_atomic_inc_long(&obs->num_deferred_modules);
+
+		blog(LOG_DEBUG, "Deferring module '%s'", load->name);
 	}
 
-	if (!is_safe_module(info->name)) {
-		blog(LOG_WARNING, "Skipping module '%s', not on safe list",
-		     info->name);
+	obs_data_release(entry);
+	return defer;
+}
+
+static void finish_module_load(struct module_load *load,
+			       struct fail_info *fail_info)
+{
+	obs_module_t *module;
+
+	if (!load->is_obs_plugin) {
+		blog(LOG_WARNING, "Skipping module '%s', not an OBS plugin",
+		     load->bin_path);
 		return;
 	}
 
-	if (!can_load_obs_plugin) {
+	if (!load->can_load) {
 		blog(LOG_WARNING,
 		     "Skipping module '%s' due to possible "
 		     "import conflicts",
-		     info->bin_path);
+		     load->bin_path);
 		goto load_failure;
 	}
 
-	int code = obs_open_module(&module, info->bin_path, info->data_path);
-	switch (code) {
+	switch (load->code) {
 	case MODULE_MISSING_EXPORTS:
 		blog(LOG_DEBUG,
 		     "Failed to load module file '%s', not an OBS plugin",
-		     info->bin_path);
+		     load->bin_path);
 		return;
 	case MODULE_FILE_NOT_FOUND:
 		blog(LOG_DEBUG,
 		     "Failed to load module file '%s', file not found",
-		     info->bin_path);
+		     load->bin_path);
 		return;
 	case MODULE_ERROR:
 		blog(LOG_DEBUG, "Failed to load module file '%s'",
-		     info->bin_path);
+		     load->bin_path);
 		goto load_failure;
 	case MODULE_INCOMPATIBLE_VER:
 		blog(LOG_DEBUG,
 		     "Failed to load module file '%s', incompatible version",
-		     info->bin_path);
+		     load->bin_path);
 		goto load_failure;
 	case MODULE_HARDCODED_SKIP:
 		return;
 	}
 
+	attach_module(&module, load->mod, load->bin_path, load->data_path);
 	if (!obs_init_module(module))
 		free_module(module);
-
-	UNUSED_PARAMETER(param);
 	return;
 
 load_failure:
 	if (fail_info) {
-		dstr_cat(&fail_info->fail_modules, info->name);
+		dstr_cat(&fail_info->fail_modules, load->name);
 		dstr_cat(&fail_info->fail_modules, ";");
 		fail_info->fail_count++;
 	}
 }
 
+static void load_all_modules(struct fail_info *fail_info)
+{
+	module_load_array_t modules = {0};
+	obs_data_array_t *manifest = load_module_manifest();
+	os_task_group_t *group;
+
+	obs_find_modules2(collect_module, &modules);
+
+	group = os_task_group_create(obs->task_pool,
+				     OS_TASK_PRIORITY_BACKGROUND);
+
+	for (size_t i = 0; i < modules.num; i++) {
+		struct module_load *load = &modules.array[i];
+
+		if (!is_safe_module(load->name)) {
+			blog(LOG_WARNING,
+			     "Skipping module '%s', not on safe list",
+			     load->name);
+			load->skip = true;
+		} else if (manifest && defer_module(manifest, load)) {
+			load->skip = true;
+		} else if (!group ||
+			   !os_task_group_queue_task(group, open_module_task,
+						     load)) {
+			open_module_task(load);
+		}
+	}
+
+	if (group) {
+		os_task_group_join(group);
+		os_task_group_destroy(group);
+	}
+
+	/* modules register their types in obs_module_load, which has to stay
+	 * on this thread and in the same order as before */
+	for (size_t i = 0; i < modules.num; i++) {
+		struct module_load *load = &modules.array[i];
+
+		if (!load->skip)
+			finish_module_load(load, fail_info);
+
+		bfree(load->bin_path);
+		bfree(load->data_path);
+		bfree(load->name);
+	}
+
+	da_free(modules);
+	obs_data_array_release(manifest);
+
+	reserve_deferred_types();
+	save_module_manifest();
+}
+
 static const char *obs_load_all_modules_name = "obs_load_all_modules";
 #ifdef _WIN32
 static const char *reset_win32_symbol_paths_name = "reset_win32_symbol_paths";
@@ -395,7 +909,7 @@ static const char *reset_win32_symbol_paths_name = "reset_win32_symbol_paths";
 void obs_load_all_modules(void)
 {
 	profile_start(obs_load_all_modules_name);
-	obs_find_modules2(load_all_callback, NULL);
+	load_all_modules(NULL);
 #ifdef _WIN32
 	profile_start(reset_win32_symbol_paths_name);
 	reset_win32_symbol_paths();
@@ -412,7 +926,7 @@ void obs_load_all_modules2(struct obs_module_failure_info *mfi)
 	memset(mfi, 0, sizeof(*mfi));
 
 	profile_start(obs_load_all_modules2_name);
-	obs_find_modules2(load_all_callback, &fail_info);
+	load_all_modules(&fail_info);
 #ifdef _WIN32
 	profile_start(reset_win32_symbol_paths_name);
 	reset_win32_symbol_paths();
@@ -697,6 +1211,34 @@ cleanup:
 	return lookup;
 }
 
+/* other threads read the type arrays without locking them, so a deferred
+ * module can only use the room reserved for it at startup */
+static bool type_array_full(const struct darray *dst, const char *id)
+{
+	if (!loading_deferred || dst->num < dst->capacity)
+		return false;
+
+	blog(LOG_WARNING,
+	     "Not registering '%s', no room left for the types of "
+	     "deferred modules",
+	     id);
+	return true;
+}
+
+/* for the same reason the count is published with an atomic store after
+ * the item is written, readers load it with os_atomic_load_size */
+static void push_type(struct darray *dst, size_t element_size,
+		      const void *item)
+{
+	if (!loading_deferred) {
+		darray_push_back(element_size, dst, item);
+		return;
+	}
+
+	memcpy(darray_item(element_size, dst, dst->num), item, element_size);
+	os_atomic_store_size(&dst->num, dst->num + 1);
+}
+
 #define REGISTER_OBS_DEF(size_var, structure, dest, info)               \
 	do {                                                            \
 		struct structure data = {0};                            \
@@ -717,8 +1259,11 @@ cleanup:
 			goto error;                                     \
 		}                                                       \
                                                                         \
+		if (type_array_full(&dest.da, info->id))                \
+			goto error;                                     \
+                                                                        \
 		memcpy(&data, info, size_var);                          \
-		da_push_back(dest, &data);                              \
+		push_type(&dest.da, sizeof(data), &data);               \
 	} while (false)
 
 #define HAS_VAL(type, info, val) \
@@ -855,6 +1400,10 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 	}
 #undef CHECK_REQUIRED_VAL_
 
+	if ((array && type_array_full(&array->da, data.id)) ||
+	    type_array_full(&obs->source_types.da, data.id))
+		goto error;
+
 	/* version-related stuff */
 	data.unversioned_id = data.id;
 	if (data.version) {
@@ -867,8 +1416,10 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 	}
 
 	if (array)
-		da_push_back(*array, &data);
-	da_push_back(obs->source_types, &data);
+		push_type(&array->da, sizeof(data), &data);
+	push_type(&obs->source_types.da, sizeof(data), &data);
+	manifest_add_type(OBS_MODULE_TYPES_SOURCE, data.id,
+			  data.unversioned_id);
 	return;
 
 error:
@@ -915,6 +1466,7 @@ void obs_register_output_s(const struct obs_output_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_output_info, obs->output_types, info);
+	manifest_add_type(OBS_MODULE_TYPES_OUTPUT, info->id, NULL);
 
 	if (info->flags & OBS_OUTPUT_SERVICE) {
 		char **protocols = strlist_split(info->protocols, ';', false);
@@ -926,10 +1478,12 @@ void obs_register_output_s(const struct obs_output_info *info, size_t size)
 					skip = true;
 			}
 
-			if (skip)
+			if (skip ||
+			    type_array_full(&obs->data.protocols.da, *protocol))
 				continue;
 			char *new_prtcl = bstrdup(*protocol);
-			da_push_back(obs->data.protocols, &new_prtcl);
+			push_type(&obs->data.protocols.da, sizeof(new_prtcl),
+				  &new_prtcl);
 		}
 		strlist_free(protocols);
 	}
@@ -966,6 +1520,7 @@ void obs_register_encoder_s(const struct obs_encoder_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_encoder_info, obs->encoder_types, info);
+	manifest_add_type(OBS_MODULE_TYPES_ENCODER, info->id, NULL);
 	return;
 
 error:
@@ -990,6 +1545,7 @@ void obs_register_service_s(const struct obs_service_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_service_info, obs->service_types, info);
+	manifest_add_type(OBS_MODULE_TYPES_SERVICE, info->id, NULL);
 	return;
 
 error:
@@ -127,9 +127,13 @@ static inline bool log_flag_service(const struct obs_output *output,
 const struct obs_output_info *find_output(const char *id)
 {
 	size_t i;
-	for (i = 0; i < obs->output_types.num; i++)
-		if (strcmp(obs->output_types.array[i].id, id) == 0)
-			return obs->output_types.array + i;
+	do {
+		size_t num = os_atomic_load_size(&obs->output_types.num);
+
+		for (i = 0; i < num; i++)
+			if (strcmp(obs->output_types.array[i].id, id) == 0)
+				return obs->output_types.array + i;
+	} while (obs_load_deferred_module_type(OBS_MODULE_TYPES_OUTPUT, id));
 
 	return NULL;
 }
@@ -246,10 +250,18 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array +
-					   i);
-	da_free(output->interleaved_packets);
+	for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++) {
+		struct deque *track = &output->interleaved_tracks[i];
+		struct encoder_packet packet;
+
+		while (track->size) {
+			deque_pop_front(track, &packet, sizeof(packet));
+			obs_encoder_packet_release(&packet);
+		}
+		deque_free(track);
+	}
+
+	output->interleaved_heap_size = 0;
 }
 
 static inline void clear_raw_audio_buffers(obs_output_t *output)
@@ -1527,6 +1539,126 @@ static inline bool has_higher_opposing_ts(struct obs_output *output,
 			  output->highest_audio_ts > packet->dts_usec);
 }
 
+/* packets are sent in dts order.  video is sent before audio with the same
+ * dts, and video tracks with the same dts are sent by track index to prevent
+ * the pruning logic from removing additional video tracks */
+static inline bool packet_before(const struct encoder_packet *a,
+				 const struct encoder_packet *b)
+{
+	if (a->dts_usec != b->dts_usec)
+		return a->dts_usec < b->dts_usec;
+	if (a->type != b->type)
+		return a->type == OBS_ENCODER_VIDEO;
+	return a->track_idx < b->track_idx;
+}
+
+static inline struct deque *get_interleaved_track(struct obs_output *output,
+						  enum obs_encoder_type type,
+						  size_t idx)
+{
+	if (type == OBS_ENCODER_VIDEO)
+		return &output->interleaved_tracks[idx];
+	return &output->interleaved_tracks[MAX_OUTPUT_VIDEO_ENCODERS + idx];
+}
+
+static inline size_t track_packet_count(const struct deque *track)
+{
+	return track->size / sizeof(struct encoder_packet);
+}
+
+static inline struct encoder_packet *track_packet(struct deque *track,
+						  size_t idx)
+{
+	return deque_data(track, idx * sizeof(struct encoder_packet));
+}
+
+/* each track is queued in the order the encoder outputs its packets, which is
+ * also dts order, so only the first packet of each track is on the heap */
+static inline bool track_before(struct obs_output *output, size_t a, size_t b)
+{
+	return packet_before(track_packet(&output->interleaved_tracks[a], 0),
+			     track_packet(&output->interleaved_tracks[b], 0));
+}
+
+static void interleave_heap_sift_up(struct obs_output *output, size_t pos)
+{
+	size_t *heap = output->interleaved_heap;
+
+	while (pos) {
+		size_t parent = (pos - 1) / 2;
+		size_t track = heap[pos];
+
+		if (!track_before(output, track, heap[parent]))
+			break;
+
+		heap[pos] = heap[parent];
+		heap[parent] = track;
+		pos = parent;
+	}
+}
+
+static void interleave_heap_sift_down(struct obs_output *output, size_t pos)
+{
+	size_t *heap = output->interleaved_heap;
+	size_t size = output->interleaved_heap_size;
+
+	for (;;) {
+		size_t child = pos * 2 + 1;
+		size_t track = heap[pos];
+
+		if (child >= size)
+			break;
+		if (child + 1 < size &&
+		    track_before(output, heap[child + 1], heap[child]))
+			child++;
+		if (!track_before(output, heap[child], track))
+			break;
+
+		heap[pos] = heap[child];
+		heap[child] = track;
+		pos = child;
+	}
+}
+
+static void rebuild_interleave_heap(struct obs_output *output)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++) {
+		if (output->interleaved_tracks[i].size)
+			output->interleaved_heap[size++] = i;
+	}
+
+	output->interleaved_heap_size = size;
+
+	for (size_t i = size / 2; i > 0; i--)
+		interleave_heap_sift_down(output, i - 1);
+}
+
+static inline struct encoder_packet *
+first_interleaved_packet(struct obs_output *output)
+{
+	if (!output->interleaved_heap_size)
+		return NULL;
+
+	return track_packet(
+		&output->interleaved_tracks[output->interleaved_heap[0]], 0);
+}
+
+static void pop_interleaved_packet(struct obs_output *output,
+				   struct encoder_packet *packet)
+{
+	size_t *heap = output->interleaved_heap;
+	struct deque *track = &output->interleaved_tracks[heap[0]];
+
+	deque_pop_front(track, packet, sizeof(*packet));
+
+	if (!track->size)
+		heap[0] = heap[--output->interleaved_heap_size];
+	if (output->interleaved_heap_size)
+		interleave_heap_sift_down(output, 0);
+}
+
 static const uint8_t nal_start[4] = {0, 0, 0, 1};
 
 static bool add_caption(struct obs_output *output, struct encoder_packet *out)
@@ -1535,7 +1667,6 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	sei_t sei;
 	uint8_t *data;
 	size_t size;
-	long ref = 1;
 
 	DARRAY(uint8_t) out_data;
 
@@ -1545,7 +1676,6 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	sei_init(&sei, 0.0);
 
 	da_init(out_data);
-	da_push_back_array(out_data, (uint8_t *)&ref, sizeof(ref));
 	da_push_back_array(out_data, out->data, out->size);
 
 	if (output->caption_data.size > 0) {
@@ -1615,8 +1745,10 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	obs_encoder_packet_release(out);
 
 	*out = backup;
-	out->data = (uint8_t *)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	out->data = obs_packet_pool_alloc(out_data.num);
+	out->size = out_data.num;
+	memcpy(out->data, out_data.array, out_data.num);
+	da_free(out_data);
 
 	sei_free(&sei);
 
@@ -1627,15 +1759,16 @@ double last_caption_timestamp = 0;
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct encoder_packet *first = first_interleaved_packet(output);
+	struct encoder_packet out;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
 	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
+	if (!first || !has_higher_opposing_ts(output, first))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	pop_interleaved_packet(output, &out);
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1689,39 +1822,55 @@ static inline void set_higher_ts(struct obs_output *output,
 
 static inline struct encoder_packet *
 find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		       size_t audio_idx);
-static int find_first_packet_type_idx(struct obs_output *output,
-				      enum obs_encoder_type type,
-				      size_t audio_idx);
+		       size_t idx)
+{
+	return track_packet(get_interleaved_track(output, type, idx), 0);
+}
+
+static inline struct encoder_packet *
+find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
+		      size_t idx)
+{
+	struct deque *track = get_interleaved_track(output, type, idx);
+	size_t count = track_packet_count(track);
+
+	return count ? track_packet(track, count - 1) : NULL;
+}
 
 /* gets the point where audio and video are closest together */
-static size_t get_interleaved_start_idx(struct obs_output *output)
+static struct encoder_packet *get_interleaved_start(struct obs_output *output)
 {
 	int64_t closest_diff = 0x7FFFFFFFFFFFFFFFLL;
 	struct encoder_packet *first_video =
 		find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
-	size_t video_idx = DARRAY_INVALID;
-	size_t idx = 0;
-
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		int64_t diff;
+	struct encoder_packet *closest = NULL;
 
-		if (packet->type != OBS_ENCODER_AUDIO) {
-			if (packet == first_video)
-				video_idx = i;
-			continue;
-		}
+	if (!first_video)
+		return NULL;
 
-		diff = llabs(packet->dts_usec - first_video->dts_usec);
-		if (diff < closest_diff) {
-			closest_diff = diff;
-			idx = i;
+	for (size_t i = 0; i < MAX_OUTPUT_AUDIO_ENCODERS; i++) {
+		struct deque *track =
+			get_interleaved_track(output, OBS_ENCODER_AUDIO, i);
+		size_t count = track_packet_count(track);
+
+		for (size_t j = 0; j < count; j++) {
+			struct encoder_packet *packet = track_packet(track, j);
+			int64_t diff;
+
+			diff = llabs(packet->dts_usec - first_video->dts_usec);
+			if (diff < closest_diff ||
+			    (closest && diff == closest_diff &&
+			     packet_before(packet, closest))) {
+				closest_diff = diff;
+				closest = packet;
+			}
 		}
 	}
 
-	return video_idx < idx ? video_idx : idx;
+	if (!closest)
+		return NULL;
+
+	return packet_before(first_video, closest) ? first_video : closest;
 }
 
 static int64_t get_encoder_duration(struct obs_encoder *encoder)
@@ -1730,43 +1879,40 @@ static int64_t get_encoder_duration(struct obs_encoder *encoder)
 	       encoder->framesize;
 }
 
-static int prune_premature_packets(struct obs_output *output)
+/* returns -1 if a track has no packets yet, otherwise 1 if every packet up to
+ * and including *last has to be pruned, and 0 if none do */
+static int prune_premature_packets(struct obs_output *output,
+				   struct encoder_packet **last)
 {
 	struct encoder_packet *video;
-	int video_idx;
-	int max_idx;
 	int64_t duration_usec, max_audio_duration_usec = 0;
 	int64_t max_diff = 0;
 	int64_t diff = 0;
 	int audio_encoders = 0;
 
-	video_idx = find_first_packet_type_idx(output, OBS_ENCODER_VIDEO, 0);
-	if (video_idx == -1)
+	video = find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
+	if (!video)
 		return -1;
 
-	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
+	*last = video;
 	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
 
 	for (size_t i = 0; i < MAX_OUTPUT_AUDIO_ENCODERS; i++) {
 		struct encoder_packet *audio;
-		int audio_idx;
 		int64_t audio_duration_usec = 0;
 
 		if (!output->audio_encoders[i])
 			continue;
 		audio_encoders++;
 
-		audio_idx = find_first_packet_type_idx(output,
-						       OBS_ENCODER_AUDIO, i);
-		if (audio_idx == -1) {
+		audio = find_first_packet_type(output, OBS_ENCODER_AUDIO, i);
+		if (!audio) {
 			output->received_audio = false;
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
-		if (audio_idx > max_idx)
-			max_idx = audio_idx;
+		if (packet_before(*last, audio))
+			*last = audio;
 
 		diff = audio->dts_usec - video->dts_usec;
 		if (diff > max_diff)
@@ -1788,95 +1934,71 @@ static int prune_premature_packets(struct obs_output *output)
 		duration_usec = max_audio_duration_usec;
 	}
 
-	return diff > duration_usec ? max_idx + 1 : 0;
+	return diff > duration_usec ? 1 : 0;
 }
 
-static void discard_to_idx(struct obs_output *output, size_t idx)
+/* discards every packet that would be sent before start, returns whether any
+ * packets were discarded */
+static bool discard_to_packet(struct obs_output *output,
+			      const struct encoder_packet *start)
 {
-	for (size_t i = 0; i < idx; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		obs_encoder_packet_release(packet);
+	struct encoder_packet key = *start;
+	struct encoder_packet *first;
+	struct encoder_packet packet;
+	bool discarded = false;
+
+	while ((first = first_interleaved_packet(output)) &&
+	       packet_before(first, &key)) {
+		pop_interleaved_packet(output, &packet);
+		obs_encoder_packet_release(&packet);
+		discarded = true;
 	}
 
-	da_erase_range(output->interleaved_packets, 0, idx);
+	return discarded;
 }
 
 #define DEBUG_STARTING_PACKETS 0
 
 static bool prune_interleaved_packets(struct obs_output *output)
 {
-	size_t start_idx = 0;
-	int prune_start = prune_premature_packets(output);
+	struct encoder_packet *start = NULL;
+	struct encoder_packet packet;
+	int prune_start = prune_premature_packets(output, &start);
 
 #if DEBUG_STARTING_PACKETS == 1
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
-		     packet->type == OBS_ENCODER_AUDIO ? "audio" : "video",
-		     (int)packet->track_idx, packet->dts_usec,
-		     (int)i < prune_start ? "true" : "false");
+	for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++) {
+		struct deque *track = &output->interleaved_tracks[i];
+
+		for (size_t j = 0; j < track_packet_count(track); j++) {
+			struct encoder_packet *packet = track_packet(track, j);
+			bool pruned = prune_start == 1 &&
+				      !packet_before(start, packet);
+
+			blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
+			     packet->type == OBS_ENCODER_AUDIO ? "audio"
+								 : "video",
+			     (int)packet->track_idx, packet->dts_usec,
+			     pruned ? "true" : "false");
+		}
 	}
 #endif
 
 	/* prunes the first video packet if it's too far away from audio */
 	if (prune_start == -1)
 		return false;
-	else if (prune_start != 0)
-		start_idx = (size_t)prune_start;
-	else
-		start_idx = get_interleaved_start_idx(output);
-
-	if (start_idx)
-		discard_to_idx(output, start_idx);
-
-	return true;
-}
-
-static int find_first_packet_type_idx(struct obs_output *output,
-				      enum obs_encoder_type type, size_t idx)
-{
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type && packet->track_idx == idx)
-			return (int)i;
-	}
-
-	return -1;
-}
-
-static int find_last_packet_type_idx(struct obs_output *output,
-				     enum obs_encoder_type type, size_t idx)
-{
-	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
 
-		if (packet->type == type && packet->track_idx == idx)
-			return (int)(i - 1);
+	if (prune_start != 0) {
+		discard_to_packet(output, start);
+		pop_interleaved_packet(output, &packet);
+		obs_encoder_packet_release(&packet);
+	} else {
+		start = get_interleaved_start(output);
+		if (start)
+			discard_to_packet(output, start);
 	}
 
-	return -1;
-}
-
-static inline struct encoder_packet *
-find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		       size_t audio_idx)
-{
-	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
-static inline struct encoder_packet *
-find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		      size_t audio_idx)
-{
-	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	return true;
 }
 
 static bool get_audio_and_video_packets(struct obs_output *output,
@@ -1916,7 +2038,7 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	struct encoder_packet *video[MAX_OUTPUT_VIDEO_ENCODERS] = {0};
 	struct encoder_packet *audio[MAX_OUTPUT_AUDIO_ENCODERS] = {0};
 	struct encoder_packet *last_audio[MAX_OUTPUT_AUDIO_ENCODERS] = {0};
-	size_t start_idx;
+	struct encoder_packet *start;
 	size_t first_audio_idx;
 	size_t first_video_idx;
 
@@ -1947,9 +2069,8 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	}
 
 	/* clear out excess starting audio if it hasn't been already */
-	start_idx = get_interleaved_start_idx(output);
-	if (start_idx) {
-		discard_to_idx(output, start_idx);
+	start = get_interleaved_start(output);
+	if (start && discard_to_packet(output, start)) {
 		if (!get_audio_and_video_packets(output, video, audio))
 			return false;
 	}
@@ -1985,10 +2106,12 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	}
 
 	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
+	for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++) {
+		struct deque *track = &output->interleaved_tracks[i];
+
+		for (size_t j = 0; j < track_packet_count(track); j++)
+			apply_interleaved_packet_offset(output,
+							track_packet(track, j));
 	}
 
 	return true;
@@ -1997,60 +2120,38 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 static inline void insert_interleaved_packet(struct obs_output *output,
 					     struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		// sort video packets with same DTS by track index,
-		// to prevent the pruning logic from removing additional
-		// video tracks
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO &&
-		    cur_packet->type == OBS_ENCODER_VIDEO &&
-		    out->track_idx > cur_packet->track_idx)
-			continue;
+	struct deque *track =
+		get_interleaved_track(output, out->type, out->track_idx);
+	bool was_empty = !track->size;
 
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
-	}
+	deque_push_back(track, out, sizeof(*out));
+
+	if (was_empty) {
+		size_t pos = output->interleaved_heap_size++;
 
-	da_insert(output->interleaved_packets, idx, out);
+		output->interleaved_heap[pos] =
+			(size_t)(track - output->interleaved_tracks);
+		interleave_heap_sift_up(output, pos);
+	}
 }
 
-static void resort_interleaved_packets(struct obs_output *output)
+/* the offsets change the order between tracks, but not within them */
+static inline void resort_interleaved_packets(struct obs_output *output)
 {
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-	       sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
+	rebuild_interleave_heap(output);
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
 					 int64_t dts_usec)
 {
-	size_t idx = 0;
-
-	for (; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+	struct encoder_packet *first;
+	struct encoder_packet packet;
 
-		if (p->dts_usec >= dts_usec)
-			break;
+	while ((first = first_interleaved_packet(output)) &&
+	       first->dts_usec < dts_usec) {
+		pop_interleaved_packet(output, &packet);
+		obs_encoder_packet_release(&packet);
 	}
-
-	if (idx)
-		discard_to_idx(output, idx);
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -3187,7 +3288,9 @@ void obs_enum_output_types_with_protocol(const char *protocol, void *data,
 		return;
 
 	size_t protocol_len = strlen(protocol);
-	for (size_t i = 0; i < obs->output_types.num; i++) {
+	size_t num = os_atomic_load_size(&obs->output_types.num);
+
+	for (size_t i = 0; i < num; i++) {
 		if (!(obs->output_types.array[i].flags & OBS_OUTPUT_SERVICE))
 			continue;
 
@@ -0,0 +1,238 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <inttypes.h>
+#include "util/threading.h"
+#include "util/bmem.h"
+#include "util/base.h"
+#include "obs-internal.h"
+
+/*
+ * Encoder packet payloads are recycled through size classes instead of being
+ * allocated and freed for every packet.  Each power of two is split into four
+ * classes so at most a fifth of a block is wasted, which matters for the
+ * replay buffer where thousands of packets stay alive at a time.  Payloads
+ * larger than the biggest class are allocated directly.
+ *
+ * Packets are usually created on an encoder thread and released on an output
+ * thread, so there are no per-thread caches: they would only ever fill up on
+ * one side.  Each class has its own lock instead, which is only held to push
+ * or pop a block.
+ */
+
+/* the header is 32 bytes to keep payloads aligned, the reference count used by
+ * obs_encoder_packet_ref/release is always the last long before the data */
+#define PACKET_HEADER_SIZE 32
+
+#define MIN_CLASS_SHIFT 8
+#define MAX_CLASS_SHIFT 22
+#define CLASS_STEPS 4
+#define NUM_CLASSES (1 + (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT) * CLASS_STEPS)
+#define UNPOOLED_CLASS ((size_t)-1)
+
+#define MAX_RETAINED_SIZE (64 * 1024 * 1024)
+
+struct packet_block {
+	struct packet_block *next;
+	size_t size_class;
+};
+
+struct packet_class {
+	pthread_mutex_t mutex;
+	struct packet_block *free_list;
+	uint64_t allocs;
+	uint64_t reused;
+};
+
+static struct packet_class classes[NUM_CLASSES];
+static pthread_once_t pool_init_token = PTHREAD_ONCE_INIT;
+
+static volatile long retained_size = 0;
+static volatile long peak_retained_size = 0;
+static volatile long unpooled_allocs = 0;
+
+static void init_pool(void)
+{
+	for (size_t i = 0; i < NUM_CLASSES; i++)
+		pthread_mutex_init(&classes[i].mutex, NULL);
+}
+
+static inline struct packet_block *get_block(uint8_t *data)
+{
+	return (struct packet_block *)(data - PACKET_HEADER_SIZE);
+}
+
+static inline uint8_t *get_data(struct packet_block *block)
+{
+	return (uint8_t *)block + PACKET_HEADER_SIZE;
+}
+
+static inline size_t class_capacity(size_t size_class)
+{
+	size_t shift, base;
+
+	if (size_class == 0)
+		return (size_t)1 << MIN_CLASS_SHIFT;
+
+	shift = MIN_CLASS_SHIFT + (size_class - 1) / CLASS_STEPS;
+	base = (size_t)1 << shift;
+	return base + (base / CLASS_STEPS) * ((size_class - 1) % CLASS_STEPS + 1);
+}
+
+static size_t get_size_class(size_t size)
+{
+	size_t shift = MIN_CLASS_SHIFT;
+	size_t base;
+
+	if (size <= ((size_t)1 << MIN_CLASS_SHIFT))
+		return 0;
+	if (size > ((size_t)1 << MAX_CLASS_SHIFT))
+		return UNPOOLED_CLASS;
+
+	while (((size_t)2 << shift) < size)
+		shift++;
+
+	base = (size_t)1 << shift;
+	return 1 + (shift - MIN_CLASS_SHIFT) * CLASS_STEPS +
+	       (size - base - 1) / (base / CLASS_STEPS);
+}
+
+static bool reserve_retained(long size)
+{
+	long cur = os_atomic_load_long(&retained_size);
+	long peak;
+
+	do {
+		if (cur + size > MAX_RETAINED_SIZE)
+			return false;
+	} while (!os_atomic_compare_exchange_long(&retained_size, &cur,
+						  cur + size));
+
+	peak = os_atomic_load_long(&peak_retained_size);
+	while (cur + size > peak &&
+	       !os_atomic_compare_exchange_long(&peak_retained_size, &peak,
+						cur + size))
+		;
+
+	return true;
+}
+
+static void unreserve_retained(long size)
+{
+	long cur = os_atomic_load_long(&retained_size);
+	while (!os_atomic_compare_exchange_long(&retained_size, &cur,
+						cur - size))
+		;
+}
+
+uint8_t *obs_packet_pool_alloc(size_t size)
+{
+	size_t size_class = get_size_class(size);
+	struct packet_block *block = NULL;
+	uint8_t *data;
+
+	if (size_class == UNPOOLED_CLASS) {
+		block = bmalloc(PACKET_HEADER_SIZE + size);
+		os_atomic_inc_long(&unpooled_allocs);
+
+	} else {
+		struct packet_class *pc = &classes[size_class];
+
+		pthread_once(&pool_init_token, init_pool);
+
+		pthread_mutex_lock(&pc->mutex);
+		block = pc->free_list;
+		if (block) {
+			pc->free_list = block->next;
+			pc->reused++;
+		}
+		pc->allocs++;
+		pthread_mutex_unlock(&pc->mutex);
+
+		if (block)
+			unreserve_retained((long)class_capacity(size_class));
+		else
+			block = bmalloc(PACKET_HEADER_SIZE +
+					class_capacity(size_class));
+	}
+
+	block->next = NULL;
+	block->size_class = size_class;
+
+	data = get_data(block);
+	*((long *)data - 1) = PACKET_POOL_REF_FLAG | 1;
+	return data;
+}
+
+void obs_packet_pool_release(uint8_t *data)
+{
+	struct packet_block *block = get_block(data);
+	struct packet_class *pc;
+
+	if (block->size_class == UNPOOLED_CLASS ||
+	    !reserve_retained((long)class_capacity(block->size_class))) {
+		bfree(block);
+		return;
+	}
+
+	pc = &classes[block->size_class];
+
+	pthread_mutex_lock(&pc->mutex);
+	block->next = pc->free_list;
+	pc->free_list = block;
+	pthread_mutex_unlock(&pc->mutex);
+}
+
+void obs_packet_pool_free(void)
+{
+	uint64_t allocs = 0;
+	uint64_t reused = 0;
+
+	pthread_once(&pool_init_token, init_pool);
+
+	for (size_t i = 0; i < NUM_CLASSES; i++) {
+		struct packet_class *pc = &classes[i];
+		struct packet_block *block;
+
+		pthread_mutex_lock(&pc->mutex);
+		block = pc->free_list;
+		pc->free_list = NULL;
+		allocs += pc->allocs;
+		reused += pc->reused;
+		pc->allocs = 0;
+		pc->reused = 0;
+		pthread_mutex_unlock(&pc->mutex);
+
+		while (block) {
+			struct packet_block *next = block->next;
+			unreserve_retained((long)class_capacity(i));
+			bfree(block);
+			block = next;
+		}
+	}
+
+	if (allocs)
+		blog(LOG_INFO,
+		     "Encoder packet pool: %" PRIu64 " allocations, %" PRIu64
+		     " reused (%0.1f%%), %ld unpooled, peak retained %ld KB",
+		     allocs, reused, (double)reused / (double)allocs * 100.0,
+		     os_atomic_load_long(&unpooled_allocs),
+		     os_atomic_load_long(&peak_retained_size) / 1024);
+
+	os_atomic_set_long(&unpooled_allocs, 0);
+	os_atomic_set_long(&peak_retained_size, 0);
+}
@@ -1116,7 +1116,7 @@ static void scene_load_item(struct obs_scene *scene, obs_data_t *item_data)
 
 	obs_data_release(item->private_settings);
 	item->private_settings =
-		obs_data_get_obj(item_data, "private_settings");
+		obs_data_get_obj_copy(item_data, "private_settings");
 	if (!item->private_settings)
 		item->private_settings = obs_data_create();
 
@@ -4113,7 +4113,7 @@ void obs_sceneitem_transition_load(struct obs_scene_item *item,
 	const char *id = obs_data_get_string(data, "id");
 	if (id && strlen(id)) {
 		const char *tn = obs_data_get_string(data, "name");
-		obs_data_t *s = obs_data_get_obj(data, "transition");
+		obs_data_t *s = obs_data_get_obj_copy(data, "transition");
 		obs_source_t *t = obs_source_create_private(id, tn, s);
 		obs_sceneitem_set_transition(item, show, t);
 		obs_source_release(t);
@@ -22,9 +22,13 @@
 const struct obs_service_info *find_service(const char *id)
 {
 	size_t i;
-	for (i = 0; i < obs->service_types.num; i++)
-		if (strcmp(obs->service_types.array[i].id, id) == 0)
-			return obs->service_types.array + i;
+	do {
+		size_t num = os_atomic_load_size(&obs->service_types.num);
+
+		for (i = 0; i < num; i++)
+			if (strcmp(obs->service_types.array[i].id, id) == 0)
+				return obs->service_types.array + i;
+	} while (obs_load_deferred_module_type(OBS_MODULE_TYPES_SERVICE, id));
 
 	return NULL;
 }
@@ -52,11 +52,16 @@ static inline bool destroying(const struct obs_source *source)
 
 struct obs_source_info *get_source_info(const char *id)
 {
-	for (size_t i = 0; i < obs->source_types.num; i++) {
-		struct obs_source_info *info = &obs->source_types.array[i];
-		if (strcmp(info->id, id) == 0)
-			return info;
-	}
+	do {
+		size_t num = os_atomic_load_size(&obs->source_types.num);
+
+		for (size_t i = 0; i < num; i++) {
+			struct obs_source_info *info =
+				&obs->source_types.array[i];
+			if (strcmp(info->id, id) == 0)
+				return info;
+		}
+	} while (obs_load_deferred_module_type(OBS_MODULE_TYPES_SOURCE, id));
 
 	return NULL;
 }
@@ -64,12 +69,18 @@ struct obs_source_info *get_source_info(const char *id)
 struct obs_source_info *get_source_info2(const char *unversioned_id,
 					 uint32_t ver)
 {
-	for (size_t i = 0; i < obs->source_types.num; i++) {
-		struct obs_source_info *info = &obs->source_types.array[i];
-		if (strcmp(info->unversioned_id, unversioned_id) == 0 &&
-		    info->version == ver)
-			return info;
-	}
+	do {
+		size_t num = os_atomic_load_size(&obs->source_types.num);
+
+		for (size_t i = 0; i < num; i++) {
+			struct obs_source_info *info =
+				&obs->source_types.array[i];
+			if (strcmp(info->unversioned_id, unversioned_id) == 0 &&
+			    info->version == ver)
+				return info;
+		}
+	} while (obs_load_deferred_module_type(OBS_MODULE_TYPES_SOURCE,
+					       unversioned_id));
 
 	return NULL;
 }
@@ -255,6 +266,8 @@ static void obs_source_init_finalize(struct obs_source *source)
 	}
 	obs_context_data_insert_uuid(&source->context, &obs->data.sources_mutex,
 				     &obs->data.sources);
+
+	obs_source_wake_tick(source);
 }
 
 static bool obs_source_hotkey_mute(void *data, obs_hotkey_pair_id id,
@@ -619,12 +632,33 @@ void obs_source_frame_init(struct obs_source_frame *frame,
 	}
 }
 
-static inline void obs_source_frame_decref(struct obs_source_frame *frame)
+/* lent frames go back to their owner instead of being freed */
+static void async_frame_destroy(struct obs_source *source,
+				struct obs_source_frame *frame)
+{
+	for (size_t i = 0; i < source->async_lent.num; i++) {
+		struct lent_frame *lf = &source->async_lent.array[i];
+
+		if (lf->frame == frame) {
+			lf->release(lf->param);
+			da_erase(source->async_lent, i);
+			bfree(frame);
+			return;
+		}
+	}
+
+	obs_source_frame_destroy(frame);
+}
+
+static inline void obs_source_frame_decref(struct obs_source *source,
+					   struct obs_source_frame *frame)
 {
 	if (os_atomic_dec_long(&frame->refs) == 0)
-		obs_source_frame_destroy(frame);
+		async_frame_destroy(source, frame);
 }
 
+static inline void free_async_cache(struct obs_source *source);
+
 static bool obs_source_filter_remove_refless(obs_source_t *source,
 					     obs_source_t *filter);
 static void obs_source_destroy_defer(struct obs_source *source);
@@ -664,6 +698,10 @@ void obs_source_destroy(struct obs_source *source)
 	}
 	pthread_mutex_unlock(&obs->data.audio_sources_mutex);
 
+	pthread_mutex_lock(&obs->data.tick_sources_mutex);
+	tick_list_remove(source);
+	pthread_mutex_unlock(&obs->data.tick_sources_mutex);
+
 	if (source->filter_parent)
 		obs_source_filter_remove_refless(source->filter_parent, source);
 
@@ -690,6 +728,13 @@ static void obs_source_destroy_defer(struct obs_source *source)
 
 	obs_source_dosignal(source, "source_destroy", "destroy");
 
+	/* lent frames have to be returned while their owner still exists */
+	pthread_mutex_lock(&source->async_mutex);
+	free_async_cache(source);
+	while (source->async_lent.num)
+		async_frame_destroy(source, source->async_lent.array[0].frame);
+	pthread_mutex_unlock(&source->async_mutex);
+
 	if (source->context.data) {
 		source->info.destroy(source->context.data);
 		source->context.data = NULL;
@@ -705,7 +750,8 @@ static void obs_source_destroy_defer(struct obs_source *source)
 	obs_hotkey_pair_unregister(source->mute_unmute_key);
 
 	for (i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+		obs_source_frame_decref(source,
+					source->async_cache.array[i].frame);
 
 	gs_enter_context(obs->video.graphics);
 	if (source->async_texrender)
@@ -740,6 +786,7 @@ static void obs_source_destroy_defer(struct obs_source *source)
 	da_free(source->caption_cb_list);
 	da_free(source->async_cache);
 	da_free(source->async_frames);
+	da_free(source->async_lent);
 	da_free(source->filters);
 	da_free(source->media_actions);
 	pthread_mutex_destroy(&source->filter_mutex);
@@ -998,6 +1045,7 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 
 	if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 		os_atomic_inc_long(&source->defer_update_count);
+		obs_source_wake_tick(source);
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data,
 				    source->context.settings);
@@ -1136,6 +1184,7 @@ static void activate_tree(obs_source_t *parent, obs_source_t *child,
 			  void *param)
 {
 	os_atomic_inc_long(&child->activate_refs);
+	obs_source_wake_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1145,6 +1194,7 @@ static void deactivate_tree(obs_source_t *parent, obs_source_t *child,
 			    void *param)
 {
 	os_atomic_dec_long(&child->activate_refs);
+	obs_source_wake_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1153,6 +1203,7 @@ static void deactivate_tree(obs_source_t *parent, obs_source_t *child,
 static void show_tree(obs_source_t *parent, obs_source_t *child, void *param)
 {
 	os_atomic_inc_long(&child->show_refs);
+	obs_source_wake_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1161,6 +1212,7 @@ static void show_tree(obs_source_t *parent, obs_source_t *child, void *param)
 static void hide_tree(obs_source_t *parent, obs_source_t *child, void *param)
 {
 	os_atomic_dec_long(&child->show_refs);
+	obs_source_wake_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1178,6 +1230,8 @@ void obs_source_activate(obs_source_t *source, enum view_type type)
 		os_atomic_inc_long(&source->activate_refs);
 		obs_source_enum_active_tree(source, activate_tree, NULL);
 	}
+
+	obs_source_wake_tick(source);
 }
 
 void obs_source_deactivate(obs_source_t *source, enum view_type type)
@@ -1197,16 +1251,72 @@ void obs_source_deactivate(obs_source_t *source, enum view_type type)
 						    NULL);
 		}
 	}
+
+	obs_source_wake_tick(source);
 }
 
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
 							 uint64_t sys_time);
 
+static bool async_filters_enabled(obs_source_t *source)
+{
+	bool enabled = false;
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; i < source->filters.num; i++) {
+		struct obs_source *filter = source->filters.array[i];
+
+		if (filter->enabled && filter->context.data &&
+		    filter->info.filter_video) {
+			enabled = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+	return enabled;
+}
+
+/* Async filters can hold on to frames for as long as they like, so a lent
+ * frame is swapped for a copy before it reaches them and goes back to its
+ * owner right away. */
+static struct obs_source_frame *copy_lent_frame(obs_source_t *source,
+						struct obs_source_frame *frame)
+{
+	struct lent_frame *lf = NULL;
+	struct lent_frame copy;
+
+	for (size_t i = 0; i < source->async_lent.num; i++) {
+		if (source->async_lent.array[i].frame == frame) {
+			lf = &source->async_lent.array[i];
+			break;
+		}
+	}
+
+	if (!lf || !lf->queued || !async_filters_enabled(source))
+		return frame;
+
+	copy.frame = obs_source_frame_create(frame->format, frame->width,
+					     frame->height);
+	obs_source_frame_copy(copy.frame, frame);
+	copy.frame->refs = 1;
+	copy.frame->prev_frame = frame->prev_frame;
+	copy.release = bfree;
+	copy.param = copy.frame->data[0];
+	copy.queued = true;
+
+	da_push_back(source->async_lent, &copy);
+	remove_async_frame(source, frame);
+	return copy.frame;
+}
+
 static void filter_frame(obs_source_t *source,
 			 struct obs_source_frame **ref_frame)
 {
 	struct obs_source_frame *frame = *ref_frame;
 	if (frame) {
+		frame = copy_lent_frame(source, frame);
 		os_atomic_inc_long(&frame->refs);
 		frame = filter_async_video(source, frame);
 		if (frame)
@@ -1299,13 +1409,100 @@ static void async_tick(obs_source_t *source)
 	pthread_mutex_unlock(&source->async_mutex);
 }
 
-void obs_source_video_tick(obs_source_t *source, float seconds)
+/* Adds the source to the list of sources ticked by the graphics thread.  Has
+ * to be called after changing anything that the next tick handles. */
+void obs_source_wake_tick(obs_source_t *source)
 {
-	bool now_showing, now_active;
+	struct obs_core_data *data = &obs->data;
 
-	if (!obs_source_valid(source, "obs_source_video_tick"))
+	if (os_atomic_load_bool(&source->tick_listed))
 		return;
 
+	pthread_mutex_lock(&data->tick_sources_mutex);
+
+	if (!source->prev_next_tick_source &&
+	    !os_atomic_load_long(&source->destroying)) {
+		source->next_tick_source = data->first_tick_source;
+		source->prev_next_tick_source = &data->first_tick_source;
+		if (data->first_tick_source)
+			data->first_tick_source->prev_next_tick_source =
+				&source->next_tick_source;
+		data->first_tick_source = source;
+	}
+
+	os_atomic_set_bool(&source->tick_listed, true);
+
+	pthread_mutex_unlock(&data->tick_sources_mutex);
+}
+
+static inline bool tick_visible(const obs_source_t *source)
+{
+	/* filters are shown and hidden along with their parent */
+	if (source->filter_parent)
+		source = source->filter_parent;
+
+	return os_atomic_load_long(&source->show_refs) > 0 ||
+	       os_atomic_load_long(&source->activate_refs) > 0;
+}
+
+/* Whether the source still has to be ticked next frame without being woken
+ * up again */
+bool obs_source_needs_tick(const obs_source_t *source)
+{
+	uint32_t flags = source->info.output_flags;
+	bool now_showing, now_active;
+
+	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
+		return true;
+	if ((flags & (OBS_SOURCE_ASYNC | OBS_SOURCE_CONTROLLABLE_MEDIA)) != 0)
+		return true;
+	if (os_atomic_load_long(&source->defer_update_count) > 0)
+		return true;
+
+	now_showing = os_atomic_load_long(&source->show_refs) > 0;
+	now_active = os_atomic_load_long(&source->activate_refs) > 0;
+	if (now_showing != source->showing || now_active != source->active)
+		return true;
+
+	if (tick_visible(source))
+		return source->info.video_tick || source->filter_texrender;
+
+	return source->info.video_tick &&
+	       (flags & OBS_SOURCE_SKIP_IDLE_TICK) == 0;
+}
+
+static inline void show_filters(obs_source_t *source, bool show)
+{
+	for (size_t i = source->filters.num; i > 0; i--) {
+		obs_source_t *filter = source->filters.array[i - 1];
+		if (show) {
+			show_source(filter);
+		} else {
+			hide_source(filter);
+		}
+		obs_source_wake_tick(filter);
+	}
+}
+
+static inline void activate_filters(obs_source_t *source, bool activate)
+{
+	for (size_t i = source->filters.num; i > 0; i--) {
+		obs_source_t *filter = source->filters.array[i - 1];
+		if (activate) {
+			activate_source(filter);
+		} else {
+			deactivate_source(filter);
+		}
+		obs_source_wake_tick(filter);
+	}
+}
+
+/* Everything the graphics thread handles for the source each frame before the
+ * source's own video_tick */
+void obs_source_tick_state(obs_source_t *source, float seconds)
+{
+	bool now_showing, now_active;
+
 	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
 		obs_transition_tick(source, seconds);
 
@@ -1331,17 +1528,8 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 			hide_source(source);
 		}
 
-		if (source->filters.num) {
-			for (size_t i = source->filters.num; i > 0; i--) {
-				obs_source_t *filter =
-					source->filters.array[i - 1];
-				if (now_showing) {
-					show_source(filter);
-				} else {
-					hide_source(filter);
-				}
-			}
-		}
+		if (source->filters.num)
+			show_filters(source, now_showing);
 
 		source->showing = now_showing;
 	}
@@ -1355,21 +1543,17 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 			deactivate_source(source);
 		}
 
-		if (source->filters.num) {
-			for (size_t i = source->filters.num; i > 0; i--) {
-				obs_source_t *filter =
-					source->filters.array[i - 1];
-				if (now_active) {
-					activate_source(filter);
-				} else {
-					deactivate_source(filter);
-				}
-			}
-		}
+		if (source->filters.num)
+			activate_filters(source, now_active);
 
 		source->active = now_active;
 	}
+}
 
+/* Calls the source's own video_tick, which may happen on a worker thread for
+ * sources with OBS_SOURCE_PARALLEL_TICK */
+void obs_source_tick_callback(obs_source_t *source, float seconds)
+{
 	if (source->context.data && source->info.video_tick)
 		source->info.video_tick(source->context.data, seconds);
 
@@ -1377,6 +1561,15 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 	source->deinterlace_rendered = false;
 }
 
+void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	if (!obs_source_valid(source, "obs_source_video_tick"))
+		return;
+
+	obs_source_tick_state(source, seconds);
+	obs_source_tick_callback(source, seconds);
+}
+
 /* unless the value is 3+ hours worth of frames, this won't overflow */
 static inline uint64_t conv_frames_to_time(const size_t sample_rate,
 					   const size_t frames)
@@ -3219,6 +3412,8 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_source_wake_tick(filter);
+
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
@@ -3609,7 +3804,17 @@ static inline bool async_texture_changed(struct obs_source *source,
 static inline void free_async_cache(struct obs_source *source)
 {
 	for (size_t i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+		obs_source_frame_decref(source,
+					source->async_cache.array[i].frame);
+
+	for (size_t i = source->async_lent.num; i > 0; i--) {
+		struct lent_frame *lf = &source->async_lent.array[i - 1];
+
+		if (lf->queued) {
+			lf->queued = false;
+			obs_source_frame_decref(source, lf->frame);
+		}
+	}
 
 	da_resize(source->async_cache, 0);
 	da_resize(source->async_frames, 0);
@@ -3635,19 +3840,15 @@ static void clean_cache(obs_source_t *source)
 }
 
 #define MAX_ASYNC_FRAMES 30
-//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
-static inline struct obs_source_frame *
-cache_video(struct obs_source *source, const struct obs_source_frame *frame)
-{
-	struct obs_source_frame *new_frame = NULL;
-
-	pthread_mutex_lock(&source->async_mutex);
 
+/* returns false if too many frames were queued and the cache was flushed */
+static bool update_async_cache(struct obs_source *source,
+			       const struct obs_source_frame *frame)
+{
 	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
 		free_async_cache(source);
 		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
-		return NULL;
+		return false;
 	}
 
 	if (async_texture_changed(source, frame)) {
@@ -3656,10 +3857,26 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 		source->async_cache_height = frame->height;
 	}
 
-	const enum video_format format = frame->format;
-	source->async_cache_format = format;
+	source->async_cache_format = frame->format;
 	source->async_cache_full_range = frame->full_range;
 	source->async_cache_trc = frame->trc;
+	return true;
+}
+
+//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
+static inline struct obs_source_frame *
+cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+{
+	struct obs_source_frame *new_frame = NULL;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	if (!update_async_cache(source, frame)) {
+		pthread_mutex_unlock(&source->async_mutex);
+		return NULL;
+	}
+
+	const enum video_format format = frame->format;
 
 	for (size_t i = 0; i < source->async_cache.num; i++) {
 		struct async_frame *af = &source->async_cache.array[i];
@@ -3784,6 +4001,46 @@ void obs_source_output_video2(obs_source_t *source,
 	obs_source_output_video_internal(source, &new_frame);
 }
 
+void obs_source_lend_video(obs_source_t *source,
+			   const struct obs_source_frame *frame,
+			   void (*release)(void *param), void *param)
+{
+	if (!obs_ptr_valid(frame, "obs_source_lend_video") ||
+	    !obs_ptr_valid(release, "obs_source_lend_video"))
+		return;
+	if (!obs_source_valid(source, "obs_source_lend_video") ||
+	    destroying(source)) {
+		release(param);
+		return;
+	}
+
+	struct lent_frame lf = {
+		.frame = bmalloc(sizeof(struct obs_source_frame)),
+		.release = release,
+		.param = param,
+		.queued = true,
+	};
+
+	*lf.frame = *frame;
+	lf.frame->full_range =
+		format_is_yuv(frame->format) ? frame->full_range : true;
+	lf.frame->refs = 1;
+	lf.frame->prev_frame = false;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	if (update_async_cache(source, lf.frame)) {
+		da_push_back(source->async_lent, &lf);
+		da_push_back(source->async_frames, &lf.frame);
+		source->async_active = true;
+	} else {
+		release(param);
+		bfree(lf.frame);
+	}
+
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
 void obs_source_set_async_rotation(obs_source_t *source, long rotation)
 {
 	if (source)
@@ -4274,7 +4531,19 @@ void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 
 		if (f->frame == frame) {
 			f->used = false;
-			break;
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < source->async_lent.num; i++) {
+		struct lent_frame *lf = &source->async_lent.array[i];
+
+		if (lf->frame == frame) {
+			if (lf->queued) {
+				lf->queued = false;
+				obs_source_frame_decref(source, frame);
+			}
+			return;
 		}
 	}
 }
@@ -4430,7 +4699,7 @@ void obs_source_release_frame(obs_source_t *source,
 		pthread_mutex_lock(&source->async_mutex);
 
 		if (os_atomic_dec_long(&frame->refs) == 0)
-			obs_source_frame_destroy(frame);
+			async_frame_destroy(source, frame);
 		else
 			remove_async_frame(source, frame);
 
@@ -4583,6 +4852,10 @@ bool obs_source_process_filter_begin_with_color_space(
 
 	filter->filter_bypass_active = false;
 
+	/* the next tick has to reset the texrender, even if the filter is
+	 * rendered while its parent is hidden */
+	obs_source_wake_tick(filter);
+
 	target = obs_filter_get_target(filter);
 	parent = obs_filter_get_parent(filter);
 
@@ -203,6 +203,18 @@ enum obs_media_state {
  */
 #define OBS_SOURCE_CAP_DONT_SHOW_PROPERTIES (1 << 16)
 
+/**
+ * Source only needs video_tick while it's showing or active, and is skipped
+ * by the graphics thread while it's hidden
+ */
+#define OBS_SOURCE_SKIP_IDLE_TICK (1 << 17)
+
+/**
+ * Source's video_tick only touches its own data and may be called from a
+ * worker thread, at the same time as the ticks of other sources
+ */
+#define OBS_SOURCE_PARALLEL_TICK (1 << 18)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
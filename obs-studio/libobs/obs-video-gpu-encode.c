@@ -137,6 +137,8 @@ static void *gpu_encode_thread(void *data)
 				next_key++;
 
 			profile_start(gpu_encode_frame_name);
+			obs_encoder_trace_frame(encoder, encoder->cur_pts,
+						timestamp);
 			if (encoder->info.encode_texture2) {
 				struct encoder_texture tex = {0};
 
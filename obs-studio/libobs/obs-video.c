@@ -29,15 +29,23 @@
 #include <windows.h>
 #endif
 
+const char *obs_frame_flow_name = "frame";
+
+static void tick_source_task(void *param)
+{
+	obs_source_tick_callback(param, obs->video.tick_seconds);
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
 	struct obs_core_data *data = &obs->data;
+	struct obs_core_video *video = &obs->video;
 	struct obs_source *source;
 	uint64_t delta_time;
 	float seconds;
 
 	if (!last_time)
-		last_time = cur_time - obs->video.video_frame_interval_ns;
+		last_time = cur_time - video->video_frame_interval_ns;
 
 	delta_time = cur_time - last_time;
 	seconds = (float)((double)delta_time / 1000000000.0);
@@ -58,29 +66,70 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	/* ------------------------------------- */
 	/* get an array of all sources to tick   */
 
+	/* only sources that are visible, tick on their own, or had something
+	 * change since the last frame are in the tick list */
 	da_clear(data->sources_to_tick);
 
-	pthread_mutex_lock(&data->sources_mutex);
+	pthread_mutex_lock(&data->tick_sources_mutex);
 
-	source = data->sources;
+	source = data->first_tick_source;
 	while (source) {
 		obs_source_t *s = obs_source_get_ref(source);
 		if (s)
 			da_push_back(data->sources_to_tick, &s);
-		source = (struct obs_source *)source->context.hh_uuid.next;
+		source = source->next_tick_source;
 	}
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	pthread_mutex_unlock(&data->tick_sources_mutex);
 
 	/* ------------------------------------- */
 	/* call the tick function of each source */
 
+	/* state changes are always handled here, but the video_tick of
+	 * sources that allow it runs on the task pool, while this thread
+	 * ticks everything else */
+	video->tick_seconds = seconds;
+
 	for (size_t i = 0; i < data->sources_to_tick.num; i++) {
 		obs_source_t *s = data->sources_to_tick.array[i];
-		obs_source_video_tick(s, seconds);
-		obs_source_release(s);
+		bool parallel = video->tick_group &&
+				(s->info.output_flags &
+				 OBS_SOURCE_PARALLEL_TICK) != 0;
+
+		obs_source_tick_state(s, seconds);
+
+		if (parallel)
+			os_task_group_queue_task(video->tick_group,
+						 tick_source_task, s);
+		else
+			obs_source_tick_callback(s, seconds);
 	}
 
+	os_task_group_join(video->tick_group);
+
+	/* ------------------------------------- */
+	/* drop sources that have gone idle      */
+
+	pthread_mutex_lock(&data->tick_sources_mutex);
+
+	for (size_t i = 0; i < data->sources_to_tick.num; i++) {
+		obs_source_t *s = data->sources_to_tick.array[i];
+
+		/* clear the flag first so that a concurrent wake either sees
+		 * it cleared and relinks the source, or changed the state
+		 * before the check below */
+		os_atomic_set_bool(&s->tick_listed, false);
+		if (obs_source_needs_tick(s))
+			os_atomic_set_bool(&s->tick_listed, true);
+		else
+			tick_list_remove(s);
+	}
+
+	pthread_mutex_unlock(&data->tick_sources_mutex);
+
+	for (size_t i = 0; i < data->sources_to_tick.num; i++)
+		obs_source_release(data->sources_to_tick.array[i]);
+
 	return cur_time;
 }
 
@@ -477,6 +526,7 @@ stage_output_texture(struct obs_core_video_mix *video, int cur_texture,
 	profile_end(stage_output_texture_name);
 }
 
+static const char *gpu_encoder_queue_name = "gpu_encoder_queue";
 static inline bool queue_frame(struct obs_core_video_mix *video,
 			       bool raw_active,
 			       struct obs_vframe_info *vframe_info)
@@ -542,6 +592,9 @@ static inline bool queue_frame(struct obs_core_video_mix *video,
 	gs_texture_release_sync(tf.tex, ++tf.lock_key);
 #endif
 	deque_push_back(&video->gpu_encoder_queue, &tf, sizeof(tf));
+	profile_trace_counter(gpu_encoder_queue_name,
+			      (int64_t)(video->gpu_encoder_queue.size /
+					sizeof(tf)));
 
 	os_sem_post(video->gpu_encode_semaphore);
 
@@ -572,6 +625,8 @@ static void output_gpu_encoders(struct obs_core_video_mix *video,
 	struct obs_vframe_info vframe_info;
 	deque_pop_front(&video->vframe_info_buffer_gpu, &vframe_info,
 			sizeof(vframe_info));
+	profile_trace_flow(obs_frame_flow_name, vframe_info.timestamp,
+			   PROFILE_FLOW_BEGIN);
 
 	pthread_mutex_lock(&video->gpu_encoder_mutex);
 	encode_gpu(video, raw_active, &vframe_info);
@@ -887,6 +942,7 @@ static inline void output_video_data(struct obs_core_video_mix *video,
 	}
 }
 
+static const char *lagged_frames_name = "lagged_frames";
 static inline void video_sleep(struct obs_core_video *video, uint64_t *p_time,
 			       uint64_t interval_ns)
 {
@@ -911,6 +967,7 @@ static inline void video_sleep(struct obs_core_video *video, uint64_t *p_time,
 
 	video->total_frames += count;
 	video->lagged_frames += count - 1;
+	profile_trace_counter(lagged_frames_name, video->lagged_frames);
 
 	vframe_info.timestamp = cur_time;
 	vframe_info.count = count;
@@ -979,6 +1036,8 @@ static inline void output_frame(struct obs_core_video_mix *video)
 
 		frame.timestamp = vframe_info.timestamp;
 		profile_start(output_frame_output_video_data_name);
+		profile_trace_flow(obs_frame_flow_name, frame.timestamp,
+				   PROFILE_FLOW_BEGIN);
 		output_video_data(video, &frame, vframe_info.count);
 		profile_end(output_frame_output_video_data_name);
 	}
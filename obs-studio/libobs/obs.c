@@ -711,6 +711,11 @@ static int obs_init_video_mix(struct obs_video_info *ovi,
 		return OBS_VIDEO_FAIL;
 	}
 
+	video_output_set_parallel_inputs(video->video,
+					 obs->video.parallel_inputs);
+	video_output_set_scale_band_height(video->video,
+					   obs->video.scale_band_height);
+
 	if (pthread_mutex_init(&video->gpu_encoder_mutex, NULL) < 0)
 		return OBS_VIDEO_FAIL;
 
@@ -753,6 +758,10 @@ static int obs_init_video(struct obs_video_info *ovi)
 	if (!obs_view_add2(&obs->data.main_view, ovi))
 		return OBS_VIDEO_FAIL;
 
+	if (os_task_pool_num_workers(obs->task_pool) > 1)
+		video->tick_group = os_task_group_create(obs->task_pool,
+							 OS_TASK_PRIORITY_VIDEO);
+
 	int errorcode;
 #ifdef __APPLE__
 	pthread_attr_t attr;
@@ -888,6 +897,9 @@ static void obs_free_video(void)
 	pthread_mutex_destroy(&obs->video.task_mutex);
 	pthread_mutex_init_value(&obs->video.task_mutex);
 	deque_free(&obs->video.tasks);
+
+	os_task_group_destroy(obs->video.tick_group);
+	obs->video.tick_group = NULL;
 }
 
 static void obs_free_graphics(void)
@@ -922,7 +934,7 @@ static void obs_free_graphics(void)
 
 static void set_audio_thread(void *unused);
 
-static bool obs_init_audio(struct audio_output_info *ai)
+static bool obs_init_audio(struct audio_output_info *ai, bool parallel)
 {
 	struct obs_core_audio *audio = &obs->audio;
 	int errorcode;
@@ -940,6 +952,10 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	audio->monitoring_device_name = bstrdup("Default");
 	audio->monitoring_device_id = bstrdup("default");
 
+	if (parallel && os_task_pool_num_workers(obs->task_pool) > 1)
+		audio->render_group = os_task_group_create(
+			obs->task_pool, OS_TASK_PRIORITY_REALTIME);
+
 	errorcode = audio_output_open(&audio->audio, ai);
 	if (errorcode == AUDIO_OUTPUT_SUCCESS)
 		return true;
@@ -967,6 +983,7 @@ static void obs_free_audio(void)
 	if (audio->audio)
 		audio_output_close(audio->audio);
 
+	os_task_group_destroy(audio->render_group);
 	deque_free(&audio->buffered_timestamps);
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
@@ -994,6 +1011,8 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init_recursive(&data->audio_sources_mutex) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->tick_sources_mutex, NULL) != 0)
+		goto fail;
 	if (pthread_mutex_init_recursive(&data->displays_mutex) != 0)
 		goto fail;
 	if (pthread_mutex_init_recursive(&data->outputs_mutex) != 0)
@@ -1078,6 +1097,7 @@ static void obs_free_data(void)
 
 	pthread_mutex_destroy(&data->sources_mutex);
 	pthread_mutex_destroy(&data->audio_sources_mutex);
+	pthread_mutex_destroy(&data->tick_sources_mutex);
 	pthread_mutex_destroy(&data->displays_mutex);
 	pthread_mutex_destroy(&data->outputs_mutex);
 	pthread_mutex_destroy(&data->encoders_mutex);
@@ -1241,6 +1261,7 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	pthread_mutex_init_value(&obs->audio.task_mutex);
 	pthread_mutex_init_value(&obs->video.task_mutex);
 	pthread_mutex_init_value(&obs->video.mixes_mutex);
+	pthread_mutex_init_value(&obs->deferred_modules_mutex);
 
 	obs->name_store_owned = !store;
 	obs->name_store = store ? store : profiler_name_store_create();
@@ -1258,6 +1279,13 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	if (!obs_init_hotkeys())
 		return false;
 
+	obs->task_pool = os_task_pool_get_shared();
+	if (!obs->task_pool)
+		return false;
+
+	if (pthread_mutex_init_recursive(&obs->deferred_modules_mutex) != 0)
+		return false;
+
 	obs->destruction_task_thread = os_task_queue_create();
 	if (!obs->destruction_task_thread)
 		return false;
@@ -1446,11 +1474,14 @@ void obs_shutdown(void)
 		module = next;
 	}
 	obs->first_module = NULL;
+	obs_free_deferred_modules();
 
 	obs_free_data();
 	obs_free_audio();
 	obs_free_video();
+	obs_packet_pool_free();
 	os_task_queue_destroy(obs->destruction_task_thread);
+	os_task_pool_release(obs->task_pool);
 	obs_free_hotkeys();
 	obs_free_graphics();
 	proc_handler_destroy(obs->procs);
@@ -1648,11 +1679,13 @@ bool obs_reset_audio2(const struct obs_audio_info2 *oai)
 	     "\tsamples per sec: %d\n"
 	     "\tspeakers:        %d\n"
 	     "\tmax buffering:   %d milliseconds\n"
-	     "\tbuffering type:  %s",
+	     "\tbuffering type:  %s\n"
+	     "\tparallel render: %s",
 	     (int)ai.samples_per_sec, (int)ai.speakers, max_buffering_ms,
-	     oai->fixed_buffering ? "fixed" : "dynamically increasing");
+	     oai->fixed_buffering ? "fixed" : "dynamically increasing",
+	     oai->parallel_render ? "enabled" : "disabled");
 
-	return obs_init_audio(&ai);
+	return obs_init_audio(&ai, oai->parallel_render);
 }
 
 bool obs_reset_audio(const struct obs_audio_info *oai)
@@ -1697,6 +1730,34 @@ void obs_set_video_levels(float sdr_white_level, float hdr_nominal_peak_level)
 	     hdr_nominal_peak_level);
 }
 
+void obs_set_video_parallel_inputs(bool enable)
+{
+	struct obs_core_video *video = &obs->video;
+
+	pthread_mutex_lock(&video->mixes_mutex);
+	video->parallel_inputs = enable;
+	for (size_t i = 0; i < video->mixes.num; i++) {
+		struct obs_core_video_mix *mix = video->mixes.array[i];
+		if (mix && mix->video)
+			video_output_set_parallel_inputs(mix->video, enable);
+	}
+	pthread_mutex_unlock(&video->mixes_mutex);
+}
+
+void obs_set_video_scale_band_height(uint32_t lines)
+{
+	struct obs_core_video *video = &obs->video;
+
+	pthread_mutex_lock(&video->mixes_mutex);
+	video->scale_band_height = lines;
+	for (size_t i = 0; i < video->mixes.num; i++) {
+		struct obs_core_video_mix *mix = video->mixes.array[i];
+		if (mix && mix->video)
+			video_output_set_scale_band_height(mix->video, lines);
+	}
+	pthread_mutex_unlock(&video->mixes_mutex);
+}
+
 bool obs_get_audio_info(struct obs_audio_info *oai)
 {
 	struct obs_core_audio *audio = &obs->audio;
@@ -1726,7 +1787,8 @@ EXPORT bool obs_get_enum_video_adapters(
 
 bool obs_enum_source_types(size_t idx, const char **id)
 {
-	if (idx >= obs->source_types.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_SOURCE);
+	if (idx >= os_atomic_load_size(&obs->source_types.num))
 		return false;
 	*id = obs->source_types.array[idx].id;
 	return true;
@@ -1734,7 +1796,8 @@ bool obs_enum_source_types(size_t idx, const char **id)
 
 bool obs_enum_input_types(size_t idx, const char **id)
 {
-	if (idx >= obs->input_types.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_SOURCE);
+	if (idx >= os_atomic_load_size(&obs->input_types.num))
 		return false;
 	*id = obs->input_types.array[idx].id;
 	return true;
@@ -1743,7 +1806,8 @@ bool obs_enum_input_types(size_t idx, const char **id)
 bool obs_enum_input_types2(size_t idx, const char **id,
 			   const char **unversioned_id)
 {
-	if (idx >= obs->input_types.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_SOURCE);
+	if (idx >= os_atomic_load_size(&obs->input_types.num))
 		return false;
 	if (id)
 		*id = obs->input_types.array[idx].id;
@@ -1760,14 +1824,20 @@ const char *obs_get_latest_input_type_id(const char *unversioned_id)
 	if (!unversioned_id)
 		return NULL;
 
-	for (size_t i = 0; i < obs->source_types.num; i++) {
-		struct obs_source_info *info = &obs->source_types.array[i];
-		if (strcmp(info->unversioned_id, unversioned_id) == 0 &&
-		    (int)info->version > version) {
-			latest = info;
-			version = info->version;
+	do {
+		size_t num = os_atomic_load_size(&obs->source_types.num);
+
+		for (size_t i = 0; i < num; i++) {
+			struct obs_source_info *info =
+				&obs->source_types.array[i];
+			if (strcmp(info->unversioned_id, unversioned_id) == 0 &&
+			    (int)info->version > version) {
+				latest = info;
+				version = info->version;
+			}
 		}
-	}
+	} while (!latest && obs_load_deferred_module_type(
+				    OBS_MODULE_TYPES_SOURCE, unversioned_id));
 
 	assert(!!latest);
 	if (!latest)
@@ -1778,7 +1848,8 @@ const char *obs_get_latest_input_type_id(const char *unversioned_id)
 
 bool obs_enum_filter_types(size_t idx, const char **id)
 {
-	if (idx >= obs->filter_types.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_SOURCE);
+	if (idx >= os_atomic_load_size(&obs->filter_types.num))
 		return false;
 	*id = obs->filter_types.array[idx].id;
 	return true;
@@ -1786,7 +1857,8 @@ bool obs_enum_filter_types(size_t idx, const char **id)
 
 bool obs_enum_transition_types(size_t idx, const char **id)
 {
-	if (idx >= obs->transition_types.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_SOURCE);
+	if (idx >= os_atomic_load_size(&obs->transition_types.num))
 		return false;
 	*id = obs->transition_types.array[idx].id;
 	return true;
@@ -1794,7 +1866,8 @@ bool obs_enum_transition_types(size_t idx, const char **id)
 
 bool obs_enum_output_types(size_t idx, const char **id)
 {
-	if (idx >= obs->output_types.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_OUTPUT);
+	if (idx >= os_atomic_load_size(&obs->output_types.num))
 		return false;
 	*id = obs->output_types.array[idx].id;
 	return true;
@@ -1802,7 +1875,8 @@ bool obs_enum_output_types(size_t idx, const char **id)
 
 bool obs_enum_encoder_types(size_t idx, const char **id)
 {
-	if (idx >= obs->encoder_types.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_ENCODER);
+	if (idx >= os_atomic_load_size(&obs->encoder_types.num))
 		return false;
 	*id = obs->encoder_types.array[idx].id;
 	return true;
@@ -1810,7 +1884,8 @@ bool obs_enum_encoder_types(size_t idx, const char **id)
 
 bool obs_enum_service_types(size_t idx, const char **id)
 {
-	if (idx >= obs->service_types.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_SERVICE);
+	if (idx >= os_atomic_load_size(&obs->service_types.num))
 		return false;
 	*id = obs->service_types.array[idx].id;
 	return true;
@@ -1835,7 +1910,7 @@ audio_t *obs_get_audio(void)
 
 video_t *obs_get_video(void)
 {
-	return obs->video.main_mix->video;
+	return obs->video.main_mix ? obs->video.main_mix->video : NULL;
 }
 
 obs_source_t *obs_get_output_source(uint32_t channel)
@@ -2301,8 +2376,8 @@ static obs_source_t *obs_load_source_type(obs_data_t *source_data,
 	const char *uuid = obs_data_get_string(source_data, "uuid");
 	const char *id = obs_data_get_string(source_data, "id");
 	const char *v_id = obs_data_get_string(source_data, "versioned_id");
-	obs_data_t *settings = obs_data_get_obj(source_data, "settings");
-	obs_data_t *hotkeys = obs_data_get_obj(source_data, "hotkeys");
+	obs_data_t *settings = obs_data_get_obj_copy(source_data, "settings");
+	obs_data_t *hotkeys = obs_data_get_obj_copy(source_data, "hotkeys");
 	double volume;
 	double balance;
 	int64_t sync;
@@ -2397,7 +2472,7 @@ static obs_source_t *obs_load_source_type(obs_data_t *source_data,
 
 	obs_data_release(source->private_settings);
 	source->private_settings =
-		obs_data_get_obj(source_data, "private_settings");
+		obs_data_get_obj_copy(source_data, "private_settings");
 	if (!source->private_settings)
 		source->private_settings = obs_data_create();
 
@@ -3437,6 +3512,11 @@ bool obs_wait_for_destroy_queue(void)
 	return os_task_queue_wait(obs->destruction_task_thread);
 }
 
+os_task_pool_t *obs_get_task_pool(void)
+{
+	return obs ? obs->task_pool : NULL;
+}
+
 static void set_ui_thread(void *unused)
 {
 	is_ui_thread = true;
@@ -3526,7 +3606,10 @@ bool obs_weak_object_references_object(obs_weak_object_t *weak,
 
 bool obs_is_output_protocol_registered(const char *protocol)
 {
-	for (size_t i = 0; i < obs->data.protocols.num; i++) {
+	obs_load_deferred_modules(OBS_MODULE_TYPES_OUTPUT);
+	size_t num = os_atomic_load_size(&obs->data.protocols.num);
+
+	for (size_t i = 0; i < num; i++) {
 		if (strcmp(protocol, obs->data.protocols.array[i]) == 0)
 			return true;
 	}
@@ -3536,7 +3619,8 @@ bool obs_is_output_protocol_registered(const char *protocol)
 
 bool obs_enum_output_protocols(size_t idx, char **protocol)
 {
-	if (idx >= obs->data.protocols.num)
+	obs_load_deferred_modules(OBS_MODULE_TYPES_OUTPUT);
+	if (idx >= os_atomic_load_size(&obs->data.protocols.num))
 		return false;
 
 	*protocol = obs->data.protocols.array[idx];
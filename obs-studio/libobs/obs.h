@@ -21,6 +21,7 @@
 #include "util/bmem.h"
 #include "util/profiler.h"
 #include "util/text-lookup.h"
+#include "util/task.h"
 #include "graphics/graphics.h"
 #include "graphics/vec2.h"
 #include "graphics/vec3.h"
@@ -220,6 +221,9 @@ struct obs_audio_info2 {
 
 	uint32_t max_buffering_ms;
 	bool fixed_buffering;
+
+	/* renders large runs of independent sources on the task pool */
+	bool parallel_render;
 };
 
 /**
@@ -448,6 +452,21 @@ EXPORT float obs_get_video_hdr_nominal_peak_level(void);
 EXPORT void obs_set_video_levels(float sdr_white_level,
 				 float hdr_nominal_peak_level);
 
+/**
+ * Converts and feeds raw encoders that use different scales or formats on
+ * their own threads, so one slow encoder doesn't hold back the others.  Off
+ * by default, applies to encoders connected afterwards.
+ */
+EXPORT void obs_set_video_parallel_inputs(bool enable);
+
+/**
+ * Splits each frame scaled for a raw encoder into bands of about this many
+ * output lines and scales them in parallel on the shared task pool.  0 (the
+ * default) scales on a single thread, applies to encoders connected
+ * afterwards.
+ */
+EXPORT void obs_set_video_scale_band_height(uint32_t lines);
+
 /** Gets the current audio settings, returns false if no audio */
 EXPORT bool obs_get_audio_info(struct obs_audio_info *oai);
 
@@ -553,6 +572,19 @@ struct obs_module_failure_info {
 EXPORT void obs_module_failure_info_free(struct obs_module_failure_info *mfi);
 EXPORT void obs_load_all_modules2(struct obs_module_failure_info *mfi);
 
+/**
+ * Defers loading modules until they are used.  The ids of the types each
+ * module registers are cached in the manifest file at manifest_path, which is
+ * updated by every obs_load_all_modules call.  Bundled modules known to only
+ * register types in obs_module_load are then skipped if they registered
+ * sources, outputs, encoders or services the last time they were loaded and
+ * have no obs_module_post_load, and loaded the first time one of their types
+ * is looked up or enumerated.
+ *
+ * Must be called before obs_load_all_modules, NULL disables deferring.
+ */
+EXPORT void obs_defer_module_loading(const char *manifest_path);
+
 /** Notifies modules that all modules have been loaded.  This function should
  * be called after all modules have been loaded. */
 EXPORT void obs_post_load_modules(void);
@@ -921,6 +953,9 @@ EXPORT bool obs_in_task_thread(enum obs_task_type type);
 
 EXPORT bool obs_wait_for_destroy_queue(void);
 
+/* Shared work-stealing pool for parallel work inside libobs and plugins */
+EXPORT os_task_pool_t *obs_get_task_pool(void);
+
 typedef void (*obs_task_handler_t)(obs_task_t task, void *param, bool wait);
 EXPORT void obs_set_ui_task_handler(obs_task_handler_t handler);
 
@@ -1466,6 +1501,22 @@ EXPORT void obs_source_output_video(obs_source_t *source,
 EXPORT void obs_source_output_video2(obs_source_t *source,
 				     const struct obs_source_frame2 *frame);
 
+/**
+ * Outputs asynchronous video data without copying it.  The frame data stays
+ * owned by the caller and must remain valid until release is called, once the
+ * frame has been rendered or dropped.  release may be called on any thread
+ * while the source's frame lock is held, so it must not call back into the
+ * source.  If the frame can't be queued, release is called before returning.
+ *
+ * Frames can be held for a while (buffering, deinterlacing), so the caller
+ * should fall back to obs_source_output_video when it runs low on buffers
+ * rather than waiting for a release.  Frames are copied before they reach
+ * async filters, which may hold on to them indefinitely.
+ */
+EXPORT void obs_source_lend_video(obs_source_t *source,
+				  const struct obs_source_frame *frame,
+				  void (*release)(void *param), void *param);
+
 EXPORT void obs_source_set_async_rotation(obs_source_t *source, long rotation);
 
 EXPORT void obs_source_output_cea708(obs_source_t *source,
@@ -2688,6 +2739,28 @@ EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
 				   struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+/**
+ * Allocates packet->data from the encoder packet pool and sets packet->size.
+ *
+ * When called from an encoder's encode callback, the packet returned by that
+ * call is handed to outputs without being copied and libobs releases it
+ * afterwards, so the encoder must not use the data once encode returns.
+ * Otherwise the packet is released with obs_encoder_packet_release.
+ */
+EXPORT uint8_t *obs_encoder_packet_alloc(struct encoder_packet *packet,
+					 size_t size);
+
+/**
+ * Sends an already encoded packet to the outputs of a started encoder as if
+ * its encode callback had returned it, e.g. to drive outputs with synthetic
+ * packets.  The packet's type, pts, dts and keyframe flag must be set, the
+ * encoder and timebase are filled in from the encoder.  Data allocated with
+ * obs_encoder_packet_alloc on the calling thread is handed over and released
+ * by libobs, any other data is copied by the outputs that keep it.
+ */
+EXPORT void obs_encoder_send_packet(obs_encoder_t *encoder,
+				    struct encoder_packet *packet);
+
 EXPORT void *obs_encoder_create_rerouted(obs_encoder_t *encoder,
 					 const char *reroute_id);
 
@@ -18,6 +18,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
 #include <spawn.h>
 
 #include "bmem.h"
@@ -105,6 +106,9 @@ os_process_pipe_t *os_process_pipe_create(const char *cmd_line,
 
 	close(errfds[1]);
 	process_pipe.err_file = fdopen(errfds[0], "r");
+	/* unbuffered so that os_process_pipe_wait_err can poll the fd */
+	if (process_pipe.err_file)
+		setvbuf(process_pipe.err_file, NULL, _IONBF, 0);
 
 	if (process_pipe.read_pipe) {
 		close(mainfds[1]);
@@ -168,6 +172,26 @@ size_t os_process_pipe_read_err(os_process_pipe_t *pp, uint8_t *data,
 	return fread(data, 1, len, pp->err_file);
 }
 
+bool os_process_pipe_wait_err(os_process_pipe_t *pp, uint32_t timeout_ms)
+{
+	struct pollfd pfd;
+	int ret;
+
+	if (!pp || !pp->err_file) {
+		return true;
+	}
+
+	pfd.fd = fileno(pp->err_file);
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	do {
+		ret = poll(&pfd, 1, (int)timeout_ms);
+	} while (ret == -1 && errno == EINTR);
+
+	return ret != 0;
+}
+
 size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 			     size_t len)
 {
@@ -188,3 +212,15 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 	}
 	return written;
 }
+
+bool os_process_pipe_flush(os_process_pipe_t *pp)
+{
+	if (!pp) {
+		return false;
+	}
+	if (pp->read_pipe) {
+		return false;
+	}
+
+	return fflush(pp->file) == 0;
+}
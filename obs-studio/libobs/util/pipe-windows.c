@@ -239,6 +239,28 @@ size_t os_process_pipe_read_err(os_process_pipe_t *pp, uint8_t *data,
 	return 0;
 }
 
+bool os_process_pipe_wait_err(os_process_pipe_t *pp, uint32_t timeout_ms)
+{
+	uint64_t deadline;
+	DWORD avail;
+
+	if (!pp || !pp->handle_err) {
+		return true;
+	}
+
+	/* anonymous pipes can't be waited on, so peek until data arrives */
+	deadline = os_gettime_ns() + (uint64_t)timeout_ms * 1000000ULL;
+	for (;;) {
+		if (!PeekNamedPipe(pp->handle_err, NULL, 0, NULL, &avail,
+				   NULL) ||
+		    avail > 0)
+			return true;
+		if (os_gettime_ns() >= deadline)
+			return false;
+		Sleep(1);
+	}
+}
+
 size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 			     size_t len)
 {
@@ -261,6 +283,16 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 	return 0;
 }
 
+bool os_process_pipe_flush(os_process_pipe_t *pp)
+{
+	if (!pp) {
+		return false;
+	}
+
+	/* WriteFile is unbuffered, there is nothing left to push */
+	return !pp->read_pipe;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // ASCENT_EDIT_START: Carried over (empty)
 
@@ -35,8 +35,14 @@ EXPORT size_t os_process_pipe_read(os_process_pipe_t *pp, uint8_t *data,
 				   size_t len);
 EXPORT size_t os_process_pipe_read_err(os_process_pipe_t *pp, uint8_t *data,
 				       size_t len);
+/* Waits up to timeout_ms for the process to write to stderr.  Returns true
+ * when os_process_pipe_read_err can be called without blocking (data is
+ * available or the pipe was closed), false on timeout. */
+EXPORT bool os_process_pipe_wait_err(os_process_pipe_t *pp,
+				     uint32_t timeout_ms);
 EXPORT size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 				    size_t len);
+EXPORT bool os_process_pipe_flush(os_process_pipe_t *pp);
 #ifdef _WIN32
 
 struct ipc_pipe_server;
@@ -62,6 +62,10 @@ static inline uint32_t get_winver(void)
 	return winver;
 }
 
+/* SetDllDirectory is process-wide, so modules opened from several threads at
+ * once have to take turns */
+static SRWLOCK dll_directory_lock = SRWLOCK_INIT;
+
 void *os_dlopen(const char *path)
 {
 	struct dstr dll_name;
@@ -83,6 +87,8 @@ void *os_dlopen(const char *path)
 	/* to make module dependency issues easier to deal with, allow
 	 * dynamically loaded libraries on windows to search for dependent
 	 * libraries that are within the library's own directory */
+	AcquireSRWLockExclusive(&dll_directory_lock);
+
 	wpath_slash = wcsrchr(wpath, L'/');
 	if (wpath_slash) {
 		*wpath_slash = 0;
@@ -97,6 +103,8 @@ void *os_dlopen(const char *path)
 	if (wpath_slash)
 		SetDllDirectoryW(NULL);
 
+	ReleaseSRWLockExclusive(&dll_directory_lock);
+
 	if (!h_library) {
 		DWORD error = GetLastError();
 
@@ -365,8 +365,242 @@ static void merge_context(profile_call *context)
 	free_call_context(prev_call);
 }
 
+/* ------------------------------------------------------------------------- */
+/* Trace recording */
+
+#define TRACE_DEFAULT_EVENTS (1 << 16)
+#define TRACE_MIN_EVENTS (1 << 8)
+#define TRACE_MAX_EVENTS (1 << 24)
+#define TRACE_THREAD_NAME_SIZE 64
+
+enum trace_event_type {
+	TRACE_EVENT_BEGIN,
+	TRACE_EVENT_END,
+	TRACE_EVENT_INSTANT,
+	TRACE_EVENT_COUNTER,
+	TRACE_EVENT_FLOW_BEGIN,
+	TRACE_EVENT_FLOW_STEP,
+	TRACE_EVENT_FLOW_END,
+};
+
+struct trace_event {
+	const char *name;
+	uint64_t time;
+	uint64_t value;
+	enum trace_event_type type;
+};
+
+/* Single producer ring, only ever written by its own thread.  The writer
+ * announces a slot in 'reserved' before overwriting it and publishes it in
+ * 'written' afterwards, so a reader can copy the ring at any time and drop
+ * whatever was overwritten while it was copying. */
+struct trace_buffer {
+	struct trace_event *events;
+	uint32_t mask;
+	uint32_t next;
+	volatile long reserved;
+	volatile long written;
+	volatile bool full;
+
+	uint32_t tid;
+	char thread_name[TRACE_THREAD_NAME_SIZE];
+	bool retired;
+	struct trace_buffer *next_buffer;
+};
+
+static volatile bool trace_enabled = false;
+static volatile long trace_generation = 0;
+static long trace_valid_generation = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buffer *trace_buffers = NULL;
+static uint32_t trace_capacity = TRACE_DEFAULT_EVENTS;
+static uint32_t trace_next_tid = 1;
+static uint64_t trace_start_time = 0;
+
+/* threads currently inside trace_record, profiler_free waits for them */
+static volatile long trace_recorders = 0;
+
+static pthread_once_t trace_key_init_token = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+static THREAD_LOCAL struct trace_buffer *thread_trace = NULL;
+static THREAD_LOCAL long thread_trace_generation = -1;
+static THREAD_LOCAL char thread_trace_name[TRACE_THREAD_NAME_SIZE];
+
+static void copy_thread_name(char *dst, const char *name)
+{
+	strncpy(dst, name ? name : "", TRACE_THREAD_NAME_SIZE - 1);
+	dst[TRACE_THREAD_NAME_SIZE - 1] = 0;
+}
+
+static inline bool thread_trace_valid(void)
+{
+	return thread_trace &&
+	       thread_trace_generation >= trace_valid_generation;
+}
+
+/* Called on thread exit.  The buffer of the thread stays in the list so its
+ * events can still be dumped, until a new thread takes it over. */
+static void retire_trace_buffer(void *unused)
+{
+	pthread_mutex_lock(&trace_mutex);
+	if (thread_trace_valid())
+		thread_trace->retired = true;
+	pthread_mutex_unlock(&trace_mutex);
+
+	thread_trace = NULL;
+	UNUSED_PARAMETER(unused);
+}
+
+static void init_trace_key(void)
+{
+	pthread_key_create(&trace_key, retire_trace_buffer);
+}
+
+static struct trace_buffer *find_retired_buffer(void)
+{
+	for (struct trace_buffer *buf = trace_buffers; buf;
+	     buf = buf->next_buffer) {
+		if (buf->retired && buf->mask + 1 == trace_capacity)
+			return buf;
+	}
+
+	return NULL;
+}
+
+static struct trace_buffer *create_trace_buffer(void)
+{
+	struct trace_buffer *buf = find_retired_buffer();
+
+	if (buf) {
+		buf->next = 0;
+		buf->reserved = 0;
+		buf->written = 0;
+		buf->full = false;
+		buf->retired = false;
+		return buf;
+	}
+
+	buf = bzalloc(sizeof(*buf));
+	buf->events = bmalloc(sizeof(struct trace_event) * trace_capacity);
+	buf->mask = trace_capacity - 1;
+
+	buf->next_buffer = trace_buffers;
+	trace_buffers = buf;
+	return buf;
+}
+
+/* Buffers are only freed by profiler_free once nothing is recording, so a
+ * thread can keep using its buffer without synchronization.  A buffer is
+ * replaced when the trace is restarted with a different size, the old one
+ * stays in the list so its events can still be dumped.  Buffers of threads
+ * that exited are reused by new threads, so short lived threads don't each
+ * leave a buffer behind. */
+static struct trace_buffer *get_trace_buffer(void)
+{
+	struct trace_buffer *buf = thread_trace;
+	long generation = os_atomic_load_long(&trace_generation);
+
+	if (buf && thread_trace_generation == generation)
+		return buf;
+
+	pthread_mutex_lock(&trace_mutex);
+
+	if (!thread_trace_valid())
+		buf = NULL;
+
+	if (!buf || buf->mask + 1 != trace_capacity) {
+		struct trace_buffer *new_buf = create_trace_buffer();
+		new_buf->tid = buf ? buf->tid : trace_next_tid++;
+		copy_thread_name(new_buf->thread_name, thread_trace_name);
+
+		if (buf)
+			buf->retired = true;
+		thread_trace = buf = new_buf;
+	}
+
+	thread_trace_generation = generation;
+
+	pthread_mutex_unlock(&trace_mutex);
+
+	pthread_once(&trace_key_init_token, init_trace_key);
+	pthread_setspecific(trace_key, buf);
+	return buf;
+}
+
+static void write_trace_event(enum trace_event_type type, const char *name,
+			      uint64_t value)
+{
+	struct trace_buffer *buf = get_trace_buffer();
+	uint32_t idx = buf->next++;
+	struct trace_event *event = &buf->events[idx & buf->mask];
+
+	os_atomic_set_long(&buf->reserved, (long)(idx + 1));
+
+	event->name = name;
+	event->time = os_gettime_ns();
+	event->value = value;
+	event->type = type;
+
+	os_atomic_set_long(&buf->written, (long)(idx + 1));
+	if (idx == buf->mask)
+		os_atomic_set_bool(&buf->full, true);
+}
+
+static void trace_record(enum trace_event_type type, const char *name,
+			 uint64_t value)
+{
+	if (!os_atomic_load_bool(&trace_enabled))
+		return;
+
+	os_atomic_inc_long(&trace_recorders);
+	if (os_atomic_load_bool(&trace_enabled))
+		write_trace_event(type, name, value);
+	os_atomic_dec_long(&trace_recorders);
+}
+
+void profile_trace_counter(const char *name, int64_t value)
+{
+	trace_record(TRACE_EVENT_COUNTER, name, (uint64_t)value);
+}
+
+void profile_trace_instant(const char *name)
+{
+	trace_record(TRACE_EVENT_INSTANT, name, 0);
+}
+
+void profile_trace_flow(const char *name, uint64_t id,
+			enum profile_flow_step step)
+{
+	enum trace_event_type type = step == PROFILE_FLOW_BEGIN
+					     ? TRACE_EVENT_FLOW_BEGIN
+				     : step == PROFILE_FLOW_STEP
+					     ? TRACE_EVENT_FLOW_STEP
+					     : TRACE_EVENT_FLOW_END;
+	trace_record(type, name, id);
+}
+
+void profile_trace_set_thread_name(const char *name)
+{
+	copy_thread_name(thread_trace_name, name);
+
+	if (thread_trace) {
+		pthread_mutex_lock(&trace_mutex);
+		if (thread_trace_valid())
+			copy_thread_name(thread_trace->thread_name, name);
+		pthread_mutex_unlock(&trace_mutex);
+	}
+}
+
+bool profiler_trace_active(void)
+{
+	return os_atomic_load_bool(&trace_enabled);
+}
+
 void profile_start(const char *name)
 {
+	trace_record(TRACE_EVENT_BEGIN, name, 0);
+
 	if (!thread_enabled)
 		return;
 
@@ -395,6 +629,8 @@ void profile_start(const char *name)
 void profile_end(const char *name)
 {
 	uint64_t end = os_gettime_ns();
+	trace_record(TRACE_EVENT_END, name, 0);
+
 	if (!thread_enabled)
 		return;
 
@@ -827,6 +1063,27 @@ void profiler_free(void)
 	da_free(old_root_entries);
 
 	pthread_mutex_destroy(&root_mutex);
+
+	/* threads that still hold a buffer drop it on their next event, but the
+	 * ones recording right now have to finish before the buffers go */
+	os_atomic_set_bool(&trace_enabled, false);
+	while (os_atomic_load_long(&trace_recorders))
+		os_sleep_ms(0);
+
+	pthread_mutex_lock(&trace_mutex);
+	struct trace_buffer *buf = trace_buffers;
+	trace_buffers = NULL;
+	trace_valid_generation = os_atomic_inc_long(&trace_generation);
+	pthread_mutex_unlock(&trace_mutex);
+
+	while (buf) {
+		struct trace_buffer *next = buf->next_buffer;
+		bfree(buf->events);
+		bfree(buf);
+		buf = next;
+	}
+
+	thread_trace = NULL;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -969,11 +1226,11 @@ void profile_snapshot_free(profiler_snapshot_t *snap)
 	bfree(snap);
 }
 
-typedef void (*dump_csv_func)(void *data, struct dstr *buffer);
+typedef void (*dump_func)(void *data, struct dstr *buffer);
 static void entry_dump_csv(struct dstr *buffer,
 			   const profiler_snapshot_entry_t *parent,
 			   const profiler_snapshot_entry_t *entry,
-			   dump_csv_func func, void *data)
+			   dump_func func, void *data)
 {
 	const char *parent_name = parent ? parent->name : NULL;
 
@@ -1004,7 +1261,7 @@ static void entry_dump_csv(struct dstr *buffer,
 }
 
 static void profiler_snapshot_dump(const profiler_snapshot_t *snap,
-				   dump_csv_func func, void *data)
+				   dump_func func, void *data)
 {
 	struct dstr buffer = {0};
 
@@ -1019,7 +1276,7 @@ static void profiler_snapshot_dump(const profiler_snapshot_t *snap,
 	dstr_free(&buffer);
 }
 
-static void dump_csv_fwrite(void *data, struct dstr *buffer)
+static void dump_fwrite(void *data, struct dstr *buffer)
 {
 	fwrite(buffer->array, 1, buffer->len, data);
 }
@@ -1031,19 +1288,18 @@ bool profiler_snapshot_dump_csv(const profiler_snapshot_t *snap,
 	if (!f)
 		return false;
 
-	profiler_snapshot_dump(snap, dump_csv_fwrite, f);
+	profiler_snapshot_dump(snap, dump_fwrite, f);
 
 	fclose(f);
 	return true;
 }
 
-static void dump_csv_gzwrite(void *data, struct dstr *buffer)
+static void dump_gzwrite(void *data, struct dstr *buffer)
 {
 	gzwrite(data, buffer->array, (unsigned)buffer->len);
 }
 
-bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap,
-				   const char *filename)
+static gzFile dump_gzopen(const char *filename)
 {
 	gzFile gz;
 #ifdef _WIN32
@@ -1051,23 +1307,229 @@ bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap,
 
 	os_utf8_to_wcs_ptr(filename, 0, &filename_w);
 	if (!filename_w)
-		return false;
+		return NULL;
 
 	gz = gzopen_w(filename_w, "wb");
 	bfree(filename_w);
 #else
 	gz = gzopen(filename, "wb");
 #endif
-	if (!gz)
-		return false;
-
-	profiler_snapshot_dump(snap, dump_csv_gzwrite, gz);
+	return gz;
+}
 
+static void dump_gzclose(gzFile gz)
+{
 #ifdef _WIN32
 	gzclose_w(gz);
 #else
 	gzclose(gz);
 #endif
+}
+
+bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap,
+				   const char *filename)
+{
+	gzFile gz = dump_gzopen(filename);
+	if (!gz)
+		return false;
+
+	profiler_snapshot_dump(snap, dump_gzwrite, gz);
+
+	dump_gzclose(gz);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Trace control and export */
+
+void profiler_trace_start(size_t events_per_thread)
+{
+	uint32_t capacity = TRACE_MIN_EVENTS;
+
+	if (!events_per_thread)
+		events_per_thread = TRACE_DEFAULT_EVENTS;
+	while (capacity < events_per_thread && capacity < TRACE_MAX_EVENTS)
+		capacity <<= 1;
+
+	pthread_mutex_lock(&trace_mutex);
+	trace_capacity = capacity;
+	trace_start_time = os_gettime_ns();
+	os_atomic_inc_long(&trace_generation);
+	os_atomic_set_bool(&trace_enabled, true);
+	pthread_mutex_unlock(&trace_mutex);
+}
+
+void profiler_trace_stop(void)
+{
+	os_atomic_set_bool(&trace_enabled, false);
+}
+
+struct trace_thread {
+	uint32_t tid;
+	char name[TRACE_THREAD_NAME_SIZE];
+	struct trace_event *events;
+	size_t num;
+};
+
+/* read-modify-write, keeps the event copies from being reordered past it */
+static uint32_t trace_load_reserved(struct trace_buffer *buf)
+{
+	long val = os_atomic_load_long(&buf->reserved);
+	while (!os_atomic_compare_exchange_long(&buf->reserved, &val, val))
+		;
+	return (uint32_t)val;
+}
+
+static void trace_copy_buffer(struct trace_buffer *buf,
+			      struct trace_thread *thread)
+{
+	uint32_t capacity = buf->mask + 1;
+	uint32_t end = (uint32_t)os_atomic_load_long(&buf->written);
+	uint32_t count = os_atomic_load_bool(&buf->full) ? capacity : end;
+	uint32_t start = end - count;
+
+	thread->tid = buf->tid;
+	memcpy(thread->name, buf->thread_name, sizeof(thread->name));
+	thread->events = bmalloc(sizeof(struct trace_event) * count);
+
+	for (uint32_t i = 0; i < count; i++)
+		thread->events[i] = buf->events[(start + i) & buf->mask];
+
+	/* slots the writer started reusing while they were being copied */
+	uint32_t lost = trace_load_reserved(buf) - start;
+	lost = lost > capacity ? lost - capacity : 0;
+	if (lost > count)
+		lost = count;
+
+	memmove(thread->events, thread->events + lost,
+		sizeof(struct trace_event) * (count - lost));
+	thread->num = count - lost;
+}
+
+static void trace_cat_string(struct dstr *buffer, const char *str)
+{
+	dstr_cat_ch(buffer, '"');
+
+	for (const char *ch = str ? str : ""; *ch; ch++) {
+		if (*ch == '"' || *ch == '\\') {
+			dstr_cat_ch(buffer, '\\');
+			dstr_cat_ch(buffer, *ch);
+		} else if ((unsigned char)*ch < 0x20) {
+			dstr_catf(buffer, "\\u%04x", (unsigned char)*ch);
+		} else {
+			dstr_cat_ch(buffer, *ch);
+		}
+	}
+
+	dstr_cat_ch(buffer, '"');
+}
+
+static void trace_dump_event(struct dstr *buffer, uint32_t tid,
+			     const struct trace_event *event)
+{
+	static const char *phases[] = {"B", "E", "i", "C", "s", "t", "f"};
+
+	dstr_printf(buffer, ",\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%" PRIu32
+			    ",\"ts\":%" PRIu64 ".%03d,\"name\":",
+		    phases[event->type], tid, event->time / 1000,
+		    (int)(event->time % 1000));
+	trace_cat_string(buffer, event->name);
+
+	switch (event->type) {
+	case TRACE_EVENT_INSTANT:
+		dstr_cat(buffer, ",\"s\":\"t\"");
+		break;
+	case TRACE_EVENT_COUNTER:
+		dstr_catf(buffer, ",\"args\":{\"value\":%" PRId64 "}",
+			  (int64_t)event->value);
+		break;
+	case TRACE_EVENT_FLOW_END:
+		dstr_cat(buffer, ",\"bp\":\"e\"");
+		/* fall through */
+	case TRACE_EVENT_FLOW_BEGIN:
+	case TRACE_EVENT_FLOW_STEP:
+		dstr_catf(buffer, ",\"cat\":\"flow\",\"id\":\"0x%" PRIx64 "\"",
+			  event->value);
+		break;
+	default:
+		break;
+	}
+
+	dstr_cat_ch(buffer, '}');
+}
+
+static void profiler_trace_dump(dump_func func, void *data)
+{
+	DARRAY(struct trace_thread) threads = {0};
+	struct dstr buffer = {0};
+	uint64_t start_time;
+
+	pthread_mutex_lock(&trace_mutex);
+	start_time = trace_start_time;
+	for (struct trace_buffer *buf = trace_buffers; buf;
+	     buf = buf->next_buffer)
+		trace_copy_buffer(buf, da_push_back_new(threads));
+	pthread_mutex_unlock(&trace_mutex);
+
+	dstr_copy(&buffer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+			   "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+			   "\"args\":{\"name\":\"obs\"}}");
+	func(data, &buffer);
+
+	for (size_t i = 0; i < threads.num; i++) {
+		struct trace_thread *thread = &threads.array[i];
+
+		if (*thread->name) {
+			dstr_printf(&buffer,
+				    ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%" PRIu32
+				    ",\"name\":\"thread_name\",\"args\":"
+				    "{\"name\":",
+				    thread->tid);
+			trace_cat_string(&buffer, thread->name);
+			dstr_cat(&buffer, "}}");
+			func(data, &buffer);
+		}
+
+		for (size_t j = 0; j < thread->num; j++) {
+			if (thread->events[j].time < start_time)
+				continue;
+
+			trace_dump_event(&buffer, thread->tid,
+					 &thread->events[j]);
+			func(data, &buffer);
+		}
+
+		bfree(thread->events);
+	}
+
+	dstr_copy(&buffer, "\n]}\n");
+	func(data, &buffer);
+
+	dstr_free(&buffer);
+	da_free(threads);
+}
+
+bool profiler_trace_dump_json(const char *filename)
+{
+	FILE *f = os_fopen(filename, "wb+");
+	if (!f)
+		return false;
+
+	profiler_trace_dump(dump_fwrite, f);
+
+	fclose(f);
+	return true;
+}
+
+bool profiler_trace_dump_json_gz(const char *filename)
+{
+	gzFile gz = dump_gzopen(filename);
+	if (!gz)
+		return false;
+
+	profiler_trace_dump(dump_gzwrite, gz);
+
+	dump_gzclose(gz);
 	return true;
 }
 
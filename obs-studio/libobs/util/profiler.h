@@ -33,6 +33,40 @@ EXPORT void profiler_print_time_between_calls(profiler_snapshot_t *snap);
 
 EXPORT void profiler_free(void);
 
+/* ------------------------------------------------------------------------- */
+/* Trace recording
+ *
+ * While trace recording is active, profile_start/profile_end and the trace
+ * calls below are stored as timestamped events in a fixed-size ring buffer
+ * per thread, without taking any locks.  The buffer of a thread that exits
+ * is reused by the next thread that starts recording, so the events of an
+ * exited thread are only kept until then.  Names have to stay valid until
+ * the trace has been dumped, same as with profile_start. */
+
+enum profile_flow_step {
+	PROFILE_FLOW_BEGIN,
+	PROFILE_FLOW_STEP,
+	PROFILE_FLOW_END,
+};
+
+/* events_per_thread is rounded up to a power of two, 0 uses the default */
+EXPORT void profiler_trace_start(size_t events_per_thread);
+EXPORT void profiler_trace_stop(void);
+EXPORT bool profiler_trace_active(void);
+
+EXPORT void profile_trace_counter(const char *name, int64_t value);
+EXPORT void profile_trace_instant(const char *name);
+/* Connects the enclosing profile_start scopes of different threads that
+ * handle the same id, e.g. a frame timestamp from render to output */
+EXPORT void profile_trace_flow(const char *name, uint64_t id,
+			       enum profile_flow_step step);
+EXPORT void profile_trace_set_thread_name(const char *name);
+
+/* Writes the recorded events in the Chrome trace event format, which can be
+ * loaded by Perfetto and chrome://tracing.  Safe to call while recording. */
+EXPORT bool profiler_trace_dump_json(const char *filename);
+EXPORT bool profiler_trace_dump_json_gz(const char *filename);
+
 /* ------------------------------------------------------------------------- */
 /* Profiler name storage */
 
@@ -1,13 +1,462 @@
 #include "task.h"
 #include "bmem.h"
 #include "threading.h"
+#include "platform.h"
 #include "deque.h"
 
-struct os_task_queue {
+/* ------------------------------------------------------------------------- */
+/* work-stealing pool                                                        */
+
+/* per-worker deque capacity, tasks overflow into the shared queue */
+#define WORKER_DEQUE_SIZE 256
+#define WORKER_DEQUE_MASK (WORKER_DEQUE_SIZE - 1)
+
+#define PRIORITY_COUNT (OS_TASK_PRIORITY_BACKGROUND + 1)
+
+struct os_task_item {
+	os_task_t task;
+	void *param;
+	struct os_task_group *group;
+};
+
+/* Chase-Lev deque: the owning worker pushes and pops at the bottom, other
+ * threads steal from the top.  Indices only ever increase and are compared
+ * through their unsigned difference, so wrapping around is harmless. */
+struct task_deque {
+	volatile long top;
+	volatile long bottom;
+	struct os_task_item items[WORKER_DEQUE_SIZE];
+};
+
+struct task_worker {
+	struct os_task_pool *pool;
+	size_t index;
 	pthread_t thread;
+	struct task_deque deques[PRIORITY_COUNT];
+};
+
+struct os_task_pool {
+	volatile long refs;
+	volatile bool stop;
+
+	struct task_worker *workers;
+	size_t num_workers;
 	os_sem_t *sem;
+
+	/* background tasks can hold up to this many workers at once, so that
+	 * blocking I/O never starves realtime and video tasks */
+	long max_background;
+	volatile long background_running;
+
+	/* tasks queued from outside the pool or from full worker deques */
+	pthread_mutex_t shared_mutex;
+	struct deque shared[PRIORITY_COUNT];
+};
+
+struct os_task_group {
+	struct os_task_pool *pool;
+	enum os_task_priority priority;
+
+	/* done is broadcast once nothing is pending, so any number of threads
+	 * can join at the same time */
+	pthread_mutex_t mutex;
+	pthread_cond_t done;
+	long pending;
+};
+
+static THREAD_LOCAL struct task_worker *current_worker = NULL;
+
+static pthread_mutex_t shared_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct os_task_pool *shared_pool = NULL;
+
+static inline long index_diff(long a, long b)
+{
+	return (long)((unsigned long)a - (unsigned long)b);
+}
+
+static inline long index_add(long a, long b)
+{
+	return (long)((unsigned long)a + (unsigned long)b);
+}
+
+static bool task_deque_push(struct task_deque *d,
+			    const struct os_task_item *item)
+{
+	long b = os_atomic_load_long(&d->bottom);
+	long t = os_atomic_load_long(&d->top);
+
+	if (index_diff(b, t) >= WORKER_DEQUE_SIZE)
+		return false;
+
+	d->items[(unsigned long)b & WORKER_DEQUE_MASK] = *item;
+	os_atomic_store_long(&d->bottom, index_add(b, 1));
+	return true;
+}
+
+static bool task_deque_pop(struct task_deque *d, struct os_task_item *item)
+{
+	long b = index_add(os_atomic_load_long(&d->bottom), -1);
+	long t;
+
+	os_atomic_set_long(&d->bottom, b);
+	t = os_atomic_load_long(&d->top);
+
+	if (index_diff(b, t) < 0) {
+		os_atomic_store_long(&d->bottom, index_add(b, 1));
+		return false;
+	}
+
+	*item = d->items[(unsigned long)b & WORKER_DEQUE_MASK];
+	if (b != t)
+		return true;
+
+	/* last item, race any thieves for it */
+	bool won = os_atomic_compare_swap_long(&d->top, t, index_add(t, 1));
+	os_atomic_store_long(&d->bottom, index_add(t, 1));
+	return won;
+}
+
+static bool task_deque_steal(struct task_deque *d, struct os_task_item *item)
+{
+	long t = os_atomic_load_long(&d->top);
+	long b = os_atomic_load_long(&d->bottom);
+
+	if (index_diff(b, t) <= 0)
+		return false;
+
+	*item = d->items[(unsigned long)t & WORKER_DEQUE_MASK];
+	return os_atomic_compare_swap_long(&d->top, t, index_add(t, 1));
+}
+
+static bool pop_shared(struct os_task_pool *pool, size_t priority,
+		       struct os_task_item *item)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&pool->shared_mutex);
+	if (pool->shared[priority].size) {
+		deque_pop_front(&pool->shared[priority], item, sizeof(*item));
+		found = true;
+	}
+	pthread_mutex_unlock(&pool->shared_mutex);
+	return found;
+}
+
+static bool find_task_priority(struct os_task_pool *pool,
+			       struct task_worker *self, size_t priority,
+			       struct os_task_item *item)
+{
+	if (self && task_deque_pop(&self->deques[priority], item))
+		return true;
+	if (pop_shared(pool, priority, item))
+		return true;
+
+	size_t start = self ? self->index + 1 : 0;
+	for (size_t i = 0; i < pool->num_workers; i++) {
+		struct task_worker *victim =
+			&pool->workers[(start + i) % pool->num_workers];
+		if (victim != self &&
+		    task_deque_steal(&victim->deques[priority], item))
+			return true;
+	}
+
+	return false;
+}
+
+/* Returns the priority of the task found, or -1.  Idle workers respect the
+ * background limit, a worker helping out inside a join already holds its own
+ * slot and may run anything. */
+static int find_task(struct os_task_pool *pool, struct task_worker *self,
+		     bool helping, struct os_task_item *item)
+{
+	for (size_t priority = 0; priority < PRIORITY_COUNT; priority++) {
+		bool limited = !helping &&
+			       priority == OS_TASK_PRIORITY_BACKGROUND;
+
+		if (limited && os_atomic_inc_long(&pool->background_running) >
+				       pool->max_background) {
+			os_atomic_dec_long(&pool->background_running);
+			continue;
+		}
+
+		if (find_task_priority(pool, self, priority, item))
+			return (int)priority;
+
+		if (limited)
+			os_atomic_dec_long(&pool->background_running);
+	}
+
+	return -1;
+}
+
+static void run_task(struct os_task_item *item)
+{
+	struct os_task_group *group = item->group;
+
+	item->task(item->param);
+
+	if (group) {
+		pthread_mutex_lock(&group->mutex);
+		if (--group->pending == 0)
+			pthread_cond_broadcast(&group->done);
+		pthread_mutex_unlock(&group->mutex);
+	}
+}
+
+static void *task_pool_thread(void *param)
+{
+	struct task_worker *worker = param;
+	struct os_task_pool *pool = worker->pool;
+
+	current_worker = worker;
+	os_set_thread_name("libobs: task pool worker");
+
+	while (os_sem_wait(pool->sem) == 0 &&
+	       !os_atomic_load_bool(&pool->stop)) {
+		struct os_task_item item;
+		int priority;
+
+		while ((priority = find_task(pool, worker, false, &item)) !=
+		       -1) {
+			run_task(&item);
+
+			if (priority == OS_TASK_PRIORITY_BACKGROUND)
+				os_atomic_dec_long(&pool->background_running);
+		}
+	}
+
+	return NULL;
+}
+
+os_task_pool_t *os_task_pool_create(size_t workers)
+{
+	struct os_task_pool *pool = bzalloc(sizeof(*pool));
+	size_t started = 0;
+
+	if (!workers)
+		workers = (size_t)os_get_logical_cores();
+	if (!workers)
+		workers = 1;
+
+	pool->refs = 1;
+	pool->num_workers = workers;
+	pool->max_background = workers > 1 ? (long)workers / 2 : 1;
+	pool->workers = bzalloc(sizeof(struct task_worker) * workers);
+
+	if (pthread_mutex_init(&pool->shared_mutex, NULL) != 0)
+		goto fail1;
+	if (os_sem_init(&pool->sem, 0) != 0)
+		goto fail2;
+
+	for (; started < workers; started++) {
+		struct task_worker *worker = &pool->workers[started];
+		worker->pool = pool;
+		worker->index = started;
+
+		if (pthread_create(&worker->thread, NULL, task_pool_thread,
+				   worker) != 0)
+			goto fail3;
+	}
+
+	return pool;
+
+fail3:
+	os_atomic_set_bool(&pool->stop, true);
+	for (size_t i = 0; i < started; i++)
+		os_sem_post(pool->sem);
+	for (size_t i = 0; i < started; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	os_sem_destroy(pool->sem);
+fail2:
+	pthread_mutex_destroy(&pool->shared_mutex);
+fail1:
+	bfree(pool->workers);
+	bfree(pool);
+	return NULL;
+}
+
+static void task_pool_destroy(struct os_task_pool *pool)
+{
+	os_atomic_set_bool(&pool->stop, true);
+	for (size_t i = 0; i < pool->num_workers; i++)
+		os_sem_post(pool->sem);
+	for (size_t i = 0; i < pool->num_workers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+
+	for (size_t i = 0; i < PRIORITY_COUNT; i++)
+		deque_free(&pool->shared[i]);
+
+	os_sem_destroy(pool->sem);
+	pthread_mutex_destroy(&pool->shared_mutex);
+	bfree(pool->workers);
+	bfree(pool);
+}
+
+os_task_pool_t *os_task_pool_get_shared(void)
+{
+	pthread_mutex_lock(&shared_pool_mutex);
+	if (shared_pool)
+		os_atomic_inc_long(&shared_pool->refs);
+	else
+		shared_pool = os_task_pool_create(0);
+
+	struct os_task_pool *pool = shared_pool;
+	pthread_mutex_unlock(&shared_pool_mutex);
+	return pool;
+}
+
+void os_task_pool_release(os_task_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&shared_pool_mutex);
+	bool destroy = os_atomic_dec_long(&pool->refs) == 0;
+	if (destroy && pool == shared_pool)
+		shared_pool = NULL;
+	pthread_mutex_unlock(&shared_pool_mutex);
+
+	if (destroy)
+		task_pool_destroy(pool);
+}
+
+size_t os_task_pool_num_workers(const os_task_pool_t *pool)
+{
+	return pool ? pool->num_workers : 0;
+}
+
+static void queue_item(struct os_task_pool *pool,
+		       enum os_task_priority priority,
+		       const struct os_task_item *item)
+{
+	struct task_worker *self = current_worker;
+
+	if (!self || self->pool != pool ||
+	    !task_deque_push(&self->deques[priority], item)) {
+		pthread_mutex_lock(&pool->shared_mutex);
+		deque_push_back(&pool->shared[priority], item, sizeof(*item));
+		pthread_mutex_unlock(&pool->shared_mutex);
+	}
+
+	os_sem_post(pool->sem);
+}
+
+bool os_task_pool_queue_task(os_task_pool_t *pool,
+			     enum os_task_priority priority, os_task_t task,
+			     void *param)
+{
+	struct os_task_item item = {task, param, NULL};
+
+	if (!pool || !task || priority >= PRIORITY_COUNT)
+		return false;
+
+	queue_item(pool, priority, &item);
+	return true;
+}
+
+os_task_group_t *os_task_group_create(os_task_pool_t *pool,
+				      enum os_task_priority priority)
+{
+	struct os_task_group *group;
+
+	if (!pool || priority >= PRIORITY_COUNT)
+		return NULL;
+
+	group = bzalloc(sizeof(*group));
+	group->pool = pool;
+	group->priority = priority;
+
+	if (pthread_mutex_init(&group->mutex, NULL) != 0)
+		goto fail1;
+	if (pthread_cond_init(&group->done, NULL) != 0)
+		goto fail2;
+
+	return group;
+
+fail2:
+	pthread_mutex_destroy(&group->mutex);
+fail1:
+	bfree(group);
+	return NULL;
+}
+
+bool os_task_group_queue_task(os_task_group_t *group, os_task_t task,
+			      void *param)
+{
+	struct os_task_item item = {task, param, group};
+
+	if (!group || !task)
+		return false;
+
+	pthread_mutex_lock(&group->mutex);
+	group->pending++;
+	pthread_mutex_unlock(&group->mutex);
+
+	queue_item(group->pool, group->priority, &item);
+	return true;
+}
+
+static inline bool group_pending(struct os_task_group *group)
+{
+	pthread_mutex_lock(&group->mutex);
+	bool pending = group->pending != 0;
+	pthread_mutex_unlock(&group->mutex);
+	return pending;
+}
+
+static inline void wait_group(struct os_task_group *group)
+{
+	pthread_mutex_lock(&group->mutex);
+	while (group->pending != 0)
+		pthread_cond_wait(&group->done, &group->mutex);
+	pthread_mutex_unlock(&group->mutex);
+}
+
+void os_task_group_join(os_task_group_t *group)
+{
+	struct task_worker *self = current_worker;
+
+	if (!group)
+		return;
+
+	/* Workers of the pool run other tasks while they wait, so that nested
+	 * groups can't use up every worker.  Any other thread just blocks. */
+	if (self && self->pool != group->pool)
+		self = NULL;
+
+	while (group_pending(group)) {
+		struct os_task_item item;
+
+		if (self && find_task(group->pool, self, true, &item) != -1)
+			run_task(&item);
+		else
+			wait_group(group);
+	}
+}
+
+void os_task_group_destroy(os_task_group_t *group)
+{
+	if (!group)
+		return;
+
+	os_task_group_join(group);
+	pthread_cond_destroy(&group->done);
+	pthread_mutex_destroy(&group->mutex);
+	bfree(group);
+}
+
+/* ------------------------------------------------------------------------- */
+/* serial task queue                                                         */
+
+/* tasks run per pool task before the queue yields its worker */
+#define QUEUE_BATCH_SIZE 32
+
+struct os_task_queue {
+	os_task_pool_t *pool;
+	os_task_group_t *group;
 	long id;
 
+	bool scheduled;
 	bool waiting;
 	bool tasks_processed;
 	os_event_t *wait_event;
@@ -21,11 +470,10 @@ struct os_task_info {
 	void *param;
 };
 
-static THREAD_LOCAL bool exit_thread = false;
 static THREAD_LOCAL long thread_id = 0;
 static volatile long thread_id_counter = 1;
 
-static void *tiny_tubular_task_thread(void *param);
+static void drain_task_queue(void *param);
 
 os_task_queue_t *os_task_queue_create(void)
 {
@@ -34,20 +482,23 @@ os_task_queue_t *os_task_queue_create(void)
 
 	if (pthread_mutex_init(&tq->mutex, NULL) != 0)
 		goto fail1;
-	if (os_sem_init(&tq->sem, 0) != 0)
-		goto fail2;
 	if (os_event_init(&tq->wait_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail2;
+
+	tq->pool = os_task_pool_get_shared();
+	if (!tq->pool)
 		goto fail3;
-	if (pthread_create(&tq->thread, NULL, tiny_tubular_task_thread, tq) !=
-	    0)
+
+	tq->group = os_task_group_create(tq->pool, OS_TASK_PRIORITY_BACKGROUND);
+	if (!tq->group)
 		goto fail4;
 
 	return tq;
 
 fail4:
-	os_event_destroy(tq->wait_event);
+	os_task_pool_release(tq->pool);
 fail3:
-	os_sem_destroy(tq->sem);
+	os_event_destroy(tq->wait_event);
 fail2:
 	pthread_mutex_destroy(&tq->mutex);
 fail1:
@@ -61,14 +512,19 @@ bool os_task_queue_queue_task(os_task_queue_t *tq, os_task_t task, void *param)
 		task,
 		param,
 	};
+	bool schedule;
 
 	if (!tq)
 		return false;
 
 	pthread_mutex_lock(&tq->mutex);
 	deque_push_back(&tq->tasks, &ti, sizeof(ti));
+	schedule = !tq->scheduled;
+	tq->scheduled = true;
 	pthread_mutex_unlock(&tq->mutex);
-	os_sem_post(tq->sem);
+
+	if (schedule)
+		os_task_group_queue_task(tq->group, drain_task_queue, tq);
 	return true;
 }
 
@@ -78,21 +534,14 @@ static void wait_for_thread(void *data)
 	os_event_signal(tq->wait_event);
 }
 
-static void stop_thread(void *unused)
-{
-	exit_thread = true;
-	UNUSED_PARAMETER(unused);
-}
-
 void os_task_queue_destroy(os_task_queue_t *tq)
 {
 	if (!tq)
 		return;
 
-	os_task_queue_queue_task(tq, stop_thread, NULL);
-	pthread_join(tq->thread, NULL);
+	os_task_group_destroy(tq->group);
+	os_task_pool_release(tq->pool);
 	os_event_destroy(tq->wait_event);
-	os_sem_destroy(tq->sem);
 	pthread_mutex_destroy(&tq->mutex);
 	deque_free(&tq->tasks);
 	bfree(tq);
@@ -103,18 +552,12 @@ bool os_task_queue_wait(os_task_queue_t *tq)
 	if (!tq)
 		return false;
 
-	struct os_task_info ti = {
-		wait_for_thread,
-		tq,
-	};
-
 	pthread_mutex_lock(&tq->mutex);
 	tq->waiting = true;
 	tq->tasks_processed = false;
-	deque_push_back(&tq->tasks, &ti, sizeof(ti));
 	pthread_mutex_unlock(&tq->mutex);
 
-	os_sem_post(tq->sem);
+	os_task_queue_queue_task(tq, wait_for_thread, tq);
 	os_event_wait(tq->wait_event);
 
 	pthread_mutex_lock(&tq->mutex);
@@ -129,26 +572,32 @@ bool os_task_queue_inside(os_task_queue_t *tq)
 	return tq->id == thread_id;
 }
 
-static void *tiny_tubular_task_thread(void *param)
+/* Runs the queue's tasks in order on whichever worker picked it up.  Only one
+ * drain is ever scheduled per queue, and it reschedules itself after a batch
+ * instead of holding on to the worker. */
+static void drain_task_queue(void *param)
 {
 	struct os_task_queue *tq = param;
-	thread_id = tq->id;
+	long prev_id = thread_id;
 
-	os_set_thread_name(__FUNCTION__);
+	thread_id = tq->id;
 
-	while (!exit_thread && os_sem_wait(tq->sem) == 0) {
+	for (size_t i = 0; i < QUEUE_BATCH_SIZE; i++) {
 		struct os_task_info ti;
 
 		pthread_mutex_lock(&tq->mutex);
+		if (!tq->tasks.size) {
+			tq->scheduled = false;
+			pthread_mutex_unlock(&tq->mutex);
+			thread_id = prev_id;
+			return;
+		}
+
 		deque_pop_front(&tq->tasks, &ti, sizeof(ti));
 		if (tq->tasks.size && ti.task == wait_for_thread) {
 			deque_push_back(&tq->tasks, &ti, sizeof(ti));
 			deque_pop_front(&tq->tasks, &ti, sizeof(ti));
 		}
-		if (tq->tasks.size && ti.task == stop_thread) {
-			deque_push_back(&tq->tasks, &ti, sizeof(ti));
-			deque_pop_front(&tq->tasks, &ti, sizeof(ti));
-		}
 		if (tq->waiting) {
 			if (ti.task == wait_for_thread) {
 				tq->waiting = false;
@@ -161,5 +610,6 @@ static void *tiny_tubular_task_thread(void *param)
 		ti.task(ti.param);
 	}
 
-	return NULL;
+	thread_id = prev_id;
+	os_task_group_queue_task(tq->group, drain_task_queue, tq);
 }
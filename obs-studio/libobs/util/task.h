@@ -8,9 +8,45 @@ extern "C" {
 
 struct os_task_queue;
 typedef struct os_task_queue os_task_queue_t;
+struct os_task_pool;
+typedef struct os_task_pool os_task_pool_t;
+struct os_task_group;
+typedef struct os_task_group os_task_group_t;
 
 typedef void (*os_task_t)(void *param);
 
+enum os_task_priority {
+	OS_TASK_PRIORITY_REALTIME,
+	OS_TASK_PRIORITY_VIDEO,
+	/* blocking work such as I/O, only ever holds half of the workers */
+	OS_TASK_PRIORITY_BACKGROUND,
+};
+
+/* Work-stealing pool.  Each worker has its own lock-free deque per priority,
+ * and idle workers steal from the others.  A worker count of 0 uses one
+ * worker per logical core. */
+EXPORT os_task_pool_t *os_task_pool_create(size_t workers);
+/* Returns a reference to the process-wide pool, creating it if needed */
+EXPORT os_task_pool_t *os_task_pool_get_shared(void);
+EXPORT void os_task_pool_release(os_task_pool_t *pool);
+EXPORT size_t os_task_pool_num_workers(const os_task_pool_t *pool);
+EXPORT bool os_task_pool_queue_task(os_task_pool_t *pool,
+				    enum os_task_priority priority,
+				    os_task_t task, void *param);
+
+/* Task groups track a set of pool tasks so they can be joined.  A worker that
+ * joins a group runs other queued tasks while it waits. */
+EXPORT os_task_group_t *os_task_group_create(os_task_pool_t *pool,
+					     enum os_task_priority priority);
+EXPORT bool os_task_group_queue_task(os_task_group_t *group, os_task_t task,
+				     void *param);
+EXPORT void os_task_group_join(os_task_group_t *group);
+EXPORT void os_task_group_destroy(os_task_group_t *group);
+
+/* Serial queue, runs its tasks in order as background tasks of the shared
+ * pool.  Unlike the dedicated thread queues used to have, a queue only runs
+ * while one of the pool's background slots (half of the workers) is free, so
+ * it shares them with every other background task. */
 EXPORT os_task_queue_t *os_task_queue_create(void);
 EXPORT bool os_task_queue_queue_task(os_task_queue_t *tt, os_task_t task,
 				     void *param);
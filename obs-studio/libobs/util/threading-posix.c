@@ -31,6 +31,7 @@
 #endif
 
 #include "bmem.h"
+#include "profiler.h"
 #include "threading.h"
 
 struct os_event_data {
@@ -270,4 +271,6 @@ void os_set_thread_name(const char *name)
 		bfree(thread_name);
 	}
 #endif
+
+	profile_trace_set_thread_name(name);
 }
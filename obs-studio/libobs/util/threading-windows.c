@@ -15,6 +15,7 @@
  */
 
 #include "bmem.h"
+#include "profiler.h"
 #include "threading.h"
 #include "util/platform.h"
 
@@ -213,4 +214,6 @@ void os_set_thread_name(const char *name)
 
 		FreeLibrary(hModule);
 	}
+
+	profile_trace_set_thread_name(name);
 }
@@ -92,6 +92,35 @@ static inline bool os_atomic_compare_exchange_long(volatile long *val,
 	return previous == old_val;
 }
 
+static inline void os_atomic_store_size(volatile size_t *ptr, size_t val)
+{
+#if defined(_M_ARM64)
+	_ReadWriteBarrier();
+	__stlr64((volatile unsigned __int64 *)ptr, val);
+	_ReadWriteBarrier();
+#elif defined(_M_X64)
+	_InterlockedExchange64((volatile __int64 *)ptr, (__int64)val);
+#else
+	os_atomic_store_long((volatile long *)ptr, (long)val);
+#endif
+}
+
+static inline size_t os_atomic_load_size(const volatile size_t *ptr)
+{
+#if defined(_M_ARM64)
+	const size_t val = __ldar64((volatile unsigned __int64 *)ptr);
+	_ReadWriteBarrier();
+	return val;
+#elif defined(_M_X64)
+	const size_t val =
+		__iso_volatile_load64((const volatile __int64 *)ptr);
+	_ReadWriteBarrier();
+	return val;
+#else
+	return (size_t)os_atomic_load_long((const volatile long *)ptr);
+#endif
+}
+
 static inline void os_atomic_store_bool(volatile bool *ptr, bool val)
 {
 #if defined(_M_ARM64)
@@ -41,6 +41,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define FALLBACK_FRAMERATE 30
 
+/* buffers that always stay with the driver, the rest can be lent to obs */
+#define MIN_QUEUED_BUFFERS 2
+#define LENT_WAIT_MS 1000
+
 #if HAVE_UDEV
 #include "v4l2-udev.h"
 #endif
@@ -65,6 +69,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "v4l2-input: " msg, ##__VA_ARGS__)
 
+struct v4l2_data;
+
+/**
+ * Mapped buffer that is lent to obs until the frame has been used
+ */
+struct v4l2_lent_buffer {
+	struct v4l2_data *data;
+	struct v4l2_buffer buf;
+};
+
 /**
  * Data structure for the v4l2 source
  */
@@ -92,6 +106,8 @@ struct v4l2_data {
 	int height;
 	int linesize;
 	struct v4l2_buffer_data buffers;
+	struct v4l2_lent_buffer *lent_buffers;
+	volatile long lent;
 
 	bool auto_reset;
 	int timeout_frames;
@@ -161,6 +177,44 @@ static void v4l2_prep_obs_frame(struct v4l2_data *data,
 	}
 }
 
+/*
+ * Queue a lent buffer back to the driver once obs is done with the frame
+ */
+static void v4l2_return_buffer(void *vptr)
+{
+	struct v4l2_lent_buffer *lent = vptr;
+	struct v4l2_data *data = lent->data;
+
+	if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &lent->buf) < 0)
+		blog(LOG_ERROR, "%s: failed to enqueue lent buffer",
+		     data->device_id);
+
+	os_atomic_dec_long(&data->lent);
+}
+
+/*
+ * Drop all queued frames and wait until every lent buffer has come back,
+ * the buffers must not be requeued or unmapped while obs still uses them.
+ * Async filters only ever get copies, so after the flush obs only holds on
+ * to the frame it is rendering right now.
+ */
+static void v4l2_flush_lent_buffers(struct v4l2_data *data)
+{
+	if (!os_atomic_load_long(&data->lent))
+		return;
+
+	obs_source_output_video(data->source, NULL);
+
+	for (int waited = 0; os_atomic_load_long(&data->lent); waited++) {
+		if (waited == LENT_WAIT_MS)
+			blog(LOG_WARNING,
+			     "%s: %ld lent buffers still in use after %d ms",
+			     data->device_id, os_atomic_load_long(&data->lent),
+			     LENT_WAIT_MS);
+		os_sleep_ms(1);
+	}
+}
+
 /*
  * Worker thread to get video data
  */
@@ -179,6 +233,7 @@ static void *v4l2_thread(void *vptr)
 	int fps_num, fps_denom;
 	float ffps;
 	uint64_t timeout_usec;
+	bool lend;
 
 	blog(LOG_DEBUG, "%s: new capture thread", data->device_id);
 	os_set_thread_name("v4l2: capture");
@@ -202,6 +257,15 @@ static void *v4l2_thread(void *vptr)
 	first_ts = 0;
 	v4l2_prep_obs_frame(data, &out, plane_offsets);
 
+	/* raw frames are handed to obs straight from the mapped buffers,
+	 * decoded frames already live in the decoder's own memory */
+	lend = data->pixfmt != V4L2_PIX_FMT_MJPEG &&
+	       data->pixfmt != V4L2_PIX_FMT_H264 &&
+	       data->buffers.count > MIN_QUEUED_BUFFERS;
+	if (lend)
+		data->lent_buffers = bzalloc(data->buffers.count *
+					     sizeof(struct v4l2_lent_buffer));
+
 	blog(LOG_DEBUG, "%s: obs frame prepared", data->device_id);
 
 	while (os_event_try(data->event) == EAGAIN) {
@@ -232,6 +296,7 @@ static void *v4l2_thread(void *vptr)
 			}
 
 			if (data->auto_reset) {
+				v4l2_flush_lent_buffers(data);
 				if (v4l2_reset_capture(data->dev,
 						       &data->buffers) == 0)
 					blog(LOG_INFO,
@@ -283,12 +348,28 @@ static void *v4l2_thread(void *vptr)
 			for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
 				out.data[i] = start + plane_offsets[i];
 		}
-		obs_source_output_video(data->source, &out);
 
-		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
-			blog(LOG_ERROR, "%s: failed to enqueue buffer",
-			     data->device_id);
-			break;
+		/* fall back to copying if obs is holding on to too many
+		 * buffers, otherwise the driver would run out of them */
+		if (lend && os_atomic_load_long(&data->lent) <
+				    (long)(data->buffers.count -
+					   MIN_QUEUED_BUFFERS)) {
+			struct v4l2_lent_buffer *lent =
+				&data->lent_buffers[buf.index];
+			lent->data = data;
+			lent->buf = buf;
+
+			os_atomic_inc_long(&data->lent);
+			obs_source_lend_video(data->source, &out,
+					      v4l2_return_buffer, lent);
+		} else {
+			obs_source_output_video(data->source, &out);
+
+			if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
+				blog(LOG_ERROR, "%s: failed to enqueue buffer",
+				     data->device_id);
+				break;
+			}
 		}
 
 		frames++;
@@ -298,6 +379,9 @@ static void *v4l2_thread(void *vptr)
 	     data->device_id, frames);
 
 exit:
+	v4l2_flush_lent_buffers(data);
+	bfree(data->lent_buffers);
+	data->lent_buffers = NULL;
 	v4l2_stop_capture(data->dev);
 	return NULL;
 }
@@ -43,8 +43,16 @@ target_sources(
           obs-ffmpeg-nvenc.c
           obs-ffmpeg-output.c
           obs-ffmpeg-output.h
+          obs-ffmpeg-replay-spill.c
+          obs-ffmpeg-replay-spill.h
           obs-ffmpeg-mux.c
           obs-ffmpeg-mux.h
+          obs-ffmpeg-mux-inproc.c
+          obs-ffmpeg-mux-inproc.h
+          ffmpeg-mux/ffmpeg-mux-core.c
+          ffmpeg-mux/ffmpeg-mux-core.h
+          ffmpeg-mux/ffmpeg-mux-ring.c
+          ffmpeg-mux/ffmpeg-mux-ring.h
           obs-ffmpeg-hls-mux.c
           obs-ffmpeg-source.c
           obs-ffmpeg-compat.h
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "ffmpeg-mux.h"
+
+#include <util/threading.h>
+#include <util/deque.h>
+#include <util/dstr.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+/* muxing code shared by the obs-ffmpeg-mux executable and the in-process
+ * muxer of the obs-ffmpeg plugin */
+
+struct main_params {
+	char *file;
+	/* printable_file is file with any stream key information removed */
+	struct dstr printable_file;
+	int has_video;
+	int tracks;
+	char *vcodec;
+	int vbitrate;
+	int gop;
+	int width;
+	int height;
+	int fps_num;
+	int fps_den;
+	int color_primaries;
+	int color_trc;
+	int colorspace;
+	int color_range;
+	int chroma_sample_location;
+	int max_luminance;
+	char *acodec;
+	char *muxer_settings;
+	int codec_tag;
+	/* optional, name of the shared memory ring packets are passed in */
+	char *ring_name;
+};
+
+struct audio_params {
+	char *name;
+	int abitrate;
+	int sample_rate;
+	int frame_size;
+	int channels;
+};
+
+struct header {
+	uint8_t *data;
+	int size;
+};
+
+struct audio_info {
+	AVStream *stream;
+	AVCodecContext *ctx;
+};
+
+struct io_header {
+	uint64_t seek_offset;
+	size_t data_length;
+};
+
+struct io_buffer {
+	bool active;
+	bool shutdown_requested;
+	bool output_error;
+	os_event_t *buffer_space_available_event;
+	os_event_t *new_data_available_event;
+	pthread_t io_thread;
+	pthread_mutex_t data_mutex;
+	FILE *output_file;
+	struct deque data;
+	uint64_t next_pos;
+};
+
+struct ffmpeg_mux {
+	AVFormatContext *output;
+	AVStream *video_stream;
+	AVCodecContext *video_ctx;
+	AVPacket *packet;
+	struct audio_info *audio_infos;
+	struct main_params params;
+	struct audio_params *audio;
+	struct header video_header;
+	struct header *audio_header;
+	int num_audio_streams;
+	bool initialized;
+	struct io_buffer io;
+
+	/* lets in-process users take the muxed output instead of a file */
+	int (*write_output)(void *opaque, uint8_t *buf, int buf_size);
+	void *write_opaque;
+};
+
+extern char *global_stream_key;
+
+/* diagnostics of the shared code are logged with blog unless a handler is
+ * set, the executable prints them instead.  printing them in-process would
+ * mix them into stdout, which the hosting process may use for ipc */
+typedef void (*ffm_log_handler_t)(int log_level, const char *msg);
+extern ffm_log_handler_t ffm_log_handler;
+
+extern void ffmpeg_mux_free(struct ffmpeg_mux *ffm);
+extern bool ffmpeg_mux_init_params(struct ffmpeg_mux *ffm, int argc,
+				   char *argv[]);
+extern void ffmpeg_mux_header(struct ffmpeg_mux *ffm, uint8_t *data,
+			      struct ffm_packet_info *info);
+extern int ffmpeg_mux_init_output(struct ffmpeg_mux *ffm);
+extern bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
+			      struct ffm_packet_info *info);
+extern bool ffmpeg_mux_flush(struct ffmpeg_mux *ffm);
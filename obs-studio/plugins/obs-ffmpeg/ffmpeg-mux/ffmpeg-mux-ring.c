@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/threading.h>
+
+#include "ffmpeg-mux-ring.h"
+
+#define RING_ALIGN 8
+#define RING_DATA_OFFSET 64
+
+/* both positions are byte offsets into the data area, the producer never
+ * fills the ring completely so that write_pos == read_pos means empty */
+struct ring_header {
+	volatile long write_pos;
+	volatile long read_pos;
+	uint32_t size;
+};
+
+struct ring_record {
+	uint32_t wrap;
+	uint32_t reserved;
+	struct ffm_packet_info info;
+};
+
+struct ffm_ring {
+	struct ring_header *header;
+	uint8_t *data;
+	size_t map_size;
+	long next_read;
+	bool owner;
+	char name[64];
+#ifdef _WIN32
+	HANDLE handle;
+#endif
+};
+
+static volatile long ring_counter = 0;
+
+static inline uint32_t align_size(uint32_t size)
+{
+	return (size + RING_ALIGN - 1) & ~(uint32_t)(RING_ALIGN - 1);
+}
+
+static inline uint32_t record_size(uint32_t payload_size)
+{
+	return align_size((uint32_t)sizeof(struct ring_record) + payload_size);
+}
+
+static void make_ring_name(struct ffm_ring *ring)
+{
+	long id = os_atomic_inc_long(&ring_counter);
+
+#ifdef _WIN32
+	snprintf(ring->name, sizeof(ring->name), "Local\\obs-ffmpeg-mux-%lu-%ld",
+		 GetCurrentProcessId(), id);
+#else
+	/* macOS limits shared memory names to 31 characters */
+	snprintf(ring->name, sizeof(ring->name), "/obs-ffm-%d-%ld", (int)getpid(),
+		 id);
+#endif
+}
+
+#ifdef _WIN32
+static bool map_ring(struct ffm_ring *ring, size_t size)
+{
+	DWORD high = (DWORD)((uint64_t)size >> 32);
+	DWORD low = (DWORD)size;
+
+	if (ring->owner)
+		ring->handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+						  PAGE_READWRITE, high, low,
+						  ring->name);
+	else
+		ring->handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, false,
+						ring->name);
+	if (!ring->handle)
+		return false;
+
+	ring->header = MapViewOfFile(ring->handle, FILE_MAP_ALL_ACCESS, 0, 0,
+				     size);
+	if (!ring->header)
+		return false;
+
+	if (!size) {
+		MEMORY_BASIC_INFORMATION mbi;
+		if (!VirtualQuery(ring->header, &mbi, sizeof(mbi)))
+			return false;
+		size = mbi.RegionSize;
+	}
+
+	ring->map_size = size;
+	return true;
+}
+
+static void unmap_ring(struct ffm_ring *ring)
+{
+	if (ring->header)
+		UnmapViewOfFile(ring->header);
+	if (ring->handle)
+		CloseHandle(ring->handle);
+}
+#else
+static bool map_ring(struct ffm_ring *ring, size_t size)
+{
+	void *ptr;
+	int fd;
+
+	if (ring->owner) {
+		fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd == -1)
+			return false;
+
+		if (ftruncate(fd, (off_t)size) != 0) {
+			close(fd);
+			return false;
+		}
+	} else {
+		struct stat st;
+
+		fd = shm_open(ring->name, O_RDWR, 0600);
+		if (fd == -1)
+			return false;
+
+		/* the creator keeps the mapping alive, drop the name as soon
+		 * as both processes have it open */
+		shm_unlink(ring->name);
+
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			return false;
+		}
+		size = (size_t)st.st_size;
+	}
+
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED)
+		return false;
+
+	ring->header = ptr;
+	ring->map_size = size;
+	return true;
+}
+
+static void unmap_ring(struct ffm_ring *ring)
+{
+	if (ring->header)
+		munmap(ring->header, ring->map_size);
+	if (ring->owner)
+		shm_unlink(ring->name);
+}
+#endif
+
+struct ffm_ring *ffm_ring_create(uint32_t size)
+{
+	struct ffm_ring *ring;
+
+	if (!size || (size & (size - 1)) != 0)
+		return NULL;
+
+	ring = calloc(1, sizeof(*ring));
+	ring->owner = true;
+	make_ring_name(ring);
+
+	if (!map_ring(ring, (size_t)RING_DATA_OFFSET + size)) {
+		ffm_ring_destroy(ring);
+		return NULL;
+	}
+
+	ring->data = (uint8_t *)ring->header + RING_DATA_OFFSET;
+	ring->header->write_pos = 0;
+	ring->header->read_pos = 0;
+	ring->header->size = size;
+	return ring;
+}
+
+struct ffm_ring *ffm_ring_open(const char *name)
+{
+	struct ffm_ring *ring;
+
+	if (!name || !*name || strlen(name) >= sizeof(ring->name))
+		return NULL;
+
+	ring = calloc(1, sizeof(*ring));
+	strcpy(ring->name, name);
+
+	if (!map_ring(ring, 0)) {
+		ffm_ring_destroy(ring);
+		return NULL;
+	}
+
+	ring->data = (uint8_t *)ring->header + RING_DATA_OFFSET;
+
+	if (ring->map_size < (size_t)RING_DATA_OFFSET + ring->header->size) {
+		ffm_ring_destroy(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+void ffm_ring_destroy(struct ffm_ring *ring)
+{
+	if (!ring)
+		return;
+
+	unmap_ring(ring);
+	free(ring);
+}
+
+const char *ffm_ring_name(const struct ffm_ring *ring)
+{
+	return ring->name;
+}
+
+bool ffm_ring_push(struct ffm_ring *ring, const struct ffm_packet_info *info,
+		   const uint8_t *data)
+{
+	struct ring_header *header = ring->header;
+	uint32_t size = header->size;
+	uint32_t write_pos = (uint32_t)header->write_pos;
+	uint32_t read_pos = (uint32_t)os_atomic_load_long(&header->read_pos);
+	uint32_t used = (write_pos - read_pos) & (size - 1);
+	uint32_t avail = size - used - RING_ALIGN;
+	uint32_t rec_size = record_size(info->size);
+	uint32_t tail = size - write_pos;
+	uint32_t needed = rec_size;
+	struct ring_record *rec;
+
+	if (info->size >= size)
+		return false;
+
+	/* records are never split so the consumer can read them in place,
+	 * a record that doesn't fit at the end starts over at offset 0 */
+	if (rec_size > tail)
+		needed += tail;
+	if (needed > avail)
+		return false;
+
+	if (rec_size > tail) {
+		if (tail >= sizeof(*rec)) {
+			rec = (struct ring_record *)(ring->data + write_pos);
+			rec->wrap = 1;
+		}
+		write_pos = 0;
+	}
+
+	rec = (struct ring_record *)(ring->data + write_pos);
+	rec->wrap = 0;
+	rec->info = *info;
+	memcpy(rec + 1, data, info->size);
+
+	write_pos += rec_size;
+	if (write_pos == size)
+		write_pos = 0;
+
+	os_atomic_set_long(&header->write_pos, (long)write_pos);
+	return true;
+}
+
+uint8_t *ffm_ring_peek(struct ffm_ring *ring, struct ffm_packet_info *info)
+{
+	struct ring_header *header = ring->header;
+	uint32_t size = header->size;
+	uint32_t read_pos = (uint32_t)header->read_pos;
+	uint32_t write_pos = (uint32_t)os_atomic_load_long(&header->write_pos);
+	struct ring_record *rec;
+
+	if (read_pos == write_pos)
+		return NULL;
+
+	if (size - read_pos < sizeof(*rec)) {
+		read_pos = 0;
+	} else {
+		rec = (struct ring_record *)(ring->data + read_pos);
+		if (rec->wrap)
+			read_pos = 0;
+	}
+
+	rec = (struct ring_record *)(ring->data + read_pos);
+	*info = rec->info;
+
+	ring->next_read = (long)((read_pos + record_size(info->size)) &
+				 (size - 1));
+	return (uint8_t *)(rec + 1);
+}
+
+void ffm_ring_pop(struct ffm_ring *ring)
+{
+	os_atomic_set_long(&ring->header->read_pos, ring->next_read);
+}
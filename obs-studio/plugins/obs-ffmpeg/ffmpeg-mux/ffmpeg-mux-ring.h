@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "ffmpeg-mux.h"
+
+/*
+ * Single producer/single consumer ring in shared memory used to hand packet
+ * payloads to ffmpeg-mux without copying them through the pipe.  obs-ffmpeg
+ * pushes a record and then writes an FFM_PACKET_RING message to the pipe,
+ * ffmpeg-mux muxes the record in place and releases it.
+ */
+
+#define FFM_RING_DEFAULT_SIZE (32 * 1024 * 1024)
+
+struct ffm_ring;
+
+/* creates a new ring, size must be a power of two */
+extern struct ffm_ring *ffm_ring_create(uint32_t size);
+/* opens a ring created by another process */
+extern struct ffm_ring *ffm_ring_open(const char *name);
+extern void ffm_ring_destroy(struct ffm_ring *ring);
+
+extern const char *ffm_ring_name(const struct ffm_ring *ring);
+
+/* returns false if there isn't enough free space for the packet */
+extern bool ffm_ring_push(struct ffm_ring *ring,
+			  const struct ffm_packet_info *info,
+			  const uint8_t *data);
+
+/* returns the payload of the oldest record, which stays valid until
+ * ffm_ring_pop is called */
+extern uint8_t *ffm_ring_peek(struct ffm_ring *ring,
+			      struct ffm_packet_info *info);
+extern void ffm_ring_pop(struct ffm_ring *ring);
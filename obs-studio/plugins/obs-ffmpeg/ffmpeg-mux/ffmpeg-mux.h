@@ -23,8 +23,15 @@ enum ffm_packet_type {
 	FFM_PACKET_VIDEO,
 	FFM_PACKET_AUDIO,
 	FFM_PACKET_CHANGE_FILE,
+	FFM_PACKET_FLUSH,
+	/* the packet is the next record in the shared memory ring */
+	FFM_PACKET_RING,
 };
 
+/* written to stderr once every packet sent before FFM_PACKET_FLUSH has been
+ * handed to the muxer */
+#define FFM_FLUSH_ACK "ffm-flush-ack"
+
 #define FFM_SUCCESS 0
 #define FFM_ERROR -1
 #define FFM_UNSUPPORTED -2
@@ -1,4 +1,5 @@
 #include "obs-ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-ring.h"
 #include <obs-avc.h>
 #ifdef ENABLE_HEVC
 #include <obs-hevc.h>
@@ -38,6 +39,7 @@ void ffmpeg_hls_mux_destroy(void *data)
 		deque_free(&stream->packets);
 
 		os_process_pipe_destroy(stream->pipe);
+		ffm_ring_destroy(stream->ring);
 		dstr_free(&stream->path);
 		dstr_free(&stream->printable_path);
 		dstr_free(&stream->stream_key);
@@ -0,0 +1,447 @@
+#include <libavutil/opt.h>
+
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+
+#include "ffmpeg-mux/ffmpeg-mux-core.h"
+#include "obs-ffmpeg-mux-inproc.h"
+
+/* the writer can fall behind when the disk is slow, callers are held back
+ * once this much packet data is waiting, like a full pipe would */
+#define MAX_QUEUED_BYTES (64 * 1024 * 1024)
+
+struct inproc_packet {
+	struct ffm_packet_info info;
+	uint8_t *data;
+	ffmpeg_mux_inproc_free_t free_data;
+	void *param;
+};
+
+struct ffmpeg_mux_inproc {
+	struct ffmpeg_mux ffm;
+	int argc;
+	char **argv;
+	int headers;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	os_sem_t *write_sem;
+	os_event_t *flush_event;
+	os_event_t *space_event;
+	struct deque packets;
+	size_t queued_bytes;
+
+	volatile bool stopping;
+	volatile bool failed;
+	int error_code;
+};
+
+static inline int expected_headers(struct ffmpeg_mux *ffm)
+{
+	return ffm->params.has_video + ffm->params.tracks;
+}
+
+/* splits the ffmpeg-mux command line the same way the child's C runtime
+ * would, quotes are escaped as "" in paths and as \" in muxer settings */
+static char **split_command_line(const char *cmd, int *argc)
+{
+	DARRAY(char *) args;
+	const char *p = cmd;
+
+	da_init(args);
+
+	for (;;) {
+		struct dstr arg = {0};
+		bool quoted = false;
+
+		while (*p == ' ')
+			p++;
+		if (!*p)
+			break;
+
+		while (*p && (quoted || *p != ' ')) {
+			if (*p == '\\' && p[1] == '"') {
+				dstr_cat_ch(&arg, '"');
+				p += 2;
+			} else if (*p == '"' && quoted && p[1] == '"') {
+				dstr_cat_ch(&arg, '"');
+				p += 2;
+			} else if (*p == '"') {
+				quoted = !quoted;
+				p++;
+			} else {
+				dstr_cat_ch(&arg, *p++);
+			}
+		}
+
+		char *str = arg.array ? arg.array : bstrdup("");
+		da_push_back(args, &str);
+	}
+
+	*argc = (int)args.num;
+	return args.array;
+}
+
+static void free_command_line(char **argv, int argc)
+{
+	for (int i = 0; i < argc; i++)
+		bfree(argv[i]);
+	bfree(argv);
+}
+
+static inline void free_packet(struct inproc_packet *pkt)
+{
+	if (pkt->free_data)
+		pkt->free_data(pkt->param);
+	else
+		bfree(pkt->data);
+}
+
+static inline void set_failed(struct ffmpeg_mux_inproc *mux, int code)
+{
+	if (!os_atomic_load_bool(&mux->failed)) {
+		mux->error_code = code;
+		os_atomic_set_bool(&mux->failed, true);
+	}
+}
+
+static void change_file(struct ffmpeg_mux_inproc *mux,
+			struct inproc_packet *pkt)
+{
+	ffmpeg_mux_free(&mux->ffm);
+
+	bfree(mux->argv[1]);
+	mux->argv[1] = bstrdup_n((const char *)pkt->data, pkt->info.size);
+	mux->headers = 0;
+
+	if (!ffmpeg_mux_init_params(&mux->ffm, mux->argc, mux->argv)) {
+		blog(LOG_WARNING, "[ffmpeg muxer] Couldn't initialize muxer "
+				  "for new file");
+		set_failed(mux, FFM_ERROR);
+	}
+}
+
+static void process_packet(struct ffmpeg_mux_inproc *mux,
+			   struct inproc_packet *pkt)
+{
+	struct ffmpeg_mux *ffm = &mux->ffm;
+
+	if (pkt->info.type == FFM_PACKET_CHANGE_FILE) {
+		change_file(mux, pkt);
+		return;
+	}
+
+	if (pkt->info.type == FFM_PACKET_FLUSH) {
+		if (!ffmpeg_mux_flush(ffm))
+			set_failed(mux, FFM_ERROR);
+		os_event_signal(mux->flush_event);
+		return;
+	}
+
+	if (os_atomic_load_bool(&mux->failed))
+		return;
+
+	/* the first packets of every file are the codec headers, the output
+	 * can only be opened once all of them have arrived */
+	if (!ffm->initialized) {
+		ffmpeg_mux_header(ffm, pkt->data, &pkt->info);
+
+		if (++mux->headers == expected_headers(ffm)) {
+			int ret = ffmpeg_mux_init_output(ffm);
+			if (ret != FFM_SUCCESS) {
+				blog(LOG_WARNING, "[ffmpeg muxer] Couldn't "
+						  "initialize muxer");
+				ffmpeg_mux_free(ffm);
+				set_failed(mux, ret);
+				return;
+			}
+
+			ffm->initialized = true;
+		}
+		return;
+	}
+
+	if (!ffmpeg_mux_packet(ffm, pkt->data, &pkt->info))
+		set_failed(mux, FFM_ERROR);
+}
+
+static void *writer_thread(void *data)
+{
+	struct ffmpeg_mux_inproc *mux = data;
+
+	os_set_thread_name("ffmpeg-mux: writer");
+
+	while (os_sem_wait(mux->write_sem) == 0) {
+		struct inproc_packet pkt;
+		bool has_packet = false;
+
+		pthread_mutex_lock(&mux->mutex);
+		if (mux->packets.size) {
+			deque_pop_front(&mux->packets, &pkt, sizeof(pkt));
+			mux->queued_bytes -= pkt.info.size;
+			has_packet = true;
+		}
+		pthread_mutex_unlock(&mux->mutex);
+
+		if (!has_packet) {
+			if (os_atomic_load_bool(&mux->stopping))
+				break;
+			continue;
+		}
+
+		process_packet(mux, &pkt);
+		free_packet(&pkt);
+		os_event_signal(mux->space_event);
+	}
+
+	return NULL;
+}
+
+struct ffmpeg_mux_inproc *ffmpeg_mux_inproc_create(const char *cmd_line)
+{
+	struct ffmpeg_mux_inproc *mux = bzalloc(sizeof(*mux));
+
+	pthread_mutex_init_value(&mux->mutex);
+
+	mux->argv = split_command_line(cmd_line, &mux->argc);
+	if (mux->argc < 2 ||
+	    !ffmpeg_mux_init_params(&mux->ffm, mux->argc, mux->argv)) {
+		blog(LOG_WARNING, "[ffmpeg muxer] Invalid muxer parameters");
+		goto fail;
+	}
+
+	if (pthread_mutex_init(&mux->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&mux->write_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&mux->flush_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (os_event_init(&mux->space_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (pthread_create(&mux->thread, NULL, writer_thread, mux) != 0)
+		goto fail;
+
+	return mux;
+
+fail:
+	ffmpeg_mux_free(&mux->ffm);
+	os_event_destroy(mux->space_event);
+	os_event_destroy(mux->flush_event);
+	os_sem_destroy(mux->write_sem);
+	pthread_mutex_destroy(&mux->mutex);
+	free_command_line(mux->argv, mux->argc);
+	bfree(mux);
+	return NULL;
+}
+
+int ffmpeg_mux_inproc_destroy(struct ffmpeg_mux_inproc *mux)
+{
+	int ret;
+
+	if (!mux)
+		return FFM_SUCCESS;
+
+	os_atomic_set_bool(&mux->stopping, true);
+	os_sem_post(mux->write_sem);
+	pthread_join(mux->thread, NULL);
+
+	/* writes the trailer */
+	ffmpeg_mux_free(&mux->ffm);
+
+	ret = os_atomic_load_bool(&mux->failed) ? mux->error_code
+						: FFM_SUCCESS;
+
+	os_event_destroy(mux->space_event);
+	os_event_destroy(mux->flush_event);
+	os_sem_destroy(mux->write_sem);
+	pthread_mutex_destroy(&mux->mutex);
+	deque_free(&mux->packets);
+	free_command_line(mux->argv, mux->argc);
+	bfree(mux);
+	return ret;
+}
+
+bool ffmpeg_mux_inproc_write(struct ffmpeg_mux_inproc *mux,
+			     const struct ffm_packet_info *info,
+			     const uint8_t *data,
+			     ffmpeg_mux_inproc_free_t free_data, void *param)
+{
+	struct inproc_packet pkt = {.info = *info,
+				    .free_data = free_data,
+				    .param = param};
+
+	if (os_atomic_load_bool(&mux->failed)) {
+		if (free_data)
+			free_data(param);
+		return false;
+	}
+
+	if (free_data) {
+		pkt.data = (uint8_t *)data;
+	} else if (info->size) {
+		pkt.data = bmemdup(data, info->size);
+	}
+
+	pthread_mutex_lock(&mux->mutex);
+	while (mux->queued_bytes >= MAX_QUEUED_BYTES &&
+	       !os_atomic_load_bool(&mux->failed)) {
+		pthread_mutex_unlock(&mux->mutex);
+		os_event_wait(mux->space_event);
+		pthread_mutex_lock(&mux->mutex);
+	}
+
+	deque_push_back(&mux->packets, &pkt, sizeof(pkt));
+	mux->queued_bytes += info->size;
+	pthread_mutex_unlock(&mux->mutex);
+
+	os_sem_post(mux->write_sem);
+	return true;
+}
+
+bool ffmpeg_mux_inproc_flush(struct ffmpeg_mux_inproc *mux)
+{
+	struct ffm_packet_info info = {.type = FFM_PACKET_FLUSH};
+
+	if (!ffmpeg_mux_inproc_write(mux, &info, NULL, NULL, NULL))
+		return false;
+
+	os_event_wait(mux->flush_event);
+	return !os_atomic_load_bool(&mux->failed);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct ffmpeg_mux_fragmenter {
+	struct ffmpeg_mux ffm;
+	int argc;
+	char **argv;
+	int headers;
+	bool mpegts;
+
+	DARRAY(uint8_t) output;
+	DARRAY(uint8_t) init_segment;
+};
+
+static int fragmenter_write_output(void *opaque, uint8_t *buf, int buf_size)
+{
+	struct ffmpeg_mux_fragmenter *frag = opaque;
+
+	da_push_back_array(frag->output, buf, (size_t)buf_size);
+	return buf_size;
+}
+
+struct ffmpeg_mux_fragmenter *
+ffmpeg_mux_fragmenter_create(const char *cmd_line, const char *muxer_settings)
+{
+	struct ffmpeg_mux_fragmenter *frag = bzalloc(sizeof(*frag));
+
+	frag->argv = split_command_line(cmd_line, &frag->argc);
+	if (frag->argc < 2)
+		goto fail;
+
+	bfree(frag->argv[frag->argc - 1]);
+	frag->argv[frag->argc - 1] = bstrdup(muxer_settings);
+
+	if (!ffmpeg_mux_init_params(&frag->ffm, frag->argc, frag->argv))
+		goto fail;
+
+	frag->ffm.write_output = fragmenter_write_output;
+	frag->ffm.write_opaque = frag;
+	return frag;
+
+fail:
+	blog(LOG_WARNING, "[ffmpeg muxer] Invalid fragmenter parameters");
+	ffmpeg_mux_fragmenter_destroy(frag);
+	return NULL;
+}
+
+void ffmpeg_mux_fragmenter_destroy(struct ffmpeg_mux_fragmenter *frag)
+{
+	if (!frag)
+		return;
+
+	ffmpeg_mux_free(&frag->ffm);
+	free_command_line(frag->argv, frag->argc);
+	da_free(frag->output);
+	da_free(frag->init_segment);
+	bfree(frag);
+}
+
+static bool fragmenter_init_output(struct ffmpeg_mux_fragmenter *frag)
+{
+	struct ffmpeg_mux *ffm = &frag->ffm;
+
+	if (ffmpeg_mux_init_output(ffm) != FFM_SUCCESS) {
+		blog(LOG_WARNING, "[ffmpeg muxer] Couldn't initialize "
+				  "fragmenter");
+		return false;
+	}
+
+	ffm->initialized = true;
+	frag->mpegts = strcmp(ffm->output->oformat->name, "mpegts") == 0;
+
+	/* everything written by the header belongs to the init segment */
+	avio_flush(ffm->output->pb);
+	da_move(frag->init_segment, frag->output);
+	return true;
+}
+
+bool ffmpeg_mux_fragmenter_write(struct ffmpeg_mux_fragmenter *frag,
+				 const struct ffm_packet_info *info,
+				 const uint8_t *data)
+{
+	struct ffmpeg_mux *ffm = &frag->ffm;
+	struct ffm_packet_info pkt_info = *info;
+
+	if (!ffm->initialized) {
+		ffmpeg_mux_header(ffm, (uint8_t *)data, &pkt_info);
+
+		if (++frag->headers == expected_headers(ffm))
+			return fragmenter_init_output(frag);
+		return true;
+	}
+
+	return ffmpeg_mux_packet(ffm, (uint8_t *)data, &pkt_info);
+}
+
+uint8_t *ffmpeg_mux_fragmenter_cut(struct ffmpeg_mux_fragmenter *frag,
+				   size_t *size)
+{
+	struct ffmpeg_mux *ffm = &frag->ffm;
+	uint8_t *data;
+
+	*size = 0;
+
+	if (!ffm->initialized)
+		return NULL;
+
+	/* drain the interleaving queue, then close the fragment itself */
+	if (av_interleaved_write_frame(ffm->output, NULL) < 0 ||
+	    av_write_frame(ffm->output, NULL) < 0)
+		return NULL;
+	avio_flush(ffm->output->pb);
+
+	/* every MPEG-TS fragment carries its own PAT/PMT so that it can be
+	 * played without the ones before it */
+	if (frag->mpegts)
+		av_opt_set(ffm->output->priv_data, "mpegts_flags",
+			   "+resend_headers", 0);
+
+	if (!frag->output.num)
+		return NULL;
+
+	*size = frag->output.num;
+	data = frag->output.array;
+	da_init(frag->output);
+	return data;
+}
+
+const uint8_t *
+ffmpeg_mux_fragmenter_init_segment(struct ffmpeg_mux_fragmenter *frag,
+				   size_t *size)
+{
+	*size = frag->init_segment.num;
+	return frag->init_segment.array;
+}
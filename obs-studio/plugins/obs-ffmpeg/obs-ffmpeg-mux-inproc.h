@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ffmpeg-mux/ffmpeg-mux.h"
+
+/* Runs the ffmpeg-mux muxing code on a writer thread inside the calling
+ * process instead of piping every packet to the ffmpeg-mux executable. */
+struct ffmpeg_mux_inproc;
+
+typedef void (*ffmpeg_mux_inproc_free_t)(void *param);
+
+/* cmd_line is the same command line ffmpeg-mux would be started with */
+struct ffmpeg_mux_inproc *ffmpeg_mux_inproc_create(const char *cmd_line);
+
+/* drains the queue, finishes the file and returns an FFM_* code */
+int ffmpeg_mux_inproc_destroy(struct ffmpeg_mux_inproc *mux);
+
+/* Queues a packet in the same format as the ffmpeg-mux pipe protocol. If
+ * free_data is set the data is borrowed and free_data(param) is called once
+ * the packet has been muxed, otherwise the data is copied. */
+bool ffmpeg_mux_inproc_write(struct ffmpeg_mux_inproc *mux,
+			     const struct ffm_packet_info *info,
+			     const uint8_t *data,
+			     ffmpeg_mux_inproc_free_t free_data, void *param);
+
+/* waits until every packet queued so far has been handed to the muxer */
+bool ffmpeg_mux_inproc_flush(struct ffmpeg_mux_inproc *mux);
+
+/* Muxes packets synchronously into memory and cuts the output into fragments
+ * that play back when concatenated after the init segment.  Only formats that
+ * can be written without seeking work, i.e. fragmented MP4 and MPEG-TS. */
+struct ffmpeg_mux_fragmenter;
+
+/* muxer_settings replaces the muxer settings of the command line */
+struct ffmpeg_mux_fragmenter *
+ffmpeg_mux_fragmenter_create(const char *cmd_line, const char *muxer_settings);
+void ffmpeg_mux_fragmenter_destroy(struct ffmpeg_mux_fragmenter *frag);
+
+/* the codec headers have to be written first, as over the pipe */
+bool ffmpeg_mux_fragmenter_write(struct ffmpeg_mux_fragmenter *frag,
+				 const struct ffm_packet_info *info,
+				 const uint8_t *data);
+
+/* ends the current fragment and returns it, the caller frees it with bfree */
+uint8_t *ffmpeg_mux_fragmenter_cut(struct ffmpeg_mux_fragmenter *frag,
+				   size_t *size);
+
+/* what the muxer wrote before the first packet, e.g. ftyp and moov */
+const uint8_t *
+ffmpeg_mux_fragmenter_init_segment(struct ffmpeg_mux_fragmenter *frag,
+				   size_t *size);
@@ -15,7 +15,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-ring.h"
 #include "obs-ffmpeg-mux.h"
+#include "obs-ffmpeg-mux-inproc.h"
+#include "obs-ffmpeg-replay-spill.h"
 #include "obs-ffmpeg-formats.h"
 
 #ifdef _WIN32
@@ -172,26 +175,46 @@ static const char *ffmpeg_mpegts_mux_getname(void *type)
 }
 #endif
 
-static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
+static inline void release_packets(struct deque *packets)
 {
-	while (stream->packets.size > 0) {
+	while (packets->size > 0) {
 		struct encoder_packet pkt;
-		deque_pop_front(&stream->packets, &pkt, sizeof(pkt));
+		deque_pop_front(packets, &pkt, sizeof(pkt));
 		obs_encoder_packet_release(&pkt);
 	}
+}
 
-	deque_free(&stream->packets);
+/* spilled payloads live in the spill file and aren't refcounted */
+static inline void release_mux_packet(struct ffmpeg_muxer *stream,
+				      struct encoder_packet *pkt)
+{
+	if (!replay_spill_contains(stream->spill, pkt->data))
+		obs_encoder_packet_release(pkt);
+}
 
-	while (stream->replay_pending_packets.size > 0) {
-		struct encoder_packet pkt;
-		deque_pop_front(&stream->replay_pending_packets, &pkt,
-				    sizeof(pkt));
-		obs_encoder_packet_release(&pkt);
-	}
+static void free_replay_fragments(struct ffmpeg_muxer *stream);
+
+static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
+{
+	release_packets(&stream->packets);
+	deque_free(&stream->packets);
+	deque_free(&stream->spilled_packets);
+	replay_spill_destroy(stream->spill);
+	stream->spill = NULL;
+	free_replay_fragments(stream);
+	deque_free(&stream->keyframe_index);
+	stream->packets_pushed = 0;
+	stream->packets_popped = 0;
+
+	release_packets(&stream->replay_pending_packets);
 	deque_free(&stream->replay_pending_packets);
+	release_packets(&stream->replay_write_packets);
+	deque_free(&stream->replay_write_packets);
 
 	stream->cur_size = 0;
 	stream->cur_time = 0;
+	stream->ram_size = 0;
+	stream->max_ram_size = 0;
 	stream->max_size = 0;
 	stream->max_time = 0;
 	stream->save_ts = 0;
@@ -200,19 +223,21 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->capturing_replay, false);
 }
 
+static int close_mux(struct ffmpeg_muxer *stream);
+
 static void ffmpeg_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 
-	replay_buffer_clear(stream);
 	if (stream->mux_thread_joinable)
 		pthread_join(stream->mux_thread, NULL);
 	for (size_t i = 0; i < stream->mux_packets.num; i++)
-		obs_encoder_packet_release(&stream->mux_packets.array[i]);
+		release_mux_packet(stream, &stream->mux_packets.array[i]);
 	da_free(stream->mux_packets);
+	replay_buffer_clear(stream);
 	deque_free(&stream->packets);
 
-	os_process_pipe_destroy(stream->pipe);
+	close_mux(stream);
 	dstr_free(&stream->path);
 	dstr_free(&stream->printable_path);
 	dstr_free(&stream->stream_key);
@@ -307,12 +332,18 @@ bool stopping_replay(struct ffmpeg_muxer *stream)
 	return os_atomic_load_bool(&stream->replay_stopping);
 }
 
+static inline void wake_replay_mux_thread(struct ffmpeg_muxer *stream)
+{
+	if (stream->replay_packets_event)
+		os_event_signal(stream->replay_packets_event);
+}
+
 static void add_video_encoder_params(struct ffmpeg_muxer *stream,
 				     struct dstr *cmd, obs_encoder_t *vencoder)
 {
 	obs_data_t *settings = obs_encoder_get_settings(vencoder);
 	int bitrate = (int)obs_data_get_int(settings, "bitrate");
-	video_t *video = obs_get_video();
+	video_t *video = obs_encoder_video(vencoder);
 	const struct video_output_info *info = video_output_get_info(video);
 
 	int codec_tag = (int)obs_data_get_int(settings, "codec_type");
@@ -380,7 +411,7 @@ static void add_audio_encoder_params(struct dstr *cmd, obs_encoder_t *aencoder)
 {
 	obs_data_t *settings = obs_encoder_get_settings(aencoder);
 	int bitrate = (int)obs_data_get_int(settings, "bitrate");
-	audio_t *audio = obs_get_audio();
+	audio_t *audio = obs_encoder_audio(aencoder);
 	struct dstr name = {0};
 
 	obs_data_release(settings);
@@ -498,14 +529,71 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd,
 	add_muxer_params(cmd, stream);
 }
 
+static bool use_inproc_mux(struct ffmpeg_muxer *stream)
+{
+	obs_data_t *settings;
+	bool inproc;
+
+	if (stream->is_network || stream->is_hls)
+		return false;
+
+	settings = obs_output_get_settings(stream->output);
+	inproc = obs_data_get_bool(settings, "in_process_mux");
+	obs_data_release(settings);
+	return inproc;
+}
+
 void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 {
 	struct dstr cmd;
 	build_command_line(stream, &cmd, path);
-	stream->pipe = os_process_pipe_create(cmd.array, "w");
+
+	if (use_inproc_mux(stream)) {
+		stream->inproc = ffmpeg_mux_inproc_create(cmd.array);
+		if (stream->inproc)
+			info("Using in-process muxer");
+	} else {
+		/* packets are passed through shared memory when possible, the
+		 * pipe only carries the headers and a message per packet */
+		stream->ring = ffm_ring_create(FFM_RING_DEFAULT_SIZE);
+		if (stream->ring)
+			dstr_catf(&cmd, "\"%s\" ", ffm_ring_name(stream->ring));
+		else
+			warn("Failed to create packet ring, sending packets "
+			     "through the pipe");
+
+		stream->pipe = os_process_pipe_create(cmd.array, "w");
+		if (!stream->pipe) {
+			ffm_ring_destroy(stream->ring);
+			stream->ring = NULL;
+		}
+	}
+
 	dstr_free(&cmd);
 }
 
+static inline bool mux_opened(struct ffmpeg_muxer *stream)
+{
+	return stream->pipe || stream->inproc;
+}
+
+static int close_mux(struct ffmpeg_muxer *stream)
+{
+	int ret;
+
+	if (stream->inproc) {
+		ret = ffmpeg_mux_inproc_destroy(stream->inproc);
+		stream->inproc = NULL;
+	} else {
+		ret = os_process_pipe_destroy(stream->pipe);
+		stream->pipe = NULL;
+	}
+
+	ffm_ring_destroy(stream->ring);
+	stream->ring = NULL;
+	return ret;
+}
+
 static void set_file_not_readable_error(struct ffmpeg_muxer *stream,
 					obs_data_t *settings, const char *path)
 {
@@ -655,7 +743,7 @@ static inline bool ffmpeg_mux_start_internal(struct ffmpeg_muxer *stream,
 	stream->stream_start_time = os_get_epoch_time_unix();
 	start_pipe(stream, path);
 
-	if (!stream->pipe) {
+	if (!mux_opened(stream)) {
 		obs_output_set_last_error(
 			stream->output, obs_module_text("HelperProcessFailed"));
 		warn("Failed to create process pipe");
@@ -729,8 +817,7 @@ void deactivate_full_video(void *data)
 		     ? stream->path.array
 		     : stream->printable_path.array);
 
-	bool ret = os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
+	close_mux(stream);
 	info("Output of file (full) stopped");
 
 }
@@ -749,8 +836,7 @@ int deactivate(struct ffmpeg_muxer *stream, int code)
 	}
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		ret = close_mux(stream);
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -799,6 +885,7 @@ void ffmpeg_mux_stop(void *data, uint64_t ts)
 		stream->stop_ts = (int64_t)ts / 1000LL;
 		os_atomic_set_bool(&stream->stopping, true);
 		os_atomic_set_bool(&stream->capturing, false);
+		wake_replay_mux_thread(stream);
 	}
 }
 
@@ -920,7 +1007,31 @@ static void generate_filename(struct ffmpeg_muxer *stream, struct dstr *dst,
 	obs_data_release(settings);
 }
 
-bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+static void release_packet_data(void *data)
+{
+	struct encoder_packet packet = {.data = data};
+	obs_encoder_packet_release(&packet);
+}
+
+static bool write_inproc_packet(struct ffmpeg_muxer *stream,
+				const struct ffm_packet_info *info,
+				struct encoder_packet *packet, bool header)
+{
+	struct encoder_packet ref;
+
+	/* codec headers and spilled replay packets aren't refcounted, the
+	 * muxer keeps a copy of them */
+	if (header || replay_spill_contains(stream->spill, packet->data))
+		return ffmpeg_mux_inproc_write(stream->inproc, info,
+					       packet->data, NULL, NULL);
+
+	obs_encoder_packet_ref(&ref, packet);
+	return ffmpeg_mux_inproc_write(stream->inproc, info, ref.data,
+				       release_packet_data, ref.data);
+}
+
+static bool write_packet_internal(struct ffmpeg_muxer *stream,
+				  struct encoder_packet *packet, bool header)
 {
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
 	size_t ret;
@@ -943,19 +1054,42 @@ bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
 		}
 	}
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
-				    sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
-		return false;
-	}
+	if (stream->inproc) {
+		if (!write_inproc_packet(stream, &info, packet, header)) {
+			warn("in-process muxer failed");
+			signal_failure(stream);
+			return false;
+		}
+	} else if (!header && stream->ring &&
+		   ffm_ring_push(stream->ring, &info, packet->data)) {
+		struct ffm_packet_info doorbell = {.type = FFM_PACKET_RING};
+
+		ret = os_process_pipe_write(stream->pipe,
+					    (const uint8_t *)&doorbell,
+					    sizeof(doorbell));
+		if (ret != sizeof(doorbell)) {
+			warn("os_process_pipe_write for ring packet failed");
+			signal_failure(stream);
+			return false;
+		}
+	} else {
+		/* the ring is full if the muxer has fallen behind, fall back
+		 * to the pipe rather than stalling */
+		ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
+					    sizeof(info));
+		if (ret != sizeof(info)) {
+			warn("os_process_pipe_write for info structure failed");
+			signal_failure(stream);
+			return false;
+		}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
-	if (ret != packet->size) {
-		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
-		return false;
+		ret = os_process_pipe_write(stream->pipe, packet->data,
+					    packet->size);
+		if (ret != packet->size) {
+			warn("os_process_pipe_write for packet data failed");
+			signal_failure(stream);
+			return false;
+		}
 	}
 
 	stream->total_bytes += packet->size;
@@ -976,6 +1110,11 @@ bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
 	return true;
 }
 
+bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+{
+	return write_packet_internal(stream, packet, false);
+}
+
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
 			       obs_encoder_t *aencoder, size_t idx)
 {
@@ -985,7 +1124,7 @@ static bool send_audio_headers(struct ffmpeg_muxer *stream,
 
 	if (!obs_encoder_get_extra_data(aencoder, &packet.data, &packet.size))
 		return false;
-	return write_packet(stream, &packet);
+	return write_packet_internal(stream, &packet, true);
 }
 
 static bool send_video_headers(struct ffmpeg_muxer *stream)
@@ -997,7 +1136,7 @@ static bool send_video_headers(struct ffmpeg_muxer *stream)
 
 	if (!obs_encoder_get_extra_data(vencoder, &packet.data, &packet.size))
 		return false;
-	return write_packet(stream, &packet);
+	return write_packet_internal(stream, &packet, true);
 }
 
 bool send_headers(struct ffmpeg_muxer *stream)
@@ -1061,6 +1200,17 @@ static bool send_new_filename(struct ffmpeg_muxer *stream, const char *filename)
 	struct ffm_packet_info info = {.type = FFM_PACKET_CHANGE_FILE,
 				       .size = size};
 
+	if (stream->inproc) {
+		if (!ffmpeg_mux_inproc_write(stream->inproc, &info,
+					     (const uint8_t *)filename, NULL,
+					     NULL)) {
+			warn("in-process muxer failed");
+			signal_failure(stream);
+			return false;
+		}
+		return true;
+	}
+
 	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
 				    sizeof(info));
 	if (ret != sizeof(info)) {
@@ -1457,8 +1607,9 @@ void stop_capture_replay(struct ffmpeg_muxer *stream)
 	info("stopping replay");
 	
 	if (capturing_replay(stream)) {
-	  os_atomic_set_bool(&stream->replay_stopping, true);
-	}		
+		os_atomic_set_bool(&stream->replay_stopping, true);
+		wake_replay_mux_thread(stream);
+	}
 	
 	stream->save_ts = 0;
 	stream->save_start_pts_usec = 0;
@@ -1498,6 +1649,14 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	UNUSED_PARAMETER(settings);
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
+
+	pthread_mutex_init_value(&stream->replay_packets_mutex);
+	if (pthread_mutex_init(&stream->replay_packets_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&stream->replay_packets_event, OS_EVENT_TYPE_AUTO) !=
+	    0)
+		goto fail;
+
 	stream->hotkey =
 		obs_hotkey_register_output(output, "ReplayBuffer.Save",
 					   obs_module_text("ReplayBuffer.Save"),
@@ -1517,8 +1676,13 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	signal_handler_t *sh = obs_output_get_signal_handler(output);
 	signal_handler_add(sh, "void saved()");
 
-	pthread_mutex_init_value(&stream->replay_packets_mutex);
 	return stream;
+
+fail:
+	os_event_destroy(stream->replay_packets_event);
+	pthread_mutex_destroy(&stream->replay_packets_mutex);
+	bfree(stream);
+	return NULL;
 }
 
 static void replay_buffer_destroy(void *data)
@@ -1526,9 +1690,60 @@ static void replay_buffer_destroy(void *data)
 	struct ffmpeg_muxer *stream = data;
 	if (stream->hotkey)
 		obs_hotkey_unregister(stream->hotkey);
+
+	/* the mux thread waits on the packet event, so it has to be gone
+	 * before the event is destroyed */
+	if (stream->mux_thread_joinable) {
+		stop_capture_replay(stream);
+		pthread_join(stream->mux_thread, NULL);
+		stream->mux_thread_joinable = false;
+	}
+
+	os_event_destroy(stream->replay_packets_event);
+	stream->replay_packets_event = NULL;
+	pthread_mutex_destroy(&stream->replay_packets_mutex);
 	ffmpeg_mux_destroy(data);
 }
 
+/* only the newest max_ram_size bytes of the window are kept in memory, the
+ * spill file holds the rest.  spill_path is the directory the file is
+ * created in, the module's config directory by default */
+static void create_replay_spill(struct ffmpeg_muxer *stream, const char *path)
+{
+	char *dir;
+
+	if (path && *path) {
+		dir = bstrdup(path);
+	} else {
+		dir = obs_module_config_path("");
+		os_mkdirs(dir);
+	}
+
+	stream->spill = replay_spill_create(dir, stream->max_size);
+	if (stream->spill)
+		info("Spilling replay buffer beyond %" PRId64 " MB to '%s'",
+		     stream->max_ram_size / (1024 * 1024), dir);
+	else
+		warn("Failed to create replay spill file in '%s', keeping "
+		     "the whole replay buffer in memory",
+		     dir);
+
+	bfree(dir);
+}
+
+/* the formats that can be cut into fragments and concatenated again */
+static const char *get_fragment_ext(struct ffmpeg_muxer *stream,
+				    const char *ext)
+{
+	if (astrcmpi(ext, "mp4") == 0)
+		return "mp4";
+	if (astrcmpi(ext, "ts") == 0)
+		return "ts";
+
+	warn("Replay buffer extension '%s' can't be pre-muxed", ext);
+	return NULL;
+}
+
 static bool replay_buffer_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -1541,8 +1756,21 @@ static bool replay_buffer_start(void *data)
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+	stream->max_ram_size =
+		obs_data_get_int(s, "max_ram_size_mb") * (1024 * 1024);
+	if (stream->max_ram_size && stream->max_size > stream->max_ram_size)
+		create_replay_spill(stream, obs_data_get_string(s, "spill_path"));
+	stream->fragment_ext = NULL;
+	if (obs_data_get_bool(s, "premux_fragments"))
+		stream->fragment_ext =
+			get_fragment_ext(stream,
+					 obs_data_get_string(s, "extension"));
 	obs_data_release(s);
 
+	if (stream->fragment_ext)
+		info("Pre-muxing the replay buffer, it will take about twice "
+		     "as much memory");
+
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
 
@@ -1563,86 +1791,213 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
-static bool purge_front(struct ffmpeg_muxer *stream)
+static inline size_t keyframe_count(struct ffmpeg_muxer *stream)
 {
-	struct encoder_packet pkt;
-	bool keyframe;
+	return stream->keyframe_index.size / sizeof(struct replay_keyframe);
+}
 
-	if (!stream->packets.size)
-		return false;
+static inline struct replay_keyframe *get_keyframe(struct ffmpeg_muxer *stream,
+						   size_t idx)
+{
+	return deque_data(&stream->keyframe_index,
+			  idx * sizeof(struct replay_keyframe));
+}
 
-	deque_pop_front(&stream->packets, &pkt, sizeof(pkt));
+static inline size_t spilled_count(struct ffmpeg_muxer *stream)
+{
+	return stream->spilled_packets.size / sizeof(struct encoder_packet);
+}
 
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+static inline size_t replay_packet_count(struct ffmpeg_muxer *stream)
+{
+	return (stream->spilled_packets.size + stream->packets.size) /
+	       sizeof(struct encoder_packet);
+}
 
-	if (keyframe)
-		stream->keyframes--;
+/* idx is the position in the whole window, spilled packets first */
+static inline struct encoder_packet *
+get_replay_packet(struct ffmpeg_muxer *stream, size_t idx)
+{
+	const size_t size = sizeof(struct encoder_packet);
+	size_t spilled = spilled_count(stream);
 
-	if (!stream->packets.size) {
-		stream->cur_size = 0;
-		stream->cur_time = 0;
-	} else {
-		struct encoder_packet first;
-		deque_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
+	if (idx < spilled)
+		return deque_data(&stream->spilled_packets, idx * size);
+	return deque_data(&stream->packets, (idx - spilled) * size);
+}
+
+static void index_packet(struct ffmpeg_muxer *stream,
+			 struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe) {
+		struct replay_keyframe kf = {
+			.serial = stream->packets_pushed,
+			.sys_pts_usec = packet->sys_pts_usec,
+		};
+		deque_push_back(&stream->keyframe_index, &kf, sizeof(kf));
+		stream->keyframes++;
 	}
 
-	obs_encoder_packet_release(&pkt);
-	return keyframe;
+	stream->packets_pushed++;
 }
 
-static inline void purge(struct ffmpeg_muxer *stream)
+/* drops every packet in front of the second keyframe, i.e. the oldest GOP
+ * along with any packets that were buffered ahead of it */
+static bool purge_gop(struct ffmpeg_muxer *stream)
 {
-	if (purge_front(stream)) {
-		if (!stream->fully_armed) {
-			// signal fully armed
-			info("replay bugger fully armed");
-			obs_output_signal_replay_fully_armed(stream->output);
-			stream->fully_armed = true;
-		}
+	struct replay_keyframe next;
+	size_t count;
 
-		struct encoder_packet pkt;
+	if (keyframe_count(stream) < 2)
+		return false;
 
-		for (;;) {
-			if (!stream->packets.size)
-				return;
-			deque_peek_front(&stream->packets, &pkt, sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
-				return;
+	deque_pop_front(&stream->keyframe_index, NULL,
+			sizeof(struct replay_keyframe));
+	deque_peek_front(&stream->keyframe_index, &next, sizeof(next));
+	stream->keyframes--;
+
+	count = (size_t)(next.serial - stream->packets_popped);
+	stream->packets_popped = next.serial;
+
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet pkt;
 
-			purge_front(stream);
+		if (stream->spilled_packets.size) {
+			deque_pop_front(&stream->spilled_packets, &pkt,
+					sizeof(pkt));
+			replay_spill_pop(stream->spill);
+			stream->cur_size -= (int64_t)pkt.size;
+			continue;
 		}
+
+		deque_pop_front(&stream->packets, &pkt, sizeof(pkt));
+		stream->cur_size -= (int64_t)pkt.size;
+		stream->ram_size -= (int64_t)pkt.size;
+		obs_encoder_packet_release(&pkt);
+	}
+
+	struct encoder_packet *first = get_replay_packet(stream, 0);
+	stream->cur_time = first->dts_usec;
+
+	if (!stream->fully_armed) {
+		// signal fully armed
+		info("replay bugger fully armed");
+		obs_output_signal_replay_fully_armed(stream->output);
+		stream->fully_armed = true;
 	}
+
+	return true;
 }
 
 static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
 				       struct encoder_packet *pkt)
 {
 	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
-			return;
+		while (stream->keyframes > 2 &&
+		       (stream->cur_size + (int64_t)pkt->size) >
+			       stream->max_size)
+			purge_gop(stream);
+	}
+
+	while (stream->keyframes > 2 &&
+	       (pkt->dts_usec - stream->cur_time) > stream->max_time)
+		purge_gop(stream);
+}
+
+/* serial of the first keyframe after serial, if there is one */
+static bool find_next_keyframe(struct ffmpeg_muxer *stream, uint64_t serial,
+			       uint64_t *next)
+{
+	size_t count = keyframe_count(stream);
+	size_t lo = 0;
+	size_t hi = count;
 
-		while ((stream->cur_size + (int64_t)pkt->size) >
-		       stream->max_size)
-			purge(stream);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (get_keyframe(stream, mid)->serial <= serial)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	if (!stream->packets.size || stream->keyframes <= 2)
-		return;
+	if (lo == count)
+		return false;
+
+	*next = get_keyframe(stream, lo)->serial;
+	return true;
+}
+
+/* moves the oldest GOPs that are still in memory to the spill file until the
+ * memory tier is back under max_ram_size, the GOP being filled stays put */
+static void replay_buffer_spill(struct ffmpeg_muxer *stream)
+{
+	while (stream->ram_size > stream->max_ram_size) {
+		uint64_t first = stream->packets_popped + spilled_count(stream);
+		uint64_t next;
+
+		if (!find_next_keyframe(stream, first, &next))
+			break;
+
+		for (uint64_t i = first; i < next; i++) {
+			struct encoder_packet pkt;
+			struct encoder_packet spilled;
+
+			deque_peek_front(&stream->packets, &pkt, sizeof(pkt));
+
+			/* the spill thread copies the payload and releases
+			 * the packet, so this thread never touches the file */
+			spilled = pkt;
+			spilled.data = replay_spill_write(stream->spill, &pkt);
+
+			/* full, or pinned by a save that is still muxing */
+			if (!spilled.data)
+				return;
 
-	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
-		purge(stream);
+			deque_pop_front(&stream->packets, NULL, sizeof(pkt));
+			deque_push_back(&stream->spilled_packets, &spilled,
+					sizeof(spilled));
+			stream->ram_size -= (int64_t)pkt.size;
+		}
+	}
+}
+
+/* position in the buffer of the last keyframe at or before start_pts_usec,
+ * or of the first keyframe if the request predates the buffer */
+static bool find_replay_start(struct ffmpeg_muxer *stream,
+			      int64_t start_pts_usec, size_t *start)
+{
+	size_t count = keyframe_count(stream);
+	size_t lo = 0;
+	size_t hi = count;
+
+	if (!count)
+		return false;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (get_keyframe(stream, mid)->sys_pts_usec <= start_pts_usec)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	struct replay_keyframe *kf = get_keyframe(stream, lo ? lo - 1 : 0);
+	*start = (size_t)(kf->serial - stream->packets_popped);
+	return true;
 }
 
-static void insert_packet(mux_packets_t *packets, struct encoder_packet *packet,
-			  int64_t video_offset, int64_t *audio_offsets,
-			  int64_t video_pts_offset, int64_t *audio_dts_offsets)
+static void push_rebased_packet(mux_packets_t *packets,
+				struct encoder_packet *packet, bool spilled,
+				int64_t video_offset, int64_t *audio_offsets,
+				int64_t video_pts_offset,
+				int64_t *audio_dts_offsets)
 {
 	struct encoder_packet pkt;
-	size_t idx;
 
-	obs_encoder_packet_ref(&pkt, packet);
+	if (spilled)
+		pkt = *packet;
+	else
+		obs_encoder_packet_ref(&pkt, packet);
 
 	if (pkt.type == OBS_ENCODER_VIDEO) {
 		pkt.dts_usec -= video_offset;
@@ -1654,13 +2009,167 @@ static void insert_packet(mux_packets_t *packets, struct encoder_packet *packet,
 		pkt.pts -= audio_dts_offsets[pkt.track_idx];
 	}
 
-	for (idx = packets->num; idx > 0; idx--) {
-		struct encoder_packet *p = packets->array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
+	da_push_back(*packets, &pkt);
+}
+
+#define REPLAY_TRACKS (MAX_AUDIO_MIXES + 1)
+
+/* Fills mux_packets with the buffered packets from start onwards, ordered by
+ * their rebased dts_usec. Each track is already in dts order inside the
+ * buffer, so this is a k-way merge of the per-track runs. */
+static void merge_replay_packets(struct ffmpeg_muxer *stream, size_t start,
+				 int64_t video_offset, int64_t *audio_offsets,
+				 int64_t video_pts_offset,
+				 int64_t *audio_dts_offsets)
+{
+	size_t num_packets = replay_packet_count(stream);
+	size_t spilled = spilled_count(stream);
+	DARRAY(size_t) tracks[REPLAY_TRACKS];
+	size_t heads[REPLAY_TRACKS] = {0};
+
+	memset(tracks, 0, sizeof(tracks));
+
+	for (size_t i = start; i < num_packets; i++) {
+		struct encoder_packet *pkt = get_replay_packet(stream, i);
+		size_t track = pkt->type == OBS_ENCODER_VIDEO
+				       ? 0
+				       : pkt->track_idx + 1;
+		da_push_back(tracks[track], &i);
+	}
+
+	da_reserve(stream->mux_packets, num_packets - start);
+
+	/* the mux thread reads spilled payloads straight from the file */
+	if (start < spilled)
+		replay_spill_pin(stream->spill);
+
+	for (;;) {
+		struct encoder_packet *next = NULL;
+		size_t next_idx = 0;
+		size_t next_track = 0;
+		int64_t next_dts = 0;
+
+		for (size_t t = 0; t < REPLAY_TRACKS; t++) {
+			struct encoder_packet *pkt;
+			size_t idx;
+			int64_t dts;
+
+			if (heads[t] == tracks[t].num)
+				continue;
+
+			idx = tracks[t].array[heads[t]];
+			pkt = get_replay_packet(stream, idx);
+			dts = pkt->dts_usec - (t == 0 ? video_offset
+						      : audio_offsets[t - 1]);
+
+			if (!next || dts < next_dts) {
+				next = pkt;
+				next_idx = idx;
+				next_track = t;
+				next_dts = dts;
+			}
+		}
+
+		if (!next)
+			break;
+
+		heads[next_track]++;
+		push_rebased_packet(&stream->mux_packets, next,
+				    next_idx < spilled, video_offset,
+				    audio_offsets, video_pts_offset,
+				    audio_dts_offsets);
+	}
+
+	for (size_t t = 0; t < REPLAY_TRACKS; t++)
+		da_free(tracks[t]);
+}
+
+/* a flush only drains the muxer's interleaving queue, so a child that takes
+ * longer than this is considered stuck */
+#define FLUSH_ACK_TIMEOUT_MS 5000
+
+/* asks ffmpeg-mux to push every packet written so far through the muxer and
+ * waits (at most FLUSH_ACK_TIMEOUT_MS) for its acknowledgement on stderr */
+static bool flush_pipe(struct ffmpeg_muxer *stream)
+{
+	struct ffm_packet_info info = {.type = FFM_PACKET_FLUSH};
+	struct dstr line = {0};
+	bool acked = false;
+	uint64_t deadline;
+
+	if (stream->inproc)
+		return ffmpeg_mux_inproc_flush(stream->inproc);
+
+	if (os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
+				  sizeof(info)) != sizeof(info) ||
+	    !os_process_pipe_flush(stream->pipe)) {
+		warn("os_process_pipe_write for flush request failed");
+		return false;
+	}
+
+	deadline = os_gettime_ns() + FLUSH_ACK_TIMEOUT_MS * 1000000ULL;
+
+	for (;;) {
+		uint64_t now = os_gettime_ns();
+		char ch;
+
+		if (now >= deadline ||
+		    !os_process_pipe_wait_err(
+			    stream->pipe,
+			    (uint32_t)((deadline - now) / 1000000ULL))) {
+			warn("Timed out waiting for ffmpeg-mux to flush");
+			break;
+		}
+
+		if (!os_process_pipe_read_err(stream->pipe, (uint8_t *)&ch, 1))
+			break;
+
+		if (ch == '\r')
+			continue;
+		if (ch != '\n') {
+			dstr_cat_ch(&line, ch);
+			continue;
+		}
+
+		if (dstr_cmp(&line, FFM_FLUSH_ACK) == 0) {
+			acked = true;
 			break;
+		}
+
+		if (!dstr_is_empty(&line))
+			warn("ffmpeg-mux: %s", line.array);
+		dstr_resize(&line, 0);
+	}
+
+	dstr_free(&line);
+	return acked;
+}
+
+static bool write_replay_pending_packets(struct ffmpeg_muxer *stream)
+{
+	struct deque *batch = &stream->replay_write_packets;
+	struct deque swap;
+	bool success = true;
+
+	/* hand the whole pending queue over at once, the encoder thread keeps
+	 * pushing into the (empty) previous batch while this one is written */
+	pthread_mutex_lock(&stream->replay_packets_mutex);
+	swap = stream->replay_pending_packets;
+	stream->replay_pending_packets = *batch;
+	*batch = swap;
+	pthread_mutex_unlock(&stream->replay_packets_mutex);
+
+	while (batch->size > 0) {
+		struct encoder_packet pkt;
+		deque_pop_front(batch, &pkt, sizeof(pkt));
+
+		if (success && !write_packet(stream, &pkt))
+			success = false;
+
+		obs_encoder_packet_release(&pkt);
 	}
 
-	da_insert(*packets, idx, &pkt);
+	return success;
 }
 
 static void replay_buffer_stop_mux_thread(void *data)
@@ -1668,13 +2177,11 @@ static void replay_buffer_stop_mux_thread(void *data)
 	struct ffmpeg_muxer *stream = data;
 	info("closing replay file %s", stream->path.array);
 
-	// TODO(eb): i add this to make sure all frames are
-	// handled by the ffmpeg-mux process (is some case the last fames of the replay
-	// are choppy)
-	os_sleep_ms(30);
+	if (!flush_pipe(stream))
+		warn("ffmpeg-mux did not acknowledge flush of '%s'",
+		     stream->path.array);
 
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
+	close_mux(stream);
 
 	os_atomic_set_bool(&stream->muxing, false);
 
@@ -1701,7 +2208,7 @@ static void *replay_buffer_mux_thread(void *data)
 	bool video_created = false;
 	start_pipe(stream, stream->path.array);
 
-	if (!stream->pipe) {
+	if (!mux_opened(stream)) {
 		warn("Failed to create process pipe");
 		error = true;
 		goto error;
@@ -1714,6 +2221,10 @@ static void *replay_buffer_mux_thread(void *data)
 		goto error;
 	}
 
+	/* spilled payloads may still be on their way into the file */
+	if (stream->spill)
+		replay_spill_flush(stream->spill);
+
 	for (size_t i = 0; i < stream->mux_packets.num; i++) {
 		struct encoder_packet *pkt = &stream->mux_packets.array[i];
 		if (!write_packet(stream, pkt)) {
@@ -1722,43 +2233,29 @@ static void *replay_buffer_mux_thread(void *data)
 			error = true;
 			goto error;
 		}
-		obs_encoder_packet_release(pkt);
+		release_mux_packet(stream, pkt);
 	}
 	da_free(stream->mux_packets);
+	if (stream->spill)
+		replay_spill_unpin(stream->spill);
 	stream->split_file = true;
 
 	info("Wrote replay buffer to '%s'", stream->path.array);
 	if (capturing_replay(stream)) {
 		// write to replay file until stopped
 		while (!stopping(stream) && !stopping_replay(stream)) {
-			// empty pending packets
-			while (stream->replay_pending_packets.size > 0) {
-				struct encoder_packet pkt;
-				pthread_mutex_lock(
-					&stream->replay_packets_mutex);
-
-				deque_pop_front(
-					&stream->replay_pending_packets, &pkt,
-					sizeof(pkt));
+			os_event_wait(stream->replay_packets_event);
 
-				pthread_mutex_unlock(
-					&stream->replay_packets_mutex);
-				write_packet(stream, &pkt);
-
-				obs_encoder_packet_release(&pkt);
+			if (!write_replay_pending_packets(stream)) {
+				error = true;
+				goto error;
 			}
-			os_sleep_ms(12); // 60 fps
 		}
 
 		// write all packets..
-		while (stream->replay_pending_packets.size > 0) {
-			struct encoder_packet pkt;
-			deque_pop_front(&stream->replay_pending_packets,
-					    &pkt,
-					    sizeof(pkt));
-			write_packet(stream, &pkt);
-
-			obs_encoder_packet_release(&pkt);
+		if (!write_replay_pending_packets(stream)) {
+			error = true;
+			goto error;
 		}
 
 		// close video (replay_stopping == tire)
@@ -1769,20 +2266,19 @@ static void *replay_buffer_mux_thread(void *data)
 	}
 	stream->split_file = false;
 error:
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
+	close_mux(stream);
 	
 	for (size_t i = 0; i < stream->mux_packets.num; i++)
-		obs_encoder_packet_release(&stream->mux_packets.array[i]);
+		release_mux_packet(stream, &stream->mux_packets.array[i]);
 	
 	da_free(stream->mux_packets);
+	if (stream->spill)
+		replay_spill_unpin(stream->spill);
 
-	while (stream->replay_pending_packets.size > 0) {
-		struct encoder_packet pkt;
-		deque_pop_front(&stream->replay_pending_packets, &pkt,
-				    sizeof(pkt));
-		obs_encoder_packet_release(&pkt);
-	}
+	pthread_mutex_lock(&stream->replay_packets_mutex);
+	release_packets(&stream->replay_pending_packets);
+	pthread_mutex_unlock(&stream->replay_packets_mutex);
+	release_packets(&stream->replay_write_packets);
 
 	if (video_created) {
 		obs_output_signal_replay_ready(stream->output, stream->duration,
@@ -1804,12 +2300,572 @@ error:
 	return NULL;
 }
 
-static void replay_buffer_save(struct ffmpeg_muxer *stream)
+/* ------------------------------------------------------------------------- */
+/* pre-muxed replay fragments                                                */
+
+static struct replay_fragment *fragment_create(uint64_t serial, bool keyframe,
+					       uint8_t *data, size_t size)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
+	struct replay_fragment *frag = bzalloc(sizeof(*frag));
+	frag->refs = 1;
+	frag->serial = serial;
+	frag->keyframe = keyframe;
+	frag->data = data;
+	frag->size = size;
+	return frag;
+}
+
+static inline struct replay_fragment *
+fragment_ref(struct replay_fragment *frag)
+{
+	os_atomic_inc_long(&frag->refs);
+	return frag;
+}
+
+static void fragment_release(struct replay_fragment *frag)
+{
+	if (frag && os_atomic_dec_long(&frag->refs) == 0) {
+		bfree(frag->data);
+		bfree(frag);
+	}
+}
+
+static inline size_t fragment_count(struct ffmpeg_muxer *stream)
+{
+	return stream->fragments.size / sizeof(struct replay_fragment *);
+}
+
+static inline struct replay_fragment *
+get_fragment(struct ffmpeg_muxer *stream, size_t idx)
+{
+	struct replay_fragment **frag = deque_data(
+		&stream->fragments, idx * sizeof(struct replay_fragment *));
+	return *frag;
+}
+
+static void free_save_fragments(struct ffmpeg_muxer *stream)
+{
+	for (size_t i = 0; i < stream->save_fragments.num; i++)
+		fragment_release(stream->save_fragments.array[i]);
+	da_free(stream->save_fragments);
+}
+
+static void stop_premux_thread(struct ffmpeg_muxer *stream);
+
+static void free_replay_fragments(struct ffmpeg_muxer *stream)
+{
+	stop_premux_thread(stream);
+
+	while (stream->fragments.size) {
+		struct replay_fragment *frag;
+		deque_pop_front(&stream->fragments, &frag, sizeof(frag));
+		fragment_release(frag);
+	}
+	deque_free(&stream->fragments);
+
+	fragment_release(stream->init_segment);
+	stream->init_segment = NULL;
+
+	ffmpeg_mux_fragmenter_destroy(stream->fragmenter);
+	stream->fragmenter = NULL;
+
+	free_save_fragments(stream);
+}
+
+static void disable_replay_fragments(struct ffmpeg_muxer *stream)
+{
+	warn("Pre-muxing the replay buffer failed, saves will remux it");
+	free_replay_fragments(stream);
+	stream->fragment_ext = NULL;
+}
+
+static bool write_fragment_header(struct ffmpeg_muxer *stream,
+				  obs_encoder_t *encoder,
+				  enum ffm_packet_type type, uint32_t index)
+{
+	struct ffm_packet_info info = {.type = type, .index = index};
+	uint8_t *data;
+	size_t size;
+
+	if (!obs_encoder_get_extra_data(encoder, &data, &size))
+		return false;
+
+	info.size = (uint32_t)size;
+	return ffmpeg_mux_fragmenter_write(stream->fragmenter, &info, data);
+}
+
+static bool create_fragmenter(struct ffmpeg_muxer *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	struct dstr last_path = {0};
+	struct dstr path = {0};
+	struct dstr cmd;
+	const uint8_t *init;
+	size_t init_size;
+
+	/* only the muxer parameters are used, nothing is written there */
+	dstr_printf(&path, "replay.%s", stream->fragment_ext);
+	dstr_move(&last_path, &stream->path);
+	build_command_line(stream, &cmd, path.array);
+	dstr_move(&stream->path, &last_path);
+	dstr_free(&path);
+
+	stream->fragmenter = ffmpeg_mux_fragmenter_create(
+		cmd.array,
+		strcmp(stream->fragment_ext, "mp4") == 0
+			? "movflags=frag_custom+empty_moov+default_base_moof"
+			: "");
+	dstr_free(&cmd);
+
+	if (!stream->fragmenter)
+		return false;
+
+	if (vencoder && !write_fragment_header(stream, vencoder,
+					       FFM_PACKET_VIDEO, 0))
+		return false;
+
+	for (uint32_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder =
+			obs_output_get_audio_encoder(stream->output, i);
+		if (!aencoder)
+			break;
+		if (!write_fragment_header(stream, aencoder, FFM_PACKET_AUDIO,
+					   i))
+			return false;
+	}
+
+	init = ffmpeg_mux_fragmenter_init_segment(stream->fragmenter,
+						  &init_size);
+	stream->init_segment = fragment_create(
+		0, false, init_size ? bmemdup(init, init_size) : NULL,
+		init_size);
+	stream->fragment_serial = stream->packets_pushed;
+	stream->fragment_keyframe = false;
+	return true;
+}
+
+/* closes the fragment in progress, the next one starts at serial */
+static void cut_fragment(struct ffmpeg_muxer *stream, uint64_t serial,
+			 bool keyframe)
+{
+	struct replay_fragment *frag;
+	uint8_t *data;
+	size_t size;
+
+	data = ffmpeg_mux_fragmenter_cut(stream->fragmenter, &size);
+	if (data) {
+		frag = fragment_create(stream->fragment_serial,
+				       stream->fragment_keyframe, data, size);
+
+		pthread_mutex_lock(&stream->premux_mutex);
+		deque_push_back(&stream->fragments, &frag, sizeof(frag));
+		pthread_mutex_unlock(&stream->premux_mutex);
+	}
+
+	stream->fragment_serial = serial;
+	stream->fragment_keyframe = keyframe;
+}
+
+struct premux_packet {
+	struct encoder_packet pkt;
+	uint64_t serial;
+};
+
+static bool premux_packet(struct ffmpeg_muxer *stream,
+			  struct premux_packet *job)
+{
+	struct encoder_packet *packet = &job->pkt;
+	bool is_video = packet->type == OBS_ENCODER_VIDEO;
+	struct ffm_packet_info info = {.pts = packet->pts,
+				       .dts = packet->dts,
+				       .size = (uint32_t)packet->size,
+				       .index = (int)packet->track_idx,
+				       .type = is_video ? FFM_PACKET_VIDEO
+							: FFM_PACKET_AUDIO,
+				       .keyframe = packet->keyframe};
+
+	/* every GOP starts a new fragment */
+	if (is_video && packet->keyframe)
+		cut_fragment(stream, job->serial, true);
+
+	return ffmpeg_mux_fragmenter_write(stream->fragmenter, &info,
+					   packet->data);
+}
+
+/* muxes the buffered packets into fragments off the encoder data thread */
+static void *replay_buffer_premux_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	os_set_thread_name("replay-buffer: premux");
+
+	while (os_sem_wait(stream->premux_sem) == 0) {
+		struct premux_packet job;
+		bool has_job = false;
+
+		pthread_mutex_lock(&stream->premux_mutex);
+		if (stream->premux_packets.size) {
+			deque_pop_front(&stream->premux_packets, &job,
+					sizeof(job));
+			has_job = true;
+		}
+		pthread_mutex_unlock(&stream->premux_mutex);
+
+		if (!has_job) {
+			if (os_atomic_load_bool(&stream->premux_stopping))
+				break;
+			continue;
+		}
+
+		if (!os_atomic_load_bool(&stream->premux_failed) &&
+		    !premux_packet(stream, &job))
+			os_atomic_set_bool(&stream->premux_failed, true);
+		obs_encoder_packet_release(&job.pkt);
+
+		pthread_mutex_lock(&stream->premux_mutex);
+		if (!stream->premux_packets.size)
+			os_event_signal(stream->premux_idle_event);
+		pthread_mutex_unlock(&stream->premux_mutex);
+	}
+
+	return NULL;
+}
+
+static bool start_premux_thread(struct ffmpeg_muxer *stream)
+{
+	pthread_mutex_init_value(&stream->premux_mutex);
+
+	if (pthread_mutex_init(&stream->premux_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&stream->premux_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&stream->premux_idle_event, OS_EVENT_TYPE_MANUAL) !=
+	    0)
+		goto fail;
+
+	os_event_signal(stream->premux_idle_event);
+	os_atomic_set_bool(&stream->premux_stopping, false);
+	os_atomic_set_bool(&stream->premux_failed, false);
+
+	stream->premux_thread_active =
+		pthread_create(&stream->premux_thread, NULL,
+			       replay_buffer_premux_thread, stream) == 0;
+	if (stream->premux_thread_active)
+		return true;
+
+fail:
+	os_event_destroy(stream->premux_idle_event);
+	stream->premux_idle_event = NULL;
+	os_sem_destroy(stream->premux_sem);
+	stream->premux_sem = NULL;
+	pthread_mutex_destroy(&stream->premux_mutex);
+	return false;
+}
+
+static void stop_premux_thread(struct ffmpeg_muxer *stream)
+{
+	if (!stream->premux_thread_active)
+		return;
+
+	os_atomic_set_bool(&stream->premux_stopping, true);
+	os_sem_post(stream->premux_sem);
+	pthread_join(stream->premux_thread, NULL);
+	stream->premux_thread_active = false;
+
+	while (stream->premux_packets.size) {
+		struct premux_packet job;
+		deque_pop_front(&stream->premux_packets, &job, sizeof(job));
+		obs_encoder_packet_release(&job.pkt);
+	}
+	deque_free(&stream->premux_packets);
+
+	os_event_destroy(stream->premux_idle_event);
+	stream->premux_idle_event = NULL;
+	os_sem_destroy(stream->premux_sem);
+	stream->premux_sem = NULL;
+	pthread_mutex_destroy(&stream->premux_mutex);
+}
+
+static void write_fragment_packet(struct ffmpeg_muxer *stream,
+				  struct encoder_packet *packet)
+{
+	struct premux_packet job = {.serial = stream->packets_pushed};
+
+	if (!stream->premux_thread_active) {
+		if (!create_fragmenter(stream) ||
+		    !start_premux_thread(stream)) {
+			disable_replay_fragments(stream);
+			return;
+		}
+	}
+
+	if (os_atomic_load_bool(&stream->premux_failed)) {
+		disable_replay_fragments(stream);
+		return;
+	}
+
+	obs_encoder_packet_ref(&job.pkt, packet);
+
+	pthread_mutex_lock(&stream->premux_mutex);
+	deque_push_back(&stream->premux_packets, &job, sizeof(job));
+	os_event_reset(stream->premux_idle_event);
+	pthread_mutex_unlock(&stream->premux_mutex);
+
+	os_sem_post(stream->premux_sem);
+}
+
+/* drops the fragments that only hold packets purged from the buffer */
+static void trim_fragments(struct ffmpeg_muxer *stream)
+{
+	if (!stream->premux_thread_active)
+		return;
+
+	pthread_mutex_lock(&stream->premux_mutex);
+	while (fragment_count(stream) > 1 &&
+	       get_fragment(stream, 1)->serial <= stream->packets_popped) {
+		struct replay_fragment *frag;
+		deque_pop_front(&stream->fragments, &frag, sizeof(frag));
+		fragment_release(frag);
+	}
+	pthread_mutex_unlock(&stream->premux_mutex);
+}
+
+/* how long a save waits for the premux thread, this runs on the encoder
+ * data thread so a premuxer that's behind falls back to a normal save */
+#define PREMUX_SAVE_WAIT_MS 100
+
+/* takes references to the init segment and the fragments from the keyframe
+ * at buffer position start onwards, including the GOP still in progress */
+static bool collect_replay_fragments(struct ffmpeg_muxer *stream, size_t start)
+{
+	uint64_t serial = stream->packets_popped + start;
+	size_t count;
+	size_t first;
+
+	if (!stream->premux_thread_active)
+		return false;
+
+	/* only this thread queues packets, so once the premux thread has
+	 * caught up the fragmenter can be cut from here */
+	if (os_event_timedwait(stream->premux_idle_event,
+			       PREMUX_SAVE_WAIT_MS) != 0) {
+		warn("Pre-muxer is behind, saving replay without fragments");
+		return false;
+	}
+	if (os_atomic_load_bool(&stream->premux_failed))
+		return false;
+
+	cut_fragment(stream, stream->packets_pushed, false);
+
+	pthread_mutex_lock(&stream->premux_mutex);
 
-	da_reserve(stream->mux_packets, num_packets);
+	count = fragment_count(stream);
+	for (first = 0; first < count; first++) {
+		struct replay_fragment *frag = get_fragment(stream, first);
+		if (frag->keyframe && frag->serial == serial)
+			break;
+	}
+
+	if (first == count) {
+		pthread_mutex_unlock(&stream->premux_mutex);
+		return false;
+	}
+
+	struct replay_fragment *init = fragment_ref(stream->init_segment);
+	da_push_back(stream->save_fragments, &init);
+
+	for (size_t i = first; i < count; i++) {
+		struct replay_fragment *frag =
+			fragment_ref(get_fragment(stream, i));
+		da_push_back(stream->save_fragments, &frag);
+	}
+
+	pthread_mutex_unlock(&stream->premux_mutex);
+	return true;
+}
+
+#define REBASE_TRACKS (MAX_AUDIO_MIXES + 2)
+
+/* decode time of the first fragment of each track, by track ID */
+struct fragment_rebase {
+	bool found[REBASE_TRACKS];
+	uint64_t base[REBASE_TRACKS];
+};
+
+static inline uint32_t read_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint64_t read_be64(const uint8_t *p)
+{
+	return ((uint64_t)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+static inline void write_be32(uint8_t *p, uint32_t val)
+{
+	p[0] = (uint8_t)(val >> 24);
+	p[1] = (uint8_t)(val >> 16);
+	p[2] = (uint8_t)(val >> 8);
+	p[3] = (uint8_t)val;
+}
+
+static inline void write_be64(uint8_t *p, uint64_t val)
+{
+	write_be32(p, (uint32_t)(val >> 32));
+	write_be32(p + 4, (uint32_t)val);
+}
+
+static void rebase_traf(uint8_t *traf, size_t size,
+			struct fragment_rebase *rebase)
+{
+	uint32_t track_id = 0;
+	size_t pos = 8;
+
+	while (pos + 8 <= size) {
+		uint8_t *box = traf + pos;
+		uint32_t box_size = read_be32(box);
+
+		if (box_size < 8 || pos + box_size > size)
+			break;
+
+		if (memcmp(box + 4, "tfhd", 4) == 0 && box_size >= 16) {
+			track_id = read_be32(box + 12);
+
+		} else if (memcmp(box + 4, "tfdt", 4) == 0 && box_size >= 16 &&
+			   track_id < REBASE_TRACKS) {
+			bool v1 = box[8] == 1 && box_size >= 20;
+			uint64_t time = v1 ? read_be64(box + 12)
+					   : read_be32(box + 12);
+
+			if (!rebase->found[track_id]) {
+				rebase->found[track_id] = true;
+				rebase->base[track_id] = time;
+			}
+
+			time -= rebase->base[track_id];
+			if (v1)
+				write_be64(box + 12, time);
+			else
+				write_be32(box + 12, (uint32_t)time);
+		}
+
+		pos += box_size;
+	}
+}
+
+/* moves the decode times of a moof so that the saved clip starts at 0 */
+static void rebase_moof(uint8_t *moof, size_t size,
+			struct fragment_rebase *rebase)
+{
+	size_t pos = 8;
+
+	while (pos + 8 <= size) {
+		uint8_t *box = moof + pos;
+		uint32_t box_size = read_be32(box);
+
+		if (box_size < 8 || pos + box_size > size)
+			break;
+
+		if (memcmp(box + 4, "traf", 4) == 0)
+			rebase_traf(box, box_size, rebase);
+
+		pos += box_size;
+	}
+}
+
+static bool write_mp4_fragment(FILE *file, const struct replay_fragment *frag,
+			       struct fragment_rebase *rebase)
+{
+	DARRAY(uint8_t) moof;
+	size_t pos = 0;
+	bool success = true;
+
+	da_init(moof);
+
+	while (success && pos < frag->size) {
+		const uint8_t *box = frag->data + pos;
+		size_t box_size = frag->size - pos;
+
+		if (box_size >= 8 && read_be32(box) >= 8 &&
+		    read_be32(box) <= box_size)
+			box_size = read_be32(box);
+
+		if (box_size >= 8 && memcmp(box + 4, "moof", 4) == 0) {
+			da_resize(moof, 0);
+			da_push_back_array(moof, box, box_size);
+			rebase_moof(moof.array, box_size, rebase);
+			box = moof.array;
+		}
+
+		success = fwrite(box, 1, box_size, file) == box_size;
+		pos += box_size;
+	}
+
+	da_free(moof);
+	return success;
+}
+
+static void *replay_buffer_fragments_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	struct fragment_rebase rebase = {0};
+	bool mp4 = strcmp(stream->fragment_ext, "mp4") == 0;
+	bool error = false;
+	FILE *file;
+
+	os_set_thread_name("replay-buffer: save fragments");
+
+	file = os_fopen(stream->path.array, "wb");
+	if (!file) {
+		warn("Could not open '%s'", stream->path.array);
+		error = true;
+		goto done;
+	}
+
+	for (size_t i = 0; i < stream->save_fragments.num && !error; i++) {
+		const struct replay_fragment *frag =
+			stream->save_fragments.array[i];
+
+		if (mp4 && i > 0)
+			error = !write_mp4_fragment(file, frag, &rebase);
+		else if (frag->size)
+			error = fwrite(frag->data, 1, frag->size, file) !=
+				frag->size;
+	}
+
+	if (fclose(file) != 0)
+		error = true;
+
+	if (error) {
+		warn("Could not write replay fragments to '%s'",
+		     stream->path.array);
+	} else {
+		info("Wrote replay buffer to '%s'", stream->path.array);
+		obs_output_signal_replay_ready(stream->output, stream->duration,
+					       stream->replay_system_start_time,
+					       stream->path.array);
+	}
+
+done:
+	free_save_fragments(stream);
+	os_atomic_set_bool(&stream->muxing, false);
+
+	if (!error) {
+		calldata_t cd = {0};
+		signal_handler_t *sh =
+			obs_output_get_signal_handler(stream->output);
+		signal_handler_signal(sh, "saved", &cd);
+	}
+
+	return NULL;
+}
+
+static void replay_buffer_save(struct ffmpeg_muxer *stream)
+{
+	size_t num_packets = replay_packet_count(stream);
+	size_t start = 0;
 
 	/* ---------------------------- */
 	/* reorder packets */
@@ -1820,32 +2876,14 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 	int64_t video_pts_offset = 0;
 	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
 	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
-	bool prefix_first_key_frame = false;
-	size_t last_key_frame_index = 0;
 	int64_t video_duration = 0;
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = deque_data(&stream->packets, i * size);
-		if (stream->save_start_pts_usec != 0) {
-			if (!prefix_first_key_frame &&
-			    pkt->sys_pts_usec < stream->save_start_pts_usec) {
-
-				if (pkt->keyframe) {
-					last_key_frame_index = i;
-				}
-				continue;
-			}
 
-			// make sure out first frame is key frame
-			if (!found_video) {
-				if (!pkt->keyframe &&
-				    (i != (num_packets - 1))) {
-					i = last_key_frame_index - 1;
-					prefix_first_key_frame = true;
-					continue;
-				}
-			}
-		}
+	// make sure out first frame is key frame
+	if (stream->save_start_pts_usec != 0)
+		find_replay_start(stream, stream->save_start_pts_usec, &start);
+
+	for (size_t i = start; i < num_packets; i++) {
+		struct encoder_packet *pkt = get_replay_packet(stream, i);
 
 		if (pkt->type == OBS_ENCODER_VIDEO) {
 			if (!found_video) {
@@ -1859,6 +2897,8 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 				video_offset = pkt->sys_pts_usec;
 				found_video = true;
 			}
+
+			video_duration = pkt->dts_usec - video_offset;
 		} else {
 			if (!found_audio[pkt->track_idx]) {
 				found_audio[pkt->track_idx] = true;
@@ -1866,16 +2906,14 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 				audio_dts_offsets[pkt->track_idx] = pkt->dts;
 			}
 		}
-
-		insert_packet(&stream->mux_packets, pkt, video_offset,
-			      audio_offsets, video_pts_offset,
-			      audio_dts_offsets);
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			video_duration = pkt->dts_usec - video_offset;
-		}
 	}
 
+	bool fragments = collect_replay_fragments(stream, start);
+	if (!fragments)
+		merge_replay_packets(stream, start, video_offset,
+				     audio_offsets, video_pts_offset,
+				     audio_dts_offsets);
+
 	stream->duration = video_duration;
 
 	/* ---------------------------- */
@@ -1889,9 +2927,11 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 	}
 
 	os_atomic_set_bool(&stream->muxing, true);
-	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
-						     replay_buffer_mux_thread,
-						     stream) == 0;
+	stream->mux_thread_joinable =
+		pthread_create(&stream->mux_thread, NULL,
+			       fragments ? replay_buffer_fragments_thread
+					 : replay_buffer_mux_thread,
+			       stream) == 0;
 	if (!stream->mux_thread_joinable) {
 		warn("Failed to create muxer thread");
 		os_atomic_set_bool(&stream->muxing, false);
@@ -1912,21 +2952,20 @@ static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
 
 	os_atomic_set_bool(&stream->active, false);
 	os_atomic_set_bool(&stream->sent_headers, false);
-	os_atomic_set_bool(&stream->stopping, false);	
-	replay_buffer_clear(stream);
 
 	if (stream->mux_thread_joinable) {
 		pthread_join(stream->mux_thread, NULL);
 		stream->mux_thread_joinable = false;
 	}
+
+	os_atomic_set_bool(&stream->stopping, false);
+	replay_buffer_clear(stream);
 }
 
 static void replay_buffer_start_capture(struct ffmpeg_muxer *stream)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
-
-	da_reserve(stream->mux_packets, num_packets);
+	size_t num_packets = replay_packet_count(stream);
+	size_t start = 0;
 
 	/* ---------------------------- */
 	/* reorder packets */
@@ -1940,43 +2979,18 @@ static void replay_buffer_start_capture(struct ffmpeg_muxer *stream)
 	memset(stream->audio_dts_offsets, 0, sizeof(stream->audio_dts_offsets));
 
 	int64_t video_duration = 0;
-	int last_key_frame_index = -1;
-	bool prefix_first_key_frame = false;
 	int pushed_frames = 0;
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = deque_data(&stream->packets, i * size);
-
-		// replay has tail..
-		if (stream->save_start_pts_usec != 0) {
-			if (!prefix_first_key_frame) {
-				if (pkt->sys_pts_usec < stream->save_start_pts_usec) {
-					if (pkt->keyframe) {
-						last_key_frame_index = (int)i;
-					}
-
-					// we pass all packets so use the last key frame..
-					if ((i + 1) == num_packets &&
-					    last_key_frame_index >= 0) {
-						i = last_key_frame_index - 1;
-						prefix_first_key_frame = true;
-						info("apply first key frame in buffer [%d (of %d)]",
-						     i, num_packets);
-					}
-					continue;
-				}
-			}
 
-			// make sure out first frame is key frame
-			if (!found_video) {
-				if (!pkt->keyframe &&
-				    (i != (num_packets - 1))) {
-					i = last_key_frame_index - 1;
-					prefix_first_key_frame = true;
-					continue;
-				}
-			}
-		}
+	// replay has tail.. make sure out first frame is key frame
+	if (find_replay_start(stream, stream->save_start_pts_usec, &start)) {
+		info("apply first key frame in buffer [%d (of %d)]", (int)start,
+		     (int)num_packets);
+	} else {
+		start = num_packets;
+	}
+
+	for (size_t i = start; i < num_packets; i++) {
+		struct encoder_packet *pkt = get_replay_packet(stream, i);
 
 		if (pkt->type == OBS_ENCODER_VIDEO) {
 			if (!found_video) {
@@ -1991,6 +3005,8 @@ static void replay_buffer_start_capture(struct ffmpeg_muxer *stream)
 				stream->video_pts_offset = pkt->pts;
 				found_video = true;
 			}
+
+			video_duration = pkt->dts_usec - stream->video_offset;
 		} else {
 			if (!found_audio[pkt->track_idx]) {
 				found_audio[pkt->track_idx] = true;
@@ -2000,16 +3016,7 @@ static void replay_buffer_start_capture(struct ffmpeg_muxer *stream)
 					pkt->dts;
 			}
 		}
-
-		insert_packet(&stream->mux_packets, pkt,
-			      stream->video_offset, stream->audio_offsets,
-			      stream->video_pts_offset,
-			      stream->audio_dts_offsets);
 		pushed_frames++;
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			video_duration = pkt->dts_usec - stream->video_offset;
-		}
 	}
 
 	static bool waiting_for_frame = false;
@@ -2018,14 +3025,17 @@ static void replay_buffer_start_capture(struct ffmpeg_muxer *stream)
 	if (!found_video) {
 		if (!waiting_for_frame) { // log only once
 			warn("start replay, waiting for video frame [frames: %d kf: %d packets: %d]",
-			     pushed_frames, last_key_frame_index, num_packets);
+			     pushed_frames, (int)keyframe_count(stream),
+			     num_packets);
 		}
 		waiting_for_frame = true;
-		da_free(stream->mux_packets);
 		return;
 	}
 
 	waiting_for_frame = false;
+	merge_replay_packets(stream, start, stream->video_offset,
+			     stream->audio_offsets, stream->video_pts_offset,
+			     stream->audio_dts_offsets);
 	stream->duration = video_duration;
 
 	/* ---------------------------- */
@@ -2082,21 +3092,25 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 
 	obs_encoder_packet_ref(&pkt, packet);
 	replay_buffer_purge(stream, &pkt);
+	trim_fragments(stream);
 
-	if (!stream->packets.size)
+	if (!replay_packet_count(stream))
 		stream->cur_time = pkt.dts_usec;
 	stream->cur_size += pkt.size;
+	stream->ram_size += pkt.size;
 
 	if (stream->stream_start_time == 0) {
 		stream->stream_start_time = os_get_epoch_time();
 	}
 
+	if (stream->fragment_ext)
+		write_fragment_packet(stream, packet);
+
 	deque_push_back(&stream->packets, packet, sizeof(*packet));
+	index_packet(stream, packet);
 
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe) {
-		int64_t sys_pts_usec = packet_pts_usec(packet);
-		stream->keyframes++;
-	}
+	if (stream->spill)
+		replay_buffer_spill(stream);
 
 	if (stream->save_start_pts_usec != 0) {
 		if (!stream->capturing_replay) {
@@ -2121,9 +3135,10 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 
 			pthread_mutex_lock(&stream->replay_packets_mutex);
 			deque_push_back(&stream->replay_pending_packets,
-					    packet, sizeof(*packet));
-
+					packet, sizeof(*packet));
 			pthread_mutex_unlock(&stream->replay_packets_mutex);
+
+			os_event_signal(stream->replay_packets_event);
 		}
 	}
 	//int64_t sys_pts_usec = packet_pts_usec(packet);
@@ -2159,6 +3174,9 @@ static void replay_buffer_defaults(obs_data_t *s)
 {
 	obs_data_set_default_int(s, "max_time_sec", 15);
 	obs_data_set_default_int(s, "max_size_mb", 500);
+	obs_data_set_default_int(s, "max_ram_size_mb", 0);
+	/* keeps a muxed copy of the whole window, roughly doubling memory */
+	obs_data_set_default_bool(s, "premux_fragments", false);
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
@@ -11,9 +11,32 @@
 
 typedef DARRAY(struct encoder_packet) mux_packets_t;
 
+struct ffmpeg_mux_inproc;
+struct ffm_ring;
+struct replay_spill;
+struct ffmpeg_mux_fragmenter;
+
+/* video keyframe in the replay buffer, serial is the number of packets that
+ * were buffered before it */
+struct replay_keyframe {
+	uint64_t serial;
+	int64_t sys_pts_usec;
+};
+
+/* already muxed part of the replay buffer, starting at packet serial */
+struct replay_fragment {
+	volatile long refs;
+	uint64_t serial;
+	bool keyframe;
+	uint8_t *data;
+	size_t size;
+};
+
 struct ffmpeg_muxer {
 	obs_output_t *output;
 	os_process_pipe_t *pipe;
+	struct ffmpeg_mux_inproc *inproc;
+	struct ffm_ring *ring;
 	int64_t stop_ts;
 	uint64_t total_bytes;
 	bool sent_headers;
@@ -41,10 +64,43 @@ struct ffmpeg_muxer {
 	bool replay_stopping;
 	bool fully_armed;
 	pthread_mutex_t replay_packets_mutex;
+	os_event_t *replay_packets_event;
 	struct deque replay_pending_packets;
+	struct deque replay_write_packets;
 	volatile bool capturing_replay;
 
 	int keyframes;
+	struct deque keyframe_index;
+	uint64_t packets_pushed;
+	uint64_t packets_popped;
+
+	/* older packets of the replay window whose payloads were moved to the
+	 * spill file, they come before the packets that are still in memory */
+	struct replay_spill *spill;
+	struct deque spilled_packets;
+	int64_t ram_size;
+	int64_t max_ram_size;
+
+	/* the replay window muxed ahead of time, one fragment per GOP, so a
+	 * save only has to write them out.  The fragmenter is fed by the
+	 * premux thread, fragments is shared with it under premux_mutex.
+	 * Every packet of the window is held twice while this is enabled,
+	 * once as a packet and once inside a fragment. */
+	const char *fragment_ext;
+	struct ffmpeg_mux_fragmenter *fragmenter;
+	struct replay_fragment *init_segment;
+	struct deque fragments;
+	uint64_t fragment_serial;
+	bool fragment_keyframe;
+	DARRAY(struct replay_fragment *) save_fragments;
+	pthread_t premux_thread;
+	bool premux_thread_active;
+	pthread_mutex_t premux_mutex;
+	os_sem_t *premux_sem;
+	os_event_t *premux_idle_event;
+	struct deque premux_packets;
+	volatile bool premux_stopping;
+	volatile bool premux_failed;
 	obs_hotkey_id hotkey;
 	volatile bool muxing;
 	mux_packets_t mux_packets;
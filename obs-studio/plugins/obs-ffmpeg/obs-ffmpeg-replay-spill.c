@@ -0,0 +1,339 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/deque.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include <obs.h>
+
+#include "obs-ffmpeg-replay-spill.h"
+
+#define SPILL_ALIGN 16
+
+struct spill_job {
+	uint8_t *dst;
+	struct encoder_packet pkt;
+};
+
+/* head and tail are positions in the byte stream written to the file, the
+ * file offset is position % size.  A payload that doesn't fit before the
+ * end of the file starts over at offset 0 and the gap is skipped.
+ *
+ * Space is reserved by the caller's thread, the copies into the mapping are
+ * made by the writer thread in the same order. */
+struct replay_spill {
+	uint8_t *data;
+	uint64_t size;
+
+	uint64_t head;
+	uint64_t tail;
+	struct deque ends;
+
+	volatile bool pinned;
+	uint64_t pin;
+
+	pthread_t thread;
+	bool thread_created;
+	pthread_mutex_t mutex;
+	os_sem_t *write_sem;
+	os_event_t *idle_event;
+	struct deque jobs;
+	volatile bool stopping;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+/* The file gets a unique name in dir, so nothing that's already there is
+ * touched.  Its space is allocated up front, writing to the mapping of a
+ * sparse file crashes once the disk is full. */
+#ifdef _WIN32
+static bool map_file(struct replay_spill *spill, const char *dir)
+{
+	FILE_ALLOCATION_INFO alloc;
+	LARGE_INTEGER size;
+	wchar_t path[MAX_PATH];
+	wchar_t *wdir;
+	UINT ret;
+
+	if (!os_utf8_to_wcs_ptr(dir, 0, &wdir))
+		return false;
+
+	ret = GetTempFileNameW(wdir, L"obs", 0, path);
+	bfree(wdir);
+
+	if (!ret)
+		return false;
+
+	spill->file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+				  OPEN_EXISTING,
+				  FILE_ATTRIBUTE_TEMPORARY |
+					  FILE_FLAG_DELETE_ON_CLOSE,
+				  NULL);
+
+	if (spill->file == INVALID_HANDLE_VALUE) {
+		spill->file = NULL;
+		DeleteFileW(path);
+		return false;
+	}
+
+	size.QuadPart = (LONGLONG)spill->size;
+	alloc.AllocationSize = size;
+	if (!SetFileInformationByHandle(spill->file, FileAllocationInfo, &alloc,
+					sizeof(alloc)) ||
+	    !SetFilePointerEx(spill->file, size, NULL, FILE_BEGIN) ||
+	    !SetEndOfFile(spill->file))
+		return false;
+
+	spill->mapping = CreateFileMappingW(spill->file, NULL, PAGE_READWRITE,
+					    (DWORD)(spill->size >> 32),
+					    (DWORD)spill->size, NULL);
+	if (!spill->mapping)
+		return false;
+
+	spill->data = MapViewOfFile(spill->mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+				    (SIZE_T)spill->size);
+	return !!spill->data;
+}
+
+static void unmap_file(struct replay_spill *spill)
+{
+	if (spill->data)
+		UnmapViewOfFile(spill->data);
+	if (spill->mapping)
+		CloseHandle(spill->mapping);
+	if (spill->file)
+		CloseHandle(spill->file);
+}
+#else
+static bool preallocate(int fd, off_t size)
+{
+#ifdef __APPLE__
+	fstore_t store = {
+		.fst_flags = F_ALLOCATEALL,
+		.fst_posmode = F_PEOFPOSMODE,
+		.fst_length = size,
+	};
+
+	if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+		return false;
+	return ftruncate(fd, size) == 0;
+#else
+	return posix_fallocate(fd, 0, size) == 0;
+#endif
+}
+
+static bool map_file(struct replay_spill *spill, const char *dir)
+{
+	struct dstr path = {0};
+	void *ptr;
+	int fd;
+
+	dstr_printf(&path, "%s/obs-replay-XXXXXX", dir);
+	fd = mkstemp(path.array);
+
+	/* the mapping keeps the file alive */
+	if (fd != -1)
+		unlink(path.array);
+	dstr_free(&path);
+
+	if (fd == -1)
+		return false;
+
+	if (!preallocate(fd, (off_t)spill->size)) {
+		close(fd);
+		return false;
+	}
+
+	ptr = mmap(NULL, (size_t)spill->size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED)
+		return false;
+
+	spill->data = ptr;
+	return true;
+}
+
+static void unmap_file(struct replay_spill *spill)
+{
+	if (spill->data)
+		munmap(spill->data, (size_t)spill->size);
+}
+#endif
+
+static void *spill_thread(void *data)
+{
+	struct replay_spill *spill = data;
+
+	os_set_thread_name("replay spill: writer");
+
+	while (os_sem_wait(spill->write_sem) == 0) {
+		struct spill_job job;
+		bool has_job = false;
+
+		pthread_mutex_lock(&spill->mutex);
+		if (spill->jobs.size) {
+			deque_pop_front(&spill->jobs, &job, sizeof(job));
+			has_job = true;
+		}
+		pthread_mutex_unlock(&spill->mutex);
+
+		if (!has_job) {
+			if (os_atomic_load_bool(&spill->stopping))
+				break;
+			continue;
+		}
+
+		memcpy(job.dst, job.pkt.data, job.pkt.size);
+		obs_encoder_packet_release(&job.pkt);
+
+		pthread_mutex_lock(&spill->mutex);
+		if (!spill->jobs.size)
+			os_event_signal(spill->idle_event);
+		pthread_mutex_unlock(&spill->mutex);
+	}
+
+	return NULL;
+}
+
+struct replay_spill *replay_spill_create(const char *dir, uint64_t size)
+{
+	struct replay_spill *spill = bzalloc(sizeof(*spill));
+
+	spill->size = (size + SPILL_ALIGN - 1) & ~(uint64_t)(SPILL_ALIGN - 1);
+	pthread_mutex_init_value(&spill->mutex);
+
+	if (!map_file(spill, dir)) {
+		blog(LOG_WARNING,
+		     "[replay spill] Failed to create a %" PRIu64
+		     " byte file in '%s'",
+		     spill->size, dir);
+		goto fail;
+	}
+
+	if (pthread_mutex_init(&spill->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&spill->write_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&spill->idle_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+
+	os_event_signal(spill->idle_event);
+
+	spill->thread_created =
+		pthread_create(&spill->thread, NULL, spill_thread, spill) == 0;
+	if (!spill->thread_created)
+		goto fail;
+
+	return spill;
+
+fail:
+	replay_spill_destroy(spill);
+	return NULL;
+}
+
+void replay_spill_destroy(struct replay_spill *spill)
+{
+	if (!spill)
+		return;
+
+	/* the remaining copies are made before the file is unmapped */
+	if (spill->thread_created) {
+		os_atomic_set_bool(&spill->stopping, true);
+		os_sem_post(spill->write_sem);
+		pthread_join(spill->thread, NULL);
+	}
+
+	unmap_file(spill);
+	os_event_destroy(spill->idle_event);
+	os_sem_destroy(spill->write_sem);
+	pthread_mutex_destroy(&spill->mutex);
+	deque_free(&spill->jobs);
+	deque_free(&spill->ends);
+	bfree(spill);
+}
+
+uint8_t *replay_spill_write(struct replay_spill *spill,
+			    struct encoder_packet *pkt)
+{
+	struct spill_job job = {.pkt = *pkt};
+	uint64_t aligned = ((uint64_t)pkt->size + SPILL_ALIGN - 1) &
+			   ~(uint64_t)(SPILL_ALIGN - 1);
+	uint64_t start = spill->tail;
+	uint64_t offset = start % spill->size;
+	uint64_t oldest = spill->head;
+
+	if (!aligned || aligned > spill->size)
+		return NULL;
+
+	if (offset + aligned > spill->size) {
+		start += spill->size - offset;
+		offset = 0;
+	}
+
+	if (os_atomic_load_bool(&spill->pinned) && spill->pin < oldest)
+		oldest = spill->pin;
+	if (start + aligned - oldest > spill->size)
+		return NULL;
+
+	job.dst = spill->data + offset;
+
+	pthread_mutex_lock(&spill->mutex);
+	deque_push_back(&spill->jobs, &job, sizeof(job));
+	os_event_reset(spill->idle_event);
+	pthread_mutex_unlock(&spill->mutex);
+	os_sem_post(spill->write_sem);
+
+	spill->tail = start + aligned;
+	deque_push_back(&spill->ends, &spill->tail, sizeof(spill->tail));
+	return job.dst;
+}
+
+void replay_spill_flush(struct replay_spill *spill)
+{
+	os_event_wait(spill->idle_event);
+}
+
+void replay_spill_pop(struct replay_spill *spill)
+{
+	if (spill->ends.size)
+		deque_pop_front(&spill->ends, &spill->head, sizeof(spill->head));
+}
+
+bool replay_spill_contains(const struct replay_spill *spill,
+			   const uint8_t *data)
+{
+	return spill && data >= spill->data &&
+	       data < spill->data + spill->size;
+}
+
+void replay_spill_pin(struct replay_spill *spill)
+{
+	if (os_atomic_load_bool(&spill->pinned))
+		return;
+
+	spill->pin = spill->head;
+	os_atomic_set_bool(&spill->pinned, true);
+}
+
+void replay_spill_unpin(struct replay_spill *spill)
+{
+	os_atomic_set_bool(&spill->pinned, false);
+}
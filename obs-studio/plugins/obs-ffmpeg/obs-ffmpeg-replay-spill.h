@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Memory mapped file the replay buffer moves its older GOPs to so that only
+ * the most recent part of the window has to stay in memory.  Payloads are
+ * appended like a log and released in the same order. */
+struct replay_spill;
+struct encoder_packet;
+
+/* Creates a file with a unique name in dir, preallocated to size bytes and
+ * deleted once it is closed.  Fails if the space can't be allocated. */
+struct replay_spill *replay_spill_create(const char *dir, uint64_t size);
+void replay_spill_destroy(struct replay_spill *spill);
+
+/* Returns the location of the copy, or NULL if the file is full.  The copy
+ * is made on the spill's own thread, which takes over the packet reference
+ * on success.  The payload can only be read once replay_spill_flush has
+ * returned. */
+uint8_t *replay_spill_write(struct replay_spill *spill,
+			    struct encoder_packet *pkt);
+/* waits for every write made so far to land in the file */
+void replay_spill_flush(struct replay_spill *spill);
+/* releases the oldest payload */
+void replay_spill_pop(struct replay_spill *spill);
+
+bool replay_spill_contains(const struct replay_spill *spill,
+			   const uint8_t *data);
+
+/* Keeps every payload that is currently spilled readable until unpinned,
+ * even if it is popped in the meantime.  Used while a save is muxing the
+ * spilled packets on another thread. */
+void replay_spill_pin(struct replay_spill *spill);
+void replay_spill_unpin(struct replay_spill *spill);
@@ -44,6 +44,8 @@ struct ffmpeg_source {
 	char *ffmpeg_options;
 	int buffering_mb;
 	int speed_percent;
+	int decode_threads;
+	int loop_cache_mb;
 	bool is_looping;
 	bool is_local_file;
 	bool is_hw_decoding;
@@ -105,6 +107,7 @@ static bool is_local_file_modified(obs_properties_t *props,
 	obs_property_t *buffering = obs_properties_get(props, "buffering_mb");
 	obs_property_t *seekable = obs_properties_get(props, "seekable");
 	obs_property_t *speed = obs_properties_get(props, "speed_percent");
+	obs_property_t *loop_cache = obs_properties_get(props, "loop_cache_mb");
 	obs_property_t *reconnect_delay_sec =
 		obs_properties_get(props, "reconnect_delay_sec");
 	obs_property_set_visible(input, !enabled);
@@ -113,6 +116,7 @@ static bool is_local_file_modified(obs_properties_t *props,
 	obs_property_set_visible(local_file, enabled);
 	obs_property_set_visible(looping, enabled);
 	obs_property_set_visible(speed, enabled);
+	obs_property_set_visible(loop_cache, enabled);
 	obs_property_set_visible(seekable, !enabled);
 	obs_property_set_visible(reconnect_delay_sec, !enabled);
 
@@ -185,6 +189,13 @@ static obs_properties_t *ffmpeg_source_getproperties(void *data)
 	obs_properties_add_bool(props, "restart_on_activate",
 				obs_module_text("RestartWhenActivated"));
 
+	prop = obs_properties_add_int_slider(props, "loop_cache_mb",
+					     obs_module_text("LoopCacheMB"), 0,
+					     2048, 16);
+	obs_property_int_set_suffix(prop, " MB");
+	obs_property_set_long_description(
+		prop, obs_module_text("LoopCacheMB.ToolTip"));
+
 	prop = obs_properties_add_int_slider(props, "buffering_mb",
 					     obs_module_text("BufferingMB"), 0,
 					     16, 1);
@@ -205,6 +216,12 @@ static obs_properties_t *ffmpeg_source_getproperties(void *data)
 	obs_properties_add_bool(props, "hw_decode",
 				obs_module_text("HardwareDecode"));
 
+	prop = obs_properties_add_int_slider(props, "decode_threads",
+					     obs_module_text("DecodeThreads"),
+					     0, 16, 1);
+	obs_property_set_long_description(
+		prop, obs_module_text("DecodeThreads.ToolTip"));
+
 	obs_properties_add_bool(props, "clear_on_media_end",
 				obs_module_text("ClearOnMediaEnd"));
 
@@ -258,6 +275,8 @@ static void dump_source_info(struct ffmpeg_source *s, const char *input,
 		"\tis_looping:              %s\n"
 		"\tis_linear_alpha:         %s\n"
 		"\tis_hw_decoding:          %s\n"
+		"\tdecode_threads:          %d\n"
+		"\tloop_cache_mb:           %d\n"
 		"\tis_clear_on_media_end:   %s\n"
 		"\trestart_on_activate:     %s\n"
 		"\tclose_when_inactive:     %s\n"
@@ -266,8 +285,8 @@ static void dump_source_info(struct ffmpeg_source *s, const char *input,
 		input ? input : "(null)",
 		input_format ? input_format : "(null)", s->speed_percent,
 		s->is_looping ? "yes" : "no", s->is_linear_alpha ? "yes" : "no",
-		s->is_hw_decoding ? "yes" : "no",
-		s->is_clear_on_media_end ? "yes" : "no",
+		s->is_hw_decoding ? "yes" : "no", s->decode_threads,
+		s->loop_cache_mb, s->is_clear_on_media_end ? "yes" : "no",
 		s->restart_on_activate ? "yes" : "no",
 		s->close_when_inactive ? "yes" : "no",
 		s->full_decode ? "yes" : "no", s->ffmpeg_options);
@@ -279,6 +298,13 @@ static void get_frame(void *opaque, struct obs_source_frame *f)
 	obs_source_output_video(s->source, f);
 }
 
+static void lend_frame(void *opaque, struct obs_source_frame *f,
+		       mp_frame_release_cb release, void *param)
+{
+	struct ffmpeg_source *s = opaque;
+	obs_source_lend_video(s->source, f, release, param);
+}
+
 static void preload_frame(void *opaque, struct obs_source_frame *f)
 {
 	struct ffmpeg_source *s = opaque;
@@ -329,6 +355,7 @@ static void ffmpeg_source_open(struct ffmpeg_source *s)
 		struct mp_media_info info = {
 			.opaque = s,
 			.v_cb = get_frame,
+			.v_lend_cb = lend_frame,
 			.v_preload_cb = preload_frame,
 			.v_seek_cb = seek_frame,
 			.a_cb = get_audio,
@@ -345,6 +372,11 @@ static void ffmpeg_source_open(struct ffmpeg_source *s)
 			.reconnecting = s->reconnecting,
 			.request_preload = s->is_stinger,
 			.full_decode = s->full_decode,
+			.decode_threads = s->decode_threads,
+			.loop_cache_size = s->is_local_file
+						   ? (size_t)s->loop_cache_mb *
+							     1024 * 1024
+						   : 0,
 		};
 
 		s->media = media_playback_create(&info);
@@ -453,6 +485,8 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 	enum video_range_type range;
 	bool is_linear_alpha;
 	int speed_percent;
+	int decode_threads;
+	int loop_cache_mb;
 	bool is_looping;
 
 	bfree(s->input_format);
@@ -488,10 +522,14 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 	if (speed_percent < 1 || speed_percent > 200)
 		speed_percent = 100;
 	ffmpeg_options = obs_data_get_string(settings, "ffmpeg_options");
+	decode_threads = (int)obs_data_get_int(settings, "decode_threads");
+	loop_cache_mb = (int)obs_data_get_int(settings, "loop_cache_mb");
 
 	/* Restart media source if these properties are changed */
 	if (s->is_hw_decoding != is_hw_decoding || s->range != range ||
 	    s->speed_percent != speed_percent ||
+	    s->decode_threads != decode_threads ||
+	    s->loop_cache_mb != loop_cache_mb ||
 	    (s->ffmpeg_options &&
 	     strcmp(s->ffmpeg_options, ffmpeg_options) != 0))
 		should_restart_media = true;
@@ -525,6 +563,8 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 	s->is_linear_alpha = is_linear_alpha;
 	s->buffering_mb = (int)obs_data_get_int(settings, "buffering_mb");
 	s->speed_percent = speed_percent;
+	s->decode_threads = decode_threads;
+	s->loop_cache_mb = loop_cache_mb;
 	s->is_local_file = is_local_file;
 	s->seekable = obs_data_get_bool(settings, "seekable");
 	s->ffmpeg_options = ffmpeg_options ? bstrdup(ffmpeg_options) : NULL;
@@ -56,21 +56,15 @@ enum datatype_t {
 	DATA_TYPE_OBJECT_END = 9,
 };
 
-static void s_w4cc(struct serializer *s, enum video_id_t id)
+static void w4cc(uint8_t *out, enum video_id_t id)
 {
 	switch (id) {
 	case CODEC_AV1:
-		s_w8(s, 'a');
-		s_w8(s, 'v');
-		s_w8(s, '0');
-		s_w8(s, '1');
+		memcpy(out, "av01", 4);
 		break;
 #ifdef ENABLE_HEVC
 	case CODEC_HEVC:
-		s_w8(s, 'h');
-		s_w8(s, 'v');
-		s_w8(s, 'c');
-		s_w8(s, '1');
+		memcpy(out, "hvc1", 4);
 		break;
 #endif
 	case CODEC_H264:
@@ -78,6 +72,26 @@ static void s_w4cc(struct serializer *s, enum video_id_t id)
 	}
 }
 
+static void s_w4cc(struct serializer *s, enum video_id_t id)
+{
+	uint8_t fourcc[4];
+
+	if (id == CODEC_H264) {
+		assert(0);
+		return;
+	}
+
+	w4cc(fourcc, id);
+	s_write(s, fourcc, sizeof(fourcc));
+}
+
+static inline void wb24(uint8_t *out, uint32_t val)
+{
+	out[0] = (uint8_t)(val >> 16);
+	out[1] = (uint8_t)(val >> 8);
+	out[2] = (uint8_t)val;
+}
+
 static void s_wstring(struct serializer *s, const char *str)
 {
 	size_t len = strlen(str);
@@ -335,7 +349,63 @@ void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 	*size = data.bytes.num;
 }
 
+size_t flv_packet_prefix(struct encoder_packet *packet, bool is_header,
+			 uint8_t *prefix)
+{
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		int64_t offset = packet->pts - packet->dts;
+
+		prefix[0] = packet->keyframe ? 0x17 : 0x27;
+		prefix[1] = is_header ? 0 : 1;
+		wb24(prefix + 2, (uint32_t)get_ms_time(packet, offset));
+		return 5;
+	}
+
+	prefix[0] = 0xaf;
+	prefix[1] = is_header ? 0 : 1;
+	return 2;
+}
+
 // Y2023 spec
+static int get_packet_ex_type(struct encoder_packet *packet,
+			      enum video_id_t codec, bool is_header,
+			      bool is_footer)
+{
+	if (is_header)
+		return PACKETTYPE_SEQ_START;
+	if (is_footer)
+		return PACKETTYPE_SEQ_END;
+
+#ifdef ENABLE_HEVC
+	if (codec == CODEC_HEVC && packet->dts == packet->pts)
+		return PACKETTYPE_FRAMESX;
+#else
+	UNUSED_PARAMETER(packet);
+	UNUSED_PARAMETER(codec);
+#endif
+	return PACKETTYPE_FRAMES;
+}
+
+size_t flv_packet_ex_prefix(struct encoder_packet *packet,
+			    enum video_id_t codec, bool is_header,
+			    bool is_footer, uint8_t *prefix)
+{
+	int type = get_packet_ex_type(packet, codec, is_header, is_footer);
+
+	prefix[0] = FRAME_HEADER_EX | type |
+		    (packet->keyframe ? FT_KEY : FT_INTER);
+	w4cc(prefix + 1, codec);
+
+#ifdef ENABLE_HEVC
+	if (codec == CODEC_HEVC && type == PACKETTYPE_FRAMES) {
+		wb24(prefix + 5, (uint32_t)get_ms_time(packet, packet->pts -
+								     packet->dts));
+		return 8;
+	}
+#endif
+	return 5;
+}
+
 void flv_packet_ex(struct encoder_packet *packet, enum video_id_t codec_id,
 		   int32_t dts_offset, uint8_t **output, size_t *size, int type)
 {
@@ -59,6 +59,17 @@ extern void flv_additional_packet_mux(struct encoder_packet *packet,
 				      int32_t dts_offset, uint8_t **output,
 				      size_t *size, bool is_header,
 				      size_t index);
+
+/* Senders that transmit the packet data separately from the FLV tag use these
+ * to get the start of the tag body that precedes the data. */
+#define FLV_PACKET_PREFIX_MAX 8
+
+extern size_t flv_packet_prefix(struct encoder_packet *packet, bool is_header,
+				uint8_t *prefix);
+extern size_t flv_packet_ex_prefix(struct encoder_packet *packet,
+				   enum video_id_t codec, bool is_header,
+				   bool is_footer, uint8_t *prefix);
+
 // Y2023 spec
 extern void flv_packet_start(struct encoder_packet *packet,
 			     enum video_id_t codec, uint8_t **output,
@@ -39,6 +39,10 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#endif
+
 #ifdef CRYPTO
 
 #ifdef __APPLE__
@@ -1576,11 +1580,29 @@ ReadN(RTMP *r, char *buffer, int n)
     return nOriginalSize - n;
 }
 
+static void
+AbortSend(RTMP *r, int sockerr)
+{
+    struct linger l;
+
+    r->last_error_code = sockerr;
+
+    // Force-close the socket. Sometimes a send() error isn't fatal, so
+    // we could end up writing an unpublish message which some services
+    // treat as a clean shutdown. We need to disable lingering too so
+    // the remote side sees an abortive shutdown (RST).
+    l.l_onoff = 1;
+    l.l_linger = 0;
+    setsockopt(r->m_sb.sb_socket, SOL_SOCKET, SO_LINGER, (char *)&l, sizeof(l));
+    RTMPSockBuf_Close(&r->m_sb);
+
+    RTMP_Close(r);
+}
+
 static int
 WriteN(RTMP *r, const char *buffer, int n)
 {
     const char *ptr = buffer;
-    struct linger l;
 
     while (n > 0)
     {
@@ -1603,18 +1625,7 @@ WriteN(RTMP *r, const char *buffer, int n)
             if (sockerr == EINTR && !RTMP_ctrlC)
                 continue;
 
-            r->last_error_code = sockerr;
-
-            // Force-close the socket. Sometimes a send() error isn't fatal, so
-            // we could end up writing an unpublish message which some services
-            // treat as a clean shutdown. We need to disable lingering too so
-            // the remote side sees an abortive shutdown (RST).
-            l.l_onoff = 1;
-            l.l_linger = 0;
-            setsockopt(r->m_sb.sb_socket, SOL_SOCKET, SO_LINGER, (char *)&l, sizeof(l));
-            RTMPSockBuf_Close(&r->m_sb);
-
-            RTMP_Close(r);
+            AbortSend(r, sockerr);
             n = 1;
             break;
         }
@@ -1629,6 +1640,120 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+#define RTMP_MAX_IOV 64
+
+typedef struct RTMPIOVec
+{
+    const char *base;
+    int len;
+} RTMPIOVec;
+
+/* Sends a list of buffers with a single gathering write where possible */
+static int
+WriteV(RTMP *r, RTMPIOVec *iov, int niov)
+{
+    int i;
+
+    /* keep TLS records and RTMPT requests whole rather than splitting them
+     * at every chunk header */
+    if ((r->Link.protocol & RTMP_FEATURE_HTTP) || r->m_sb.sb_ssl)
+    {
+        char *buf, *ptr;
+        int total = 0, ret;
+
+        for (i = 0; i < niov; i++)
+            total += iov[i].len;
+
+        buf = ptr = malloc(total);
+        if (!buf)
+            return FALSE;
+
+        for (i = 0; i < niov; i++)
+        {
+            memcpy(ptr, iov[i].base, iov[i].len);
+            ptr += iov[i].len;
+        }
+
+        ret = WriteN(r, buf, total);
+        free(buf);
+        return ret;
+    }
+
+    if (r->m_bCustomSend && r->m_customSendFunc)
+    {
+        for (i = 0; i < niov; i++)
+        {
+            if (!WriteN(r, iov[i].base, iov[i].len))
+                return FALSE;
+        }
+        return TRUE;
+    }
+
+    while (niov > 0)
+    {
+        int nBytes;
+#ifdef _WIN32
+        WSABUF bufs[RTMP_MAX_IOV];
+        DWORD sent = 0;
+
+        for (i = 0; i < niov; i++)
+        {
+            bufs[i].buf = (CHAR *)iov[i].base;
+            bufs[i].len = (ULONG)iov[i].len;
+        }
+
+        nBytes = WSASend(r->m_sb.sb_socket, bufs, (DWORD)niov, &sent, 0,
+                         NULL, NULL) == 0 ? (int)sent : -1;
+#else
+        struct iovec bufs[RTMP_MAX_IOV];
+        struct msghdr msg;
+
+        for (i = 0; i < niov; i++)
+        {
+            bufs[i].iov_base = (void *)iov[i].base;
+            bufs[i].iov_len = (size_t)iov[i].len;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = bufs;
+        msg.msg_iovlen = niov;
+
+        nBytes = (int)sendmsg(r->m_sb.sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            AbortSend(r, sockerr);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* drop what was sent, the last buffer may be partially sent */
+        while (niov > 0 && nBytes >= iov->len)
+        {
+            nBytes -= iov->len;
+            iov++;
+            niov--;
+        }
+        if (niov > 0)
+        {
+            iov->base += nBytes;
+            iov->len -= nBytes;
+        }
+    }
+
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -5383,3 +5508,158 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* Sends one FLV tag like RTMP_Write, but without first copying the tag into
+ * an RTMPPacket: prefix is the start of the tag body (the FLV audio/video
+ * header bytes) and data the rest of it.  The chunk headers are built in
+ * small local buffers and sent together with the data in one gathering
+ * write. */
+int
+RTMP_WriteTag(RTMP *r, uint8_t packetType, uint32_t timestamp,
+              const char *prefix, int prefixSize,
+              const char *data, int dataSize, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    const RTMPPacket *prevPacket;
+    RTMPIOVec iov[RTMP_MAX_IOV];
+    char hbuf[RTMP_MAX_HEADER_SIZE], cbuf[5];
+    char *hptr, *hend = hbuf + sizeof(hbuf);
+    int nSize, hSize, cSize, niov = 0;
+    int bodySize = prefixSize + dataSize;
+    int nChunkSize = r->m_outChunkSize;
+    int pos = 0;
+    uint32_t last = 0, t;
+    char c;
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = packetType;
+    packet.m_nTimeStamp = timestamp;
+    packet.m_nBodySize = bodySize;
+
+    if (((packetType == RTMP_PACKET_TYPE_AUDIO
+            || packetType == RTMP_PACKET_TYPE_VIDEO) && !timestamp)
+            || packetType == RTMP_PACKET_TYPE_INFO)
+        packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    else
+        packet.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+
+    if (packet.m_nChannel >= r->m_channelsAllocatedOut)
+    {
+        int n = packet.m_nChannel + 10;
+        RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * n);
+        if (!packets)
+        {
+            free(r->m_vecChannelsOut);
+            r->m_vecChannelsOut = NULL;
+            r->m_channelsAllocatedOut = 0;
+            return FALSE;
+        }
+        r->m_vecChannelsOut = packets;
+        memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
+        r->m_channelsAllocatedOut = n;
+    }
+
+    /* same header compression as RTMP_SendPacket */
+    prevPacket = r->m_vecChannelsOut[packet.m_nChannel];
+    if (prevPacket && packet.m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        if (prevPacket->m_nBodySize == packet.m_nBodySize
+                && prevPacket->m_packetType == packet.m_packetType
+                && packet.m_headerType == RTMP_PACKET_SIZE_MEDIUM)
+            packet.m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet.m_nTimeStamp
+                && packet.m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet.m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    nSize = packetSize[packet.m_headerType];
+    t = packet.m_nTimeStamp - last;
+
+    /* the source channel always fits in the one byte basic header */
+    c = packet.m_headerType << 6 | packet.m_nChannel;
+    hptr = hbuf;
+    *hptr++ = c;
+
+    if (nSize > 1)
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet.m_nBodySize);
+        *hptr++ = packet.m_packetType;
+    }
+
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet.m_nInfoField2);
+
+    if (nSize > 1 && t >= 0xffffff)
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+
+    hSize = (int)(hptr - hbuf);
+
+    /* type 3 header for every following chunk */
+    cbuf[0] = (0xc0 | c);
+    cSize = 1;
+    if (t >= 0xffffff)
+    {
+        AMF_EncodeInt32(cbuf + 1, cbuf + sizeof(cbuf), t);
+        cSize += 4;
+    }
+
+    iov[niov].base = hbuf;
+    iov[niov++].len = hSize;
+
+    while (pos < bodySize)
+    {
+        int chunk = bodySize - pos;
+        if (chunk > nChunkSize)
+            chunk = nChunkSize;
+
+        if (pos > 0)
+        {
+            iov[niov].base = cbuf;
+            iov[niov++].len = cSize;
+        }
+
+        if (pos < prefixSize)
+        {
+            int n = prefixSize - pos;
+            if (n > chunk)
+                n = chunk;
+
+            iov[niov].base = prefix + pos;
+            iov[niov++].len = n;
+
+            if (chunk > n)
+            {
+                iov[niov].base = data;
+                iov[niov++].len = chunk - n;
+            }
+        }
+        else
+        {
+            iov[niov].base = data + (pos - prefixSize);
+            iov[niov++].len = chunk;
+        }
+
+        pos += chunk;
+
+        if (niov > RTMP_MAX_IOV - 3)
+        {
+            if (!WriteV(r, iov, niov))
+                return FALSE;
+            niov = 0;
+        }
+    }
+
+    if (niov && !WriteV(r, iov, niov))
+        return FALSE;
+
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        r->m_vecChannelsOut[packet.m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet.m_nChannel], &packet, sizeof(RTMPPacket));
+    return TRUE;
+}
@@ -542,6 +542,9 @@ extern "C"
     void RTMP_DropRequest(RTMP *r, int i, int freeit);
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
+    int RTMP_WriteTag(RTMP *r, uint8_t packetType, uint32_t timestamp,
+                      const char *prefix, int prefixSize,
+                      const char *data, int dataSize, int streamIdx);
 
 #ifdef USE_HASHSWF
     /* hashswf.c */
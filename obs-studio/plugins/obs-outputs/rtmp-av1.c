@@ -586,16 +586,15 @@ void obs_parse_av1_packet(struct encoder_packet *av1_packet,
 {
 	struct array_output_data output;
 	struct serializer s;
-	long ref = 1;
 
 	array_output_serializer_init(&s, &output);
-	serialize(&s, &ref, sizeof(ref));
 
 	*av1_packet = *src;
 	serialize_av1_data(&s, src->data, src->size, &av1_packet->keyframe,
 			   &av1_packet->priority);
 
-	av1_packet->data = output.bytes.array + sizeof(ref);
-	av1_packet->size = output.bytes.num - sizeof(ref);
+	memcpy(obs_encoder_packet_alloc(av1_packet, output.bytes.num),
+	       output.bytes.array, output.bytes.num);
+	array_output_serializer_free(&output);
 	av1_packet->drop_priority = av1_packet->priority;
 }
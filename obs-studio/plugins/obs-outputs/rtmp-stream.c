@@ -405,12 +405,41 @@ static int handle_socket_read(struct rtmp_stream *stream)
 	return 0;
 }
 
+/* Sends the FLV tag for a packet without copying the packet data: only the
+ * bytes of the tag body that precede the data are written to a local buffer,
+ * librtmp adds the chunk headers and sends both along with the data. */
+static int write_packet_tag(struct rtmp_stream *stream,
+			    struct encoder_packet *packet, int32_t dts_offset,
+			    const uint8_t *prefix, size_t prefix_size,
+			    size_t *size)
+{
+	uint8_t type = packet->type == OBS_ENCODER_VIDEO
+			       ? RTMP_PACKET_TYPE_VIDEO
+			       : RTMP_PACKET_TYPE_AUDIO;
+	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+
+	/* the FLV tag header, payload and tag size */
+	*size = 11 + prefix_size + packet->size + 4;
+
+#ifdef TEST_FRAMEDROPS
+	droptest_cap_data_rate(stream, *size);
+#endif
+
+	if (!RTMP_WriteTag(&stream->rtmp, type, (uint32_t)time_ms & 0x7FFFFFFF,
+			   (const char *)prefix, (int)prefix_size,
+			   (const char *)packet->data, (int)packet->size, 0))
+		return -1;
+
+	return (int)*size;
+}
+
 static int send_packet(struct rtmp_stream *stream,
 		       struct encoder_packet *packet, bool is_header,
 		       size_t idx)
 {
+	uint8_t prefix[FLV_PACKET_PREFIX_MAX];
 	uint8_t *data;
-	size_t size;
+	size_t size = 0;
 	int ret = 0;
 
 	assert(idx < RTMP_MAX_STREAMS);
@@ -421,17 +450,22 @@ static int send_packet(struct rtmp_stream *stream,
 		flv_additional_packet_mux(
 			packet, is_header ? 0 : stream->start_dts_offset, &data,
 			&size, is_header, idx);
-	} else {
-		flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset,
-			       &data, &size, is_header);
-	}
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+		ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
+		bfree(data);
+
+	} else if (packet->data && packet->size) {
+		size_t prefix_size =
+			flv_packet_prefix(packet, is_header, prefix);
+
+		ret = write_packet_tag(stream, packet,
+				       is_header ? 0 : stream->start_dts_offset,
+				       prefix, prefix_size, &size);
+	}
 
 	if (is_header)
 		bfree(packet->data);
@@ -446,28 +480,22 @@ static int send_packet_ex(struct rtmp_stream *stream,
 			  struct encoder_packet *packet, bool is_header,
 			  bool is_footer)
 {
-	uint8_t *data;
+	uint8_t prefix[FLV_PACKET_PREFIX_MAX];
+	size_t prefix_size;
 	size_t size = 0;
 	int ret = 0;
 
 	if (handle_socket_read(stream))
 		return -1;
 
-	if (is_header) {
-		flv_packet_start(packet, stream->video_codec, &data, &size);
-	} else if (is_footer) {
-		flv_packet_end(packet, stream->video_codec, &data, &size);
-	} else {
-		flv_packet_frames(packet, stream->video_codec,
-				  stream->start_dts_offset, &data, &size);
-	}
-
-#ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
-#endif
+	prefix_size = flv_packet_ex_prefix(packet, stream->video_codec,
+					   is_header, is_footer, prefix);
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+	ret = write_packet_tag(stream, packet,
+			       is_header || is_footer
+				       ? 0
+				       : stream->start_dts_offset,
+			       prefix, prefix_size, &size);
 
 	if (is_header || is_footer) // manually created packets
 		bfree(packet->data);
@@ -0,0 +1,372 @@
+/******************************************************************************
+Copyright (C) 2014 by Nibbles
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <sys/stat.h>
+#include <string.h>
+#include "file-watch.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+struct file_watch {
+	char *path;
+
+	/* inotify */
+	int fd;
+	const char *name;
+
+#ifdef _WIN32
+	/* ReadDirectoryChangesW */
+	HANDLE dir;
+	OVERLAPPED overlapped;
+	wchar_t *name_w;
+	DWORD buf[1024];
+#endif
+
+	uint64_t first_modified;
+	uint64_t last_modified;
+
+	/* fallback */
+	time_t timestamp;
+	uint64_t last_checked;
+	bool pending;
+};
+
+static time_t get_modified_timestamp(const char *path)
+{
+	struct stat stats;
+
+	if (os_stat(path, &stats) != 0)
+		return -1;
+
+	return stats.st_mtime;
+}
+
+#if defined(__linux__) || defined(_WIN32)
+/* writes to files that are kept open, like logs, are reported once they've
+ * stopped for a moment, or at least once a second while they go on */
+#define MODIFY_QUIET_NS 250000000ULL
+#define MODIFY_MAX_NS 1000000000ULL
+
+static inline void note_modified(struct file_watch *fw, uint64_t ts)
+{
+	if (!fw->first_modified)
+		fw->first_modified = ts;
+	fw->last_modified = ts;
+}
+
+static inline bool modify_settled(struct file_watch *fw, uint64_t ts)
+{
+	if (fw->first_modified &&
+	    (ts - fw->last_modified >= MODIFY_QUIET_NS ||
+	     ts - fw->first_modified >= MODIFY_MAX_NS)) {
+		fw->first_modified = 0;
+		return true;
+	}
+
+	return false;
+}
+#endif
+
+#ifdef __linux__
+/* The directory is watched rather than the file itself, so that files which
+ * are replaced by a rename are still picked up.  Closed and renamed files are
+ * reported right away, other writes are debounced so half-written files
+ * aren't read on every write. */
+static bool init_inotify(struct file_watch *fw)
+{
+	char *slash = strrchr(fw->path, '/');
+	char *dir;
+	int wd;
+
+	if (!slash)
+		return false;
+
+	fw->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fw->fd == -1)
+		return false;
+
+	dir = bstrdup_n(fw->path, slash == fw->path ? 1 : slash - fw->path);
+	wd = inotify_add_watch(fw->fd, dir,
+			       IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY);
+	bfree(dir);
+
+	if (wd == -1) {
+		close(fw->fd);
+		fw->fd = -1;
+		return false;
+	}
+
+	fw->name = slash + 1;
+	return true;
+}
+
+static bool read_inotify(struct file_watch *fw)
+{
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	uint64_t ts = os_gettime_ns();
+	bool changed = false;
+	ssize_t len;
+
+	while ((len = read(fw->fd, buf, sizeof(buf))) > 0) {
+		for (char *ptr = buf; ptr < buf + len;
+		     ptr += sizeof(*event) + event->len) {
+			event = (const struct inotify_event *)ptr;
+
+			if (!event->len || strcmp(event->name, fw->name) != 0)
+				continue;
+
+			if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+				changed = true;
+				fw->first_modified = 0;
+			} else if (event->mask & IN_MODIFY) {
+				note_modified(fw, ts);
+			}
+		}
+	}
+
+	if (modify_settled(fw, ts))
+		changed = true;
+
+	return changed;
+}
+
+#elif defined(_WIN32)
+static inline bool queue_dir_changes(struct file_watch *fw)
+{
+	return !!ReadDirectoryChangesW(fw->dir, fw->buf, sizeof(fw->buf), false,
+				       FILE_NOTIFY_CHANGE_FILE_NAME |
+					       FILE_NOTIFY_CHANGE_SIZE |
+					       FILE_NOTIFY_CHANGE_LAST_WRITE,
+				       NULL, &fw->overlapped, NULL);
+}
+
+static void close_dir_changes(struct file_watch *fw)
+{
+	DWORD bytes;
+
+	if (fw->dir == INVALID_HANDLE_VALUE)
+		return;
+
+	CancelIoEx(fw->dir, &fw->overlapped);
+	GetOverlappedResult(fw->dir, &fw->overlapped, &bytes, true);
+	CloseHandle(fw->dir);
+	CloseHandle(fw->overlapped.hEvent);
+	fw->dir = INVALID_HANDLE_VALUE;
+}
+
+/* Same as inotify, the directory is watched so renamed files are picked up.
+ * There is no close notification, so every write is debounced. */
+static bool init_dir_changes(struct file_watch *fw)
+{
+	char *slash = strrchr(fw->path, '/');
+	char *bslash = strrchr(fw->path, '\\');
+	wchar_t *dir_w = NULL;
+	size_t len;
+	char *dir;
+
+	if (bslash > slash)
+		slash = bslash;
+	if (!slash)
+		return false;
+
+	/* keep the separator of a drive root like "C:/" */
+	len = slash - fw->path;
+	if (len && fw->path[len - 1] == ':')
+		len++;
+
+	dir = bstrdup_n(fw->path, len);
+	os_utf8_to_wcs_ptr(dir, 0, &dir_w);
+	os_utf8_to_wcs_ptr(slash + 1, 0, &fw->name_w);
+	bfree(dir);
+
+	if (!dir_w || !fw->name_w) {
+		bfree(dir_w);
+		return false;
+	}
+
+	fw->dir = CreateFileW(dir_w, FILE_LIST_DIRECTORY,
+			      FILE_SHARE_READ | FILE_SHARE_WRITE |
+				      FILE_SHARE_DELETE,
+			      NULL, OPEN_EXISTING,
+			      FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+			      NULL);
+	bfree(dir_w);
+
+	if (fw->dir == INVALID_HANDLE_VALUE)
+		return false;
+
+	fw->overlapped.hEvent = CreateEvent(NULL, true, false, NULL);
+	if (!fw->overlapped.hEvent) {
+		CloseHandle(fw->dir);
+		fw->dir = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	if (!queue_dir_changes(fw)) {
+		close_dir_changes(fw);
+		return false;
+	}
+
+	return true;
+}
+
+static inline bool is_watched_name(struct file_watch *fw,
+				   const FILE_NOTIFY_INFORMATION *info)
+{
+	return CompareStringOrdinal(info->FileName,
+				    (int)(info->FileNameLength /
+					  sizeof(wchar_t)),
+				    fw->name_w, -1, true) == CSTR_EQUAL;
+}
+
+static bool read_dir_changes(struct file_watch *fw)
+{
+	const FILE_NOTIFY_INFORMATION *info;
+	const uint8_t *ptr = (const uint8_t *)fw->buf;
+	uint64_t ts = os_gettime_ns();
+	bool changed = false;
+	DWORD bytes;
+
+	if (!GetOverlappedResult(fw->dir, &fw->overlapped, &bytes, false)) {
+		if (GetLastError() != ERROR_IO_INCOMPLETE)
+			goto fail;
+		return modify_settled(fw, ts);
+	}
+
+	/* 0 bytes means the buffer overflowed and events were lost */
+	if (!bytes)
+		note_modified(fw, ts);
+
+	while (bytes) {
+		info = (const FILE_NOTIFY_INFORMATION *)ptr;
+
+		if (is_watched_name(fw, info)) {
+			if (info->Action == FILE_ACTION_ADDED ||
+			    info->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+				changed = true;
+				fw->first_modified = 0;
+			} else if (info->Action == FILE_ACTION_MODIFIED) {
+				note_modified(fw, ts);
+			}
+		}
+
+		if (!info->NextEntryOffset)
+			break;
+		ptr += info->NextEntryOffset;
+	}
+
+	if (!queue_dir_changes(fw))
+		goto fail;
+
+	if (modify_settled(fw, ts))
+		changed = true;
+
+	return changed;
+
+fail:
+	/* fall back to checking the modification time */
+	close_dir_changes(fw);
+	fw->timestamp = get_modified_timestamp(fw->path);
+	fw->last_checked = ts;
+	return true;
+}
+#endif
+
+/* a change is only reported on the check after it was seen, to give the
+ * writer time to finish */
+static bool poll_file(struct file_watch *fw)
+{
+	uint64_t ts = os_gettime_ns();
+	bool changed;
+	time_t t;
+
+	if (ts - fw->last_checked < 1000000000)
+		return false;
+
+	t = get_modified_timestamp(fw->path);
+	fw->last_checked = ts;
+
+	changed = fw->pending;
+	fw->pending = false;
+
+	if (fw->timestamp != t) {
+		fw->timestamp = t;
+		fw->pending = true;
+	}
+
+	return changed;
+}
+
+struct file_watch *file_watch_create(const char *path)
+{
+	struct file_watch *fw = bzalloc(sizeof(struct file_watch));
+	fw->path = bstrdup(path);
+	fw->fd = -1;
+
+#ifdef __linux__
+	if (init_inotify(fw))
+		return fw;
+#elif defined(_WIN32)
+	fw->dir = INVALID_HANDLE_VALUE;
+	if (init_dir_changes(fw))
+		return fw;
+#endif
+
+	fw->timestamp = get_modified_timestamp(path);
+	fw->last_checked = os_gettime_ns();
+	return fw;
+}
+
+void file_watch_destroy(struct file_watch *fw)
+{
+	if (!fw)
+		return;
+
+#ifdef __linux__
+	if (fw->fd != -1)
+		close(fw->fd);
+#elif defined(_WIN32)
+	close_dir_changes(fw);
+	bfree(fw->name_w);
+#endif
+
+	bfree(fw->path);
+	bfree(fw);
+}
+
+bool file_watch_changed(struct file_watch *fw)
+{
+#ifdef __linux__
+	if (fw->fd != -1)
+		return read_inotify(fw);
+#elif defined(_WIN32)
+	if (fw->dir != INVALID_HANDLE_VALUE)
+		return read_dir_changes(fw);
+#endif
+
+	return poll_file(fw);
+}
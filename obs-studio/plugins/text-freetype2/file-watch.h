@@ -0,0 +1,32 @@
+/******************************************************************************
+Copyright (C) 2014 by Nibbles
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+
+/* Reports when a text file has been written.  Uses inotify on Linux and
+ * ReadDirectoryChangesW on Windows, where writes to files that stay open
+ * (logs) are debounced, and otherwise checks the modification time of the
+ * file once a second. */
+struct file_watch;
+
+struct file_watch *file_watch_create(const char *path);
+void file_watch_destroy(struct file_watch *fw);
+
+/* non-blocking, returns true once for each time the file changed */
+bool file_watch_changed(struct file_watch *fw);
@@ -0,0 +1,296 @@
+/******************************************************************************
+Copyright (C) 2014 by Nibbles
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include "glyph-atlas.h"
+
+extern FT_Library ft2_lib;
+extern uint32_t texbuf_w, texbuf_h;
+
+static pthread_mutex_t atlas_list_mutex;
+static struct glyph_atlas *first_atlas = NULL;
+
+void glyph_atlas_startup(void)
+{
+	pthread_mutex_init(&atlas_list_mutex, NULL);
+}
+
+void glyph_atlas_shutdown(void)
+{
+	if (first_atlas)
+		blog(LOG_WARNING, "FT2-text: Glyph atlases still in use");
+
+	pthread_mutex_destroy(&atlas_list_mutex);
+}
+
+static FT_Render_Mode get_render_mode(struct glyph_atlas *atlas)
+{
+	return atlas->antialiasing ? FT_RENDER_MODE_NORMAL
+				   : FT_RENDER_MODE_MONO;
+}
+
+static void load_glyph(struct glyph_atlas *atlas, const FT_UInt glyph_index,
+		       const FT_Render_Mode render_mode)
+{
+	const FT_Int32 load_mode = render_mode == FT_RENDER_MODE_MONO
+					   ? FT_LOAD_TARGET_MONO
+					   : FT_LOAD_DEFAULT;
+	FT_Load_Glyph(atlas->face, glyph_index, load_mode);
+}
+
+static struct glyph_info *init_glyph(FT_GlyphSlot slot, const uint32_t dx,
+				     const uint32_t dy, const uint32_t g_w,
+				     const uint32_t g_h)
+{
+	struct glyph_info *glyph = bzalloc(sizeof(struct glyph_info));
+	glyph->u = (float)dx / (float)texbuf_w;
+	glyph->u2 = (float)(dx + g_w) / (float)texbuf_w;
+	glyph->v = (float)dy / (float)texbuf_h;
+	glyph->v2 = (float)(dy + g_h) / (float)texbuf_h;
+	glyph->w = g_w;
+	glyph->h = g_h;
+	glyph->yoff = slot->bitmap_top;
+	glyph->xoff = slot->bitmap_left;
+	glyph->xadv = slot->advance.x >> 6;
+
+	return glyph;
+}
+
+static uint8_t get_pixel_value(const unsigned char *buf_row,
+			       FT_Render_Mode render_mode, const uint32_t x)
+{
+	if (render_mode == FT_RENDER_MODE_NORMAL) {
+		return buf_row[x];
+	}
+
+	const uint32_t byte_index = x / 8;
+	const uint8_t bit_index = x % 8;
+	const bool pixel_set = (buf_row[byte_index] >> (7 - bit_index)) & 1;
+	return pixel_set ? 255 : 0;
+}
+
+static void rasterize(struct glyph_atlas *atlas, FT_GlyphSlot slot,
+		      const FT_Render_Mode render_mode, const uint32_t dx,
+		      const uint32_t dy)
+{
+	/**
+	 * The pitch's absolute value is the number of bytes taken by one bitmap
+	 * row, including padding.
+	 *
+	 * Source: https://www.freetype.org/freetype2/docs/reference/ft2-basic_types.html
+	 */
+	const int pitch = abs(slot->bitmap.pitch);
+
+	for (uint32_t y = 0; y < slot->bitmap.rows; y++) {
+		const uint32_t row_start = y * pitch;
+		const uint32_t row = (dy + y) * texbuf_w;
+
+		for (uint32_t x = 0; x < slot->bitmap.width; x++) {
+			const uint32_t row_pixel_position = dx + x;
+			const uint8_t pixel_value =
+				get_pixel_value(&slot->bitmap.buffer[row_start],
+						render_mode, x);
+			atlas->texbuf[row_pixel_position + row] = pixel_value;
+		}
+	}
+}
+
+static void cache_glyphs(struct glyph_atlas *atlas, const wchar_t *cache_glyphs)
+{
+	FT_GlyphSlot slot = atlas->face->glyph;
+
+	uint32_t dx = atlas->texbuf_x;
+	uint32_t dy = atlas->texbuf_y;
+
+	int32_t cached_glyphs = 0;
+	const size_t len = wcslen(cache_glyphs);
+
+	const FT_Render_Mode render_mode = get_render_mode(atlas);
+
+	for (size_t i = 0; i < len; i++) {
+		const FT_UInt glyph_index =
+			FT_Get_Char_Index(atlas->face, cache_glyphs[i]);
+
+		if (atlas->glyphs[glyph_index] != NULL) {
+			continue;
+		}
+
+		load_glyph(atlas, glyph_index, render_mode);
+		FT_Render_Glyph(slot, render_mode);
+
+		const uint32_t g_w = slot->bitmap.width;
+		const uint32_t g_h = slot->bitmap.rows;
+
+		if (atlas->max_h < g_h) {
+			atlas->max_h = g_h;
+		}
+
+		if (dx + g_w >= texbuf_w) {
+			dx = 0;
+			dy += atlas->max_h + 1;
+		}
+
+		if (dy + g_h >= texbuf_h) {
+			blog(LOG_WARNING,
+			     "Out of space trying to render glyphs");
+			break;
+		}
+
+		atlas->glyphs[glyph_index] = init_glyph(slot, dx, dy, g_w, g_h);
+		rasterize(atlas, slot, render_mode, dx, dy);
+
+		dx += (g_w + 1);
+		if (dx >= texbuf_w) {
+			dx = 0;
+			dy += atlas->max_h;
+		}
+
+		cached_glyphs++;
+	}
+
+	atlas->texbuf_x = dx;
+	atlas->texbuf_y = dy;
+
+	if (cached_glyphs > 0)
+		atlas->dirty = true;
+}
+
+void glyph_atlas_cache(struct glyph_atlas *atlas, const wchar_t *text)
+{
+	if (!atlas || !text)
+		return;
+
+	pthread_mutex_lock(&atlas->mutex);
+	cache_glyphs(atlas, text);
+	pthread_mutex_unlock(&atlas->mutex);
+}
+
+static struct glyph_atlas *glyph_atlas_create(const char *path, FT_Long index,
+					      uint16_t size, bool antialiasing)
+{
+	FT_Face face;
+
+	if (FT_New_Face(ft2_lib, path, index, &face) != 0)
+		return NULL;
+
+	FT_Set_Pixel_Sizes(face, 0, size);
+	FT_Select_Charmap(face, FT_ENCODING_UNICODE);
+
+	struct glyph_atlas *atlas = bzalloc(sizeof(struct glyph_atlas));
+	atlas->path = bstrdup(path);
+	atlas->index = index;
+	atlas->size = size;
+	atlas->antialiasing = antialiasing;
+	atlas->face = face;
+	atlas->texbuf = bzalloc((size_t)texbuf_w * (size_t)texbuf_h);
+	atlas->dirty = true;
+	pthread_mutex_init(&atlas->mutex, NULL);
+
+	cache_glyphs(atlas, L"abcdefghijklmnopqrstuvwxyz"
+			    L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"
+			    L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"\0");
+	return atlas;
+}
+
+struct glyph_atlas *glyph_atlas_acquire(const char *path, FT_Long index,
+					uint16_t size, bool antialiasing)
+{
+	struct glyph_atlas *atlas;
+
+	pthread_mutex_lock(&atlas_list_mutex);
+
+	for (atlas = first_atlas; atlas; atlas = atlas->next) {
+		if (atlas->index == index && atlas->size == size &&
+		    atlas->antialiasing == antialiasing &&
+		    strcmp(atlas->path, path) == 0)
+			break;
+	}
+
+	if (!atlas) {
+		atlas = glyph_atlas_create(path, index, size, antialiasing);
+		if (atlas) {
+			atlas->next = first_atlas;
+			first_atlas = atlas;
+		}
+	}
+
+	if (atlas)
+		atlas->refs++;
+
+	pthread_mutex_unlock(&atlas_list_mutex);
+	return atlas;
+}
+
+void glyph_atlas_release(struct glyph_atlas *atlas)
+{
+	struct glyph_atlas **prev_next;
+
+	if (!atlas)
+		return;
+
+	pthread_mutex_lock(&atlas_list_mutex);
+
+	if (--atlas->refs > 0) {
+		pthread_mutex_unlock(&atlas_list_mutex);
+		return;
+	}
+
+	prev_next = &first_atlas;
+	while (*prev_next != atlas)
+		prev_next = &(*prev_next)->next;
+	*prev_next = atlas->next;
+
+	/* faces are created and destroyed under the same lock, as the library
+	 * is shared */
+	FT_Done_Face(atlas->face);
+
+	pthread_mutex_unlock(&atlas_list_mutex);
+
+	for (uint32_t i = 0; i < num_cache_slots; i++)
+		bfree(atlas->glyphs[i]);
+
+	obs_enter_graphics();
+	gs_texture_destroy(atlas->tex);
+	obs_leave_graphics();
+
+	pthread_mutex_destroy(&atlas->mutex);
+	bfree(atlas->texbuf);
+	bfree(atlas->path);
+	bfree(atlas);
+}
+
+gs_texture_t *glyph_atlas_get_texture(struct glyph_atlas *atlas)
+{
+	pthread_mutex_lock(&atlas->mutex);
+
+	/* new glyphs from any number of sources are uploaded at most once per
+	 * frame, into the same texture */
+	if (atlas->dirty) {
+		if (!atlas->tex)
+			atlas->tex = gs_texture_create(
+				texbuf_w, texbuf_h, GS_A8, 1,
+				(const uint8_t **)&atlas->texbuf, GS_DYNAMIC);
+		else
+			gs_texture_set_image(atlas->tex, atlas->texbuf,
+					     texbuf_w, false);
+
+		atlas->dirty = false;
+	}
+
+	pthread_mutex_unlock(&atlas->mutex);
+	return atlas->tex;
+}
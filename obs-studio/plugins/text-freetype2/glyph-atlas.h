@@ -0,0 +1,68 @@
+/******************************************************************************
+Copyright (C) 2014 by Nibbles
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs-module.h>
+#include <util/threading.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#define num_cache_slots 65535
+
+struct glyph_info {
+	float u, v, u2, v2;
+	int32_t w, h, xoff, yoff;
+	FT_Pos xadv;
+};
+
+/* Glyph atlases are shared by every source using the same font file, face,
+ * size and antialiasing, and only grow: glyphs are rasterized the first time
+ * any of those sources needs them.  The face and glyphs may only be used
+ * while holding the mutex. */
+struct glyph_atlas {
+	char *path;
+	FT_Long index;
+	uint16_t size;
+	bool antialiasing;
+	long refs;
+
+	pthread_mutex_t mutex;
+	FT_Face face;
+	uint32_t max_h;
+
+	uint32_t texbuf_x, texbuf_y;
+	uint8_t *texbuf;
+	gs_texture_t *tex;
+	bool dirty;
+
+	struct glyph_info *glyphs[num_cache_slots];
+
+	struct glyph_atlas *next;
+};
+
+void glyph_atlas_startup(void);
+void glyph_atlas_shutdown(void);
+
+struct glyph_atlas *glyph_atlas_acquire(const char *path, FT_Long index,
+					uint16_t size, bool antialiasing);
+void glyph_atlas_release(struct glyph_atlas *atlas);
+
+void glyph_atlas_cache(struct glyph_atlas *atlas, const wchar_t *text);
+
+/* must be called within the graphics context */
+gs_texture_t *glyph_atlas_get_texture(struct glyph_atlas *atlas);
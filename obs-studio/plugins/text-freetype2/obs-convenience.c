@@ -57,7 +57,7 @@ gs_vertbuffer_t *create_uv_vbuffer(uint32_t num_verts, bool add_color)
 }
 
 void draw_uv_vbuffer(gs_vertbuffer_t *vbuf, gs_texture_t *tex,
-		     gs_effect_t *effect, uint32_t num_verts)
+		     gs_effect_t *effect, uint32_t num_verts, bool flush)
 {
 	gs_texture_t *texture = tex;
 	gs_technique_t *tech = gs_effect_get_technique(effect, "Draw");
@@ -72,7 +72,8 @@ void draw_uv_vbuffer(gs_vertbuffer_t *vbuf, gs_texture_t *tex,
 	const bool previous = gs_framebuffer_srgb_enabled();
 	gs_enable_framebuffer_srgb(linear_srgb);
 
-	gs_vertexbuffer_flush(vbuf);
+	if (flush)
+		gs_vertexbuffer_flush(vbuf);
 	gs_load_vertexbuffer(vbuf);
 	gs_load_indexbuffer(NULL);
 
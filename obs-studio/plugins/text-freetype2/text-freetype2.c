@@ -104,6 +104,8 @@ bool obs_module_load()
 		bfree(config_dir);
 	}
 
+	glyph_atlas_startup();
+
 	obs_register_source(&freetype2_source_info_v1);
 	obs_register_source(&freetype2_source_info_v2);
 
@@ -116,6 +118,8 @@ void obs_module_unload(void)
 		free_os_font_list();
 		FT_Done_FreeType(ft2_lib);
 	}
+
+	glyph_atlas_shutdown();
 }
 
 static const char *ft2_source_get_name(void *unused)
@@ -220,17 +224,11 @@ static void ft2_source_destroy(void *data)
 {
 	struct ft2_source *srcdata = data;
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
+	glyph_atlas_release(srcdata->atlas);
+	srcdata->atlas = NULL;
 
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
+	file_watch_destroy(srcdata->watch);
+	srcdata->watch = NULL;
 
 	if (srcdata->font_name != NULL)
 		bfree(srcdata->font_name);
@@ -238,19 +236,15 @@ static void ft2_source_destroy(void *data)
 		bfree(srcdata->font_style);
 	if (srcdata->text != NULL)
 		bfree(srcdata->text);
-	if (srcdata->texbuf != NULL)
-		bfree(srcdata->texbuf);
 	if (srcdata->colorbuf != NULL)
 		bfree(srcdata->colorbuf);
+	if (srcdata->vbuf_text != NULL)
+		bfree(srcdata->vbuf_text);
 	if (srcdata->text_file != NULL)
 		bfree(srcdata->text_file);
 
 	obs_enter_graphics();
 
-	if (srcdata->tex != NULL) {
-		gs_texture_destroy(srcdata->tex);
-		srcdata->tex = NULL;
-	}
 	if (srcdata->vbuf != NULL) {
 		gs_vertexbuffer_destroy(srcdata->vbuf);
 		srcdata->vbuf = NULL;
@@ -271,19 +265,30 @@ static void ft2_source_render(void *data, gs_effect_t *effect)
 	if (srcdata == NULL)
 		return;
 
-	if (srcdata->tex == NULL || srcdata->vbuf == NULL)
+	if (srcdata->atlas == NULL || srcdata->vbuf == NULL)
 		return;
 	if (srcdata->text == NULL || *srcdata->text == 0)
 		return;
+	if (srcdata->num_glyphs == 0)
+		return;
+
+	gs_texture_t *tex = glyph_atlas_get_texture(srcdata->atlas);
+	if (tex == NULL)
+		return;
 
 	gs_reset_blend_state();
 	if (srcdata->outline_text)
-		draw_outlines(srcdata);
+		draw_outlines(srcdata, tex);
 	if (srcdata->drop_shadow)
-		draw_drop_shadow(srcdata);
+		draw_drop_shadow(srcdata, tex);
 
-	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex, srcdata->draw_effect,
-			(uint32_t)wcslen(srcdata->text) * 6);
+	/* the vertex buffer is only uploaded when it changed, or when the
+	 * outline/drop shadow colors were uploaded in its place */
+	bool flush = srcdata->vbuf_dirty || srcdata->outline_text ||
+		     srcdata->drop_shadow;
+	draw_uv_vbuffer(srcdata->vbuf, tex, srcdata->draw_effect,
+			srcdata->num_glyphs * 6, flush);
+	srcdata->vbuf_dirty = false;
 
 	UNUSED_PARAMETER(effect);
 }
@@ -293,28 +298,17 @@ static void ft2_video_tick(void *data, float seconds)
 	struct ft2_source *srcdata = data;
 	if (srcdata == NULL)
 		return;
-	if (!srcdata->from_file || !srcdata->text_file)
+	if (!srcdata->from_file || !srcdata->text_file || !srcdata->watch)
 		return;
 
-	if (os_gettime_ns() - srcdata->last_checked >= 1000000000) {
-		time_t t = get_modified_timestamp(srcdata->text_file);
-		srcdata->last_checked = os_gettime_ns();
-
-		if (srcdata->update_file) {
-			if (srcdata->log_mode)
-				read_from_end(srcdata, srcdata->text_file);
-			else
-				load_text_from_file(srcdata,
-						    srcdata->text_file);
-			cache_glyphs(srcdata, srcdata->text);
-			set_up_vertex_buffer(srcdata);
-			srcdata->update_file = false;
-		}
+	if (file_watch_changed(srcdata->watch)) {
+		if (srcdata->log_mode)
+			read_from_end(srcdata, srcdata->text_file);
+		else
+			load_text_from_file(srcdata, srcdata->text_file);
 
-		if (srcdata->m_timestamp != t) {
-			srcdata->m_timestamp = t;
-			srcdata->update_file = true;
-		}
+		glyph_atlas_cache(srcdata->atlas, srcdata->text);
+		set_up_vertex_buffer(srcdata);
 	}
 
 	UNUSED_PARAMETER(seconds);
@@ -329,12 +323,12 @@ static bool init_font(struct ft2_source *srcdata)
 	if (!path)
 		return false;
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
+	struct glyph_atlas *old_atlas = srcdata->atlas;
+	srcdata->atlas = glyph_atlas_acquire(path, index, srcdata->font_size,
+					     srcdata->antialiasing);
+	glyph_atlas_release(old_atlas);
 
-	return FT_New_Face(ft2_lib, path, index, &srcdata->font_face) == 0;
+	return srcdata->atlas != NULL;
 }
 
 static void ft2_source_update(void *data, obs_data_t *settings)
@@ -408,8 +402,6 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	if (ft2_lib == NULL)
 		goto error;
 
-	const size_t texbuf_size = (size_t)texbuf_w * (size_t)texbuf_h;
-
 	if (srcdata->draw_effect == NULL) {
 		char *effect_file = NULL;
 		char *error_string = NULL;
@@ -435,10 +427,7 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	const bool aa_changed = srcdata->antialiasing != new_aa_setting;
 	if (aa_changed) {
 		srcdata->antialiasing = new_aa_setting;
-		if (srcdata->texbuf != NULL) {
-			memset(srcdata->texbuf, 0, texbuf_size);
-		}
-		cache_standard_glyphs(srcdata);
+		vbuf_needs_update = true;
 	}
 
 	srcdata->file_load_failed = false;
@@ -448,14 +437,13 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 		if (strcmp(font_name, srcdata->font_name) == 0 &&
 		    strcmp(font_style, srcdata->font_style) == 0 &&
 		    font_flags == srcdata->font_flags &&
-		    font_size == srcdata->font_size)
+		    font_size == srcdata->font_size && !aa_changed)
 			goto skip_font_load;
 
 		bfree(srcdata->font_name);
 		bfree(srcdata->font_style);
 		srcdata->font_name = NULL;
 		srcdata->font_style = NULL;
-		srcdata->max_h = 0;
 		vbuf_needs_update = true;
 	}
 
@@ -464,23 +452,11 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	srcdata->font_size = font_size;
 	srcdata->font_flags = font_flags;
 
-	if (!init_font(srcdata) || srcdata->font_face == NULL) {
+	if (!init_font(srcdata)) {
 		blog(LOG_WARNING, "FT2-text: Failed to load font %s",
 		     srcdata->font_name);
 		goto error;
-	} else {
-		FT_Set_Pixel_Sizes(srcdata->font_face, 0, srcdata->font_size);
-		FT_Select_Charmap(srcdata->font_face, FT_ENCODING_UNICODE);
-	}
-
-	if (srcdata->texbuf != NULL) {
-		bfree(srcdata->texbuf);
-		srcdata->texbuf = NULL;
 	}
-	srcdata->texbuf = bzalloc(texbuf_size);
-
-	if (srcdata->font_face)
-		cache_standard_glyphs(srcdata);
 
 skip_font_load:
 	if (from_file) {
@@ -494,6 +470,8 @@ skip_font_load:
 
 			os_utf8_to_wcs_ptr(emptystr, strlen(emptystr),
 					   &srcdata->text);
+			file_watch_destroy(srcdata->watch);
+			srcdata->watch = NULL;
 			blog(LOG_WARNING,
 			     "FT2-text: Failed to open %s for "
 			     "reading",
@@ -511,13 +489,18 @@ skip_font_load:
 				read_from_end(srcdata, tmp);
 			else
 				load_text_from_file(srcdata, tmp);
-			srcdata->last_checked = os_gettime_ns();
+
+			file_watch_destroy(srcdata->watch);
+			srcdata->watch = file_watch_create(tmp);
 		}
 	} else {
 		const char *tmp = obs_data_get_string(settings, "text");
 		if (!tmp)
 			goto error;
 
+		file_watch_destroy(srcdata->watch);
+		srcdata->watch = NULL;
+
 		if (srcdata->text != NULL) {
 			bfree(srcdata->text);
 			srcdata->text = NULL;
@@ -526,8 +509,8 @@ skip_font_load:
 		os_utf8_to_wcs_ptr(tmp, strlen(tmp), &srcdata->text);
 	}
 
-	if (srcdata->font_face) {
-		cache_glyphs(srcdata, srcdata->text);
+	if (srcdata->atlas) {
+		glyph_atlas_cache(srcdata->atlas, srcdata->text);
 		set_up_vertex_buffer(srcdata);
 	}
 
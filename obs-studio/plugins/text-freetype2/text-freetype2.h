@@ -19,14 +19,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <ft2build.h>
+#include "glyph-atlas.h"
+#include "file-watch.h"
 
-#define num_cache_slots 65535
-#define src_glyph srcdata->cacheglyphs[glyph_index]
+#define src_glyph srcdata->atlas->glyphs[glyph_index]
 
-struct glyph_info {
-	float u, v, u2, v2;
-	int32_t w, h, xoff, yoff;
-	FT_Pos xadv;
+struct vbuf_layout {
+	struct glyph_atlas *atlas;
+	uint32_t max_h, offset, custom_width;
+	uint32_t color[2];
 };
 
 struct ft2_source {
@@ -40,26 +41,24 @@ struct ft2_source {
 	bool antialiasing;
 	char *text_file;
 	wchar_t *text;
-	time_t m_timestamp;
-	bool update_file;
-	uint64_t last_checked;
+	struct file_watch *watch;
 
-	uint32_t cx, cy, max_h, custom_width;
+	uint32_t cx, cy, custom_width;
 	uint32_t outline_width;
-	uint32_t texbuf_x, texbuf_y;
 	uint32_t color[2];
 	uint32_t *colorbuf;
 
 	int32_t cur_scroll, scroll_speed;
 
-	gs_texture_t *tex;
-
-	struct glyph_info *cacheglyphs[num_cache_slots];
+	struct glyph_atlas *atlas;
 
-	FT_Face font_face;
-
-	uint8_t *texbuf;
+	/* the vertex buffer is only reallocated when it needs to grow, and
+	 * only the glyphs after the first changed character are rewritten */
 	gs_vertbuffer_t *vbuf;
+	uint32_t vbuf_glyphs, num_glyphs;
+	wchar_t *vbuf_text;
+	struct vbuf_layout vbuf_layout;
+	bool vbuf_dirty;
 
 	gs_effect_t *draw_effect;
 	bool outline_text, drop_shadow;
@@ -77,8 +76,8 @@ static void ft2_source_update(void *data, obs_data_t *settings);
 static void ft2_source_render(void *data, gs_effect_t *effect);
 static void ft2_video_tick(void *data, float seconds);
 
-void draw_outlines(struct ft2_source *srcdata);
-void draw_drop_shadow(struct ft2_source *srcdata);
+void draw_outlines(struct ft2_source *srcdata, gs_texture_t *tex);
+void draw_drop_shadow(struct ft2_source *srcdata, gs_texture_t *tex);
 
 static uint32_t ft2_source_get_width(void *data);
 static uint32_t ft2_source_get_height(void *data);
@@ -94,12 +93,8 @@ static obs_missing_files_t *ft2_missing_files(void *data);
 
 uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata);
 
-time_t get_modified_timestamp(char *filename);
 void load_text_from_file(struct ft2_source *srcdata, const char *filename);
 void read_from_end(struct ft2_source *srcdata, const char *filename);
 
-void cache_standard_glyphs(struct ft2_source *srcdata);
-void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs);
-
 void set_up_vertex_buffer(struct ft2_source *srcdata);
 void fill_vertex_buffer(struct ft2_source *srcdata);
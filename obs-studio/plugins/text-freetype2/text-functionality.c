@@ -19,16 +19,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <util/platform.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
-#include <sys/stat.h>
 #include "text-freetype2.h"
 #include "obs-convenience.h"
 
 float offsets[16] = {-2.0f, 0.0f, 0.0f, -2.0f, 2.0f,  0.0f, 2.0f,  0.0f,
 		     0.0f,  2.0f, 0.0f, 2.0f,  -2.0f, 0.0f, -2.0f, 0.0f};
 
-extern uint32_t texbuf_w, texbuf_h;
-
-void draw_outlines(struct ft2_source *srcdata)
+void draw_outlines(struct ft2_source *srcdata, gs_texture_t *tex)
 {
 	// Horrible (hopefully temporary) solution for outlines.
 	uint32_t *tmp;
@@ -45,9 +42,8 @@ void draw_outlines(struct ft2_source *srcdata)
 	for (int32_t i = 0; i < 8; i++) {
 		gs_matrix_translate3f(offsets[i * 2], offsets[(i * 2) + 1],
 				      0.0f);
-		draw_uv_vbuffer(srcdata->vbuf, srcdata->tex,
-				srcdata->draw_effect,
-				(uint32_t)wcslen(srcdata->text) * 6);
+		draw_uv_vbuffer(srcdata->vbuf, tex, srcdata->draw_effect,
+				srcdata->num_glyphs * 6, i == 0);
 	}
 	gs_matrix_identity();
 	gs_matrix_pop();
@@ -55,7 +51,7 @@ void draw_outlines(struct ft2_source *srcdata)
 	vdata->colors = tmp;
 }
 
-void draw_drop_shadow(struct ft2_source *srcdata)
+void draw_drop_shadow(struct ft2_source *srcdata, gs_texture_t *tex)
 {
 	// Horrible (hopefully temporary) solution for drop shadow.
 	uint32_t *tmp;
@@ -70,51 +66,74 @@ void draw_drop_shadow(struct ft2_source *srcdata)
 
 	gs_matrix_push();
 	gs_matrix_translate3f(4.0f, 4.0f, 0.0f);
-	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex, srcdata->draw_effect,
-			(uint32_t)wcslen(srcdata->text) * 6);
+	draw_uv_vbuffer(srcdata->vbuf, tex, srcdata->draw_effect,
+			srcdata->num_glyphs * 6, !srcdata->outline_text);
 	gs_matrix_identity();
 	gs_matrix_pop();
 
 	vdata->colors = tmp;
 }
 
+static void resize_vertex_buffer(struct ft2_source *srcdata, uint32_t len)
+{
+	uint32_t size = srcdata->vbuf_glyphs ? srcdata->vbuf_glyphs : 64;
+	while (size < len)
+		size *= 2;
+
+	if (srcdata->vbuf != NULL) {
+		gs_vertexbuffer_destroy(srcdata->vbuf);
+		srcdata->vbuf = NULL;
+	}
+
+	srcdata->vbuf = create_uv_vbuffer(size * 6, true);
+	srcdata->vbuf_glyphs = srcdata->vbuf ? size : 0;
+	srcdata->num_glyphs = 0;
+
+	bfree(srcdata->colorbuf);
+	srcdata->colorbuf = bmalloc(sizeof(uint32_t) * size * 6);
+	for (size_t i = 0; i < (size_t)size * 6; i++) {
+		srcdata->colorbuf[i] = 0xFF000000;
+	}
+
+	bfree(srcdata->vbuf_text);
+	srcdata->vbuf_text = NULL;
+}
+
 void set_up_vertex_buffer(struct ft2_source *srcdata)
 {
 	FT_UInt glyph_index = 0;
 	uint32_t x = 0, space_pos = 0, word_width = 0;
 	size_t len;
 
-	if (!srcdata->text)
+	if (!srcdata->text || !srcdata->atlas)
 		return;
 
+	obs_enter_graphics();
+	pthread_mutex_lock(&srcdata->atlas->mutex);
+
 	if (srcdata->custom_width >= 100)
 		srcdata->cx = srcdata->custom_width;
 	else
 		srcdata->cx = get_ft2_text_width(srcdata->text, srcdata);
-	srcdata->cy = srcdata->max_h;
+	srcdata->cy = srcdata->atlas->max_h;
 
-	obs_enter_graphics();
-	if (srcdata->vbuf != NULL) {
-		gs_vertbuffer_t *tmpvbuf = srcdata->vbuf;
-		srcdata->vbuf = NULL;
-		gs_vertexbuffer_destroy(tmpvbuf);
-	}
+	len = wcslen(srcdata->text);
 
-	if (*srcdata->text == 0) {
-		obs_leave_graphics();
-		return;
+	if (len == 0) {
+		srcdata->num_glyphs = 0;
+		goto unlock;
 	}
 
-	srcdata->vbuf =
-		create_uv_vbuffer((uint32_t)wcslen(srcdata->text) * 6, true);
+	if (len > srcdata->vbuf_glyphs)
+		resize_vertex_buffer(srcdata, (uint32_t)len);
+	if (srcdata->vbuf == NULL)
+		goto unlock;
 
 	if (srcdata->custom_width <= 100)
 		goto skip_word_wrap;
 	if (!srcdata->word_wrap)
 		goto skip_word_wrap;
 
-	len = wcslen(srcdata->text);
-
 	for (uint32_t i = 0; i <= len; i++) {
 		if (i == wcslen(srcdata->text))
 			goto eos_check;
@@ -138,8 +157,8 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 		if (srcdata->text[i] == L' ')
 			space_pos = i;
 	next_char:;
-		glyph_index =
-			FT_Get_Char_Index(srcdata->font_face, srcdata->text[i]);
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->face,
+						srcdata->text[i]);
 		if (src_glyph)
 			word_width += src_glyph->xadv;
 	eos_skip:;
@@ -147,9 +166,31 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 
 skip_word_wrap:;
 	fill_vertex_buffer(srcdata);
+
+unlock:
+	pthread_mutex_unlock(&srcdata->atlas->mutex);
 	obs_leave_graphics();
 }
 
+static bool update_vbuf_layout(struct ft2_source *srcdata, uint32_t offset)
+{
+	struct vbuf_layout *layout = &srcdata->vbuf_layout;
+	bool changed = layout->atlas != srcdata->atlas ||
+		       layout->max_h != srcdata->atlas->max_h ||
+		       layout->offset != offset ||
+		       layout->custom_width != srcdata->custom_width ||
+		       layout->color[0] != srcdata->color[0] ||
+		       layout->color[1] != srcdata->color[1];
+
+	layout->atlas = srcdata->atlas;
+	layout->max_h = srcdata->atlas->max_h;
+	layout->offset = offset;
+	layout->custom_width = srcdata->custom_width;
+	layout->color[0] = srcdata->color[0];
+	layout->color[1] = srcdata->color[1];
+	return changed;
+}
+
 void fill_vertex_buffer(struct ft2_source *srcdata)
 {
 	struct gs_vb_data *vdata = gs_vertexbuffer_get_data(srcdata->vbuf);
@@ -161,24 +202,25 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 
 	FT_UInt glyph_index = 0;
 
-	uint32_t dx = 0, dy = srcdata->max_h, max_y = dy;
+	uint32_t max_h = srcdata->atlas->max_h;
+	uint32_t dx = 0, dy = max_h, max_y = dy;
 	uint32_t cur_glyph = 0;
 	uint32_t offset = 0;
 	size_t len = wcslen(srcdata->text);
+	size_t unchanged = 0;
+	bool changed = false;
 
 	if (srcdata->outline_text) {
 		offset = 2;
 		dx = offset;
 	}
 
-	if (srcdata->colorbuf != NULL) {
-		bfree(srcdata->colorbuf);
-		srcdata->colorbuf = NULL;
-	}
-	srcdata->colorbuf =
-		bzalloc(sizeof(uint32_t) * wcslen(srcdata->text) * 6);
-	for (size_t i = 0; i < len * 6; i++) {
-		srcdata->colorbuf[i] = 0xFF000000;
+	// Glyphs before the first changed character keep their vertices
+	if (!update_vbuf_layout(srcdata, offset) && srcdata->vbuf_text) {
+		while (srcdata->text[unchanged] &&
+		       srcdata->text[unchanged] ==
+			       srcdata->vbuf_text[unchanged])
+			unchanged++;
 	}
 
 	for (size_t i = 0; i < len; i++) {
@@ -187,7 +229,7 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 			goto draw_glyph;
 		dx = offset;
 		i++;
-		dy += srcdata->max_h + 4;
+		dy += max_h + 4;
 		if (i == wcslen(srcdata->text))
 			goto skip_glyph;
 		if (srcdata->text[i] == L'\n')
@@ -197,8 +239,8 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 		if (srcdata->text[i] == L'\r')
 			goto skip_glyph;
 
-		glyph_index =
-			FT_Get_Char_Index(srcdata->font_face, srcdata->text[i]);
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->face,
+						srcdata->text[i]);
 		if (src_glyph == NULL)
 			goto skip_glyph;
 
@@ -207,19 +249,22 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 
 		if (dx + src_glyph->xadv > srcdata->custom_width) {
 			dx = offset;
-			dy += srcdata->max_h + 4;
+			dy += max_h + 4;
 		}
 
 	skip_custom_width:;
 
-		set_v3_rect(vdata->points + (cur_glyph * 6),
-			    (float)dx + (float)src_glyph->xoff,
-			    (float)dy - (float)src_glyph->yoff,
-			    (float)src_glyph->w, (float)src_glyph->h);
-		set_v2_uv(tvarray + (cur_glyph * 6), src_glyph->u, src_glyph->v,
-			  src_glyph->u2, src_glyph->v2);
-		set_rect_colors2(col + (cur_glyph * 6), srcdata->color[0],
-				 srcdata->color[1]);
+		if (i >= unchanged) {
+			set_v3_rect(vdata->points + (cur_glyph * 6),
+				    (float)dx + (float)src_glyph->xoff,
+				    (float)dy - (float)src_glyph->yoff,
+				    (float)src_glyph->w, (float)src_glyph->h);
+			set_v2_uv(tvarray + (cur_glyph * 6), src_glyph->u,
+				  src_glyph->v, src_glyph->u2, src_glyph->v2);
+			set_rect_colors2(col + (cur_glyph * 6),
+					 srcdata->color[0], srcdata->color[1]);
+			changed = true;
+		}
 		dx += src_glyph->xadv;
 		if (dy - (float)src_glyph->yoff + src_glyph->h > max_y)
 			max_y = dy - src_glyph->yoff + src_glyph->h;
@@ -228,184 +273,12 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 	}
 
 	srcdata->cy = max_y;
-}
-
-void cache_standard_glyphs(struct ft2_source *srcdata)
-{
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
-
-	srcdata->texbuf_x = 0;
-	srcdata->texbuf_y = 0;
-
-	cache_glyphs(srcdata, L"abcdefghijklmnopqrstuvwxyz"
-			      L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"
-			      L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"\0");
-}
-
-FT_Render_Mode get_render_mode(struct ft2_source *srcdata)
-{
-	return srcdata->antialiasing ? FT_RENDER_MODE_NORMAL
-				     : FT_RENDER_MODE_MONO;
-}
-
-void load_glyph(struct ft2_source *srcdata, const FT_UInt glyph_index,
-		const FT_Render_Mode render_mode)
-{
-	const FT_Int32 load_mode = render_mode == FT_RENDER_MODE_MONO
-					   ? FT_LOAD_TARGET_MONO
-					   : FT_LOAD_DEFAULT;
-	FT_Load_Glyph(srcdata->font_face, glyph_index, load_mode);
-}
-
-struct glyph_info *init_glyph(FT_GlyphSlot slot, const uint32_t dx,
-			      const uint32_t dy, const uint32_t g_w,
-			      const uint32_t g_h)
-{
-	struct glyph_info *glyph = bzalloc(sizeof(struct glyph_info));
-	glyph->u = (float)dx / (float)texbuf_w;
-	glyph->u2 = (float)(dx + g_w) / (float)texbuf_w;
-	glyph->v = (float)dy / (float)texbuf_h;
-	glyph->v2 = (float)(dy + g_h) / (float)texbuf_h;
-	glyph->w = g_w;
-	glyph->h = g_h;
-	glyph->yoff = slot->bitmap_top;
-	glyph->xoff = slot->bitmap_left;
-	glyph->xadv = slot->advance.x >> 6;
-
-	return glyph;
-}
-
-uint8_t get_pixel_value(const unsigned char *buf_row,
-			FT_Render_Mode render_mode, const uint32_t x)
-{
-	if (render_mode == FT_RENDER_MODE_NORMAL) {
-		return buf_row[x];
-	}
-
-	const uint32_t byte_index = x / 8;
-	const uint8_t bit_index = x % 8;
-	const bool pixel_set = (buf_row[byte_index] >> (7 - bit_index)) & 1;
-	return pixel_set ? 255 : 0;
-}
-
-void rasterize(struct ft2_source *srcdata, FT_GlyphSlot slot,
-	       const FT_Render_Mode render_mode, const uint32_t dx,
-	       const uint32_t dy)
-{
-	/**
-	 * The pitch's absolute value is the number of bytes taken by one bitmap
-	 * row, including padding.
-	 *
-	 * Source: https://www.freetype.org/freetype2/docs/reference/ft2-basic_types.html
-	 */
-	const int pitch = abs(slot->bitmap.pitch);
-
-	for (uint32_t y = 0; y < slot->bitmap.rows; y++) {
-		const uint32_t row_start = y * pitch;
-		const uint32_t row = (dy + y) * texbuf_w;
-
-		for (uint32_t x = 0; x < slot->bitmap.width; x++) {
-			const uint32_t row_pixel_position = dx + x;
-			const uint8_t pixel_value =
-				get_pixel_value(&slot->bitmap.buffer[row_start],
-						render_mode, x);
-			srcdata->texbuf[row_pixel_position + row] = pixel_value;
-		}
-	}
-}
-
-void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs)
-{
-	if (!srcdata->font_face || !cache_glyphs)
-		return;
-
-	FT_GlyphSlot slot = srcdata->font_face->glyph;
-
-	uint32_t dx = srcdata->texbuf_x;
-	uint32_t dy = srcdata->texbuf_y;
-
-	int32_t cached_glyphs = 0;
-	const size_t len = wcslen(cache_glyphs);
-
-	const FT_Render_Mode render_mode = get_render_mode(srcdata);
-
-	for (size_t i = 0; i < len; i++) {
-		const FT_UInt glyph_index =
-			FT_Get_Char_Index(srcdata->font_face, cache_glyphs[i]);
-
-		if (src_glyph != NULL) {
-			continue;
-		}
-
-		load_glyph(srcdata, glyph_index, render_mode);
-		FT_Render_Glyph(slot, render_mode);
-
-		const uint32_t g_w = slot->bitmap.width;
-		const uint32_t g_h = slot->bitmap.rows;
-
-		if (srcdata->max_h < g_h) {
-			srcdata->max_h = g_h;
-		}
-
-		if (dx + g_w >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h + 1;
-		}
-
-		if (dy + g_h >= texbuf_h) {
-			blog(LOG_WARNING,
-			     "Out of space trying to render glyphs");
-			break;
-		}
-
-		src_glyph = init_glyph(slot, dx, dy, g_w, g_h);
-		rasterize(srcdata, slot, render_mode, dx, dy);
-
-		dx += (g_w + 1);
-		if (dx >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h;
-		}
-
-		cached_glyphs++;
-	}
-
-	srcdata->texbuf_x = dx;
-	srcdata->texbuf_y = dy;
-
-	if (cached_glyphs > 0) {
-
-		obs_enter_graphics();
-
-		if (srcdata->tex != NULL) {
-			gs_texture_t *tmp_texture = srcdata->tex;
-			srcdata->tex = NULL;
-			gs_texture_destroy(tmp_texture);
-		}
+	srcdata->num_glyphs = cur_glyph;
+	if (changed)
+		srcdata->vbuf_dirty = true;
 
-		srcdata->tex = gs_texture_create(
-			texbuf_w, texbuf_h, GS_A8, 1,
-			(const uint8_t **)&srcdata->texbuf, 0);
-
-		obs_leave_graphics();
-	}
-}
-
-time_t get_modified_timestamp(char *filename)
-{
-	struct stat stats;
-
-	// stat is apparently terrifying and horrible, but we only call it once
-	// every second at most.
-	if (os_stat(filename, &stats) != 0)
-		return -1;
-
-	return stats.st_mtime;
+	bfree(srcdata->vbuf_text);
+	srcdata->vbuf_text = bwstrdup(srcdata->text);
 }
 
 static void remove_cr(wchar_t *source)
@@ -563,22 +436,21 @@ uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata)
 		return 0;
 	}
 
-	FT_GlyphSlot slot = srcdata->font_face->glyph;
+	// Uses the advances of the cached glyphs, so nothing has to be loaded
+	FT_UInt glyph_index;
 	uint32_t w = 0, max_w = 0;
 	const size_t len = wcslen(text);
 	for (size_t i = 0; i < len; i++) {
-		const FT_UInt glyph_index =
-			FT_Get_Char_Index(srcdata->font_face, text[i]);
-
-		load_glyph(srcdata, glyph_index, get_render_mode(srcdata));
-
-		if (text[i] == L'\n')
+		if (text[i] == L'\n') {
 			w = 0;
-		else {
-			w += slot->advance.x >> 6;
-			if (w > max_w)
-				max_w = w;
+			continue;
 		}
+
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->face, text[i]);
+		if (src_glyph)
+			w += (uint32_t)src_glyph->xadv;
+		if (w > max_w)
+			max_w = w;
 	}
 
 	return max_w;
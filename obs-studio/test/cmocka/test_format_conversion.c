@@ -0,0 +1,300 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <media-io/format-conversion.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+
+/* widths that leave a scalar tail after the vector loops */
+#define TEST_WIDTH 1004
+#define TEST_HEIGHT 36
+#define BENCH_WIDTH 3840
+#define BENCH_HEIGHT 2160
+#define BENCH_FRAMES 10
+
+/* ------------------------------------------------------------------------- */
+/* scalar references                                                         */
+
+static void ref_decompress_420(const uint8_t *const input[],
+			       const uint32_t in_linesize[], uint32_t start_y,
+			       uint32_t end_y, uint8_t *output,
+			       uint32_t out_linesize)
+{
+	for (uint32_t y = start_y; y < end_y; y++) {
+		uint32_t *out = (uint32_t *)(output + y * out_linesize);
+
+		for (uint32_t x = 0; x < in_linesize[0]; x++) {
+			uint32_t lum = input[0][y * in_linesize[0] + x];
+			uint32_t u = input[1][y / 2 * in_linesize[1] + x / 2];
+			uint32_t v = input[2][y / 2 * in_linesize[2] + x / 2];
+			out[x] = (lum << 16) | (u << 8) | v;
+		}
+	}
+}
+
+static void ref_decompress_nv12(const uint8_t *const input[],
+				const uint32_t in_linesize[], uint32_t start_y,
+				uint32_t end_y, uint8_t *output,
+				uint32_t out_linesize)
+{
+	for (uint32_t y = start_y; y < end_y; y++) {
+		uint32_t *out = (uint32_t *)(output + y * out_linesize);
+		const uint8_t *uv = input[1] + y / 2 * in_linesize[1];
+
+		for (uint32_t x = 0; x < in_linesize[0]; x++) {
+			uint32_t lum = input[0][y * in_linesize[0] + x];
+			uint32_t u = uv[x / 2 * 2];
+			uint32_t v = uv[x / 2 * 2 + 1];
+			out[x] = lum | (u << 8) | (v << 16);
+		}
+	}
+}
+
+static void ref_decompress_p010(const uint8_t *const input[],
+				const uint32_t in_linesize[], uint32_t start_y,
+				uint32_t end_y, uint8_t *output,
+				uint32_t out_linesize)
+{
+	for (uint32_t y = start_y; y < end_y; y++) {
+		uint32_t *out = (uint32_t *)(output + y * out_linesize);
+		const uint16_t *lum =
+			(const uint16_t *)(input[0] + y * in_linesize[0]);
+		const uint16_t *uv =
+			(const uint16_t *)(input[1] + y / 2 * in_linesize[1]);
+
+		for (uint32_t x = 0; x < in_linesize[0] / 2; x++) {
+			uint32_t u = uv[x / 2 * 2] >> 8;
+			uint32_t v = uv[x / 2 * 2 + 1] >> 8;
+			out[x] = (uint32_t)(lum[x] >> 8) | (u << 8) | (v << 16);
+		}
+	}
+}
+
+static void ref_decompress_i010(const uint8_t *const input[],
+				const uint32_t in_linesize[], uint32_t start_y,
+				uint32_t end_y, uint8_t *output,
+				uint32_t out_linesize)
+{
+	for (uint32_t y = start_y; y < end_y; y++) {
+		uint32_t *out = (uint32_t *)(output + y * out_linesize);
+		const uint16_t *lum =
+			(const uint16_t *)(input[0] + y * in_linesize[0]);
+		const uint16_t *u =
+			(const uint16_t *)(input[1] + y / 2 * in_linesize[1]);
+		const uint16_t *v =
+			(const uint16_t *)(input[2] + y / 2 * in_linesize[2]);
+
+		for (uint32_t x = 0; x < in_linesize[0] / 2; x++) {
+			out[x] = ((uint32_t)(lum[x] >> 2) << 16) |
+				 ((uint32_t)(u[x / 2] >> 2) << 8) |
+				 (uint32_t)(v[x / 2] >> 2);
+		}
+	}
+}
+
+static void ref_decompress_422(const uint8_t *input, uint32_t in_linesize,
+			       uint32_t start_y, uint32_t end_y,
+			       uint8_t *output, uint32_t out_linesize,
+			       bool leading_lum)
+{
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint8_t *in = input + y * in_linesize;
+		uint8_t *out = output + y * out_linesize;
+
+		for (uint32_t x = 0; x < in_linesize / 4; x++) {
+			memcpy(out, in, 4);
+			memcpy(out + 4, in, 4);
+			if (leading_lum)
+				out[4] = in[2];
+			else
+				out[5] = in[3];
+			in += 4;
+			out += 8;
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void fill_random(void *data, size_t size, uint16_t mask)
+{
+	uint16_t *data16 = data;
+
+	for (size_t i = 0; i < size / 2; i++)
+		data16[i] = (uint16_t)rand() & mask;
+}
+
+struct planes {
+	uint8_t *data[3];
+	uint32_t linesize[3];
+};
+
+static void planes_alloc(struct planes *planes, uint32_t width,
+			 uint32_t height, uint32_t bpp, uint32_t count,
+			 uint16_t mask)
+{
+	memset(planes, 0, sizeof(*planes));
+
+	for (uint32_t i = 0; i < count; i++) {
+		/* chroma planes of planar formats are half as wide, NV12-style
+		 * chroma planes interleave both channels at full width */
+		uint32_t linesize = i > 0 && count == 3 ? width * bpp / 2
+							: width * bpp;
+		uint32_t lines = i == 0 ? height : height / 2;
+
+		planes->linesize[i] = linesize;
+		planes->data[i] = bmalloc(linesize * lines);
+		fill_random(planes->data[i], linesize * lines, mask);
+	}
+}
+
+static void planes_free(struct planes *planes)
+{
+	for (size_t i = 0; i < 3; i++)
+		bfree(planes->data[i]);
+}
+
+typedef void (*planar_func)(const uint8_t *const input[],
+			    const uint32_t in_linesize[], uint32_t start_y,
+			    uint32_t end_y, uint8_t *output,
+			    uint32_t out_linesize);
+
+static void check_planar(planar_func func, planar_func ref, uint32_t bpp,
+			 uint32_t count, uint16_t mask)
+{
+	struct planes in;
+	uint32_t out_linesize = TEST_WIDTH * 4;
+	size_t out_size = out_linesize * TEST_HEIGHT;
+	uint8_t *out = bzalloc(out_size);
+	uint8_t *out_ref = bzalloc(out_size);
+
+	planes_alloc(&in, TEST_WIDTH, TEST_HEIGHT, bpp, count, mask);
+
+	/* convert in two bands to cover start_y */
+	func((const uint8_t *const *)in.data, in.linesize, 0, TEST_HEIGHT / 2,
+	     out, out_linesize);
+	func((const uint8_t *const *)in.data, in.linesize, TEST_HEIGHT / 2,
+	     TEST_HEIGHT, out, out_linesize);
+	ref((const uint8_t *const *)in.data, in.linesize, 0, TEST_HEIGHT,
+	    out_ref, out_linesize);
+
+	assert_memory_equal(out, out_ref, out_size);
+
+	planes_free(&in);
+	bfree(out);
+	bfree(out_ref);
+}
+
+static void decompress_420_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+	check_planar(decompress_420, ref_decompress_420, 1, 3, 0xFFFF);
+}
+
+static void decompress_nv12_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+	check_planar(decompress_nv12, ref_decompress_nv12, 1, 2, 0xFFFF);
+}
+
+static void decompress_p010_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+	check_planar(decompress_p010, ref_decompress_p010, 2, 2, 0xFFC0);
+}
+
+static void decompress_i010_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+	check_planar(decompress_i010, ref_decompress_i010, 2, 3, 0x03FF);
+}
+
+static void decompress_422_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	uint32_t in_linesize = TEST_WIDTH * 2;
+	uint32_t out_linesize = TEST_WIDTH * 4;
+	size_t out_size = out_linesize * TEST_HEIGHT;
+	uint8_t *in = bmalloc(in_linesize * TEST_HEIGHT);
+	uint8_t *out = bzalloc(out_size);
+	uint8_t *out_ref = bzalloc(out_size);
+
+	fill_random(in, in_linesize * TEST_HEIGHT, 0xFFFF);
+
+	for (int leading_lum = 0; leading_lum < 2; leading_lum++) {
+		decompress_422(in, in_linesize, 0, TEST_HEIGHT, out,
+			       out_linesize, leading_lum);
+		ref_decompress_422(in, in_linesize, 0, TEST_HEIGHT, out_ref,
+				   out_linesize, leading_lum);
+		assert_memory_equal(out, out_ref, out_size);
+	}
+
+	bfree(in);
+	bfree(out);
+	bfree(out_ref);
+}
+
+/* ------------------------------------------------------------------------- */
+/* throughput against the scalar references, informational only              */
+
+static double bench_planar(planar_func func, struct planes *in, uint8_t *out)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (int i = 0; i < BENCH_FRAMES; i++)
+		func((const uint8_t *const *)in->data, in->linesize, 0,
+		     BENCH_HEIGHT, out, BENCH_WIDTH * 4);
+
+	return (double)(os_gettime_ns() - start) / 1000000.0 / BENCH_FRAMES;
+}
+
+static void print_planar_bench(const char *name, planar_func func,
+			       planar_func ref, uint32_t bpp, uint32_t count)
+{
+	struct planes in;
+	uint8_t *out = bmalloc(BENCH_WIDTH * 4 * BENCH_HEIGHT);
+
+	planes_alloc(&in, BENCH_WIDTH, BENCH_HEIGHT, bpp, count, 0x03FF);
+
+	double time = bench_planar(func, &in, out);
+	double time_ref = bench_planar(ref, &in, out);
+
+	print_message("%-16s %7.3f ms/frame (scalar %7.3f ms/frame)\n", name,
+		      time, time_ref);
+
+	planes_free(&in);
+	bfree(out);
+}
+
+static void throughput_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	print_planar_bench("decompress_420", decompress_420, ref_decompress_420,
+			   1, 3);
+	print_planar_bench("decompress_nv12", decompress_nv12,
+			   ref_decompress_nv12, 1, 2);
+	print_planar_bench("decompress_p010", decompress_p010,
+			   ref_decompress_p010, 2, 2);
+	print_planar_bench("decompress_i010", decompress_i010,
+			   ref_decompress_i010, 2, 3);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(decompress_420_test),
+		cmocka_unit_test(decompress_nv12_test),
+		cmocka_unit_test(decompress_p010_test),
+		cmocka_unit_test(decompress_i010_test),
+		cmocka_unit_test(decompress_422_test),
+		cmocka_unit_test(throughput_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
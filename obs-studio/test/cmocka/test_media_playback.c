@@ -0,0 +1,130 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <media-playback/media-playback.h>
+#include <util/threading.h>
+#include <util/platform.h>
+
+#define TEST_FILE "test_media_playback.y4m"
+#define WIDTH 16
+#define HEIGHT 16
+#define NUM_FRAMES 5
+
+static uint8_t frame_luma(int idx)
+{
+	return (uint8_t)(16 + idx * 32);
+}
+
+/* uncompressed yuv4mpeg, which libavformat can always read */
+static bool write_test_file(void)
+{
+	uint8_t plane[WIDTH * HEIGHT];
+	FILE *f = os_fopen(TEST_FILE, "wb");
+	if (!f)
+		return false;
+
+	fprintf(f, "YUV4MPEG2 W%d H%d F30:1 Ip A1:1\n", WIDTH, HEIGHT);
+
+	for (int i = 0; i < NUM_FRAMES; i++) {
+		fprintf(f, "FRAME\n");
+
+		memset(plane, frame_luma(i), sizeof(plane));
+		fwrite(plane, 1, WIDTH * HEIGHT, f);
+
+		memset(plane, 128, sizeof(plane));
+		fwrite(plane, 1, WIDTH * HEIGHT / 4, f);
+		fwrite(plane, 1, WIDTH * HEIGHT / 4, f);
+	}
+
+	fclose(f);
+	return true;
+}
+
+struct lend_data {
+	os_event_t *done;
+	volatile long lent;
+	bool bad_frame;
+
+	mp_frame_release_cb held_release;
+	void *held_param;
+	const uint8_t *held_data;
+	uint8_t held_luma;
+};
+
+static void lend_frame(void *opaque, struct obs_source_frame *frame,
+		       mp_frame_release_cb release, void *param)
+{
+	struct lend_data *data = opaque;
+
+	if (frame->width != WIDTH || frame->height != HEIGHT ||
+	    !frame->data[0])
+		data->bad_frame = true;
+
+	/* the first frame is held until the media is gone */
+	if (!data->held_release) {
+		data->held_release = release;
+		data->held_param = param;
+		data->held_data = frame->data[0];
+		data->held_luma = frame->data[0][0];
+	} else {
+		release(param);
+	}
+
+	if (os_atomic_inc_long(&data->lent) == NUM_FRAMES)
+		os_event_signal(data->done);
+}
+
+static void media_stopped(void *opaque)
+{
+	struct lend_data *data = opaque;
+	os_event_signal(data->done);
+}
+
+static void lent_frame_release_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct lend_data data = {0};
+	assert_true(write_test_file());
+	assert_int_equal(os_event_init(&data.done, OS_EVENT_TYPE_MANUAL), 0);
+
+	struct mp_media_info info = {
+		.opaque = &data,
+		.v_lend_cb = lend_frame,
+		.stop_cb = media_stopped,
+		.path = TEST_FILE,
+		.speed = 100,
+		.is_local_file = true,
+	};
+
+	media_playback_t *mp = media_playback_create(&info);
+	assert_non_null(mp);
+	assert_true(media_playback_has_video(mp));
+
+	media_playback_play(mp, false, false);
+	assert_int_equal(os_event_timedwait(data.done, 5000), 0);
+	media_playback_destroy(mp);
+
+	assert_int_equal(data.lent, NUM_FRAMES);
+	assert_false(data.bad_frame);
+	assert_non_null(data.held_release);
+
+	/* lent frames stay valid and can be released after the media */
+	assert_int_equal(data.held_luma, frame_luma(0));
+	assert_int_equal(data.held_data[0], frame_luma(0));
+	data.held_release(data.held_param);
+
+	os_event_destroy(data.done);
+	os_unlink(TEST_FILE);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(lent_frame_release_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,126 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs-data.h>
+
+static const char *compact_json =
+	"{\"name\":\"caf\\u00e9 \\\"quoted\\\"\\n\",\"int\":-9223372036854775808,"
+	"\"real\":0.1,\"exp\":1e+300,\"whole\":2.0,\"flag\":true,\"off\":false,"
+	"\"none\":null,\"obj\":{\"inner\":[{\"a\":1},5,\"skipped\",{}]},"
+	"\"empty\":{},\"list\":[]}";
+
+static const char *expected_compact =
+	"{\"name\":\"caf\xc3\xa9 \\\"quoted\\\"\\n\",\"int\":-9223372036854775808,"
+	"\"real\":0.10000000000000001,\"exp\":1.0000000000000001e300,"
+	"\"whole\":2.0,\"flag\":true,\"off\":false,"
+	"\"obj\":{\"inner\":[{\"a\":1},{}]},\"empty\":{},\"list\":[]}";
+
+static const char *expected_pretty = "{\n"
+				     "    \"a\": 1,\n"
+				     "    \"b\": {\n"
+				     "        \"c\": [\n"
+				     "            {\n"
+				     "                \"d\": \"\\u0001\"\n"
+				     "            },\n"
+				     "            {}\n"
+				     "        ]\n"
+				     "    },\n"
+				     "    \"e\": []\n"
+				     "}";
+
+static void round_trip_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	obs_data_t *data = obs_data_create_from_json(compact_json);
+	assert_non_null(data);
+
+	assert_string_equal(obs_data_get_json(data), expected_compact);
+	assert_int_equal(obs_data_get_int(data, "int"), INT64_MIN);
+	assert_true(obs_data_has_user_value(data, "whole"));
+	assert_false(obs_data_has_user_value(data, "none"));
+
+	obs_data_t *copy = obs_data_create_from_json(obs_data_get_json(data));
+	assert_non_null(copy);
+	assert_string_equal(obs_data_get_json(copy), expected_compact);
+
+	obs_data_release(copy);
+	obs_data_release(data);
+}
+
+static void pretty_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	obs_data_t *data = obs_data_create_from_json(
+		"{\"a\":1,\"b\":{\"c\":[{\"d\":\"\\u0001\"},{}]},\"e\":[]}");
+	assert_non_null(data);
+	assert_string_equal(obs_data_get_json_pretty(data), expected_pretty);
+	obs_data_release(data);
+}
+
+static void invalid_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const char *invalid[] = {
+		"",
+		"\"string\"",
+		"{\"a\":1,\"a\":2}",
+		"{\"a\":null,\"a\":1}",
+		"[[{\"a\":1,\"a\":2}]]",
+		"{\"a\":01}",
+		"{\"a\":1.}",
+		"{\"a\":99999999999999999999}",
+		"{\"a\":1e999}",
+		"{\"a\":\"\\u0000\"}",
+		"{\"a\":\"\\ud800\"}",
+		"{\"a\":\"\xc3\x28\"}",
+		"{\"a\":\"\x01\"}",
+		"{\"a\":1,}",
+		"{\"a\":true} x",
+	};
+
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+		assert_null(obs_data_create_from_json(invalid[i]));
+
+	obs_data_t *data = obs_data_create_from_json("[1, {\"a\": 2}]");
+	assert_non_null(data);
+	assert_string_equal(obs_data_get_json(data), "{}");
+	obs_data_release(data);
+}
+
+static void modify_parsed_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	obs_data_t *data =
+		obs_data_create_from_json("{\"a\":\"x\",\"b\":1,\"c\":true}");
+	assert_non_null(data);
+
+	/* parsed items have to be able to grow and go away on their own */
+	obs_data_set_string(data, "a", "a much longer string than before");
+	obs_data_set_default_int(data, "b", 2);
+	obs_data_erase(data, "c");
+
+	obs_data_item_t *item = obs_data_item_byname(data, "b");
+	obs_data_release(data);
+
+	assert_int_equal(obs_data_item_get_int(item), 1);
+	assert_int_equal(obs_data_item_get_default_int(item), 2);
+	obs_data_item_release(&item);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(round_trip_test),
+		cmocka_unit_test(pretty_test),
+		cmocka_unit_test(invalid_test),
+		cmocka_unit_test(modify_parsed_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
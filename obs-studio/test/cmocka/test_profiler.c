@@ -0,0 +1,166 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <obs-data.h>
+#include <util/profiler.h>
+#include <util/threading.h>
+#include <util/platform.h>
+
+#define NUM_THREADS 4
+#define NUM_EVENTS 256
+#define TRACE_FILE "test_profiler_trace.json"
+
+static const char *outer_name = "outer \"quoted\"";
+static const char *inner_name = "inner";
+static const char *counter_name = "counter";
+static const char *flow_name = "flow";
+
+struct trace_thread {
+	pthread_t thread;
+	char name[16];
+	long iterations;
+	volatile bool *stop;
+};
+
+static void *trace_thread(void *param)
+{
+	struct trace_thread *data = param;
+	os_set_thread_name(data->name);
+
+	for (long i = 0; i < data->iterations ||
+			 (data->stop && !os_atomic_load_bool(data->stop));
+	     i++) {
+		profile_start(outer_name);
+		profile_start(inner_name);
+		profile_trace_counter(counter_name, i);
+		profile_trace_flow(flow_name, (uint64_t)i,
+				   PROFILE_FLOW_STEP);
+		profile_end(inner_name);
+		profile_end(outer_name);
+	}
+
+	return NULL;
+}
+
+struct trace_stats {
+	size_t begin;
+	size_t end;
+	size_t counter;
+	size_t flow;
+	size_t thread_names;
+};
+
+static bool load_trace(struct trace_stats *stats)
+{
+	obs_data_t *data = obs_data_create_from_json_file(TRACE_FILE);
+	if (!data)
+		return false;
+
+	obs_data_array_t *events = obs_data_get_array(data, "traceEvents");
+	memset(stats, 0, sizeof(*stats));
+
+	for (size_t i = 0; i < obs_data_array_count(events); i++) {
+		obs_data_t *event = obs_data_array_item(events, i);
+		const char *ph = obs_data_get_string(event, "ph");
+		const char *name = obs_data_get_string(event, "name");
+
+		if (strcmp(ph, "B") == 0)
+			stats->begin++;
+		else if (strcmp(ph, "E") == 0)
+			stats->end++;
+		else if (strcmp(ph, "C") == 0)
+			stats->counter++;
+		else if (strcmp(ph, "t") == 0)
+			stats->flow++;
+		else if (strcmp(name, "thread_name") == 0)
+			stats->thread_names++;
+
+		obs_data_release(event);
+	}
+
+	obs_data_array_release(events);
+	obs_data_release(data);
+	return true;
+}
+
+static void record_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct trace_thread threads[NUM_THREADS] = {0};
+	struct trace_stats stats;
+
+	profiler_trace_start(NUM_EVENTS * 6);
+
+	for (size_t i = 0; i < NUM_THREADS; i++) {
+		snprintf(threads[i].name, sizeof(threads[i].name), "trace %d",
+			 (int)i);
+		threads[i].iterations = NUM_EVENTS;
+		pthread_create(&threads[i].thread, NULL, trace_thread,
+			       &threads[i]);
+	}
+	for (size_t i = 0; i < NUM_THREADS; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	profiler_trace_stop();
+
+	assert_true(profiler_trace_dump_json(TRACE_FILE));
+	assert_true(load_trace(&stats));
+	assert_int_equal(stats.begin, NUM_THREADS * NUM_EVENTS * 2);
+	assert_int_equal(stats.end, NUM_THREADS * NUM_EVENTS * 2);
+	assert_int_equal(stats.counter, NUM_THREADS * NUM_EVENTS);
+	assert_int_equal(stats.flow, NUM_THREADS * NUM_EVENTS);
+	assert_int_equal(stats.thread_names, NUM_THREADS);
+
+	os_unlink(TRACE_FILE);
+}
+
+static void live_dump_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct trace_thread threads[NUM_THREADS] = {0};
+	struct trace_stats stats;
+	volatile bool stop = false;
+
+	/* the rings wrap many times while they're being dumped */
+	profiler_trace_start(NUM_EVENTS);
+
+	for (size_t i = 0; i < NUM_THREADS; i++) {
+		snprintf(threads[i].name, sizeof(threads[i].name), "live %d",
+			 (int)i);
+		threads[i].stop = &stop;
+		pthread_create(&threads[i].thread, NULL, trace_thread,
+			       &threads[i]);
+	}
+
+	for (int i = 0; i < 10; i++) {
+		os_sleep_ms(2);
+		assert_true(profiler_trace_dump_json(TRACE_FILE));
+		assert_true(load_trace(&stats));
+		assert_true(stats.begin + stats.end + stats.counter +
+				    stats.flow <=
+			    NUM_THREADS * NUM_EVENTS);
+	}
+
+	os_atomic_set_bool(&stop, true);
+	for (size_t i = 0; i < NUM_THREADS; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	profiler_trace_stop();
+	os_unlink(TRACE_FILE);
+	profiler_free();
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(record_test),
+		cmocka_unit_test(live_dump_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
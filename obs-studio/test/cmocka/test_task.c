@@ -0,0 +1,219 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/task.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+#include <util/platform.h>
+
+#define NUM_TASKS 10000
+#define NUM_QUEUES 4
+
+struct counter_data {
+	volatile long count;
+};
+
+static void count_task(void *param)
+{
+	struct counter_data *data = param;
+	os_atomic_inc_long(&data->count);
+}
+
+static void group_join_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct counter_data data = {0};
+	os_task_pool_t *pool = os_task_pool_create(4);
+	assert_non_null(pool);
+
+	os_task_group_t *group =
+		os_task_group_create(pool, OS_TASK_PRIORITY_VIDEO);
+	assert_non_null(group);
+
+	for (int round = 1; round <= 3; round++) {
+		for (int i = 0; i < NUM_TASKS; i++)
+			os_task_group_queue_task(group, count_task, &data);
+		os_task_group_join(group);
+
+		assert_int_equal(os_atomic_load_long(&data.count),
+				 round * NUM_TASKS);
+	}
+
+	os_task_group_destroy(group);
+	os_task_pool_release(pool);
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define NUM_JOINERS 4
+
+struct joiner_data {
+	os_task_group_t *group;
+	struct counter_data *counter;
+	long seen;
+};
+
+static void *joiner_thread(void *param)
+{
+	struct joiner_data *data = param;
+
+	os_task_group_join(data->group);
+	data->seen = os_atomic_load_long(&data->counter->count);
+	return NULL;
+}
+
+static void sleep_task(void *param)
+{
+	os_sleep_ms(1);
+	count_task(param);
+}
+
+static void concurrent_join_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct counter_data data = {0};
+	struct joiner_data joiners[NUM_JOINERS];
+	pthread_t threads[NUM_JOINERS];
+	os_task_pool_t *pool = os_task_pool_create(2);
+
+	os_task_group_t *group =
+		os_task_group_create(pool, OS_TASK_PRIORITY_VIDEO);
+
+	for (int i = 0; i < 100; i++)
+		os_task_group_queue_task(group, sleep_task, &data);
+
+	/* every joiner has to wake up once the group is done */
+	for (size_t i = 0; i < NUM_JOINERS; i++) {
+		joiners[i].group = group;
+		joiners[i].counter = &data;
+		joiners[i].seen = 0;
+		pthread_create(&threads[i], NULL, joiner_thread, &joiners[i]);
+	}
+
+	os_task_group_join(group);
+
+	for (size_t i = 0; i < NUM_JOINERS; i++) {
+		pthread_join(threads[i], NULL);
+		assert_int_equal(joiners[i].seen, 100);
+	}
+
+	os_task_group_destroy(group);
+	os_task_pool_release(pool);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct nested_data {
+	os_task_pool_t *pool;
+	struct counter_data counter;
+};
+
+static void nested_task(void *param)
+{
+	struct nested_data *data = param;
+	os_task_group_t *group =
+		os_task_group_create(data->pool, OS_TASK_PRIORITY_VIDEO);
+
+	for (int i = 0; i < 16; i++)
+		os_task_group_queue_task(group, count_task, &data->counter);
+	os_task_group_destroy(group);
+}
+
+static void nested_join_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	/* more joining tasks than workers, only works if joins help out */
+	struct nested_data data = {0};
+	data.pool = os_task_pool_create(2);
+
+	os_task_group_t *group =
+		os_task_group_create(data.pool, OS_TASK_PRIORITY_VIDEO);
+
+	for (int i = 0; i < 64; i++)
+		os_task_group_queue_task(group, nested_task, &data);
+	os_task_group_destroy(group);
+
+	assert_int_equal(os_atomic_load_long(&data.counter.count), 64 * 16);
+	os_task_pool_release(data.pool);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct order_data {
+	os_task_queue_t *queue;
+	long next;
+	bool in_order;
+	bool inside;
+};
+
+struct order_task {
+	struct order_data *data;
+	long index;
+};
+
+static void order_task(void *param)
+{
+	struct order_task *task = param;
+	struct order_data *data = task->data;
+
+	if (data->next++ != task->index)
+		data->in_order = false;
+	if (!os_task_queue_inside(data->queue))
+		data->inside = false;
+}
+
+static void queue_order_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct order_data data[NUM_QUEUES];
+	struct order_task *tasks[NUM_QUEUES];
+
+	for (size_t q = 0; q < NUM_QUEUES; q++) {
+		data[q].queue = os_task_queue_create();
+		data[q].next = 0;
+		data[q].in_order = true;
+		data[q].inside = true;
+		tasks[q] = bmalloc(sizeof(struct order_task) * NUM_TASKS);
+	}
+
+	for (long i = 0; i < NUM_TASKS; i++) {
+		for (size_t q = 0; q < NUM_QUEUES; q++) {
+			tasks[q][i].data = &data[q];
+			tasks[q][i].index = i;
+			os_task_queue_queue_task(data[q].queue, order_task,
+						 &tasks[q][i]);
+		}
+	}
+
+	for (size_t q = 0; q < NUM_QUEUES; q++) {
+		os_task_queue_wait(data[q].queue);
+		assert_false(os_task_queue_wait(data[q].queue));
+		assert_false(os_task_queue_inside(data[q].queue));
+	}
+
+	for (size_t q = 0; q < NUM_QUEUES; q++) {
+		os_task_queue_destroy(data[q].queue);
+		assert_int_equal(data[q].next, NUM_TASKS);
+		assert_true(data[q].in_order);
+		assert_true(data[q].inside);
+		bfree(tasks[q]);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(group_join_test),
+		cmocka_unit_test(concurrent_join_test),
+		cmocka_unit_test(nested_join_test),
+		cmocka_unit_test(queue_order_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
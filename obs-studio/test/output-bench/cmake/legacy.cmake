@@ -0,0 +1,13 @@
+project(output-bench)
+
+add_executable(output-bench)
+
+target_sources(output-bench PRIVATE output-bench.c)
+
+target_link_libraries(output-bench PRIVATE OBS::libobs)
+
+if(OS_WINDOWS)
+  target_link_libraries(output-bench PRIVATE OBS::w32-pthreads psapi)
+endif()
+
+set_target_properties(output-bench PROPERTIES FOLDER "tests and examples")
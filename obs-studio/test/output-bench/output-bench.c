@@ -0,0 +1,805 @@
+/*
+ * Headless benchmark of the encoded packet output path.
+ *
+ * Synthetic H.264/AAC packets are generated at a configurable bitrate, frame
+ * rate, GOP length and audio track count and are sent through libobs to one
+ * of the following outputs:
+ *
+ *   interleave     a null output, measures the obs_output interleaver alone
+ *   replay_buffer  the replay buffer of obs-ffmpeg (kept in memory, not saved)
+ *   ffmpeg_muxer   the ffmpeg_muxer file output of obs-ffmpeg
+ *   flv            the flv_output of obs-outputs (flv_packet_mux)
+ *
+ * No graphics or capture is needed: the encoders are fed packets directly
+ * with obs_encoder_send_packet.  On Linux, libobs still needs an X11 display
+ * for hotkeys, use e.g. xvfb-run on machines without one.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <obs-nal.h>
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_FRAME_SIZE 1024
+#define KEYFRAME_WEIGHT 4
+
+struct bench_config {
+	const char *target;
+	const char *sink;
+	const char *out_dir;
+	const char *plugin_dir;
+	uint32_t fps;
+	uint32_t video_kbps;
+	uint32_t audio_kbps;
+	uint32_t gop;
+	uint32_t tracks;
+	uint32_t seconds;
+	uint32_t replay_sec;
+	uint32_t replay_mb;
+	bool realtime;
+	bool inproc;
+	bool verbose;
+};
+
+static struct bench_config config = {
+	.target = "interleave",
+	.sink = "null",
+	.out_dir = ".",
+	.plugin_dir = NULL,
+	.fps = 60,
+	.video_kbps = 20000,
+	.audio_kbps = 160,
+	.gop = 120,
+	.tracks = 1,
+	.seconds = 60,
+	.replay_sec = 30,
+	.replay_mb = 512,
+};
+
+/* ------------------------------------------------------------------------- */
+/* synthetic encoders, they never encode raw data, packets are sent to them  */
+
+/* Annex B SPS/PPS of a 1280x720 high profile stream */
+static const uint8_t video_header[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9,
+	0x40, 0x50, 0x05, 0xbb, 0x01, 0x10, 0x00, 0x00, 0x03, 0x00,
+	0x10, 0x00, 0x00, 0x03, 0x03, 0xc0, 0xf1, 0x83, 0x19, 0x60,
+	0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0,
+};
+
+/* AAC-LC, 48 kHz, stereo */
+static const uint8_t audio_header[] = {0x11, 0x90};
+
+static const char *bench_video_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark Video Encoder";
+}
+
+static const char *bench_audio_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark Audio Encoder";
+}
+
+static void *bench_encoder_create(obs_data_t *settings, obs_encoder_t *encoder)
+{
+	UNUSED_PARAMETER(settings);
+	return encoder;
+}
+
+static void bench_encoder_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static bool bench_encoder_encode(void *data, struct encoder_frame *frame,
+				 struct encoder_packet *packet,
+				 bool *received_packet)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(frame);
+	UNUSED_PARAMETER(packet);
+
+	*received_packet = false;
+	return true;
+}
+
+static bool bench_video_extra_data(void *data, uint8_t **extra_data,
+				   size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	*extra_data = (uint8_t *)video_header;
+	*size = sizeof(video_header);
+	return true;
+}
+
+static bool bench_audio_extra_data(void *data, uint8_t **extra_data,
+				   size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	*extra_data = (uint8_t *)audio_header;
+	*size = sizeof(audio_header);
+	return true;
+}
+
+static size_t bench_audio_frame_size(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return AUDIO_FRAME_SIZE;
+}
+
+static void bench_encoder_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "bitrate", 0);
+}
+
+static struct obs_encoder_info bench_video_encoder = {
+	.id = "bench_video_encoder",
+	.type = OBS_ENCODER_VIDEO,
+	.codec = "h264",
+	.get_name = bench_video_name,
+	.create = bench_encoder_create,
+	.destroy = bench_encoder_destroy,
+	.encode = bench_encoder_encode,
+	.get_defaults = bench_encoder_defaults,
+	.get_extra_data = bench_video_extra_data,
+};
+
+static struct obs_encoder_info bench_audio_encoder = {
+	.id = "bench_audio_encoder",
+	.type = OBS_ENCODER_AUDIO,
+	.codec = "aac",
+	.get_name = bench_audio_name,
+	.create = bench_encoder_create,
+	.destroy = bench_encoder_destroy,
+	.encode = bench_encoder_encode,
+	.get_defaults = bench_encoder_defaults,
+	.get_extra_data = bench_audio_extra_data,
+	.get_frame_size = bench_audio_frame_size,
+};
+
+/* ------------------------------------------------------------------------- */
+/* null output, receives the interleaved packets and drops them              */
+
+struct null_output {
+	obs_output_t *output;
+	uint64_t packets;
+	uint64_t bytes;
+};
+
+static const char *null_output_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark Null Output";
+}
+
+static void *null_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct null_output *context = bzalloc(sizeof(struct null_output));
+	context->output = output;
+	UNUSED_PARAMETER(settings);
+	return context;
+}
+
+static void null_output_destroy(void *data)
+{
+	bfree(data);
+}
+
+static bool null_output_start(void *data)
+{
+	struct null_output *context = data;
+
+	if (!obs_output_can_begin_data_capture(context->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(context->output, 0))
+		return false;
+
+	obs_output_begin_data_capture(context->output, 0);
+	return true;
+}
+
+static void null_output_stop(void *data, uint64_t ts)
+{
+	struct null_output *context = data;
+	obs_output_end_data_capture(context->output);
+	UNUSED_PARAMETER(ts);
+}
+
+static void null_output_data(void *data, struct encoder_packet *packet)
+{
+	struct null_output *context = data;
+
+	if (!packet)
+		return;
+
+	context->packets++;
+	context->bytes += packet->size;
+}
+
+static struct obs_output_info null_output_info = {
+	.id = "bench_null_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name = null_output_name,
+	.create = null_output_create,
+	.destroy = null_output_destroy,
+	.start = null_output_start,
+	.stop = null_output_stop,
+	.encoded_packet = null_output_data,
+};
+
+/* ------------------------------------------------------------------------- */
+/* packet generation                                                         */
+
+struct packet_gen {
+	uint64_t rand_state;
+	uint64_t video_frames;
+	uint64_t audio_frames;
+	size_t video_p_size;
+	size_t video_key_size;
+	size_t audio_size;
+};
+
+static inline uint32_t gen_rand(struct packet_gen *gen)
+{
+	/* xorshift64*, seeded with a constant so every run is the same */
+	uint64_t x = gen->rand_state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	gen->rand_state = x;
+	return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/* size +/- spread percent */
+static inline size_t gen_size(struct packet_gen *gen, size_t size,
+			      uint32_t spread)
+{
+	int64_t delta = (int64_t)(gen_rand(gen) % (spread * 2 + 1)) - spread;
+	size_t result = (size_t)((int64_t)size + (int64_t)size * delta / 100);
+	return result > 16 ? result : 16;
+}
+
+static void packet_gen_init(struct packet_gen *gen)
+{
+	uint64_t gop_bytes = (uint64_t)config.video_kbps * 1000 / 8 *
+			     config.gop / config.fps;
+
+	memset(gen, 0, sizeof(*gen));
+	gen->rand_state = 0x9E3779B97F4A7C15ULL;
+	gen->video_p_size =
+		(size_t)(gop_bytes / (config.gop - 1 + KEYFRAME_WEIGHT));
+	gen->video_key_size = gen->video_p_size * KEYFRAME_WEIGHT;
+	gen->audio_size = (size_t)((uint64_t)config.audio_kbps * 1000 / 8 *
+				   AUDIO_FRAME_SIZE / AUDIO_SAMPLE_RATE);
+}
+
+static inline int64_t video_ts_usec(uint64_t frame)
+{
+	return (int64_t)(frame * 1000000 / config.fps);
+}
+
+static inline int64_t audio_ts_usec(uint64_t frame)
+{
+	return (int64_t)(frame * AUDIO_FRAME_SIZE * 1000000 /
+			 AUDIO_SAMPLE_RATE);
+}
+
+static void gen_video_packet(struct packet_gen *gen,
+			     struct encoder_packet *packet)
+{
+	bool keyframe = gen->video_frames % config.gop == 0;
+	size_t size = gen_size(gen, keyframe ? gen->video_key_size
+					     : gen->video_p_size,
+			       25);
+	uint8_t *data = obs_encoder_packet_alloc(packet, size);
+
+	/* one IDR or non-IDR slice, the payload has no zero bytes so it can
+	 * never contain a start code */
+	data[0] = 0;
+	data[1] = 0;
+	data[2] = 0;
+	data[3] = 1;
+	data[4] = keyframe ? 0x65 : 0x41;
+	memset(data + 5, 0xAA, size - 5);
+
+	packet->type = OBS_ENCODER_VIDEO;
+	packet->pts = (int64_t)gen->video_frames;
+	packet->dts = (int64_t)gen->video_frames;
+	packet->keyframe = keyframe;
+	packet->priority = keyframe ? OBS_NAL_PRIORITY_HIGHEST
+				    : OBS_NAL_PRIORITY_HIGH;
+	packet->drop_priority = packet->priority;
+}
+
+static void gen_audio_packet(struct packet_gen *gen,
+			     struct encoder_packet *packet)
+{
+	size_t size = gen_size(gen, gen->audio_size, 10);
+	uint8_t *data = obs_encoder_packet_alloc(packet, size);
+
+	memset(data, 0x21, size);
+
+	packet->type = OBS_ENCODER_AUDIO;
+	packet->pts = (int64_t)(gen->audio_frames * AUDIO_FRAME_SIZE);
+	packet->dts = packet->pts;
+	packet->keyframe = true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* results                                                                   */
+
+struct bench_results {
+	DARRAY(uint64_t) latencies;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t wall_ns;
+};
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t *)a;
+	uint64_t val_b = *(const uint64_t *)b;
+	return (val_a > val_b) - (val_a < val_b);
+}
+
+static inline double percentile_us(struct bench_results *results, double p)
+{
+	size_t idx = (size_t)((double)(results->latencies.num - 1) * p);
+	return (double)results->latencies.array[idx] / 1000.0;
+}
+
+static uint64_t get_peak_rss(void)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return (uint64_t)pmc.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return (uint64_t)usage.ru_maxrss;
+#else
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static void print_results(struct bench_results *results)
+{
+	double seconds = (double)results->wall_ns / 1000000000.0;
+	double media_seconds = (double)config.seconds;
+
+	if (!results->latencies.num || seconds <= 0.0)
+		return;
+
+	qsort(results->latencies.array, results->latencies.num,
+	      sizeof(uint64_t), cmp_u64);
+
+	printf("target:          %s (%s sink)\n", config.target, config.sink);
+	printf("stream:          %u fps, gop %u, video %u kbps, "
+	       "%u x audio %u kbps, %u s\n",
+	       config.fps, config.gop, config.video_kbps, config.tracks,
+	       config.audio_kbps, config.seconds);
+	printf("packets:         %" PRIu64 " (%.2f MB)\n", results->packets,
+	       (double)results->bytes / (1024.0 * 1024.0));
+	printf("wall time:       %.3f s (%.1fx realtime)\n", seconds,
+	       media_seconds / seconds);
+	printf("throughput:      %.0f packets/s, %.2f MB/s\n",
+	       (double)results->packets / seconds,
+	       (double)results->bytes / (1024.0 * 1024.0) / seconds);
+	printf("send latency us: p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, "
+	       "max %.2f\n",
+	       percentile_us(results, 0.5), percentile_us(results, 0.9),
+	       percentile_us(results, 0.99), percentile_us(results, 0.999),
+	       percentile_us(results, 1.0));
+	printf("peak rss:        %.2f MB\n",
+	       (double)get_peak_rss() / (1024.0 * 1024.0));
+}
+
+/* ------------------------------------------------------------------------- */
+/* setup                                                                     */
+
+static bool load_plugin(const char *name)
+{
+	obs_module_t *module;
+	struct dstr path = {0};
+	int ret;
+
+	if (!config.plugin_dir) {
+		fprintf(stderr, "Target '%s' needs --plugin-dir\n",
+			config.target);
+		return false;
+	}
+
+	dstr_printf(&path, "%s/%s", config.plugin_dir, name);
+	ret = obs_open_module(&module, path.array, NULL);
+	dstr_free(&path);
+
+	if (ret != MODULE_SUCCESS) {
+		fprintf(stderr, "Failed to open module '%s' (%d)\n", name, ret);
+		return false;
+	}
+
+	return obs_init_module(module);
+}
+
+static obs_output_t *create_output(size_t *max_tracks)
+{
+	obs_data_t *settings = obs_data_create();
+	obs_output_t *output = NULL;
+	struct dstr path = {0};
+	bool null_sink = strcmp(config.sink, "null") == 0;
+
+	*max_tracks = MAX_OUTPUT_AUDIO_ENCODERS;
+
+	if (strcmp(config.target, "interleave") == 0) {
+		output = obs_output_create("bench_null_output", "bench",
+					   settings, NULL);
+
+	} else if (strcmp(config.target, "replay_buffer") == 0) {
+		if (!load_plugin("obs-ffmpeg"))
+			goto fail;
+
+		obs_data_set_int(settings, "max_time_sec", config.replay_sec);
+		obs_data_set_int(settings, "max_size_mb", config.replay_mb);
+		obs_data_set_string(settings, "directory", config.out_dir);
+		obs_data_set_string(settings, "format", "output-bench");
+		obs_data_set_string(settings, "extension", "ts");
+		output = obs_output_create("replay_buffer", "bench", settings,
+					   NULL);
+
+	} else if (strcmp(config.target, "ffmpeg_muxer") == 0) {
+		if (null_sink) {
+			fprintf(stderr, "ffmpeg_muxer needs --sink file\n");
+			goto fail;
+		}
+		if (!load_plugin("obs-ffmpeg"))
+			goto fail;
+
+		dstr_printf(&path, "%s/output-bench.ts", config.out_dir);
+		obs_data_set_string(settings, "path", path.array);
+		obs_data_set_bool(settings, "in_process_mux", config.inproc);
+		output = obs_output_create("ffmpeg_muxer", "bench", settings,
+					   NULL);
+
+	} else if (strcmp(config.target, "flv") == 0) {
+		if (!load_plugin("obs-outputs"))
+			goto fail;
+
+#ifdef _WIN32
+		const char *null_path = "NUL";
+#else
+		const char *null_path = "/dev/null";
+#endif
+		if (null_sink)
+			dstr_copy(&path, null_path);
+		else
+			dstr_printf(&path, "%s/output-bench.flv",
+				    config.out_dir);
+		obs_data_set_string(settings, "path", path.array);
+		output = obs_output_create("flv_output", "bench", settings,
+					   NULL);
+		*max_tracks = 1;
+
+	} else {
+		fprintf(stderr, "Unknown target '%s'\n", config.target);
+	}
+
+fail:
+	dstr_free(&path);
+	obs_data_release(settings);
+	return output;
+}
+
+static bool wait_for_output(obs_output_t *output, bool active)
+{
+	uint64_t timeout = os_gettime_ns() + 10000000000ULL;
+
+	while (obs_output_active(output) != active) {
+		if (os_gettime_ns() > timeout)
+			return false;
+		os_sleep_ms(1);
+	}
+
+	return true;
+}
+
+static void run(obs_output_t *output, obs_encoder_t *video,
+		obs_encoder_t **audio, size_t tracks,
+		struct bench_results *results)
+{
+	struct packet_gen gen;
+	uint64_t video_frames = (uint64_t)config.seconds * config.fps;
+	uint64_t start;
+
+	packet_gen_init(&gen);
+	start = os_gettime_ns();
+
+	while (gen.video_frames < video_frames) {
+		struct encoder_packet packet = {0};
+		int64_t video_ts = video_ts_usec(gen.video_frames);
+		int64_t audio_ts = audio_ts_usec(gen.audio_frames);
+		bool is_video = video_ts <= audio_ts;
+		int64_t ts = is_video ? video_ts : audio_ts;
+
+		if (config.realtime)
+			os_sleepto_ns(start + (uint64_t)ts * 1000);
+
+		for (size_t i = 0; i < (is_video ? 1 : tracks); i++) {
+			if (is_video)
+				gen_video_packet(&gen, &packet);
+			else
+				gen_audio_packet(&gen, &packet);
+
+			size_t size = packet.size;
+			uint64_t send_start = os_gettime_ns();
+			obs_encoder_send_packet(is_video ? video : audio[i],
+						&packet);
+			uint64_t latency = os_gettime_ns() - send_start;
+
+			da_push_back(results->latencies, &latency);
+			results->packets++;
+			results->bytes += size;
+		}
+
+		if (is_video)
+			gen.video_frames++;
+		else
+			gen.audio_frames++;
+
+		if (!obs_output_active(output)) {
+			fprintf(stderr, "Output stopped: %s\n",
+				obs_output_get_last_error(output));
+			break;
+		}
+	}
+
+	obs_output_force_stop(output);
+	if (!wait_for_output(output, false))
+		fprintf(stderr, "Timed out waiting for the output to stop\n");
+
+	results->wall_ns = os_gettime_ns() - start;
+}
+
+static int bench(void)
+{
+	struct bench_results results = {0};
+	obs_encoder_t *audio[MAX_OUTPUT_AUDIO_ENCODERS] = {0};
+	obs_encoder_t *video = NULL;
+	obs_output_t *output = NULL;
+	video_t *video_out = NULL;
+	size_t max_tracks;
+	size_t tracks;
+	int ret = 1;
+
+	/* encoders need a video_t, but no frames are ever output to it */
+	struct video_output_info voi = {
+		.name = "bench",
+		.format = VIDEO_FORMAT_NV12,
+		.fps_num = config.fps,
+		.fps_den = 1,
+		.width = 1280,
+		.height = 720,
+		.cache_size = 1,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+	};
+	if (video_output_open(&video_out, &voi) != VIDEO_OUTPUT_SUCCESS) {
+		fprintf(stderr, "Failed to open video output\n");
+		return 1;
+	}
+
+	struct obs_audio_info oai = {
+		.samples_per_sec = AUDIO_SAMPLE_RATE,
+		.speakers = SPEAKERS_STEREO,
+	};
+	if (!obs_reset_audio(&oai)) {
+		fprintf(stderr, "Failed to reset audio\n");
+		goto cleanup;
+	}
+
+	output = create_output(&max_tracks);
+	if (!output)
+		goto cleanup;
+
+	tracks = config.tracks < max_tracks ? config.tracks : max_tracks;
+
+	obs_data_t *settings = obs_data_create();
+	obs_data_set_int(settings, "bitrate", config.video_kbps);
+	video = obs_video_encoder_create("bench_video_encoder", "bench video",
+					 settings, NULL);
+	obs_encoder_set_video(video, video_out);
+	obs_output_set_video_encoder(output, video);
+	obs_data_release(settings);
+
+	settings = obs_data_create();
+	obs_data_set_int(settings, "bitrate", config.audio_kbps);
+	for (size_t i = 0; i < tracks; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "bench audio %zu", i + 1);
+
+		audio[i] = obs_audio_encoder_create("bench_audio_encoder", name,
+						    settings, i, NULL);
+		obs_encoder_set_audio(audio[i], obs_get_audio());
+		obs_output_set_audio_encoder(output, audio[i], i);
+	}
+	obs_data_release(settings);
+
+	if (!obs_output_start(output) || !wait_for_output(output, true)) {
+		fprintf(stderr, "Failed to start output: %s\n",
+			obs_output_get_last_error(output));
+		goto cleanup;
+	}
+
+	run(output, video, audio, tracks, &results);
+	print_results(&results);
+	ret = 0;
+
+cleanup:
+	obs_output_release(output);
+	obs_encoder_release(video);
+	for (size_t i = 0; i < MAX_OUTPUT_AUDIO_ENCODERS; i++)
+		obs_encoder_release(audio[i]);
+	video_output_close(video_out);
+	da_free(results.latencies);
+	return ret;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void do_log(int log_level, const char *msg, va_list args, void *param)
+{
+	if (log_level <= LOG_WARNING || config.verbose) {
+		vfprintf(stderr, msg, args);
+		fputc('\n', stderr);
+	}
+
+	UNUSED_PARAMETER(param);
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "  --target NAME      interleave, replay_buffer, ffmpeg_muxer "
+	       "or flv (default %s)\n"
+	       "  --sink NAME        null or file (default %s)\n"
+	       "  --out-dir DIR      directory of file sinks (default %s)\n"
+	       "  --plugin-dir DIR   directory of obs-ffmpeg and obs-outputs\n"
+	       "  --fps N            video frame rate (default %u)\n"
+	       "  --video-kbps N     video bitrate (default %u)\n"
+	       "  --audio-kbps N     bitrate of each audio track (default %u)\n"
+	       "  --gop N            keyframe interval in frames (default %u)\n"
+	       "  --tracks N         audio track count (default %u)\n"
+	       "  --seconds N        stream duration (default %u)\n"
+	       "  --replay-sec N     replay buffer length (default %u)\n"
+	       "  --replay-mb N      replay buffer size limit (default %u)\n"
+	       "  --realtime         send packets at the stream's pace\n"
+	       "  --inproc           mux ffmpeg_muxer in process\n"
+	       "  --verbose          show libobs log messages\n",
+	       name, config.target, config.sink, config.out_dir, config.fps,
+	       config.video_kbps, config.audio_kbps, config.gop, config.tracks,
+	       config.seconds, config.replay_sec, config.replay_mb);
+}
+
+static bool parse_uint(const char *str, uint32_t *val)
+{
+	char *end;
+	unsigned long result = strtoul(str, &end, 10);
+
+	if (!*str || *end || result == 0 || result > UINT32_MAX)
+		return false;
+
+	*val = (uint32_t)result;
+	return true;
+}
+
+static bool parse_args(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+		bool ok = true;
+
+		if (strcmp(arg, "--realtime") == 0) {
+			config.realtime = true;
+			continue;
+		} else if (strcmp(arg, "--inproc") == 0) {
+			config.inproc = true;
+			continue;
+		} else if (strcmp(arg, "--verbose") == 0) {
+			config.verbose = true;
+			continue;
+		}
+
+		if (!val)
+			return false;
+
+		if (strcmp(arg, "--target") == 0)
+			config.target = val;
+		else if (strcmp(arg, "--sink") == 0)
+			config.sink = val;
+		else if (strcmp(arg, "--out-dir") == 0)
+			config.out_dir = val;
+		else if (strcmp(arg, "--plugin-dir") == 0)
+			config.plugin_dir = val;
+		else if (strcmp(arg, "--fps") == 0)
+			ok = parse_uint(val, &config.fps);
+		else if (strcmp(arg, "--video-kbps") == 0)
+			ok = parse_uint(val, &config.video_kbps);
+		else if (strcmp(arg, "--audio-kbps") == 0)
+			ok = parse_uint(val, &config.audio_kbps);
+		else if (strcmp(arg, "--gop") == 0)
+			ok = parse_uint(val, &config.gop);
+		else if (strcmp(arg, "--tracks") == 0)
+			ok = parse_uint(val, &config.tracks);
+		else if (strcmp(arg, "--seconds") == 0)
+			ok = parse_uint(val, &config.seconds);
+		else if (strcmp(arg, "--replay-sec") == 0)
+			ok = parse_uint(val, &config.replay_sec);
+		else if (strcmp(arg, "--replay-mb") == 0)
+			ok = parse_uint(val, &config.replay_mb);
+		else
+			ok = false;
+
+		if (!ok)
+			return false;
+		i++;
+	}
+
+	if (strcmp(config.sink, "null") != 0 &&
+	    strcmp(config.sink, "file") != 0)
+		return false;
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	if (!parse_args(argc, argv)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	base_set_log_handler(do_log, NULL);
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "Failed to start libobs\n");
+		return 1;
+	}
+
+	obs_register_encoder(&bench_video_encoder);
+	obs_register_encoder(&bench_audio_encoder);
+	obs_register_output(&null_output_info);
+
+	ret = bench();
+
+	obs_shutdown();
+	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	base_set_log_handler(NULL, NULL);
+	return ret;
+}